@@ -138,7 +138,10 @@ struct session;
  *
  * session watch callback should never block as this function is
  * called from dataplane forwarding path and can affect forwarding
- * performance.
+ * performance, unless the watcher is registered with
+ * SESSION_WATCH_F_DEFERRED. In that case it is called from a session
+ * watch thread, the session is guaranteed to exist for the duration
+ * of the call, but it may have changed again since the event.
  */
 typedef void (session_watch_fn_t) (struct session *session,
 				   enum dp_session_hook hook, void *data);
@@ -148,6 +151,16 @@ typedef void (session_watch_fn_t) (struct session *session,
  */
 typedef int (dp_session_walk_t)(struct session *session, void *data);
 
+/**
+ * Session watch flags, for dp_session_watch_register_flags().
+ */
+/**
+ * Queue events per lcore and call fn from the session watch thread.
+ * An event is dropped, and counted, if the queue is full. A stats
+ * update is not queued for a session that already has one queued.
+ */
+#define SESSION_WATCH_F_DEFERRED	(1 << 0)
+
 /**
  * A structure used for registering a session watcher callback.
  */
@@ -170,6 +183,21 @@ struct session_watch {
  */
 int dp_session_watch_register(struct session_watch *se_watch);
 
+/**
+ * Register a session watcher, as dp_session_watch_register(), with
+ * flags that change how events are delivered.
+ *
+ * @param [in] se_watch - a filled up struct session_watch.
+ * @param [in] flags - bitwise or of SESSION_WATCH_F_*.
+ *
+ * @return - non-negative watcher id on success,
+ *     -EBUSY if another watcher is already registered.
+ *     -EINVAL if flags are not known.
+ *     -errno other errors.
+ */
+int dp_session_watch_register_flags(struct session_watch *se_watch,
+				    unsigned int flags);
+
 /**
  * unregister a previously registered watcher.
  *
@@ -172,6 +172,61 @@ int dp_lcore_events_register(const struct dp_lcore_events *events,
  */
 int dp_lcore_events_unregister(const struct dp_lcore_events *events);
 
+/*
+ * Per lcore housekeeping.
+ *
+ * Periodic background work (e.g. ageing out cache entries) for state
+ * that is owned by a single lcore is better done on that lcore than from
+ * a timer on the main lcore, as the caches are already warm and no other
+ * core touches the state. Forwarding lcores run the registered callbacks
+ * when they are about to nap, so the work uses cycles that would
+ * otherwise be idle. A busy lcore that never naps still runs a callback
+ * once it is a full interval overdue, so the work can not be starved.
+ */
+struct dp_lcore_housekeeping {
+	/*
+	 * Minimum time between runs of the callback on any one lcore.
+	 */
+	unsigned int interval_ms;
+	/*
+	 * Function called on the forwarding lcore to do one bounded slice
+	 * of work for the state owned by that lcore. It is called with the
+	 * rcu read lock held and must not block. The arg is passed through
+	 * from the registration call.
+	 */
+	void (*dp_lcore_housekeeping_fn)(unsigned int lcore_id, void *arg);
+};
+
+/*
+ * Register a housekeeping callback to be run on each forwarding lcore.
+ *
+ * This function must be called on the main thread.
+ *
+ * @param[in] hk Structure containing the callback and its interval.
+ * @param[in, out] arg Argument passed through to the callback.
+ *
+ * @return 0 on success
+ *         -EINVAL for invalid arguments
+ *         -ENOMEM if not enough memory to register the callback.
+ */
+int dp_lcore_housekeeping_register(const struct dp_lcore_housekeeping *hk,
+				   void *arg);
+
+/*
+ * Unregister a previously registered housekeeping callback. The callback
+ * may still be running on a forwarding lcore until the next rcu grace
+ * period has elapsed.
+ *
+ * This function must be called on the main thread.
+ *
+ * @param[in] hk The structure that was previously registered.
+ *
+ * @return 0 on success
+ *         -EINVAL for invalid arguments
+ *         -ENOENT if there was no existing entry
+ */
+int dp_lcore_housekeeping_unregister(const struct dp_lcore_housekeeping *hk);
+
 
 /*
  * The possible uses of lcores in the dataplane. There is one main thread
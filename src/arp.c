@@ -51,6 +51,7 @@
 #include "compat.h"
 #include "config_internal.h"
 #include "ether.h"
+#include "if/dpdk-eth/vhost.h"
 #include "if_ether.h"
 #include "if_llatbl.h"
 #include "if_var.h"
@@ -295,6 +296,12 @@ resolved:
 	 * the oldest packet if we have exceeded the system
 	 * setting.
 	 */
+	m = vhost_zero_copy_unpin(m);
+	if (unlikely(!m)) {
+		ARPSTAT_INC(if_vrfid(ifp), dropped);
+		rte_spinlock_unlock(&la->ll_lock);
+		return -ENOMEM;
+	}
 	if (la->la_numheld >= ARP_MAXHOLD) {
 		ARPSTAT_INC(if_vrfid(ifp), dropped);
 		rte_pktmbuf_free(la->la_held[0]);
@@ -69,6 +69,7 @@
 #include "netinet6/route_v6.h"
 #include "netinet6/ip6_funcs.h"
 #include "pipeline/nodes/pl_nodes_common.h"
+#include "pkt_latency.h"
 #include "pktmbuf_internal.h"
 #include "pd_show.h"
 #include "pl_commands.h"
@@ -1756,6 +1757,7 @@ static const cmd_t cmd_table[] = {
 	{ 0,	"ipsec",	cmd_ipsec,	"Show IPsec information" },
 	{ 0,	"l2tpeth",	cmd_l2tp,	"Show l2tp sessions" },
 	{ 0,	"lag",		cmd_lag,	"Show Link Aggregation" },
+	{ 0,	"latency",	cmd_latency,	"Packet latency sampling" },
 	{ 0,	"led",		cmd_led,	"Toggle interface LED" },
 	{ 0,	"local",	cmd_local,	"Show local IP addresses" },
 	{ 0,	"log",		cmd_log,	"Show log messages" },
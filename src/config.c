@@ -398,6 +398,7 @@ struct str_val rx_offload_strs[] = {
 struct str_val tx_offload_strs[] = {
 	{ "dev_tx_offload_multi_segs", DEV_TX_OFFLOAD_MULTI_SEGS },
 	{ "dev_tx_offload_vlan_insert", DEV_TX_OFFLOAD_VLAN_INSERT },
+	{ "dev_tx_offload_mbuf_fast_free", DEV_TX_OFFLOAD_MBUF_FAST_FREE },
 };
 
 #define MAX_TX_OFFLOAD_STRS (sizeof(tx_offload_strs) / \
@@ -647,6 +648,26 @@ static int parse_driver_entry(void *user, const char *section,
 			param->tx_desc_vm_multiplier = val;
                 }
         }
+	if (strcmp(name, "rx_coalesce_us") == 0) {
+		val = strtoul(value, &end, 10);
+		/* make sure val is sane */
+		if (val <= MAX_RX_COALESCE_US) {
+			DP_DEBUG(INIT, INFO, DATAPLANE,
+				 "Setting rx coalesce for %s, %lu us\n",
+				 section, val);
+			param->rx_coalesce_us = val;
+		}
+	}
+	if (strcmp(name, "rx_buf_split") == 0) {
+		val = strtoul(value, &end, 10);
+		/* make sure val is sane */
+		if (val >= MIN_RX_SPLIT_LEN && val <= MAX_RX_SPLIT_LEN) {
+			DP_DEBUG(INIT, INFO, DATAPLANE,
+				 "Setting rx buf split for %s, %lu\n",
+				 section, val);
+			param->rx_split_len = val;
+		}
+	}
 	if (strcmp(name, "dev_flags") == 0) {
 		parse_option_strs(strdupa(value), dev_flags_strs,
 				  MAX_DEV_FLAGS_STRS,
@@ -7,12 +7,28 @@
  * SPDX-License-Identifier: LGPL-2.1-only
  */
 
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/ip6.h>
+#include <netinet/tcp.h>
+#include <netinet/udp.h>
+#include <rte_cycles.h>
+#include <rte_ether.h>
+#include <rte_malloc.h>
+#include <rte_mbuf.h>
+#include <urcu/uatomic.h>
+
 #include "vplane_debug.h"
 #include "soft_ticks.h"
 #include "commands.h"
+#include "cpp_rate_limiter.h"
+#include "ether.h"
+#include "lcore_sched.h"
 #include "protobuf.h"
 #include "protobuf/cpp_rl.pb-c.h"
 #include "fal.h"
+#include "ip_funcs.h"
+#include "rcu.h"
 
 #define CPP_RL_INFO(args...) \
 	DP_DEBUG(CPP_RL, INFO, CPP_RL, args)
@@ -349,6 +365,305 @@ cpp_rl_cfg_cleanup(void)
 	CPP_RL_INFO("successfully deleted existing limiters\n");
 }
 
+/* === software enforcement === */
+
+#define CPP_RL_PROT_MAX		(FAL_CPP_LIMITER_ATTR_IP_MC + 1)
+
+/* fixed point shift for the cycles per packet or byte of a limiter */
+#define CPP_RL_SW_SHIFT		16
+
+#define BFD_PORT		3784
+#define BFD_ECHO_PORT		3785
+#define BFD_MULTIHOP_PORT	4784
+#define BGP_PORT		179
+#define LDP_PORT		646
+#define OSPF_PROTO		89
+#define PIM_PROTO		103
+
+/*
+ * A limiter is a virtual scheduling token bucket: tat is the time at
+ * which the limiter would next be idle. A packet is accepted if that is
+ * no further ahead than the burst allowance, and pushes it on by the
+ * time the packet costs at the configured rate. Updated with a single
+ * compare and swap so it is shared by all forwarding threads.
+ */
+struct cpp_rl_sw_limiter {
+	uint64_t tat;
+	uint64_t cycles_per_unit;	/* << CPP_RL_SW_SHIFT */
+	uint64_t burst_cycles;
+	uint64_t rate;			/* pps or kbps as configured */
+	bool	 bytes;
+	bool	 configured;
+} __rte_cache_aligned;
+
+struct cpp_rl_sw_cfg {
+	struct cpp_rl_sw_limiter limiter[CPP_RL_PROT_MAX];
+	struct rcu_head rcu;
+};
+
+struct cpp_rl_sw_lcore_stats {
+	uint64_t cnt[CPP_RL_PROT_MAX][FAL_POLICER_STAT_MAX];
+} __rte_cache_aligned;
+
+bool cpp_rl_sw_active __hot_data;
+
+static struct cpp_rl_sw_cfg *cpp_rl_sw_cfg;
+static struct cpp_rl_sw_lcore_stats cpp_rl_sw_stats[RTE_MAX_LCORE];
+static uint64_t cpp_rl_sw_shadow_counts[CPP_RL_PROT_MAX][FAL_POLICER_STAT_MAX];
+
+/* Less specific limiter to use if one for a class isn't configured */
+static const uint8_t cpp_rl_sw_fallback[CPP_RL_PROT_MAX] = {
+	[FAL_CPP_LIMITER_ATTR_OSPF_MC] = FAL_CPP_LIMITER_ATTR_LL_MC,
+	[FAL_CPP_LIMITER_ATTR_BGP] = FAL_CPP_LIMITER_ATTR_TCP,
+	[FAL_CPP_LIMITER_ATTR_LDP_UDP] = FAL_CPP_LIMITER_ATTR_UDP,
+	[FAL_CPP_LIMITER_ATTR_BFD_UDP] = FAL_CPP_LIMITER_ATTR_UDP,
+};
+
+static uint32_t cpp_rl_sw_classify_l4(uint8_t proto, const void *l4,
+				      const void *end, bool ll_mc, bool mc)
+{
+	const struct tcphdr *th = l4;
+	const struct udphdr *uh = l4;
+
+	switch (proto) {
+	case OSPF_PROTO:
+		return mc ? FAL_CPP_LIMITER_ATTR_OSPF_MC :
+			FAL_CPP_LIMITER_ATTR_OSPF;
+	case PIM_PROTO:
+		return FAL_CPP_LIMITER_ATTR_PIM;
+	case IPPROTO_RSVP:
+		return FAL_CPP_LIMITER_ATTR_RSVP;
+	case IPPROTO_ICMP:
+	case IPPROTO_ICMPV6:
+		return FAL_CPP_LIMITER_ATTR_ICMP;
+	}
+
+	if (ll_mc)
+		return FAL_CPP_LIMITER_ATTR_LL_MC;
+	if (mc)
+		return FAL_CPP_LIMITER_ATTR_IP_MC;
+
+	switch (proto) {
+	case IPPROTO_TCP:
+		if ((const char *)(th + 1) <= (const char *)end &&
+		    (th->source == htons(BGP_PORT) ||
+		     th->dest == htons(BGP_PORT)))
+			return FAL_CPP_LIMITER_ATTR_BGP;
+		return FAL_CPP_LIMITER_ATTR_TCP;
+	case IPPROTO_UDP:
+		if ((const char *)(uh + 1) > (const char *)end)
+			return FAL_CPP_LIMITER_ATTR_UDP;
+		if (uh->dest == htons(LDP_PORT))
+			return FAL_CPP_LIMITER_ATTR_LDP_UDP;
+		if (uh->dest == htons(BFD_PORT) ||
+		    uh->dest == htons(BFD_ECHO_PORT) ||
+		    uh->dest == htons(BFD_MULTIHOP_PORT))
+			return FAL_CPP_LIMITER_ATTR_BFD_UDP;
+		return FAL_CPP_LIMITER_ATTR_UDP;
+	}
+
+	return FAL_CPP_LIMITER_ATTR_DEFAULT;
+}
+
+/* Map a punted packet to the limiter class the FAL would use for it */
+static uint32_t cpp_rl_sw_classify(struct rte_mbuf *m)
+{
+	const struct rte_ether_hdr *eh = ethhdr(m);
+	const char *end = rte_pktmbuf_mtod(m, const char *) +
+		rte_pktmbuf_data_len(m);
+
+	if (eh->ether_type == htons(RTE_ETHER_TYPE_IPV4)) {
+		const struct iphdr *ip = (const struct iphdr *)(eh + 1);
+		uint32_t daddr;
+
+		if ((const char *)(ip + 1) > end)
+			return FAL_CPP_LIMITER_ATTR_DEFAULT;
+		if (ip_is_fragment(ip))
+			return FAL_CPP_LIMITER_ATTR_IPV4_FRAGMENT;
+
+		daddr = ntohl(ip->daddr);
+		return cpp_rl_sw_classify_l4(
+			ip->protocol, (const char *)ip + (ip->ihl << 2), end,
+			(daddr & 0xffffff00) == INADDR_UNSPEC_GROUP,
+			IN_MULTICAST(daddr));
+	}
+
+	if (eh->ether_type == htons(RTE_ETHER_TYPE_IPV6)) {
+		const struct ip6_hdr *ip6 = (const struct ip6_hdr *)(eh + 1);
+
+		if ((const char *)(ip6 + 1) > end)
+			return FAL_CPP_LIMITER_ATTR_DEFAULT;
+
+		switch (ip6->ip6_nxt) {
+		case IPPROTO_HOPOPTS:
+		case IPPROTO_ROUTING:
+		case IPPROTO_FRAGMENT:
+		case IPPROTO_DSTOPTS:
+			return FAL_CPP_LIMITER_ATTR_IPV6_EXT;
+		}
+
+		return cpp_rl_sw_classify_l4(
+			ip6->ip6_nxt, ip6 + 1, end,
+			IN6_IS_ADDR_MC_LINKLOCAL(&ip6->ip6_dst),
+			IN6_IS_ADDR_MULTICAST(&ip6->ip6_dst));
+	}
+
+	return FAL_CPP_LIMITER_ATTR_DEFAULT;
+}
+
+static bool cpp_rl_sw_limiter_accept(struct cpp_rl_sw_limiter *lim,
+				     uint32_t len)
+{
+	uint64_t now = rte_rdtsc();
+	uint64_t units = lim->bytes ? len : 1;
+	uint64_t cost = (units * lim->cycles_per_unit) >> CPP_RL_SW_SHIFT;
+	uint64_t tat, start;
+
+	do {
+		tat = CMM_LOAD_SHARED(lim->tat);
+		start = RTE_MAX(tat, now);
+		if (start - now > lim->burst_cycles)
+			return false;
+	} while (uatomic_cmpxchg(&lim->tat, tat, start + cost) != tat);
+
+	return true;
+}
+
+bool cpp_rl_sw_police(struct rte_mbuf *m)
+{
+	struct cpp_rl_sw_cfg *cfg = rcu_dereference(cpp_rl_sw_cfg);
+	struct cpp_rl_sw_limiter *lim;
+	uint64_t *cnt;
+	uint32_t prot;
+	bool accept;
+
+	if (!cfg)
+		return true;
+
+	prot = cpp_rl_sw_classify(m);
+	while (!cfg->limiter[prot].configured) {
+		if (prot == FAL_CPP_LIMITER_ATTR_DEFAULT)
+			return true;
+		if (cpp_rl_sw_fallback[prot])
+			prot = cpp_rl_sw_fallback[prot];
+		else
+			prot = FAL_CPP_LIMITER_ATTR_DEFAULT;
+	}
+	lim = &cfg->limiter[prot];
+
+	accept = cpp_rl_sw_limiter_accept(lim, rte_pktmbuf_pkt_len(m));
+
+	cnt = cpp_rl_sw_stats[dp_lcore_id()].cnt[prot];
+	if (accept) {
+		cnt[CPP_RL_ACCEPTED_PACKETS]++;
+		cnt[CPP_RL_ACCEPTED_BYTES] += rte_pktmbuf_pkt_len(m);
+	} else {
+		cnt[CPP_RL_DROPPED_PACKETS]++;
+		cnt[CPP_RL_DROPPED_BYTES] += rte_pktmbuf_pkt_len(m);
+	}
+
+	return accept;
+}
+
+static void cpp_rl_sw_cfg_free(struct rcu_head *head)
+{
+	rte_free(caa_container_of(head, struct cpp_rl_sw_cfg, rcu));
+}
+
+static void cpp_rl_sw_cfg_set(struct cpp_rl_sw_cfg *cfg)
+{
+	struct cpp_rl_sw_cfg *old = cpp_rl_sw_cfg;
+
+	rcu_assign_pointer(cpp_rl_sw_cfg, cfg);
+	if (old)
+		call_rcu(&old->rcu, cpp_rl_sw_cfg_free);
+}
+
+/*
+ * Build the software limiters from the same configuration given to the
+ * FAL. Parameters the FAL path would reject are skipped.
+ */
+static void cpp_rl_sw_configure(CppRl__CPPLimiter *cpp_msg)
+{
+	uint64_t hz = rte_get_tsc_hz();
+	struct cpp_rl_sw_cfg *cfg;
+	bool any = false;
+
+	if (!cpp_msg->n_attributes) {
+		cpp_rl_sw_cfg_set(NULL);
+		return;
+	}
+
+	cfg = rte_zmalloc("cpp_rl_sw", sizeof(*cfg), RTE_CACHE_LINE_SIZE);
+	if (!cfg) {
+		CPP_RL_ERR("software limiter allocation failure\n");
+		return;
+	}
+
+	for (uint32_t i = 0; i < cpp_msg->n_attributes; i++) {
+		CppRl__CPPLimiter__CPPAttribute *attribute =
+			cpp_msg->attributes[i];
+		struct cpp_rl_sw_limiter *lim;
+		uint32_t fal_attr;
+
+		if (!attribute->has_attr ||
+		    cpp_rl_pb_attr_to_fal(attribute->attr, &fal_attr) ||
+		    fal_attr >= CPP_RL_PROT_MAX)
+			continue;
+
+		lim = &cfg->limiter[fal_attr];
+
+		for (uint32_t j = 0; j < attribute->n_parameters; j++) {
+			CppRl__CPPLimiter__CPPAttribute__CPPParameter
+				*parameter = attribute->parameters[j];
+			uint64_t rate;
+
+			if (!(parameter->has_rate_pps ^
+			      parameter->has_rate_kbps))
+				continue;
+
+			if (parameter->has_rate_pps) {
+				lim->bytes = false;
+				lim->rate = parameter->rate_pps;
+				rate = parameter->rate_pps;
+			} else {
+				lim->bytes = true;
+				lim->rate = parameter->rate_kbps;
+				/* convert from kilobits into bytes */
+				rate = (uint64_t)parameter->rate_kbps *
+					(1024 / 8);
+			}
+
+			if (!rate)
+				continue;
+
+			lim->cycles_per_unit = (hz << CPP_RL_SW_SHIFT) / rate;
+			lim->burst_cycles = hz * CPP_RL_DEF_BURST_MS / 1000;
+			lim->configured = true;
+			any = true;
+		}
+	}
+
+	if (!any) {
+		rte_free(cfg);
+		cfg = NULL;
+	}
+	cpp_rl_sw_cfg_set(cfg);
+}
+
+static void cpp_rl_sw_get_counts(uint32_t prot,
+				 uint64_t count[FAL_POLICER_STAT_MAX])
+{
+	unsigned int lcore_id, stat;
+
+	for (stat = 0; stat < FAL_POLICER_STAT_MAX; stat++)
+		count[stat] = 0;
+
+	for (lcore_id = 0; lcore_id < RTE_MAX_LCORE; lcore_id++)
+		for (stat = 0; stat < num_policer_stats; stat++)
+			count[stat] += cpp_rl_sw_stats[lcore_id].cnt[prot][stat];
+}
+
 /*
  * Locates the index of an existing configurable for the given selector.
  *
@@ -513,6 +828,8 @@ cpp_rl_cfg(struct pb_msg *msg)
 
 	cpp_rl_set_detection_interval(detection_interval);
 
+	cpp_rl_sw_configure(cpp_msg);
+
 	if (!cpp_rl_limiter_cfg_changed(cpp_msg)) {
 		CPP_RL_INFO("limiters unchanged in config, so not "
 			    "reconstructing them\n");
@@ -723,6 +1040,13 @@ cpp_rl_cfg(struct pb_msg *msg)
 	cpp_rl_monitor_restart();
 
 end:
+	/* Police in software whatever the FAL isn't policing */
+	CMM_STORE_SHARED(cpp_rl_sw_active,
+			 limiter_obj_id == FAL_NULL_OBJECT_ID &&
+			 cpp_rl_sw_cfg != NULL);
+	if (cpp_rl_sw_active)
+		CPP_RL_INFO("policing punted packets in software\n");
+
 	if (cpp_msg)
 		cpp_rl__cpp_limiter__free_unpacked(cpp_msg, NULL);
 
@@ -756,6 +1080,102 @@ PB_REGISTER_CMD(cpp_rl_cfgcmd) = {
 
 /* === op-mode === */
 
+/*
+ * Returns the state of the software limiters, in the same format as
+ * for the FAL ones.
+ */
+static int
+cpp_rl_sw_state(FILE *fp)
+{
+	struct cpp_rl_sw_cfg *cfg = rcu_dereference(cpp_rl_sw_cfg);
+	json_writer_t *json;
+	uint32_t prot;
+
+	if (!cfg)
+		return 0;
+
+	json = jsonw_new(fp);
+	if (!json) {
+		CPP_RL_ERR("could not allocate json buffer\n");
+		return -ENOMEM;
+	}
+
+	jsonw_pretty(json, true);
+
+	jsonw_name(json, "limiter");
+	jsonw_start_array(json);
+
+	for (prot = 0; prot < CPP_RL_PROT_MAX; prot++) {
+		const struct cpp_rl_sw_limiter *lim = &cfg->limiter[prot];
+		uint64_t count[FAL_POLICER_STAT_MAX];
+		uint32_t stat;
+
+		if (!lim->configured)
+			continue;
+
+		cpp_rl_sw_get_counts(prot, count);
+		for (stat = 0; stat < num_policer_stats; stat++)
+			count[stat] -= cpp_rl_sw_shadow_counts[prot][stat];
+
+		jsonw_start_object(json); /* start of array entry */
+
+		jsonw_string_field(json, "limiter-type",
+				   cpp_rl_prot_to_name(prot));
+		jsonw_string_field(json, "enforcement", "software");
+
+		jsonw_name(json, "state");
+		jsonw_start_object(json);
+		jsonw_uint_field(json, "packets-accepted",
+				 count[CPP_RL_ACCEPTED_PACKETS]);
+		jsonw_uint_field(json, "bytes-accepted",
+				 count[CPP_RL_ACCEPTED_BYTES]);
+		jsonw_uint_field(json, "packets-dropped",
+				 count[CPP_RL_DROPPED_PACKETS]);
+		jsonw_uint_field(json, "bytes-dropped",
+				 count[CPP_RL_DROPPED_BYTES]);
+		jsonw_end_object(json); /* end of state */
+
+		jsonw_name(json, lim->bytes ? "kilobits-per-second" :
+			   "packets-per-second");
+		jsonw_start_object(json);
+		jsonw_name(json, "state");
+		jsonw_start_object(json);
+		jsonw_uint_field(json, "rate", lim->rate);
+		jsonw_end_object(json); /* end of state */
+		jsonw_end_object(json); /* pps or kbps */
+
+		jsonw_end_object(json); /* end of array entry */
+	}
+
+	jsonw_end_array(json);  /* end of limiter array */
+	jsonw_destroy(&json);
+
+	return 0;
+}
+
+static int cpp_rl_sw_clear(char *param)
+{
+	uint32_t prot_id = 0;
+	uint32_t prot;
+	int ret;
+
+	if (param != NULL && strcmp(param, "ALL") != 0) {
+		ret = cpp_rl_name_to_prot(param, &prot_id);
+		if (ret != 0) {
+			CPP_RL_ERR("unknown limiter named %s\n", param);
+			return ret;
+		}
+	}
+
+	for (prot = 0; prot < CPP_RL_PROT_MAX; prot++) {
+		if (prot_id && prot != prot_id)
+			continue;
+		cpp_rl_sw_get_counts(prot, cpp_rl_sw_shadow_counts[prot]);
+	}
+
+	return 0;
+}
+
 /*
  * Returns the CPP rate limiter operation status and statistics information
  * in JSON format.
@@ -771,6 +1191,8 @@ fal_cpp_rl_state(FILE *fp)
 	json_writer_t *json;
 
 	if (limiter_obj_id == FAL_NULL_OBJECT_ID) {
+		if (cpp_rl_sw_active)
+			return cpp_rl_sw_state(fp);
 		CPP_RL_INFO("no limiter to get state for\n");
 		return 0;
 	}
@@ -882,6 +1304,8 @@ static int fal_cpp_rl_clear(char *param)
 	bool clear_all = false;
 
 	if (limiter_obj_id == FAL_NULL_OBJECT_ID) {
+		if (cpp_rl_sw_active)
+			return cpp_rl_sw_clear(param);
 		CPP_RL_INFO("no limiter to clear statistics for\n");
 		return 0;
 	}
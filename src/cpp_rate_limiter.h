@@ -0,0 +1,41 @@
+/*
+ * cpp_rate_limiter.h
+ *
+ * Copyright (c) 2021, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+
+#ifndef CPP_RATE_LIMITER_H
+#define CPP_RATE_LIMITER_H
+
+#include <stdbool.h>
+
+#include <rte_branch_prediction.h>
+#include <urcu/compiler.h>
+
+#include "compiler.h"
+
+struct rte_mbuf;
+
+/*
+ * Software control plane policing of packets punted to the kernel.
+ *
+ * Used when the rate limiter configuration could not be given to the
+ * FAL, e.g. on platforms without switch hardware, so that a flood of
+ * one kind of punted traffic can't starve the others.
+ */
+extern bool cpp_rl_sw_active __hot_data;
+
+bool cpp_rl_sw_police(struct rte_mbuf *m);
+
+/* Returns false if the punted packet is over its limit and must be dropped */
+static inline bool cpp_rl_sw_accept(struct rte_mbuf *m)
+{
+	if (likely(!CMM_ACCESS_ONCE(cpp_rl_sw_active)))
+		return true;
+
+	return cpp_rl_sw_police(m);
+}
+
+#endif /* CPP_RATE_LIMITER_H */
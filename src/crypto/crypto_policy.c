@@ -52,6 +52,7 @@
 #include "ip_icmp.h"
 #include "json_writer.h"
 #include "lcore_sched.h"
+#include "main.h"
 #include "nh_common.h"
 #include "pipeline/nodes/pl_nodes_common.h"
 #include "pktmbuf_internal.h"
@@ -63,6 +64,7 @@
 #include "shadow.h"
 #include "snmp_mib.h"
 #include "urcu.h"
+#include "util.h"
 #include "vplane_debug.h"
 #include "vplane_log.h"
 #include "vrf_internal.h"
@@ -257,20 +259,52 @@ int crypto_flow_cache_teardown_lcore(unsigned int lcore_id)
 	return err;
 }
 
+/*
+ * Each forwarding lcore ages its own flow cache table.
+ */
+static void crypto_flow_cache_housekeeping(unsigned int lcore_id,
+					   void *arg __unused)
+{
+	flow_cache_age_lcore(flow_cache, lcore_id);
+}
+
+static const struct dp_lcore_housekeeping crypto_flow_cache_hk = {
+	.interval_ms = MSEC_PER_SEC,
+	.dp_lcore_housekeeping_fn = crypto_flow_cache_housekeeping,
+};
+
 int crypto_flow_cache_init(void)
 {
+	int err;
+
 	flow_cache = flow_cache_init(CRYPTO_FLOW_CACHE_MAX_COUNT);
 	if (!flow_cache)
 		return -ENOMEM;
 
-	return 0;
+	err = dp_lcore_housekeeping_register(&crypto_flow_cache_hk, NULL);
+	if (err) {
+		flow_cache_destroy(flow_cache);
+		flow_cache = NULL;
+	}
+	return err;
 }
 
+/*
+ * The forwarding lcores age their own tables while they run. The timer
+ * ages the tables of those that are stopped, including the main lcore
+ * unless it is also the forwarding lcore. Lcores are only started from
+ * the main thread, so a stopped one can't start while this runs.
+ */
 void
 crypto_flow_cache_timer_handler(struct rte_timer *tmr __rte_unused,
 				void *arg __rte_unused)
 {
-	flow_cache_age(flow_cache);
+	unsigned int lcore;
+
+	RTE_LCORE_FOREACH(lcore) {
+		if (!dp_lcore_is_active(lcore))
+			flow_cache_age_lcore(flow_cache, lcore);
+	}
 }
 
 static unsigned long policy_rule_sel_hash(const struct policy_rule_key *key)
@@ -7,10 +7,13 @@
  */
 
 
+#include <urcu/system.h>
+
 #include "ether.h"
 
 #include "compiler.h"
 #include "dp_event.h"
+#include "if/dpdk-eth/vhost.h"
 #include "l2_rx_fltr.h"
 #include "pl_common.h"
 #include "pl_fused.h"
@@ -38,21 +41,71 @@ ether_input(struct ifnet *ifp, struct rte_mbuf *m)
 }
 
 /*
- * Ether switching input without support for dynamic pipeline features
+ * Defines an ether switching input function running the given fused
+ * graph, without support for dynamic pipeline features
  *
  * Always consumes the mbuf
  */
-__noinline void
-ether_input_no_dyn_feats(struct ifnet *ifp, struct rte_mbuf *m)
-{
-	struct pl_packet pkt;
+#define ETHER_INPUT_NO_DYN_FEATS(fn, graph)				\
+void									\
+fn(struct ifnet *ifp, struct rte_mbuf *m)				\
+{									\
+	struct pl_packet pkt;						\
+									\
+	pkt.mbuf = m;							\
+	/* Init to null, to aid compiler optimisation*/			\
+	pkt.nxt.v6 = NULL;						\
+	pkt.in_ifp = ifp;						\
+	pkt.max_data_used = 0;						\
+	graph(&pkt);							\
+}
 
-	pkt.mbuf = m;
-	/* Init to null, to aid compiler optimisation*/
-	pkt.nxt.v6 = NULL;
-	pkt.in_ifp = ifp;
-	pkt.max_data_used = 0;
-	pipeline_fused_no_dyn_feats_ether_in(&pkt);
+__noinline
+ETHER_INPUT_NO_DYN_FEATS(ether_input_no_dyn_feats,
+			 pipeline_fused_no_dyn_feats_ether_in)
+
+/* Through the graph specialised for an interface class */
+#define ETHER_INPUT_CLASS(cls)						\
+static __noinline							\
+ETHER_INPUT_NO_DYN_FEATS(ether_input_##cls,				\
+			 pipeline_fused_##cls##_ether_in)
+
+ETHER_INPUT_CLASS(routed)
+ETHER_INPUT_CLASS(bridge_port)
+ETHER_INPUT_CLASS(tunnel)
+ETHER_INPUT_CLASS(vhost)
+
+const packet_input_t ether_if_class_input[] = {
+	[PL_IF_CLASS_ROUTED] = ether_input_routed,
+	[PL_IF_CLASS_BRIDGE_PORT] = ether_input_bridge_port,
+	[PL_IF_CLASS_TUNNEL] = ether_input_tunnel,
+	[PL_IF_CLASS_VHOST] = ether_input_vhost,
+};
+
+_Static_assert(ARRAY_SIZE(ether_if_class_input) == PL_IF_CLASS_NUM,
+	       "missing input function for interface class");
+
+/*
+ * Select the input graph for an interface from what it is configured
+ * as. Needs to be called whenever that changes; features enabled on it
+ * that its class doesn't expect still run, only out of line.
+ */
+void ether_if_class_update(struct ifnet *ifp)
+{
+	enum pl_if_class if_class;
+
+	if (ifp->if_brport)
+		if_class = PL_IF_CLASS_BRIDGE_PORT;
+	else if (ifp->if_type == IFT_VXLAN ||
+		 ifp->if_type == IFT_TUNNEL_GRE ||
+		 ifp->if_type == IFT_L2TPETH)
+		if_class = PL_IF_CLASS_TUNNEL;
+	else if (is_vhost(ifp))
+		if_class = PL_IF_CLASS_VHOST;
+	else
+		if_class = PL_IF_CLASS_ROUTED;
+
+	CMM_STORE_SHARED(ifp->if_pl_class, if_class);
 }
 
 int ether_if_set_l2_address(struct ifnet *ifp, uint32_t l2_addr_len,
@@ -17,6 +17,7 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <string.h>
+#include <urcu/compiler.h>
 
 #include "compiler.h"
 #include "if_var.h"
@@ -219,6 +220,24 @@ typedef void (*packet_input_t)(struct ifnet *ifp, struct rte_mbuf *pkt);
 void set_packet_input_func(packet_input_t input_fn);
 extern packet_input_t packet_input_func __hot_data;
 
+/* Input functions specialised per interface class, by if_pl_class */
+extern const packet_input_t ether_if_class_input[];
+
+void ether_if_class_update(struct ifnet *ifp);
+
+/*
+ * Input function for frames received on an interface: the graph for
+ * its class unless dynamic features need the generic one.
+ */
+static inline packet_input_t ether_if_input_func(const struct ifnet *ifp)
+{
+	packet_input_t input_fn = CMM_ACCESS_ONCE(packet_input_func);
+
+	if (likely(input_fn == ether_input_no_dyn_feats))
+		return ether_if_class_input[CMM_ACCESS_ONCE(ifp->if_pl_class)];
+	return input_fn;
+}
+
 int ether_if_set_l2_address(struct ifnet *ifp, uint32_t l2_addr_len,
 			    void *l2_addr);
 int ether_if_set_broadcast(struct ifnet *ifp, bool enable);
@@ -401,44 +401,59 @@ struct flow_cache *flow_cache_init(uint32_t max_entries)
 	return cache;
 }
 
-void flow_cache_age(struct flow_cache *flow_cache)
+void flow_cache_destroy(struct flow_cache *flow_cache)
+{
+	if (!flow_cache)
+		return;
+
+	flow_cache_invalidate(flow_cache, true, false);
+	free(flow_cache->cache_lcore);
+	free(flow_cache);
+}
+
+void flow_cache_age_lcore(struct flow_cache *flow_cache,
+			  unsigned int lcore_id)
 {
-	unsigned int lcore_id, max_lcores = get_lcore_max() + 1;
-	struct flow_cache_entry *cache_entry;
 	struct flow_cache_lcore *cache_lcore;
+	struct flow_cache_entry *cache_entry;
 	struct flow_cache_af *cache_af;
 	enum flow_cache_ftype af;
 	struct cds_lfht_iter iter;
 	struct cds_lfht *table;
 
-	for (lcore_id = 0; lcore_id < max_lcores; lcore_id++) {
-		cache_lcore = &flow_cache->cache_lcore[lcore_id];
-		for (af = FLOW_CACHE_IPV4; af < FLOW_CACHE_MAX; af++) {
-			cache_af = &cache_lcore->cache_af[af];
-			table = rcu_dereference(cache_af->cache_tbl);
-			if (!table)
-				continue;
-
-			cds_lfht_for_each_entry(table, &iter, cache_entry,
-						fl_node) {
-				/*
-				 * if hit count wasn't cached, cache it and
-				 * wait for the next iteration. If not, remove
-				 * the entry if there have been no more hits
-				 */
-				if (!cache_entry->last_hit_count &&
-				    cache_entry->hit_count)
-					cache_entry->last_hit_count =
-						cache_entry->hit_count;
-				else if (cache_entry->last_hit_count ==
-					 cache_entry->hit_count)
-					flow_cache_entry_remove(cache_lcore,
-								cache_entry);
-			}
+	cache_lcore = &flow_cache->cache_lcore[lcore_id];
+	for (af = FLOW_CACHE_IPV4; af < FLOW_CACHE_MAX; af++) {
+		cache_af = &cache_lcore->cache_af[af];
+		table = rcu_dereference(cache_af->cache_tbl);
+		if (!table)
+			continue;
+
+		cds_lfht_for_each_entry(table, &iter, cache_entry, fl_node) {
+			/*
+			 * if hit count wasn't cached, cache it and
+			 * wait for the next iteration. If not, remove
+			 * the entry if there have been no more hits
+			 */
+			if (!cache_entry->last_hit_count &&
+			    cache_entry->hit_count)
+				cache_entry->last_hit_count =
+					cache_entry->hit_count;
+			else if (cache_entry->last_hit_count ==
+				 cache_entry->hit_count)
+				flow_cache_entry_remove(cache_lcore,
+							cache_entry);
 		}
 	}
 }
 
+void flow_cache_age(struct flow_cache *flow_cache)
+{
+	unsigned int lcore_id, max_lcores = get_lcore_max() + 1;
+
+	for (lcore_id = 0; lcore_id < max_lcores; lcore_id++)
+		flow_cache_age_lcore(flow_cache, lcore_id);
+}
+
 static void
 flow_cache_destroy_table(struct flow_cache *flow_cache, unsigned int lcore,
 			 enum flow_cache_ftype af)
@@ -178,6 +178,18 @@ void flow_cache_invalidate(struct flow_cache *cache, bool disable,
  */
 void flow_cache_age(struct flow_cache *cache);
 
+/**
+ * As flow_cache_age, but only for the table belonging to one lcore.
+ * Intended to be called on that lcore.
+ *
+ * @param cache
+ *   Address of the flow cache
+ *
+ * @param lcore_id
+ *   core id returned by dp_lcore_id()
+ */
+void flow_cache_age_lcore(struct flow_cache *cache, unsigned int lcore_id);
+
 
 typedef void (*flow_cache_dump_cb)(struct flow_cache_entry *entry,
 				   bool detail, json_writer_t *wr);
@@ -17,8 +17,10 @@
 #include "include/fal_plugin.h"
 #include "fal.h"
 #include "gpc_pb.h"
+#include "gpc_sw.h"
 #include "gpc_util.h"
 #include "json_writer.h"
+#include "npf/config/gpc_cntr_query.h"
 #include "npf/config/gpc_db_query.h"
 #include "npf/config/gpc_hw.h"
 #include "urcu.h"
@@ -44,6 +46,20 @@ struct gpc_show_context {
 	json_writer_t *wr;
 };
 
+/*
+ * Counters of tables not offloaded to the FAL are kept by the software
+ * forwarding path.
+ */
+static bool
+gpc_op_counter_read(struct gpc_cntr *cntr, uint64_t *packets, uint64_t *bytes)
+{
+	if (!gpc_cntr_is_ll_created(cntr) &&
+	    gpc_sw_counter_read(cntr, packets, bytes))
+		return true;
+
+	return gpc_hw_counter_read(cntr, packets, bytes);
+}
+
 static int
 gpc_ip_prefix_str(struct ip_prefix *ip_prefix, char *outstr, size_t outstr_len)
 {
@@ -204,6 +220,12 @@ gpc_op_show_action(struct gpc_pb_action *action,
 				drops = drops - policer->reset_drops;
 			}
 			jsonw_uint_field(wr, "drops", drops);
+		} else {
+			uint64_t drops;
+
+			if (gpc_sw_policer_read(policer, &drops))
+				jsonw_uint_field(wr, "drops",
+						 drops - policer->reset_drops);
 		}
 		jsonw_end_object(wr);
 		break;
@@ -253,7 +275,7 @@ gpc_op_show_rule(struct gpc_pb_rule *rule, struct gpc_walk_context *walk_ctx)
 
 		struct gpc_cntr *cntr = gpc_rule_get_cntr(rule->gpc_rule);
 
-		if (cntr && gpc_hw_counter_read(cntr, &packets, &bytes)) {
+		if (cntr && gpc_op_counter_read(cntr, &packets, &bytes)) {
 			packets = packets - rule->counter.reset_packets;
 			bytes = bytes - rule->counter.reset_bytes;
 		}
@@ -420,6 +442,8 @@ gpc_op_clear_action(struct gpc_pb_action *action,
 					strerror(-rv));
 			else
 				policer->reset_drops = drops;
+		} else if (gpc_sw_policer_read(policer, &drops)) {
+			policer->reset_drops = drops;
 		}
 	}
 	return true;
@@ -429,8 +453,8 @@ static gpc_pb_table_rule_walker_cb gpc_op_clear_rule;
 static bool
 gpc_op_clear_rule(struct gpc_pb_rule *rule, struct gpc_walk_context *walk_ctx)
 {
-	uint64_t bytes;
-	uint64_t packets;
+	uint64_t bytes = 0;
+	uint64_t packets = 0;
 
 	/*
 	 * Rules with a number of zero are not being used
@@ -444,7 +468,7 @@ gpc_op_clear_rule(struct gpc_pb_rule *rule, struct gpc_walk_context *walk_ctx)
 	    rule->counter.name) {
 		struct gpc_cntr *cntr = gpc_rule_get_cntr(rule->gpc_rule);
 
-		if (cntr && gpc_hw_counter_read(cntr, &packets, &bytes)) {
+		if (cntr && gpc_op_counter_read(cntr, &packets, &bytes)) {
 			rule->counter.reset_packets = packets;
 			rule->counter.reset_bytes = bytes;
 		}
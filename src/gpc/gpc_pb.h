@@ -206,6 +206,8 @@ struct gpc_pb_table {
 	/* Internal operational fields */
 	struct gpc_rlset		*gpc_rlset;
 	struct gpc_group		*gpc_group;
+	/* Compiled rules, when not offloaded to the FAL */
+	struct gpc_sw_table		*sw_table;
 	/* The following array is variable length */
 	char				*table_names[0];
 };
@@ -18,6 +18,7 @@
 #include "fal.h"
 #include "fal_plugin.h"
 #include "gpc_pb.h"
+#include "gpc_sw.h"
 #include "gpc_util.h"
 #include "interface.h"
 #include "ip.h"
@@ -178,6 +179,11 @@ gpc_pb_policer_create(struct gpc_pb_policer *policer)
 
 	/* Create policer from attribute list. */
 	rv = fal_policer_create(attr_count, attr_list, &policer->objid);
+	if (rv == -EOPNOTSUPP) {
+		/* Only usable if the table is classified in software */
+		policer->objid = FAL_NULL_OBJECT_ID;
+		return 0;
+	}
 	if (rv) {
 		RTE_LOG(ERR, GPC,
 			"Failed to create FAL policer %d\n", rv);
@@ -1334,6 +1340,8 @@ gpc_pb_table_delete(struct gpc_pb_table *table)
 	cds_list_del(&table->table_list);
 	DP_DEBUG(GPC, DEBUG, GPC, "Freeing GPC table %p\n", table);
 
+	gpc_sw_table_delete(table);
+
 	for (i = 0; i < table->n_rules; i++)
 		gpc_pb_rule_delete(&table->rules_table[i]);
 
@@ -1384,6 +1392,33 @@ gpc_pb_table_find(struct gpc_pb_feature *feature, const char *ifname,
 	return NULL;
 }
 
+static gpc_pb_rule_action_walker_cb gpc_pb_find_sw_policer;
+static bool
+gpc_pb_find_sw_policer(struct gpc_pb_action *action,
+		       struct gpc_walk_context *walk_ctx)
+{
+	if (action->action_type != GPC_RULE_ACTION_VALUE_POLICER ||
+	    action->action_value.policer.objid != FAL_NULL_OBJECT_ID)
+		return true;
+
+	walk_ctx->data = &action->action_value.policer;
+	return false;
+}
+
+/* Does any rule use a policer which the FAL could not create? */
+static bool
+gpc_pb_table_has_sw_policer(struct gpc_pb_table *table)
+{
+	struct gpc_walk_context walk_ctx = { 0 };
+	uint32_t i;
+
+	for (i = 0; i < table->n_rules && !walk_ctx.data; i++)
+		gpc_pb_rule_action_walk(&table->rules_table[i],
+					gpc_pb_find_sw_policer, &walk_ctx);
+
+	return walk_ctx.data != NULL;
+}
+
 static int
 gpc_pb_table_add(struct gpc_pb_feature *feature, GPCTable *msg)
 {
@@ -1465,6 +1500,21 @@ gpc_pb_table_add(struct gpc_pb_feature *feature, GPCTable *msg)
 	 */
 	gpc_group_hw_ntfy_create(table->gpc_group, NULL);
 
+	/*
+	 * Policers the FAL doesn't support are only applied when the table
+	 * is classified in software; the hardware would pass the traffic
+	 * unpoliced.
+	 */
+	if (gpc_group_is_ll_created(table->gpc_group) &&
+	    gpc_pb_table_has_sw_policer(table)) {
+		RTE_LOG(ERR, GPC,
+			"FAL does not support the policers of table %s/%s\n",
+			table->ifname,
+			gpc_get_table_location_str(table->location));
+		rv = -EOPNOTSUPP;
+		goto error_path;
+	}
+
 	/*
 	 * Now the gpc_group has been created down in the GPC hw layer
 	 * we can now create any counters associated with the group's rules.
@@ -1485,6 +1535,9 @@ gpc_pb_table_add(struct gpc_pb_feature *feature, GPCTable *msg)
 	gpc_group_hw_ntfy_rules_create(table->gpc_group);
 	gpc_group_hw_ntfy_attach(table->gpc_group);
 
+	/* Anything the FAL didn't take is classified in software */
+	gpc_sw_table_update(table);
+
 	return rv;
 
  error_path:
@@ -0,0 +1,1009 @@
+/*-
+ * Copyright (c) 2021, AT&T Intellectual Property.
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * Generalised Packet Classification (GPC) software forwarding path
+ */
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/ip6.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/queue.h>
+#include <rte_acl.h>
+#include <rte_cycles.h>
+#include <rte_ether.h>
+#include <rte_lcore.h>
+#include <rte_malloc.h>
+#include <rte_mbuf.h>
+#include <urcu/list.h>
+#include <urcu/uatomic.h>
+#include <vplane_log.h>
+#include <vplane_debug.h>
+
+#include "dp_event.h"
+#include "gpc_pb.h"
+#include "gpc_sw.h"
+#include "if_var.h"
+#include "ip_funcs.h"
+#include "lcore_sched.h"
+#include "netinet6/in6.h"
+#include "netinet6/ip6_funcs.h"
+#include "npf/config/gpc_cntr_query.h"
+#include "npf/config/gpc_db_query.h"
+#include "npf/config/pmf_rule.h"
+#include "pipeline/nodes/pl_nodes_common.h"
+#include "pktmbuf_internal.h"
+#include "pl_node.h"
+#include "protobuf/GPCConfig.pb-c.h"
+#include "urcu.h"
+#include "util.h"
+
+#define GPC_SW_MAX_TABLES 4
+
+/* Policer buckets are kept in cycles, fixed point with this shift */
+#define GPC_SW_SHIFT 16
+#define GPC_SW_BURST_MS 10
+
+/*
+ * The classification keys, filled in from the packet headers so that
+ * IP options and IPv6 extension headers don't move the fields.
+ *
+ * rte_acl requires the first field to be a single byte, and reads the
+ * remaining inputs 4 bytes at a time, so the single byte matches after
+ * the protocol are grouped into one input. Addresses and ports are in
+ * network byte order as for any other rte_acl input. For ICMP the type
+ * and code are given as the source and destination ports.
+ */
+struct gpc_sw_key4 {
+	uint8_t		proto;		/* final protocol */
+	uint8_t		proto_base;
+	uint8_t		dscp;
+	uint8_t		ttl;
+	uint8_t		frag;
+	uint8_t		pad[3];
+	uint32_t	src;
+	uint32_t	dst;
+	uint16_t	sport;
+	uint16_t	dport;
+};
+
+struct gpc_sw_key6 {
+	uint8_t		proto;		/* final protocol */
+	uint8_t		proto_base;
+	uint8_t		dscp;
+	uint8_t		ttl;		/* hop limit */
+	uint8_t		frag;
+	uint8_t		pad[3];
+	uint32_t	src[4];
+	uint32_t	dst[4];
+	uint16_t	sport;
+	uint16_t	dport;
+};
+
+/* Fields common to both families */
+enum {
+	GPC_SW_FLD_PROTO,
+	GPC_SW_FLD_PROTO_BASE,
+	GPC_SW_FLD_DSCP,
+	GPC_SW_FLD_TTL,
+	GPC_SW_FLD_FRAG,
+	GPC_SW_FLD_SRC,
+};
+
+enum {
+	GPC_SW_V4_SPORT = GPC_SW_FLD_SRC + 2,
+	GPC_SW_V4_DPORT,
+	GPC_SW_V4_NUM_FIELDS
+};
+
+enum {
+	GPC_SW_V6_SPORT = GPC_SW_FLD_SRC + 8,
+	GPC_SW_V6_DPORT,
+	GPC_SW_V6_NUM_FIELDS
+};
+
+#define GPC_SW_FIELD(t, key, fld, idx, in, word)			\
+	{								\
+		.type = RTE_ACL_FIELD_TYPE_ ## t,			\
+		.size = sizeof(((struct key *)0)->fld) /		\
+			((word) ? 4 : 1),				\
+		.field_index = (idx),					\
+		.input_index = (in),					\
+		.offset = offsetof(struct key, fld),			\
+	}
+
+#define GPC_SW_FIELD_U8(key, fld, idx, in) \
+	GPC_SW_FIELD(BITMASK, key, fld, idx, in, false)
+
+static struct rte_acl_field_def gpc_sw_v4_defs[GPC_SW_V4_NUM_FIELDS] = {
+	GPC_SW_FIELD_U8(gpc_sw_key4, proto, GPC_SW_FLD_PROTO, 0),
+	GPC_SW_FIELD_U8(gpc_sw_key4, proto_base, GPC_SW_FLD_PROTO_BASE, 1),
+	GPC_SW_FIELD_U8(gpc_sw_key4, dscp, GPC_SW_FLD_DSCP, 1),
+	GPC_SW_FIELD_U8(gpc_sw_key4, ttl, GPC_SW_FLD_TTL, 1),
+	GPC_SW_FIELD_U8(gpc_sw_key4, frag, GPC_SW_FLD_FRAG, 1),
+	GPC_SW_FIELD(MASK, gpc_sw_key4, src, GPC_SW_FLD_SRC, 2, false),
+	GPC_SW_FIELD(MASK, gpc_sw_key4, dst, GPC_SW_FLD_SRC + 1, 3, false),
+	GPC_SW_FIELD(RANGE, gpc_sw_key4, sport, GPC_SW_V4_SPORT, 4, false),
+	GPC_SW_FIELD(RANGE, gpc_sw_key4, dport, GPC_SW_V4_DPORT, 4, false),
+};
+
+#define GPC_SW_FIELD_V6_ADDR(fld, base, in, i)				\
+	{								\
+		.type = RTE_ACL_FIELD_TYPE_MASK,			\
+		.size = sizeof(uint32_t),				\
+		.field_index = (base) + (i),				\
+		.input_index = (in) + (i),				\
+		.offset = offsetof(struct gpc_sw_key6, fld) +		\
+			  (i) * sizeof(uint32_t),			\
+	}
+
+static struct rte_acl_field_def gpc_sw_v6_defs[GPC_SW_V6_NUM_FIELDS] = {
+	GPC_SW_FIELD_U8(gpc_sw_key6, proto, GPC_SW_FLD_PROTO, 0),
+	GPC_SW_FIELD_U8(gpc_sw_key6, proto_base, GPC_SW_FLD_PROTO_BASE, 1),
+	GPC_SW_FIELD_U8(gpc_sw_key6, dscp, GPC_SW_FLD_DSCP, 1),
+	GPC_SW_FIELD_U8(gpc_sw_key6, ttl, GPC_SW_FLD_TTL, 1),
+	GPC_SW_FIELD_U8(gpc_sw_key6, frag, GPC_SW_FLD_FRAG, 1),
+	GPC_SW_FIELD_V6_ADDR(src, GPC_SW_FLD_SRC, 2, 0),
+	GPC_SW_FIELD_V6_ADDR(src, GPC_SW_FLD_SRC, 2, 1),
+	GPC_SW_FIELD_V6_ADDR(src, GPC_SW_FLD_SRC, 2, 2),
+	GPC_SW_FIELD_V6_ADDR(src, GPC_SW_FLD_SRC, 2, 3),
+	GPC_SW_FIELD_V6_ADDR(dst, GPC_SW_FLD_SRC + 4, 6, 0),
+	GPC_SW_FIELD_V6_ADDR(dst, GPC_SW_FLD_SRC + 4, 6, 1),
+	GPC_SW_FIELD_V6_ADDR(dst, GPC_SW_FLD_SRC + 4, 6, 2),
+	GPC_SW_FIELD_V6_ADDR(dst, GPC_SW_FLD_SRC + 4, 6, 3),
+	GPC_SW_FIELD(RANGE, gpc_sw_key6, sport, GPC_SW_V6_SPORT, 10, false),
+	GPC_SW_FIELD(RANGE, gpc_sw_key6, dport, GPC_SW_V6_DPORT, 10, false),
+};
+
+RTE_ACL_RULE_DEF(gpc_sw_acl_rule, GPC_SW_V6_NUM_FIELDS);
+
+struct gpc_sw_rule {
+	bool		rl_drop;
+	uint16_t	rl_cntr;	/* counter slot + 1, 0 if none */
+	uint16_t	rl_police;	/* policer slot + 1, 0 if none */
+};
+
+struct gpc_sw_police {
+	struct gpc_pb_policer const *sp_policer;
+	uint64_t	sp_cycles_per_byte;	/* << GPC_SW_SHIFT */
+	uint64_t	sp_burst_cycles;
+};
+
+struct gpc_sw_count {
+	uint64_t	pkts;
+	uint64_t	bytes;
+};
+
+/*
+ * Virtual scheduling token bucket, tat being the time at which it
+ * would next be idle. There is one per policer, shared by all the
+ * forwarding threads so that the rate applies to the table as a whole.
+ */
+struct gpc_sw_bucket {
+	uint64_t	tat;
+} __rte_cache_aligned;
+
+/* A compiled ingress GPC table */
+struct gpc_sw_table {
+	TAILQ_ENTRY(gpc_sw_table) st_list;
+	struct rcu_head		st_rcu;
+	struct gpc_pb_table	*st_table;
+	struct gpc_group	*st_gprg;
+	struct ifnet		*st_ifp;
+	bool			st_v6;
+	struct rte_acl_ctx	*st_acl;
+	uint16_t		st_n_cntrs;
+	uint16_t		st_n_police;
+	struct gpc_sw_rule	*st_rules;	/* by rte_acl userdata - 1 */
+	struct gpc_cntr const	**st_cntrs;
+	struct gpc_sw_police	*st_police;
+	struct gpc_sw_bucket	*st_buckets;	/* by policer slot */
+	/* Per forwarding thread state */
+	struct gpc_sw_count	*st_counts[RTE_MAX_LCORE];
+	uint64_t		*st_red[RTE_MAX_LCORE];	/* by policer slot */
+};
+
+/* The compiled tables attached to an interface, in the order to apply */
+struct gpc_sw_if {
+	struct rcu_head		gsi_rcu;
+	struct gpc_sw_table	*gsi_tbl[2][GPC_SW_MAX_TABLES];	/* by v6 */
+};
+
+static TAILQ_HEAD(, gpc_sw_table) gpc_sw_tables =
+	TAILQ_HEAD_INITIALIZER(gpc_sw_tables);
+
+/*
+ * Rule compilation
+ */
+
+static void
+gpc_sw_fld_u8(struct rte_acl_field *fld, uint8_t value, uint8_t mask)
+{
+	fld->value.u8 = value;
+	fld->mask_range.u8 = mask;
+}
+
+static void
+gpc_sw_fld_range(struct rte_acl_field *fld, uint16_t lo, uint16_t hi)
+{
+	fld->value.u16 = lo;
+	fld->mask_range.u16 = hi;
+}
+
+static int
+gpc_sw_fld_prefix(struct rte_acl_field *fld, union pmf_mattr_l3 attr,
+		  bool v6)
+{
+	const uint8_t *bytes;
+	unsigned int words, i;
+	int plen;
+
+	if (v6) {
+		if (attr.pm_any->pm_tag != PMAT_IPV6_PREFIX ||
+		    attr.pm_l3v6->pm_invert)
+			return -ENOTSUP;
+		bytes = attr.pm_l3v6->pm_bytes;
+		plen = attr.pm_l3v6->pm_plen;
+		words = 4;
+	} else {
+		if (attr.pm_any->pm_tag != PMAT_IPV4_PREFIX ||
+		    attr.pm_l3v4->pm_invert)
+			return -ENOTSUP;
+		bytes = attr.pm_l3v4->pm_bytes;
+		plen = attr.pm_l3v4->pm_plen;
+		words = 1;
+	}
+
+	for (i = 0; i < words; i++) {
+		uint32_t word;
+
+		memcpy(&word, &bytes[i * sizeof(word)], sizeof(word));
+		fld[i].value.u32 = ntohl(word);
+		fld[i].mask_range.u32 = RTE_MIN(RTE_MAX(plen, 0), 32);
+		plen -= 32;
+	}
+
+	return 0;
+}
+
+/* Translate the matches of a rule into rte_acl fields */
+static int
+gpc_sw_rule_fields(struct pmf_rule const *rule, bool v6,
+		   struct rte_acl_field *fld)
+{
+	unsigned int sport = v6 ? GPC_SW_V6_SPORT : GPC_SW_V4_SPORT;
+	unsigned int dst = GPC_SW_FLD_SRC + (v6 ? 4 : 1);
+	uint32_t summary = rule->pp_summary;
+	struct pmf_attr_l4port_range const *ports;
+	struct pmf_attr_l4icmp_vals const *icmp;
+	struct pmf_attr_proto const *proto;
+	int rc;
+
+	/* Everything is wildcarded unless matched on */
+	gpc_sw_fld_range(&fld[sport], 0, UINT16_MAX);
+	gpc_sw_fld_range(&fld[sport + 1], 0, UINT16_MAX);
+
+	if (summary & (PMF_RMS_L3_RH | PMF_RMS_L4_TCPFL))
+		return -ENOTSUP;
+
+	if (summary & PMF_RMS_L3_PROTO_FINAL) {
+		proto = rule->pp_match.l3[PMF_L3F_PROTOF].pm_l3proto;
+		if (proto->pm_tag != PMAT_IP_PROTO || proto->pm_unknown)
+			return -ENOTSUP;
+		gpc_sw_fld_u8(&fld[GPC_SW_FLD_PROTO], proto->pm_proto,
+			      UINT8_MAX);
+	}
+
+	if (summary & PMF_RMS_L3_PROTO_BASE) {
+		proto = rule->pp_match.l3[PMF_L3F_PROTOB].pm_l3proto;
+		if (proto->pm_tag != PMAT_IP_PROTO)
+			return -ENOTSUP;
+		gpc_sw_fld_u8(&fld[GPC_SW_FLD_PROTO_BASE], proto->pm_proto,
+			      UINT8_MAX);
+	}
+
+	if (summary & PMF_RMS_L3_DSCP) {
+		struct pmf_attr_dscp const *dscp =
+			rule->pp_match.l3[PMF_L3F_DSCP].pm_l3dscp;
+
+		if (dscp->pm_tag != PMAT_IP_DSCP)
+			return -ENOTSUP;
+		gpc_sw_fld_u8(&fld[GPC_SW_FLD_DSCP], dscp->pm_dscp, 0x3f);
+	}
+
+	if (summary & PMF_RMS_L3_TTL)
+		gpc_sw_fld_u8(&fld[GPC_SW_FLD_TTL],
+			      rule->pp_match.l3[PMF_L3F_TTL].pm_l3ttl->pm_ttl,
+			      UINT8_MAX);
+
+	if (summary & PMF_RMS_L3_FRAG)
+		gpc_sw_fld_u8(&fld[GPC_SW_FLD_FRAG], 1, 1);
+
+	if (summary & PMF_RMS_L3_SRC) {
+		rc = gpc_sw_fld_prefix(&fld[GPC_SW_FLD_SRC],
+				       rule->pp_match.l3[PMF_L3F_SRC], v6);
+		if (rc)
+			return rc;
+	}
+
+	if (summary & PMF_RMS_L3_DST) {
+		rc = gpc_sw_fld_prefix(&fld[dst],
+				       rule->pp_match.l3[PMF_L3F_DST], v6);
+		if (rc)
+			return rc;
+	}
+
+	if (summary & PMF_RMS_L4_SRC) {
+		ports = rule->pp_match.l4[PMF_L4F_SRC].pm_l4port_range;
+		if (ports->pm_tag != PMAT_L4_PORT_RANGE)
+			return -ENOTSUP;
+		gpc_sw_fld_range(&fld[sport], ports->pm_loport,
+				 ports->pm_hiport);
+	}
+
+	if (summary & PMF_RMS_L4_DST) {
+		ports = rule->pp_match.l4[PMF_L4F_DST].pm_l4port_range;
+		if (ports->pm_tag != PMAT_L4_PORT_RANGE)
+			return -ENOTSUP;
+		gpc_sw_fld_range(&fld[sport + 1], ports->pm_loport,
+				 ports->pm_hiport);
+	}
+
+	if (summary & (PMF_RMS_L4_ICMP_TYPE | PMF_RMS_L4_ICMP_CODE)) {
+		icmp = rule->pp_match.l4[PMF_L4F_ICMP_VALS].pm_l4icmp_vals;
+		if (icmp->pm_tag != (v6 ? PMAT_L4_ICMP_V6_VALS
+					: PMAT_L4_ICMP_V4_VALS))
+			return -ENOTSUP;
+
+		/* The type and code are only in the key for ICMP */
+		if (!(summary & PMF_RMS_L3_PROTO_FINAL))
+			gpc_sw_fld_u8(&fld[GPC_SW_FLD_PROTO],
+				      v6 ? IPPROTO_ICMPV6 : IPPROTO_ICMP,
+				      UINT8_MAX);
+
+		if (icmp->pm_class)
+			gpc_sw_fld_range(&fld[sport], icmp->pm_type & 0x80,
+					 (icmp->pm_type & 0x80) | 0x7f);
+		else if (summary & PMF_RMS_L4_ICMP_TYPE)
+			gpc_sw_fld_range(&fld[sport], icmp->pm_type,
+					 icmp->pm_type);
+
+		if ((summary & PMF_RMS_L4_ICMP_CODE) && !icmp->pm_any_code)
+			gpc_sw_fld_range(&fld[sport + 1], icmp->pm_code,
+					 icmp->pm_code);
+	}
+
+	return 0;
+}
+
+static gpc_pb_rule_action_walker_cb gpc_sw_find_policer;
+static bool
+gpc_sw_find_policer(struct gpc_pb_action *action,
+		    struct gpc_walk_context *walk_ctx)
+{
+	if (action->action_type != GPC_RULE_ACTION_VALUE_POLICER)
+		return true;
+
+	walk_ctx->data = &action->action_value.policer;
+	return false;
+}
+
+/*
+ * Red packets are those beyond the committed plus any excess rate and
+ * burst, which is all the software policer has to find.
+ */
+static void
+gpc_sw_police_init(struct gpc_sw_police *sp,
+		   struct gpc_pb_policer const *policer)
+{
+	uint64_t hz = rte_get_tsc_hz();
+	uint64_t rate = policer->bw;
+	uint64_t burst;
+
+	if (policer->flags & POLICER_HAS_EXCESS_BW)
+		rate += policer->excess_bw;
+	rate = RTE_MAX(rate, 1ul);
+
+	if (policer->flags & POLICER_HAS_BURST)
+		burst = policer->burst;
+	else
+		burst = RTE_MAX(rate * GPC_SW_BURST_MS / 1000,
+				(uint64_t)RTE_ETHER_MAX_LEN);
+	if (policer->flags & POLICER_HAS_EXCESS_BURST)
+		burst += policer->excess_burst;
+
+	sp->sp_policer = policer;
+	sp->sp_cycles_per_byte = (hz << GPC_SW_SHIFT) / rate;
+	sp->sp_burst_cycles = (burst * sp->sp_cycles_per_byte) >> GPC_SW_SHIFT;
+}
+
+static uint16_t
+gpc_sw_cntr_slot(struct gpc_sw_table *st, struct gpc_cntr const *cntr)
+{
+	uint16_t i;
+
+	/* Named counters may be shared by several rules */
+	for (i = 0; i < st->st_n_cntrs; i++)
+		if (st->st_cntrs[i] == cntr)
+			return i + 1;
+
+	st->st_cntrs[st->st_n_cntrs] = cntr;
+	return ++st->st_n_cntrs;
+}
+
+static int
+gpc_sw_table_compile(struct gpc_sw_table *st, struct gpc_pb_table *table)
+{
+	static uint32_t gpc_sw_ctx_id;
+	unsigned int nflds = st->st_v6 ? GPC_SW_V6_NUM_FIELDS
+				       : GPC_SW_V4_NUM_FIELDS;
+	struct rte_acl_param acl_param = {
+		.socket_id = SOCKET_ID_ANY,
+		.rule_size = RTE_ACL_RULE_SZ(nflds),
+		.max_rule_num = table->n_rules,
+	};
+	struct rte_acl_config cfg = {
+		.num_categories = 1,
+		.num_fields = nflds,
+	};
+	char acl_name[RTE_ACL_NAMESIZE];
+	struct gpc_sw_acl_rule acl_rule;
+	uint32_t i, n = 0;
+	int rc;
+
+	/* The name must be unique, a table is rebuilt on every change */
+	snprintf(acl_name, sizeof(acl_name), "gpc-%u", ++gpc_sw_ctx_id);
+	acl_param.name = acl_name;
+
+	st->st_acl = rte_acl_create(&acl_param);
+	if (!st->st_acl)
+		return -ENOMEM;
+
+	for (i = 0; i < table->n_rules; i++) {
+		struct gpc_pb_rule *rule = &table->rules_table[i];
+		struct gpc_sw_rule *rl = &st->st_rules[n];
+		struct pmf_rule *pmf_rule = rule->pmf_rule;
+
+		/* Rules with a number of zero are not being used */
+		if (!rule->number || !pmf_rule)
+			continue;
+
+		memset(&acl_rule, 0, sizeof(acl_rule));
+		rc = gpc_sw_rule_fields(pmf_rule, st->st_v6, acl_rule.field);
+		if (rc) {
+			RTE_LOG(ERR, GPC,
+				"GPC rule %u on %s can't be applied in software\n",
+				rule->number, table->ifname);
+			return rc;
+		}
+
+		/* Rules arrive in order, the first to match wins */
+		acl_rule.data.category_mask = 1;
+		acl_rule.data.priority = RTE_ACL_MAX_PRIORITY - n;
+		acl_rule.data.userdata = n + 1;
+
+		rl->rl_drop = pmf_rule->pp_summary & PMF_RAS_DROP;
+
+		if (pmf_rule->pp_summary & PMF_RAS_COUNT_REF) {
+			struct gpc_cntr *cntr =
+				gpc_rule_get_cntr(rule->gpc_rule);
+
+			if (cntr)
+				rl->rl_cntr = gpc_sw_cntr_slot(st, cntr);
+		}
+
+		if (pmf_rule->pp_summary & PMF_RAS_QOS_POLICE) {
+			struct gpc_walk_context walk_ctx = { .data = NULL };
+
+			gpc_pb_rule_action_walk(rule, gpc_sw_find_policer,
+						&walk_ctx);
+			if (walk_ctx.data) {
+				gpc_sw_police_init(
+					&st->st_police[st->st_n_police],
+					walk_ctx.data);
+				rl->rl_police = ++st->st_n_police;
+			}
+		}
+
+		rc = rte_acl_add_rules(st->st_acl,
+				       (struct rte_acl_rule *)&acl_rule, 1);
+		if (rc)
+			return rc;
+		n++;
+	}
+
+	if (!n)
+		return -ENOENT;
+
+	if (st->st_v6)
+		memcpy(cfg.defs, gpc_sw_v6_defs, sizeof(gpc_sw_v6_defs));
+	else
+		memcpy(cfg.defs, gpc_sw_v4_defs, sizeof(gpc_sw_v4_defs));
+
+	rc = rte_acl_build(st->st_acl, &cfg);
+	if (rc)
+		return rc;
+
+	if (st->st_n_police) {
+		st->st_buckets = rte_zmalloc(
+			"gpc", st->st_n_police * sizeof(struct gpc_sw_bucket),
+			RTE_CACHE_LINE_SIZE);
+		if (!st->st_buckets)
+			return -ENOMEM;
+	}
+
+	RTE_LCORE_FOREACH(i) {
+		int socket = rte_lcore_to_socket_id(i);
+
+		if (st->st_n_cntrs) {
+			st->st_counts[i] = rte_zmalloc_socket(
+				"gpc", st->st_n_cntrs * sizeof(struct gpc_sw_count),
+				RTE_CACHE_LINE_SIZE, socket);
+			if (!st->st_counts[i])
+				return -ENOMEM;
+		}
+		if (st->st_n_police) {
+			st->st_red[i] = rte_zmalloc_socket(
+				"gpc", st->st_n_police * sizeof(uint64_t),
+				RTE_CACHE_LINE_SIZE, socket);
+			if (!st->st_red[i])
+				return -ENOMEM;
+		}
+	}
+
+	return 0;
+}
+
+static void
+gpc_sw_table_free(struct gpc_sw_table *st)
+{
+	unsigned int i;
+
+	for (i = 0; i < RTE_MAX_LCORE; i++) {
+		rte_free(st->st_counts[i]);
+		rte_free(st->st_red[i]);
+	}
+	rte_free(st->st_buckets);
+	rte_acl_free(st->st_acl);
+	free(st->st_rules);
+	free(st->st_cntrs);
+	free(st->st_police);
+	free(st);
+}
+
+static void
+gpc_sw_table_free_rcu(struct rcu_head *head)
+{
+	gpc_sw_table_free(caa_container_of(head, struct gpc_sw_table, st_rcu));
+}
+
+/*
+ * Interface attachment
+ */
+
+static void
+gpc_sw_if_free(struct rcu_head *head)
+{
+	free(caa_container_of(head, struct gpc_sw_if, gsi_rcu));
+}
+
+static void
+gpc_sw_if_feat(struct ifnet *ifp, struct gpc_sw_if const *old,
+	       struct gpc_sw_if const *new, bool v6)
+{
+	bool was = old && old->gsi_tbl[v6][0];
+	bool is = new && new->gsi_tbl[v6][0];
+
+	if (was == is)
+		return;
+
+	if (is)
+		pl_node_add_feature_by_inst(v6 ? &ipv6_gpc_in_feat
+					       : &ipv4_gpc_in_feat, ifp);
+	else
+		pl_node_remove_feature_by_inst(v6 ? &ipv6_gpc_in_feat
+						  : &ipv4_gpc_in_feat, ifp);
+}
+
+/* Republish the set of compiled tables to apply on an interface */
+static void
+gpc_sw_if_update(struct ifnet *ifp)
+{
+	struct gpc_sw_if *old = ifp->if_gpc_sw;
+	unsigned int n[2] = { 0, 0 };
+	struct gpc_sw_if *new = NULL;
+	struct gpc_sw_table *st;
+
+	TAILQ_FOREACH(st, &gpc_sw_tables, st_list) {
+		if (st->st_ifp != ifp)
+			continue;
+
+		if (n[st->st_v6] == GPC_SW_MAX_TABLES) {
+			RTE_LOG(ERR, GPC,
+				"Too many software GPC tables on %s\n",
+				ifp->if_name);
+			continue;
+		}
+
+		if (!new) {
+			new = calloc(1, sizeof(*new));
+			if (!new) {
+				RTE_LOG(ERR, GPC,
+					"Failed to allocate software GPC state for %s\n",
+					ifp->if_name);
+				return;
+			}
+		}
+		new->gsi_tbl[st->st_v6][n[st->st_v6]++] = st;
+	}
+
+	rcu_assign_pointer(ifp->if_gpc_sw, new);
+
+	gpc_sw_if_feat(ifp, old, new, false);
+	gpc_sw_if_feat(ifp, old, new, true);
+
+	if (old)
+		call_rcu(&old->gsi_rcu, gpc_sw_if_free);
+}
+
+static void
+gpc_sw_table_create(struct gpc_pb_table *table)
+{
+	struct gpc_sw_table *st;
+	struct ifnet *ifp;
+	int rc;
+
+	st = calloc(1, sizeof(*st));
+	if (!st)
+		goto nomem;
+
+	st->st_table = table;
+	st->st_gprg = table->gpc_group;
+	st->st_v6 = (table->traffic_type == TRAFFIC_TYPE__IPV6);
+	st->st_rules = calloc(table->n_rules, sizeof(*st->st_rules));
+	st->st_cntrs = calloc(table->n_rules, sizeof(*st->st_cntrs));
+	st->st_police = calloc(table->n_rules, sizeof(*st->st_police));
+	if (!st->st_rules || !st->st_cntrs || !st->st_police)
+		goto nomem;
+
+	rc = gpc_sw_table_compile(st, table);
+	if (rc) {
+		if (rc != -ENOENT)
+			RTE_LOG(ERR, GPC,
+				"Failed to build software GPC table for %s: %s\n",
+				table->ifname, strerror(-rc));
+		gpc_sw_table_free(st);
+		return;
+	}
+
+	TAILQ_INSERT_TAIL(&gpc_sw_tables, st, st_list);
+	table->sw_table = st;
+
+	DP_DEBUG(GPC, DEBUG, GPC,
+		 "Built software GPC table %p for %s/%s\n",
+		 st, table->ifname, st->st_v6 ? "ipv6" : "ipv4");
+
+	ifp = dp_ifnet_byifname(table->ifname);
+	if (ifp) {
+		st->st_ifp = ifp;
+		gpc_sw_if_update(ifp);
+	}
+	return;
+
+nomem:
+	RTE_LOG(ERR, GPC, "Failed to allocate software GPC table for %s\n",
+		table->ifname);
+	if (st)
+		gpc_sw_table_free(st);
+}
+
+void
+gpc_sw_table_delete(struct gpc_pb_table *table)
+{
+	struct gpc_sw_table *st = table->sw_table;
+
+	if (!st)
+		return;
+
+	TAILQ_REMOVE(&gpc_sw_tables, st, st_list);
+	table->sw_table = NULL;
+
+	if (st->st_ifp)
+		gpc_sw_if_update(st->st_ifp);
+
+	call_rcu(&st->st_rcu, gpc_sw_table_free_rcu);
+}
+
+void
+gpc_sw_table_update(struct gpc_pb_table *table)
+{
+	if (table->location != GPCTABLE__FEATURE_LOCATION__INGRESS ||
+	    !table->gpc_group || !table->n_rules)
+		return;
+
+	/* Offloaded to the FAL */
+	if (gpc_group_is_ll_created(table->gpc_group)) {
+		gpc_sw_table_delete(table);
+		return;
+	}
+
+	if (!table->sw_table)
+		gpc_sw_table_create(table);
+}
+
+static void
+gpc_sw_if_index_set(struct ifnet *ifp)
+{
+	struct gpc_sw_table *st;
+	bool changed = false;
+
+	TAILQ_FOREACH(st, &gpc_sw_tables, st_list) {
+		if (!st->st_ifp && !strcmp(st->st_table->ifname, ifp->if_name)) {
+			st->st_ifp = ifp;
+			changed = true;
+		}
+	}
+
+	if (changed)
+		gpc_sw_if_update(ifp);
+}
+
+static void
+gpc_sw_if_index_unset(struct ifnet *ifp, uint32_t ifindex __unused)
+{
+	struct gpc_sw_table *st;
+
+	TAILQ_FOREACH(st, &gpc_sw_tables, st_list) {
+		if (st->st_ifp == ifp)
+			st->st_ifp = NULL;
+	}
+
+	if (ifp->if_gpc_sw)
+		gpc_sw_if_update(ifp);
+}
+
+static const struct dp_event_ops gpc_sw_events = {
+	.if_index_set = gpc_sw_if_index_set,
+	.if_index_unset = gpc_sw_if_index_unset,
+};
+
+DP_STARTUP_EVENT_REGISTER(gpc_sw_events);
+
+/*
+ * Statistics
+ */
+
+bool
+gpc_sw_counter_read(struct gpc_cntr const *cntr,
+		    uint64_t *pkts, uint64_t *bytes)
+{
+	struct gpc_group *gprg = gpc_cntg_get_group(gpc_cntr_get_cntg(cntr));
+	struct gpc_sw_table *st;
+	unsigned int lcore;
+	uint16_t slot;
+
+	TAILQ_FOREACH(st, &gpc_sw_tables, st_list) {
+		if (st->st_gprg != gprg)
+			continue;
+
+		for (slot = 0; slot < st->st_n_cntrs; slot++)
+			if (st->st_cntrs[slot] == cntr)
+				break;
+		if (slot == st->st_n_cntrs)
+			continue;
+
+		*pkts = 0;
+		*bytes = 0;
+		RTE_LCORE_FOREACH(lcore) {
+			struct gpc_sw_count *counts = st->st_counts[lcore];
+
+			if (!counts)
+				continue;
+			*pkts += CMM_LOAD_SHARED(counts[slot].pkts);
+			*bytes += CMM_LOAD_SHARED(counts[slot].bytes);
+		}
+		return true;
+	}
+
+	return false;
+}
+
+bool
+gpc_sw_policer_read(struct gpc_pb_policer const *policer, uint64_t *drops)
+{
+	struct gpc_sw_table *st;
+	unsigned int lcore;
+	uint16_t slot;
+
+	TAILQ_FOREACH(st, &gpc_sw_tables, st_list) {
+		for (slot = 0; slot < st->st_n_police; slot++)
+			if (st->st_police[slot].sp_policer == policer)
+				break;
+		if (slot == st->st_n_police)
+			continue;
+
+		*drops = 0;
+		RTE_LCORE_FOREACH(lcore) {
+			uint64_t *red = st->st_red[lcore];
+
+			if (red)
+				*drops += CMM_LOAD_SHARED(red[slot]);
+		}
+		return true;
+	}
+
+	return false;
+}
+
+/*
+ * Forwarding path
+ */
+
+static void
+gpc_sw_key_l4(struct rte_mbuf *m, uint32_t off, uint8_t proto,
+	      uint16_t *sport, uint16_t *dport)
+{
+	const uint8_t *l4;
+	uint8_t buf[4];
+
+	switch (proto) {
+	case IPPROTO_TCP:
+	case IPPROTO_UDP:
+	case IPPROTO_UDPLITE:
+	case IPPROTO_SCTP:
+	case IPPROTO_DCCP:
+		l4 = rte_pktmbuf_read(m, off, 4, buf);
+		if (!l4)
+			return;
+		memcpy(sport, &l4[0], sizeof(*sport));
+		memcpy(dport, &l4[2], sizeof(*dport));
+		break;
+	case IPPROTO_ICMP:
+	case IPPROTO_ICMPV6:
+		l4 = rte_pktmbuf_read(m, off, 2, buf);
+		if (!l4)
+			return;
+		*sport = htons(l4[0]);
+		*dport = htons(l4[1]);
+		break;
+	default:
+		break;
+	}
+}
+
+static void
+gpc_sw_key4(struct rte_mbuf *m, struct gpc_sw_key4 *key)
+{
+	const struct iphdr *ip = iphdr(m);
+
+	memset(key, 0, sizeof(*key));
+	key->proto = ip->protocol;
+	key->proto_base = ip->protocol;
+	key->dscp = ip->tos >> 2;
+	key->ttl = ip->ttl;
+	key->frag = !!(ip->frag_off & htons(IP_MF | IP_OFFMASK));
+	key->src = ip->saddr;
+	key->dst = ip->daddr;
+
+	if (!(ip->frag_off & htons(IP_OFFMASK)))
+		gpc_sw_key_l4(m, dp_pktmbuf_l2_len(m) + (ip->ihl << 2),
+			      ip->protocol, &key->sport, &key->dport);
+}
+
+static void
+gpc_sw_key6(struct rte_mbuf *m, struct gpc_sw_key6 *key)
+{
+	const struct ip6_hdr *ip6 = ip6hdr(m);
+	uint16_t off = 0;
+	uint8_t proto;
+
+	/* Stops at the fragment header of a non-initial fragment */
+	proto = ip6_findpayload(m, &off);
+
+	memset(key, 0, sizeof(*key));
+	key->proto = proto;
+	key->proto_base = ip6->ip6_nxt;
+	key->dscp = (ntohl(ip6->ip6_flow) >> 22) & 0x3f;
+	key->ttl = ip6->ip6_hlim;
+	key->frag = (ip6->ip6_nxt == IPPROTO_FRAGMENT ||
+		     proto == IPPROTO_FRAGMENT);
+	memcpy(key->src, &ip6->ip6_src, sizeof(key->src));
+	memcpy(key->dst, &ip6->ip6_dst, sizeof(key->dst));
+
+	/* No offset is given back if the headers could not be parsed */
+	if (off && proto != IPPROTO_FRAGMENT)
+		gpc_sw_key_l4(m, off, proto, &key->sport, &key->dport);
+}
+
+static bool
+gpc_sw_police(struct gpc_sw_police const *sp, struct gpc_sw_bucket *b,
+	      uint64_t *red, uint32_t len, uint64_t now)
+{
+	uint64_t cost = (len * sp->sp_cycles_per_byte) >> GPC_SW_SHIFT;
+	uint64_t tat, start, old;
+
+	tat = CMM_LOAD_SHARED(b->tat);
+	for (;;) {
+		start = RTE_MAX(tat, now);
+		if (start - now > sp->sp_burst_cycles) {
+			(*red)++;
+			return false;
+		}
+
+		old = uatomic_cmpxchg(&b->tat, tat, start + cost);
+		if (old == tat)
+			return true;
+		tat = old;
+	}
+}
+
+static bool
+gpc_sw_table_apply(struct gpc_sw_table const *st, const uint8_t *key,
+		   struct rte_mbuf *m, uint64_t *now)
+{
+	unsigned int lcore = dp_lcore_id();
+	struct gpc_sw_rule const *rl;
+	uint32_t res = 0;
+
+	if (rte_acl_classify(st->st_acl, &key, &res, 1, 1) || !res)
+		return true;
+
+	rl = &st->st_rules[res - 1];
+
+	if (rl->rl_cntr && st->st_counts[lcore]) {
+		struct gpc_sw_count *c = &st->st_counts[lcore][rl->rl_cntr - 1];
+
+		c->pkts++;
+		c->bytes += rte_pktmbuf_pkt_len(m) - dp_pktmbuf_l2_len(m);
+	}
+
+	if (rl->rl_drop)
+		return false;
+
+	if (rl->rl_police && st->st_red[lcore]) {
+		if (!*now)
+			*now = rte_rdtsc();
+		return gpc_sw_police(&st->st_police[rl->rl_police - 1],
+				     &st->st_buckets[rl->rl_police - 1],
+				     &st->st_red[lcore][rl->rl_police - 1],
+				     rte_pktmbuf_pkt_len(m), *now);
+	}
+
+	return true;
+}
+
+bool
+gpc_sw_input(struct ifnet *ifp, struct rte_mbuf *m, bool v6)
+{
+	struct gpc_sw_if *gsi = rcu_dereference(ifp->if_gpc_sw);
+	union {
+		struct gpc_sw_key4 v4;
+		struct gpc_sw_key6 v6;
+	} key;
+	struct gpc_sw_table *st;
+	uint64_t now = 0;
+	unsigned int i;
+
+	if (unlikely(!gsi))
+		return true;
+
+	if (v6)
+		gpc_sw_key6(m, &key.v6);
+	else
+		gpc_sw_key4(m, &key.v4);
+
+	for (i = 0; i < GPC_SW_MAX_TABLES; i++) {
+		st = gsi->gsi_tbl[v6][i];
+		if (!st)
+			break;
+		if (!gpc_sw_table_apply(st, (const uint8_t *)&key, m, &now))
+			return false;
+	}
+
+	return true;
+}
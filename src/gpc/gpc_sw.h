@@ -0,0 +1,46 @@
+/*-
+ * Copyright (c) 2021, AT&T Intellectual Property.
+ * All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * Generalised Packet Classification (GPC) software forwarding path
+ */
+
+#ifndef GPC_SW_H
+#define GPC_SW_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct gpc_cntr;
+struct gpc_pb_policer;
+struct gpc_pb_table;
+struct ifnet;
+struct rte_mbuf;
+
+/*
+ * Ingress GPC tables which could not be given to the FAL, e.g. on
+ * platforms without switch hardware, are compiled into an rte_acl
+ * context and applied by the ipv[46]-gpc-in pipeline features.
+ *
+ * Rules may drop or pass a packet, count it and police it. Counters
+ * are kept per forwarding thread; each policer has one bucket shared
+ * by all threads. Marking actions (designation, colour) only have
+ * meaning to the hardware and are not applied.
+ *
+ * gpc_sw_table_update() builds the software copy of a table if the FAL
+ * did not create it, and removes it if the FAL did.
+ */
+void gpc_sw_table_update(struct gpc_pb_table *table);
+void gpc_sw_table_delete(struct gpc_pb_table *table);
+
+bool gpc_sw_counter_read(struct gpc_cntr const *cntr,
+			 uint64_t *pkts, uint64_t *bytes);
+bool gpc_sw_policer_read(struct gpc_pb_policer const *policer,
+			 uint64_t *drops);
+
+/* Returns false if the packet is to be dropped */
+bool gpc_sw_input(struct ifnet *ifp, struct rte_mbuf *m, bool v6);
+
+#endif /* GPC_SW_H */
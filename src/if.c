@@ -1177,6 +1177,8 @@ struct ifnet *if_alloc(const char *ifname, enum if_type type,
 		}
 	}
 
+	ether_if_class_update(ifp);
+
 	dp_event(DP_EVT_IF_CREATE, 0, ifp, 0, 0, NULL);
 
 	return ifp;
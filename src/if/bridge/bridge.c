@@ -68,6 +68,7 @@
 #include "pl_fused.h"
 #include "pktmbuf_internal.h"
 #include "pl_node.h"
+#include "storm_ctl.h"
 #include "urcu.h"
 #include "util.h"
 #include "vplane_debug.h"
@@ -892,6 +893,7 @@ static void bridge_newport(int ifindex, const char *name,
 		pl_node_add_feature_by_inst(&bridge_in_feat, ifp);
 
 		rcu_assign_pointer(ifp->if_brport, port);
+		ether_if_class_update(ifp);
 		bridge_port_add_to_list(port, &sc->scbr_porthead);
 
 		if (!bridge_can_create_in_fal(ifp))
@@ -1030,6 +1032,7 @@ static void bridge_delport(struct ifnet *ifp, struct bridge_port *brport)
 	pl_node_remove_feature_by_inst(&bridge_in_feat, ifp);
 
 	rcu_assign_pointer(ifp->if_brport, NULL);
+	ether_if_class_update(ifp);
 	fal_created = bridge_port_is_fal_created(brport);
 	bridge_port_destroy(brport);
 
@@ -1363,6 +1366,17 @@ drop:
 static void bridge_flood(struct bridge_softc *sc, struct ifnet *in_ifp,
 			 struct rte_mbuf *m, struct ifnet *brif, bool is_pvst)
 {
+	/*
+	 * Frames forwarded by the hardware have been through its storm
+	 * control policers, police the rest here.
+	 */
+	if (in_ifp && !in_ifp->hw_forwarding && unlikely(in_ifp->sc_info) &&
+	    !storm_ctl_sw_accept(in_ifp, m, bridge_frame_get_vlan(m))) {
+		if_incr_dropped(brif);
+		rte_pktmbuf_free(m);
+		return;
+	}
+
 	if_incr_out(brif, m);
 
 	if (unlikely(brif->capturing))
@@ -494,8 +494,10 @@ static int reconfigure_pkt_len(struct ifnet *ifp, uint32_t mtu)
 		if (dev_info.rx_offload_capa & DEV_RX_OFFLOAD_SCATTER)
 			dev_conf.rxmode.offloads |= DEV_RX_OFFLOAD_SCATTER;
 	} else {
-		dev_conf.rxmode.offloads &= ~(DEV_RX_OFFLOAD_JUMBO_FRAME |
-			DEV_RX_OFFLOAD_SCATTER);
+		dev_conf.rxmode.offloads &= ~DEV_RX_OFFLOAD_JUMBO_FRAME;
+		/* rx buffer split always needs scatter */
+		if (!port_uses_rx_split(ifp->if_port))
+			dev_conf.rxmode.offloads &= ~DEV_RX_OFFLOAD_SCATTER;
 	}
 	dev_conf.rxmode.max_rx_pkt_len = mtu +
 					 RTE_ETHER_HDR_LEN +
@@ -1495,6 +1497,7 @@ struct ifnet *dpdk_eth_if_alloc_w_port(const char *if_name,
 
 	/* port is on this dataplane, so if_port is valid */
 	ifp->if_local_port = 1;
+	ether_if_class_update(ifp);
 
 	/*
 	 * Set mac-address driver filtering as initially
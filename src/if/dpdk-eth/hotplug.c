@@ -126,6 +126,9 @@ int detach_device(const char *name)
 			ret = -1;
 		}
 	}
+
+	/* The rx rings have been emptied back into the pools by now */
+	mbuf_hdr_pool_release_portid(port_id);
 	CMM_STORE_SHARED(hotplug_inprogress, false);
 
 	return ret;
@@ -11,8 +11,10 @@
 #include <netinet/in.h>
 #include <linux/if.h>
 #include <poll.h>
+#include <rte_eth_vhost.h>
 #include <rte_ethdev.h>
 #include <rte_log.h>
+#include <rte_vhost.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
@@ -30,6 +32,7 @@
 #include "if_var.h"
 #include "json_writer.h"
 #include "main.h"
+#include "pktmbuf_internal.h"
 #include "urcu.h"
 #include "util.h"
 #include "vhost.h"
@@ -38,14 +41,21 @@
 
 #define QMP_RETURN_BUFSIZE 200
 
+#ifndef VIRTIO_F_RING_PACKED
+#define VIRTIO_F_RING_PACKED 34
+#endif
+
 struct vhost_info_private {
 	struct rcu_head sc_rcu;	   /**< Linkage for call_rcu */
 	struct cds_list_head list; /**< Linkage for vhost_info_private_list */
 	char name[IFNAMSIZ];	   /**< DPDK instance name */
 	char *qmp_path;		   /**< Path to QMP connection */
 	char *qemu_ifname;	   /**< QEMU name for guest interface */
+	bool zero_copy;		   /**< Dequeue zero-copy requested */
 };
 
+unsigned int vhost_zero_copy_ports;
+
 struct vhost_transport {
 	struct rcu_head vt_rcu;		/**< Linkage for call_rcu */
 	struct cds_list_head list;
@@ -76,7 +86,7 @@ struct vhost_event_list vhost_ev_list;
  * Check to see if an ifp is a vhost interface by examining
  * the DPDK PMD driver name.
  */
-static bool is_vhost(const struct ifnet *ifp)
+bool is_vhost(const struct ifnet *ifp)
 {
 	if (ifp->if_local_port) {
 		struct rte_eth_dev *eth_dev = &rte_eth_devices[ifp->if_port];
@@ -259,6 +269,8 @@ static void vhost_info_private_free(struct rcu_head *head)
 	struct vhost_info_private *vip =
 		caa_container_of(head, struct vhost_info_private, sc_rcu);
 
+	if (vip->zero_copy)
+		uatomic_dec(&vhost_zero_copy_ports);
 	free(vip->qmp_path);
 	free(vip->qemu_ifname);
 	free(vip);
@@ -313,6 +325,50 @@ void vhost_info_free(struct vhost_info *vi)
 	free(vi);
 }
 
+/* Is the segment's data outside the mbuf's own buffer? */
+static bool vhost_mbuf_buf_is_foreign(struct rte_mbuf *m)
+{
+	if (RTE_MBUF_HAS_EXTBUF(m))
+		return true;
+	if (RTE_MBUF_CLONED(m))
+		m = rte_mbuf_from_indirect(m);
+	return m->buf_addr != (char *)m + sizeof(*m) +
+		rte_pktmbuf_priv_size(m->pool);
+}
+
+struct rte_mbuf *vhost_zero_copy_unpin_slow(struct rte_mbuf *m)
+{
+	struct rte_mbuf *seg, *copy;
+
+	for (seg = m; seg; seg = seg->next)
+		if (vhost_mbuf_buf_is_foreign(seg))
+			break;
+	if (!seg)
+		return m;
+
+	copy = pktmbuf_copy(m, m->pool);
+	rte_pktmbuf_free(m);
+	return copy;
+}
+
+/**
+ * Show what has been negotiated with the guest, if connected.
+ */
+static void vhost_devinfo_guest(json_writer_t *wr, const struct ifnet *ifp)
+{
+	uint64_t features;
+	int vid;
+
+	vid = rte_eth_vhost_get_vid_from_port_id(ifp->if_port);
+	if (vid < 0)
+		return;
+
+	jsonw_int_field(wr, "guest_numa_node", rte_vhost_get_numa_node(vid));
+	if (rte_vhost_get_negotiated_features(vid, &features) == 0)
+		jsonw_bool_field(wr, "packed_ring",
+				 features & (1ULL << VIRTIO_F_RING_PACKED));
+}
+
 void vhost_devinfo(json_writer_t *wr, const struct ifnet *ifp)
 {
 	struct vhost_info *vi;
@@ -326,8 +382,11 @@ void vhost_devinfo(json_writer_t *wr, const struct ifnet *ifp)
 		if (vip->qemu_ifname)
 			jsonw_string_field(wr, "qemu_ifname",
 					       vip->qemu_ifname);
+		jsonw_bool_field(wr, "dequeue_zero_copy", vip->zero_copy);
 	}
 
+	vhost_devinfo_guest(wr, ifp);
+
 	jsonw_name(wr, "transport_links");
 	jsonw_start_array(wr);
 	vi = get_vhost_info(ifp);
@@ -403,7 +462,7 @@ static int cmd_vhost_set_qemu_ifname(char *name, char *qemu_ifname)
 }
 
 static int cmd_vhost_enable(char *ifname, char *queues, char *path, char *alias,
-			    bool on_main, bool is_client)
+			    bool zero_copy, bool on_main, bool is_client)
 {
 	int rc;
 	char *devargs_p;
@@ -419,10 +478,17 @@ static int cmd_vhost_enable(char *ifname, char *queues, char *path, char *alias,
 		return -1;
 	}
 
-	/* Construct "eth_vhost1,iface=/run/dataplane/eth_vhost1" with */
-	size = asprintf(&devargs_p, "eth_%s,iface=%s%s%s%s%s",
+	/*
+	 * Construct "eth_vhost1,iface=/run/dataplane/eth_vhost1" with
+	 * options. Dequeue zero-copy leaves guest buffers referenced by
+	 * mbufs until they are freed. Packets that would be held for long
+	 * are copied (see vhost_zero_copy_unpin), but that costs a copy
+	 * per packet through QoS, so it is only used when asked for.
+	 */
+	size = asprintf(&devargs_p, "eth_%s,iface=%s%s%s%s%s%s",
 			p, dev_basename, p, is_client ? ",client=1" : "",
-			queues ? ",queues=" : "", queues ? queues : "");
+			queues ? ",queues=" : "", queues ? queues : "",
+			zero_copy ? ",dequeue-zero-copy=1" : "");
 	if (size == -1)
 		return -1;
 
@@ -455,6 +521,9 @@ static int cmd_vhost_enable(char *ifname, char *queues, char *path, char *alias,
 
 		vip = vhost_info_private_create(ifname);
 		if (vip) {
+			vip->zero_copy = zero_copy;
+			if (zero_copy)
+				uatomic_inc(&vhost_zero_copy_ports);
 			if (path)
 				cmd_vhost_set_qmp_path(ifname, path);
 			if (alias)
@@ -726,6 +795,7 @@ static int __cmd_vhost(const char *cmd,
 	char *queues = NULL;
 	char *path = NULL;
 	char *alias = NULL;
+	bool zero_copy = false;
 	int rc;
 
 	if (argc < 3)
@@ -750,12 +820,15 @@ static int __cmd_vhost(const char *cmd,
 				if (i >= argc)
 					goto bad_command;
 				alias = argv[i++];
+			} else if (strcmp(argv[i], "-z") == 0) {
+				i++;
+				zero_copy = true;
 			} else
 				goto bad_command;
 		}
 
-		rc = cmd_vhost_enable(argv[2],
-				      queues, path, alias, true, is_client);
+		rc = cmd_vhost_enable(argv[2], queues, path, alias,
+				      zero_copy, true, is_client);
 	} else if (strcmp(argv[1], "disable") == 0 && argc == 3)
 		rc = cmd_vhost_disable(argv[2], false);
 	else if (strcmp(argv[1], "set-qmp-path") == 0 && argc == 4)
@@ -769,7 +842,7 @@ static int __cmd_vhost(const char *cmd,
 
 bad_command:
 	fprintf(f, "usage: %s enable <string> "
-		   "[-q queues] [-a alias] [-p path]\n", cmd);
+		   "[-q queues] [-a alias] [-p path] [-z]\n", cmd);
 	fprintf(f, "       %s disable <string>\n", cmd);
 	fprintf(f, "       %s set-qmp-path name path\n", cmd);
 	fprintf(f, "       %s set-qemu-ifname name qemu-ifname\n", cmd);
@@ -792,6 +865,7 @@ static int __cmd_vhost_cfg(const char *cmd,
 	char *queues = NULL;
 	char *path = NULL;
 	char *alias = NULL;
+	bool zero_copy = false;
 	int rc;
 
 	if (argc < 3)
@@ -816,12 +890,15 @@ static int __cmd_vhost_cfg(const char *cmd,
 				if (i >= argc)
 					goto bad_command;
 				alias = argv[i++];
+			} else if (strcmp(argv[i], "-z") == 0) {
+				i++;
+				zero_copy = true;
 			} else
 				goto bad_command;
 		}
 
-		rc = cmd_vhost_enable(argv[2],
-				      queues, path, alias, true, is_client);
+		rc = cmd_vhost_enable(argv[2], queues, path, alias,
+				      zero_copy, true, is_client);
 	} else if (strcmp(argv[1], "disable") == 0 && argc == 3)
 		rc = cmd_vhost_disable(argv[2], true);
 	else if (strcmp(argv[1], "transport-link") == 0 && argc == 5) {
@@ -839,7 +916,8 @@ static int __cmd_vhost_cfg(const char *cmd,
 
 bad_command:
 	if (f) {
-		fprintf(f, "usage: %s enable <string> [-q <queues>]\n", cmd);
+		fprintf(f, "usage: %s enable <string> [-q <queues>] [-z]\n",
+			cmd);
 		fprintf(f, "       %s disable <string>\n", cmd);
 		fprintf(f, "       %s transport-link <vhost_name> "
 			   "<transport_name> add|del\n", cmd);
@@ -8,13 +8,58 @@
 #ifndef VHOST_H
 #define VHOST_H
 
+#include <stdbool.h>
 #include <stdio.h>
+#include <rte_branch_prediction.h>
+#include <urcu/system.h>
 
 #include "json_writer.h"
 
 struct ifnet;
+struct rte_mbuf;
 struct vhost_info;
 
+/* Number of vhost ports with dequeue zero-copy */
+extern unsigned int vhost_zero_copy_ports;
+
+struct rte_mbuf *vhost_zero_copy_unpin_slow(struct rte_mbuf *m);
+
+/*
+ * Packets received on a vhost port with dequeue zero-copy point into
+ * guest memory, and the guest can't reuse the buffer until the mbuf is
+ * freed. Anything that holds packets for an unbounded time (QoS queues,
+ * neighbour resolution) replaces them with a copy first, so zero-copy
+ * is only used where it is safe.
+ *
+ * Returns the packet to hold, or NULL, having freed it, if it could not
+ * be copied.
+ */
+static inline struct rte_mbuf *vhost_zero_copy_unpin(struct rte_mbuf *m)
+{
+	if (likely(!CMM_LOAD_SHARED(vhost_zero_copy_ports)))
+		return m;
+	return vhost_zero_copy_unpin_slow(m);
+}
+
+/* As above for a burst, returns the number of packets left */
+static inline unsigned int
+vhost_zero_copy_unpin_bulk(struct rte_mbuf *pkts[], unsigned int n)
+{
+	unsigned int i, j;
+
+	if (likely(!CMM_LOAD_SHARED(vhost_zero_copy_ports)))
+		return n;
+
+	for (i = j = 0; i < n; i++) {
+		struct rte_mbuf *m = vhost_zero_copy_unpin_slow(pkts[i]);
+
+		if (m)
+			pkts[j++] = m;
+	}
+	return j;
+}
+
+bool is_vhost(const struct ifnet *ifp);
 void vhost_devinfo(json_writer_t *wr, const struct ifnet *ifp);
 void vhost_update_guests(struct ifnet *ifp);
 int cmd_vhost(FILE *f, int argc, char **argv);
@@ -1690,7 +1690,7 @@ int ip_gre_tunnel_in(struct rte_mbuf **m0, struct iphdr *ip)
 				return 0;
 			}
 		}
-		ether_input(tun_ifp, m);
+		ether_if_input_func(tun_ifp)(tun_ifp, m);
 		break;
 	default:
 		return 1;
@@ -1957,6 +1957,16 @@ gre_tunnel_fragment_and_send(struct ifnet *input_ifp, struct ifnet *tunnel_ifp,
 			gre_frag.input_ifp = input_ifp;
 			gre_frag.nxt_ip = nxt_ip;
 			gre_frag.proto = proto;
+
+			/*
+			 * Prefer splitting TCP into segments that fit the
+			 * tunnel, so the remote end needn't reassemble.
+			 */
+			if (proto == ETH_P_IP &&
+			    ip_tcp_gso_mtu(tunnel_ifp, tunnel_ifp->if_mtu, m,
+					   &gre_frag, gre_encap_frags))
+				return;
+
 			ip_fragment(tunnel_ifp, m, &gre_frag, gre_encap_frags);
 
 			return;
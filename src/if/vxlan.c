@@ -1094,7 +1094,7 @@ vxlan_recv_encap(struct rte_mbuf *m, uint16_t ether_type,
 
 		set_spath_rx_meta_data(m, ifp, RTE_ETHER_TYPE_TEB,
 				       TUN_META_FLAGS_DEFAULT);
-		ether_input(ifp, m);
+		ether_if_input_func(ifp)(ifp, m);
 		return;
 	case VXLAN_GPE:
 		switch (nxtproto) {
@@ -1107,7 +1107,7 @@ vxlan_recv_encap(struct rte_mbuf *m, uint16_t ether_type,
 
 			set_spath_rx_meta_data(m, ifp, RTE_ETHER_TYPE_TEB,
 					       TUN_META_FLAGS_DEFAULT);
-			ether_input(ifp, m);
+			ether_if_input_func(ifp)(ifp, m);
 			return;
 		case VGPE_NXT_IPV4:
 			/* The vxlan payload had no L2 header, add one now. */
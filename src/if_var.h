@@ -87,6 +87,8 @@ struct portmonitor_info;
 struct npf_if;
 struct cgn_intf;
 struct egress_map_info;
+struct gpc_sw_if;
+struct qos_ipol_if;
 
 /*
  * Software statistics maintained per-core.
@@ -265,7 +267,8 @@ struct ifnet {
 	vrfid_t		   if_vrfid;	/* vrf tag */
 	void               **node_instance_contexts;
 	uint16_t           l2_output_features;
-	uint16_t           padding[3];
+	uint8_t            if_pl_class;	/* fused graph for input */
+	uint8_t            padding[5];
 	struct npf_if	   *if_npf;	/* NPF specific info */
 	struct ifnet	   *if_parent;	/* real device for vlan */
 
@@ -330,8 +333,9 @@ struct ifnet {
 	struct rte_ether_addr  perm_addr;   /* "permanent" MAC address */
 
 	uint16_t	   mpls_labelspace;
+	uint16_t	   if_dyn_feat_count; /* dyn features on port input */
 
-	uint8_t padding3[4];
+	uint8_t padding3[2];
 	struct cds_list_head if_addrhead; /* list of addresses per if */
 	/* --- cacheline 4 boundary (256 bytes) --- */
 	struct cds_list_head if_list; /* List of all interfaces */
@@ -393,6 +397,19 @@ struct ifnet {
 	uint16_t          ip6_out_spath_features;
 
 	struct egress_map_info *egr_map_info;
+
+	/* Ingress GPC tables applied in software */
+	struct gpc_sw_if *if_gpc_sw;
+
+	/* Ingress subscriber policing */
+	struct qos_ipol_if *if_qos_ipol;
+
+	/*
+	 * Ifindex of the port whose if_dyn_feat_count our dynamic
+	 * features are counted on, looked up again on release.
+	 */
+	uint32_t if_dyn_feat_port;
+	uint16_t if_dyn_feat_port_refs;
 };
 
 static_assert(offsetof(struct ifnet, if_vlantbl) == 64,
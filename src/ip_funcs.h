@@ -85,6 +85,12 @@ void ip_fragment(struct ifnet *, struct rte_mbuf *, void *ctx, output_t)
 void ip_fragment_mtu(struct ifnet *, unsigned int mtu,
 		 struct rte_mbuf *, void *ctx, output_t)
 	__hot_func;
+
+/* Most segments a single oversize TCP packet is split into */
+#define IP_GSO_MAX_SEGS 64
+
+bool ip_tcp_gso_mtu(struct ifnet *ifp, unsigned int mtu,
+		    struct rte_mbuf *m0, void *ctx, output_t seg_out);
 int ip_mbuf_copy(struct rte_mbuf *m, const struct rte_mbuf *n,
 		 unsigned int off, unsigned int len);
 
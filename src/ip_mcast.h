@@ -170,6 +170,10 @@ void mvif6_dump(FILE *f, struct vrf *vrf);
 void send_sg_cnt(struct sioc_sg_req *rq, vrfid_t vrf_id, uint32_t flags);
 void send_sg6_cnt(struct sioc_sg_req6 *rq, vrfid_t vrf_id, uint32_t flags);
 
+/* Send the changed mroute stats now, as the stats timer does */
+unsigned int mrt_stats_export(void);
+unsigned int mrt6_stats_export(void);
+
 int mcast_iftable_get_free_slot(struct if_set *mfc_ifset, int ifindex,
 				unsigned char *vif_index);
 #endif
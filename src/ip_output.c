@@ -15,8 +15,10 @@
 #include <linux/snmp.h>
 #include <netinet/in.h>
 #include <netinet/ip.h>
+#include <netinet/tcp.h>
 #include <rte_branch_prediction.h>
 #include <rte_ether.h>
+#include <rte_gso.h>
 #include <rte_log.h>
 #include <rte_mbuf.h>
 #include <stdbool.h>
@@ -31,6 +33,7 @@
 #include "ether.h"
 #include "if_var.h"
 #include "in_cksum.h"
+#include "ip_checksum.h"
 #include "ip_funcs.h"
 #include "mpls/mpls.h"
 #include "mpls/mpls_forward.h"
@@ -334,3 +337,84 @@ drop: __cold_label;
 	IPSTAT_INC_VRF(vrf, IPSTATS_MIB_OUTDISCARDS);
 	rte_pktmbuf_free(m0);
 }
+
+/*
+ * Segment an oversize TCP/IPv4 packet into TCP segments that fit
+ * within the mtu, rather than IP fragmenting it, so that the far end
+ * of a tunnel does not have to reassemble. The payload of each segment
+ * is attached indirectly to the original packet, so only the headers
+ * are copied.
+ *
+ * Returns true if the packet has been consumed, or false if it is not
+ * suitable for segmentation, in which case it is left untouched and
+ * the caller should fall back to ip_fragment_mtu().
+ */
+bool ip_tcp_gso_mtu(struct ifnet *ifp, unsigned int mtu, struct rte_mbuf *m0,
+		    void *ctx, output_t seg_out)
+{
+	struct rte_mbuf *segs[IP_GSO_MAX_SEGS];
+	const struct iphdr *ip = iphdr(m0);
+	struct rte_gso_ctx gso_ctx;
+	const struct tcphdr *tcp;
+	uint64_t ol_flags, tx_offload;
+	unsigned int hlen;
+	int nb_segs, i;
+
+	if (ip->protocol != IPPROTO_TCP || ip->ihl != 5 ||
+	    ip_is_fragment(ip))
+		return false;
+
+	hlen = dp_pktmbuf_l2_len(m0) + sizeof(struct iphdr);
+	if (rte_pktmbuf_data_len(m0) < hlen + sizeof(struct tcphdr))
+		return false;
+
+	tcp = (const struct tcphdr *)((const char *)ip + sizeof(struct iphdr));
+	hlen += tcp->doff << 2;
+	if (rte_pktmbuf_data_len(m0) < hlen || mtu <= hlen)
+		return false;
+
+	/* rte_gso needs these, restored if the packet is left to fragment */
+	ol_flags = m0->ol_flags;
+	tx_offload = m0->tx_offload;
+	dp_pktmbuf_l3_len(m0) = sizeof(struct iphdr);
+	m0->l4_len = tcp->doff << 2;
+	m0->ol_flags |= PKT_TX_TCP_SEG | PKT_TX_IPV4;
+
+	gso_ctx.direct_pool = m0->pool;
+	gso_ctx.indirect_pool = m0->pool;
+	gso_ctx.gso_types = DEV_TX_OFFLOAD_TCP_TSO;
+	gso_ctx.gso_size = dp_pktmbuf_l2_len(m0) + mtu;
+	gso_ctx.flag = 0;
+
+	nb_segs = rte_gso_segment(m0, &gso_ctx, segs, IP_GSO_MAX_SEGS);
+	if (nb_segs <= 1) {
+		m0->ol_flags = ol_flags;
+		m0->tx_offload = tx_offload;
+		return false;
+	}
+
+	for (i = 0; i < nb_segs; i++) {
+		struct rte_mbuf *m = segs[i];
+		struct iphdr *mhip;
+		struct tcphdr *mtcp;
+
+		pktmbuf_copy_meta(m, m0);
+		pktmbuf_set_vrf(m, pktmbuf_get_vrf(m0));
+		m->ol_flags &= ~(PKT_TX_TCP_SEG | PKT_TX_IPV4);
+
+		mhip = iphdr(m);
+		dp_set_cksum_hdr(mhip);
+		mtcp = (struct tcphdr *)(mhip + 1);
+		mtcp->check = 0;
+		mtcp->check = dp_in4_cksum_mbuf(m, mhip, mtcp);
+	}
+
+	/*
+	 * The segments now hold the only references to the original
+	 * packet data, so it is released when the last one is sent.
+	 */
+	for (i = 0; i < nb_segs; i++)
+		seg_out(ifp, segs[i], ctx);
+
+	return true;
+}
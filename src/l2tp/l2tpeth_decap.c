@@ -173,7 +173,7 @@ static int l2tp_recv_encap(struct rte_mbuf *m,
 		return 0;
 	}
 
-	ether_input(ifp, m);
+	ether_if_input_func(ifp)(ifp, m);
 	return 0;
 }
 
@@ -5,10 +5,13 @@
  */
 
 #include <sys/queue.h>
+#include <rte_cycles.h>
+#include <urcu/list.h>
 
 #include "main.h"
 #include "lcore_sched.h"
 #include "lcore_sched_internal.h"
+#include "urcu.h"
 #include "util.h"
 #include "vplane_log.h"
 
@@ -153,3 +156,85 @@ void dp_lcore_events_teardown(unsigned int lcore_id)
 
 	pthread_mutex_unlock(&dp_lcore_events_mutex);
 }
+
+struct dp_lcore_housekeeping_lcore {
+	uint64_t next_run;
+} __rte_cache_aligned;
+
+struct dp_lcore_housekeeping_internal {
+	const struct dp_lcore_housekeeping *hk;
+	void *arg;
+	uint64_t interval;
+	struct cds_list_head list_entry;
+	struct rcu_head rcu;
+	struct dp_lcore_housekeeping_lcore lcore[RTE_MAX_LCORE];
+};
+
+static CDS_LIST_HEAD(dp_lcore_housekeeping_list);
+
+int dp_lcore_housekeeping_register(const struct dp_lcore_housekeeping *hk,
+				   void *arg)
+{
+	struct dp_lcore_housekeeping_internal *entry;
+
+	ASSERT_MAIN();
+
+	if (!hk || !hk->dp_lcore_housekeeping_fn)
+		return -EINVAL;
+
+	entry = zmalloc_aligned(sizeof(*entry));
+	if (!entry)
+		return -ENOMEM;
+
+	entry->hk = hk;
+	entry->arg = arg;
+	entry->interval = hk->interval_ms * rte_get_timer_hz() / MSEC_PER_SEC;
+	cds_list_add_rcu(&entry->list_entry, &dp_lcore_housekeeping_list);
+
+	return 0;
+}
+
+static void dp_lcore_housekeeping_free(struct rcu_head *head)
+{
+	free(caa_container_of(head, struct dp_lcore_housekeeping_internal,
+			      rcu));
+}
+
+int dp_lcore_housekeeping_unregister(const struct dp_lcore_housekeeping *hk)
+{
+	struct dp_lcore_housekeeping_internal *entry;
+
+	ASSERT_MAIN();
+
+	if (!hk)
+		return -EINVAL;
+
+	cds_list_for_each_entry(entry, &dp_lcore_housekeeping_list,
+				list_entry) {
+		if (entry->hk == hk) {
+			cds_list_del_rcu(&entry->list_entry);
+			call_rcu(&entry->rcu, dp_lcore_housekeeping_free);
+			return 0;
+		}
+	}
+
+	return -ENOENT;
+}
+
+void dp_lcore_housekeeping_run(unsigned int lcore_id, bool idle)
+{
+	struct dp_lcore_housekeeping_internal *entry;
+	struct dp_lcore_housekeeping_lcore *hkl;
+	uint64_t now = rte_get_timer_cycles();
+
+	cds_list_for_each_entry_rcu(entry, &dp_lcore_housekeeping_list,
+				    list_entry) {
+		hkl = &entry->lcore[lcore_id];
+
+		if (now < hkl->next_run + (idle ? 0 : entry->interval))
+			continue;
+
+		hkl->next_run = now + entry->interval;
+		entry->hk->dp_lcore_housekeeping_fn(lcore_id, entry->arg);
+	}
+}
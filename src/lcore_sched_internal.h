@@ -7,6 +7,7 @@
 #ifndef LCORE_SCHED_INTERNAL_H
 #define LCORE_SCHED_INTERNAL_H
 
+#include <stdbool.h>
 #include <stdint.h>
 
 /*
@@ -19,4 +20,11 @@ void dp_lcore_events_init(unsigned int lcore_id);
  */
 void dp_lcore_events_teardown(unsigned int lcore_id);
 
+/*
+ * Run the registered housekeeping callbacks that are due on this lcore.
+ * If idle is false the lcore is busy and only callbacks that are a full
+ * interval overdue are run.
+ */
+void dp_lcore_housekeeping_run(unsigned int lcore_id, bool idle);
+
 #endif /* LCORE_SCHED_INTERNAL_H */
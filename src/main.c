@@ -68,6 +68,7 @@
 #include <rte_branch_prediction.h>
 #include <rte_common.h>
 #include <rte_config.h>
+#include <rte_cycles.h>
 #include <rte_debug.h>
 #include <rte_eal.h>
 #include <rte_errno.h>
@@ -117,6 +118,7 @@
 #include "npf/fragment/ipv4_rsmbl.h"
 #include "npf_shim.h"
 #include "pipeline/pl_internal.h"
+#include "pkt_latency.h"
 #include "pktmbuf_internal.h"
 #include "portmonitor/portmonitor.h"
 #include "power.h"
@@ -161,6 +163,18 @@ static struct rxtx_param *driver_param;
 #define DEFAULT_FCPAUSE	0xffff	/* see ixgbe.h */
 
 #define RX_PKT_BURST  32
+#define RX_PKT_BURST_MIN 4
+/* Times a queue returning a full burst is polled again before moving on */
+#define RX_BURST_REPOLL_MAX 3
+/*
+ * An idle queue sharing an lcore with others is polled only once every
+ * 2^backoff passes, bounding the worst case at 1 in 2^RX_POLL_BACKOFF_MAX.
+ * Passes that take long, as the busy queues fill their bursts, must not
+ * stretch that out until the idle queue's ring overflows, so it is also
+ * polled once RX_POLL_BACKOFF_MAX_US has passed since it last was.
+ */
+#define RX_POLL_BACKOFF_MAX 4
+#define RX_POLL_BACKOFF_MAX_US 20
 #define QOS_PKT_BURST 64
 #define TX_PKT_BURST  32
 
@@ -209,13 +223,21 @@ struct lcore_conf {
 	uint8_t tx_qid;	      /* my tx queue for multi-queue devices */
 	uint8_t do_crypto;    /* thread is tasked with doing crypto */
 	uint8_t crypto_fwd;   /* post-crypto forwarding workload present */
+	uint8_t rx_busy;      /* last rx pass received packets */
 
 	/* receive queues this cpu should check for input */
 	struct lcore_rx_queue {
 		portid_t portid;
 		uint8_t queueid;
+		uint8_t burst;		/* current adaptive burst size */
+		uint8_t backoff;	/* log2 of passes between polls */
+		uint8_t skip;		/* passes left before next poll */
 		struct pm_governor gov;
+		uint64_t last_poll;	/* TSC of the pass it was last polled */
 		uint64_t packets;
+		uint64_t bursts;	/* polls that returned packets */
+		uint64_t polls;		/* calls into the driver */
+		uint64_t skipped;	/* passes skipped due to backoff */
 	} rx_poll[MAX_RX_QUEUE_PER_CORE];
 
 	/* transmit queues this cpu should do output processing on */
@@ -230,8 +252,10 @@ struct lcore_conf {
 		 * control packets share a queue with data packets.
 		 */
 		uint8_t tx_no_pkts : 1;
+		uint8_t handoff_next;	/* QoS handoff ring to poll first */
 		struct pm_governor gov;
 		uint64_t packets;
+		uint64_t handoff_packets; /* taken from QoS handoff rings */
 		struct rte_mbuf *burst[TX_PKT_BURST];
 	} tx_poll[MAX_TX_QUEUE_PER_CORE];
 
@@ -263,23 +287,36 @@ static struct lcore_conf *lcore_conf[RTE_MAX_LCORE];
  */
 static const uint8_t NO_OWNER = 255;
 
+/*
+ * In QoS worker mode each thread that forwards to a QoS port has a
+ * single producer ring of its own to hand packets to the worker
+ * running the scheduler, so that they don't contend on the Tx ring.
+ */
+struct qos_handoff {
+	unsigned int	n;
+	struct rte_ring *ring[];	/* by dp_lcore_id() */
+};
+
 /* Port configuration */
 static struct port_conf {
 	struct rte_ring *pkt_ring[MAX_TX_QUEUE_PER_PORT];	/*  0 32 */
 	uint8_t		nrings;					/* 32  1 */
 	uint8_t		max_rings;				/* 33  1 */
 	bool		percoreq;				/* 34  1 */
-
-	/* XXX 5 bytes hole, try to pack. */
-
+	bool		qos_tx;					/* 35  1 */
+	uint32_t	rx_coalesce_cycles;			/* 36  4 */
 	bitmask_t	tx_enabled_queues;			/* 40 16 */
 	bitmask_t	rx_enabled_queues;			/* 56 16 */
+	struct qos_handoff *qos_handoff;			/* 72  8 */
 
-	/* size: 128, cachlines: 2, members: 6 */
-	/* sum members: 57, holes: 1, sum holes: 5 */
-	/* padding: 56 */
+	/* size: 128, cachlines: 2, members: 9 */
+	/* sum members: 80 */
+	/* padding: 48 */
 } __rte_cache_aligned port_config[DATAPLANE_MAX_PORTS] __hot_data;
 
+/* Lcores dedicated to running the QoS scheduler, if any */
+static bitmask_t qos_worker_cpus;
+
 /* Port allocations */
 static struct port_alloc {
 	uint64_t		 dev_flags;			/*   0  8 */
@@ -302,10 +339,12 @@ static struct port_alloc {
 	/* XXX 4 bytes hole, try to packet */
 
 	struct rte_mempool	*rx_pool;			/* 168  8 */
+	struct rte_mempool	*rx_hdr_pool;			/* 176  8 */
+	uint16_t		 rx_split_len;			/* 184  2 */
 
-	/* size: 176, cachelines: 3, members: 15 */
-	/* sum members: 172, holes: 1, sum holes: 4 */
-	/* last cacheline: 48 bytes */
+	/* size: 192, cachelines: 3, members: 17 */
+	/* sum members: 182, holes: 1, sum holes: 4 */
+	/* padding: 6 */
 } port_allocations[DATAPLANE_MAX_PORTS];
 
 /* Per socket mbuf pool */
@@ -331,6 +370,9 @@ bitmask_t poll_port_mask;		/* should be polled */
 /* port should be polled and is link up */
 bitmask_t active_port_mask __hot_data;
 
+/* RX_POLL_BACKOFF_MAX_US in TSC cycles */
+static uint64_t rx_poll_backoff_cycles __hot_data;
+
 uint16_t nb_ports_total;		/* highest DPDK portid + 1 */
 
 static bool daemon_mode;		/* become daemon */
@@ -429,6 +471,8 @@ eth_tx_burst(struct ifnet *ifp, uint16_t queue_id,
 	     struct rte_mbuf **tx_pkts, uint16_t nb_pkts)
 {
 	eth_tx_run_post_qos_features(ifp, tx_pkts, nb_pkts);
+	if (unlikely(CMM_ACCESS_ONCE(pkt_latency_sample)))
+		return pkt_latency_tx_burst(ifp, queue_id, tx_pkts, nb_pkts);
 	return rte_eth_tx_burst(ifp->if_port, queue_id, tx_pkts, nb_pkts);
 }
 
@@ -479,9 +523,10 @@ bool forwarding_or_crypto_engine_lcore(const struct lcore_conf *conf)
 /* Free any packets left in the rings or bursts */
 void pkt_ring_empty(portid_t port)
 {
+	struct qos_handoff *qh;
 	struct rte_ring *ring;
 	struct rte_mbuf *m;
-	unsigned int lcore;
+	unsigned int lcore, i;
 	uint8_t r;
 
 	for (r = 0; r < port_config[port].max_rings; r++) {
@@ -491,9 +536,16 @@ void pkt_ring_empty(portid_t port)
 			rte_pktmbuf_free(m);
 	}
 
+	qh = port_config[port].qos_handoff;
+	for (i = 0; qh && i < qh->n; i++) {
+		ring = qh->ring[i];
+
+		while (ring && rte_ring_sc_dequeue(ring, (void **)&m) == 0)
+			rte_pktmbuf_free(m);
+	}
+
 	FOREACH_FORWARD_LCORE(lcore) {
 		struct lcore_conf *conf = lcore_conf[lcore];
-		unsigned int i;
 
 		for (i = 0; i < MAX_TX_QUEUE_PER_CORE; i++) {
 			struct lcore_tx_queue *txq = &conf->tx_poll[i];
@@ -543,6 +595,19 @@ void dp_pkt_burst_setup(void)
 	pkt_burst_init(lcore_id, lcore_conf[lcore_id]->tx_qid);
 }
 
+/* This thread's ring to the QoS worker for a port, if it has one */
+static ALWAYS_INLINE struct rte_ring *
+qos_handoff_ring(uint16_t port)
+{
+	struct qos_handoff *qh = rcu_dereference(port_config[port].qos_handoff);
+
+	/* Threads without a burst buffer may share an lcore id */
+	if (!qh || !RTE_PER_LCORE(pkt_burst))
+		return NULL;
+
+	return qh->ring[dp_lcore_id()];
+}
+
 static ALWAYS_INLINE uint16_t
 pkt_out_burst_cmn(struct ifnet *ifp, bool qos_enabled, uint16_t port,
 		  uint16_t queue, struct rte_mbuf **mbufs, uint16_t nb_pkts)
@@ -552,8 +617,15 @@ pkt_out_burst_cmn(struct ifnet *ifp, bool qos_enabled, uint16_t port,
 	if (__use_directpath(port, qos_enabled))
 		n = eth_tx_burst(ifp, queue, mbufs, nb_pkts);
 	else {
+		struct rte_ring *handoff;
 		uint8_t rid;
 
+		handoff = qos_enabled ? qos_handoff_ring(port) : NULL;
+		if (handoff)
+			return rte_ring_sp_enqueue_burst(handoff,
+							 (void **) mbufs,
+							 nb_pkts, NULL);
+
 		if (qos_enabled)
 			rid = 0;	/* always use ringid 0 for QoS */
 		else
@@ -622,6 +694,7 @@ static __hot_func void pkt_ring_drain(void)
 	if (pb->count > 0)
 		pkt_ring_burst(pb, true);
 	crypto_send(cpb);
+	pktmbuf_free_deferred_flush();
 }
 
 ALWAYS_INLINE __hot_func
@@ -687,12 +760,12 @@ void pkt_ring_output(struct ifnet *ifp, struct rte_mbuf *m)
 
 full_txring: __cold_label;
 	if_incr_full_txring(ifp, 1);
-	rte_pktmbuf_free(m);
+	pktmbuf_free_deferred(m);
 	return;
 
 full_hwq: __cold_label;
 	if_incr_full_hwq(ifp, 1);
-	rte_pktmbuf_free(m);
+	pktmbuf_free_deferred(m);
 }
 
 void dp_pkt_burst_flush(void)
@@ -712,9 +785,19 @@ static __hot_func void
 process_burst(portid_t portid, struct rte_mbuf *pkts[], uint16_t nb)
 {
 	struct ifnet *ifp = ifport_table[portid];
-	packet_input_t input_func = packet_input_func;
+	packet_input_t input_func = ether_if_input_func(ifp);
+	uint32_t sample = CMM_ACCESS_ONCE(pkt_latency_sample);
+	uint64_t rx_tsc = 0;
 	unsigned int i;
 
+	/* One timestamp for the whole burst when latency is sampled */
+	if (unlikely(sample))
+		rx_tsc = rte_rdtsc();
+
+	/* Dynamic features on this port only, leaving others fused */
+	if (unlikely(CMM_ACCESS_ONCE(ifp->if_dyn_feat_count)))
+		input_func = ether_input;
+
 	/* Prefetch first packets */
 	for (i = 0; i < PREFETCH_OFFSET && i < nb; i++) {
 		rte_prefetch0(pkts[i]->cacheline1);
@@ -735,12 +818,16 @@ process_burst(portid_t portid, struct rte_mbuf *pkts[], uint16_t nb)
 		rte_prefetch0(rte_pktmbuf_mtod(pkts[i + PREFETCH_OFFSET],
 					       void *));
 		pktmbuf_mdata_clear_all(pkts[i]);
+		if (unlikely(rx_tsc))
+			pkt_latency_rx(pkts[i], rx_tsc, sample);
 		input_func(ifp, pkts[i]);
 	}
 
 	/* Process remaining packets */
 	for (; i < nb; i++) {
 		pktmbuf_mdata_clear_all(pkts[i]);
+		if (unlikely(rx_tsc))
+			pkt_latency_rx(pkts[i], rx_tsc, sample);
 		input_func(ifp, pkts[i]);
 	}
 }
@@ -833,18 +920,76 @@ lcore_next_state(struct lcore_conf *conf,
 	return LCORE_STATE_POWERSAVE;
 }
 
+/*
+ * Keep polling a queue that returned a partial burst until it fills or
+ * the coalesce time runs out, so the rest of the pipeline sees fuller
+ * bursts at the cost of a bounded amount of added latency.
+ */
+static uint16_t
+rx_coalesce(portid_t portid, uint16_t queueid, struct rte_mbuf **rx_pkts,
+	    uint16_t nb, uint16_t burst, uint64_t cycles)
+{
+	uint64_t deadline = rte_rdtsc() + cycles;
+
+	while (nb < burst && rte_rdtsc() < deadline)
+		nb += rte_eth_rx_burst(portid, queueid, rx_pkts + nb,
+				       burst - nb);
+	return nb;
+}
+
+/*
+ * Double the burst size while the queue keeps filling it, and halve it
+ * when polls return mostly empty bursts. A lightly loaded queue then
+ * costs less per poll, and a busy one gets the full burst.
+ */
+static inline void
+rx_burst_adapt(struct lcore_rx_queue *rxq, uint16_t nb)
+{
+	if (nb == rxq->burst) {
+		if (rxq->burst < RX_PKT_BURST)
+			rxq->burst <<= 1;
+	} else if (nb < rxq->burst / 4 && rxq->burst > RX_PKT_BURST_MIN)
+		rxq->burst >>= 1;
+}
+
+/*
+ * Back off a queue that came up empty so that an lcore with many
+ * queues spends its time on the busy ones. There is nothing to gain
+ * when the queue is the only one on the lcore.
+ */
+static inline void
+rx_poll_backoff(struct lcore_rx_queue *rxq, uint16_t high_rxq)
+{
+	if (high_rxq <= 1)
+		return;
+
+	if (rxq->backoff < RX_POLL_BACKOFF_MAX)
+		rxq->backoff++;
+	rxq->skip = (1u << rxq->backoff) - 1;
+}
+
 /* Check for packets from network ports */
 static void __hot_func
 poll_receive_queues(struct lcore_conf *conf)
 {
 	struct crypto_pkt_buffer *cpb = RTE_PER_LCORE(crypto_pkt_buffer);
+	bool busy = conf->rx_busy;
+	uint64_t now = rte_rdtsc();
 	uint16_t high_rxq;
 	unsigned int i;
 
+	/*
+	 * Backoff only applies while other queues keep the lcore busy.
+	 * Once all are idle the lcore may nap between passes, so poll
+	 * everything to keep the worst case wakeup latency unchanged.
+	 */
+	conf->rx_busy = false;
 	high_rxq = CMM_LOAD_SHARED(conf->high_rxq);
 	for (i = 0; i < high_rxq; i++) {
 		struct lcore_rx_queue *rxq = &conf->rx_poll[i];
 		struct rte_mbuf *rx_pkts[RX_PKT_BURST];
+		unsigned int repoll = 0;
+		uint32_t coalesce;
 		portid_t portid;
 		uint16_t nb;
 
@@ -855,20 +1000,51 @@ poll_receive_queues(struct lcore_conf *conf)
 		    unlikely(!bitmask_isset(&active_port_mask, portid)))
 			continue;
 
+		if (rxq->skip && busy &&
+		    now - rxq->last_poll < rx_poll_backoff_cycles) {
+			rxq->skip--;
+			rxq->skipped++;
+			continue;
+		}
+		rxq->last_poll = now;
+
 		/* read queueid after reading portid */
 		cmm_smp_rmb();
 
-		/* Check for packets from network */
-		nb = rte_eth_rx_burst(portid, rxq->queueid,
-				      rx_pkts, RX_PKT_BURST);
+		coalesce = port_config[portid].rx_coalesce_cycles;
+		do {
+			/* Check for packets from network */
+			nb = rte_eth_rx_burst(portid, rxq->queueid,
+					      rx_pkts, rxq->burst);
+			rxq->polls++;
 
-		pm_update(&rxq->gov, nb);
+			if (unlikely(coalesce) && nb > 0 && nb < rxq->burst)
+				nb = rx_coalesce(portid, rxq->queueid, rx_pkts,
+						 nb, rxq->burst, coalesce);
 
-		if (nb > 0) {
+			pm_update(&rxq->gov, nb);
+			rx_burst_adapt(rxq, nb);
+
+			if (nb == 0) {
+				if (repoll == 0)
+					rx_poll_backoff(rxq, high_rxq);
+				break;
+			}
+
+			rxq->backoff = 0;
+			rxq->skip = 0;
+			conf->rx_busy = true;
 			rxq->packets += nb;
+			rxq->bursts++;
 			process_burst(portid, rx_pkts, nb);
 			crypto_send(cpb);
-		}
+
+			/*
+			 * A queue that fills the largest burst is likely
+			 * to have more waiting, so poll it again rather
+			 * than leave it to overflow.
+			 */
+		} while (nb == RX_PKT_BURST && ++repoll <= RX_BURST_REPOLL_MAX);
 	}
 }
 
@@ -900,6 +1076,34 @@ static void put_transmit(struct ifnet *ifp, uint16_t queue_id,
 	txq->packets += sent;
 }
 
+/*
+ * Take packets from the forwarding threads' handoff rings, starting
+ * with a different ring each time so that none is starved.
+ */
+static unsigned int qos_handoff_dequeue(struct qos_handoff *qh,
+					struct lcore_tx_queue *txq,
+					struct rte_mbuf **pkts,
+					unsigned int space)
+{
+	unsigned int i, idx, n = 0;
+
+	idx = txq->handoff_next < qh->n ? txq->handoff_next : 0;
+	txq->handoff_next = idx + 1 < qh->n ? idx + 1 : 0;
+
+	for (i = 0; i < qh->n && n < space; i++) {
+		struct rte_ring *ring = qh->ring[idx];
+
+		if (ring)
+			n += rte_ring_sc_dequeue_burst(ring,
+						       (void **) (pkts + n),
+						       space - n, NULL);
+		if (++idx == qh->n)
+			idx = 0;
+	}
+
+	return n;
+}
+
 /*
  * If QoS is enabled, then always pull full chunk of packets
  * off of transmit ring (64) and then look for smaller
@@ -916,11 +1120,18 @@ static unsigned int pkt_transmit_qos(struct ifnet *ifp,
 				 unsigned int space)
 {
 	struct rte_ring *ring = port_config[portid].pkt_ring[txq->ringid];
+	struct qos_handoff *qh = rcu_dereference(port_config[portid].qos_handoff);
 	struct rte_mbuf *q_pkts[QOS_PKT_BURST];
-	unsigned int n;
+	unsigned int n, ho;
 
 	n = rte_ring_sc_dequeue_burst(ring, (void **) q_pkts,
 				      QOS_PKT_BURST, NULL);
+	if (qh && n < QOS_PKT_BURST) {
+		ho = qos_handoff_dequeue(qh, txq, q_pkts + n,
+					 QOS_PKT_BURST - n);
+		txq->handoff_packets += ho;
+		n += ho;
+	}
 
 	pm_update(&txq->gov, n);
 
@@ -1024,6 +1235,7 @@ forwarding_loop(unsigned int lcore_id)
 	crypto_create_fwd_queue(lcore_id);
 
 	pkt_burst_init(lcore_id, conf->tx_qid);
+	pktmbuf_free_list_enable();
 
 	char name[16];
 	snprintf(name, sizeof(name), "dataplane/%u", lcore_id);
@@ -1057,6 +1269,11 @@ forwarding_loop(unsigned int lcore_id)
 
 		state = lcore_next_state(conf, pm, &us);
 
+		/* Do lcore local background work before napping */
+		if (likely(state != LCORE_STATE_EXIT))
+			dp_lcore_housekeeping_run(lcore_id,
+						  state != LCORE_STATE_POLL);
+
 		dp_rcu_read_unlock();
 
 		switch (state) {
@@ -1080,6 +1297,7 @@ forwarding_loop(unsigned int lcore_id)
 	} while (likely(state != LCORE_STATE_EXIT));
 	dp_rcu_unregister_thread();
 
+	pktmbuf_free_list_disable();
 	dp_lcore_events_teardown(lcore_id);
 	dp_pkt_burst_free();
 
@@ -1164,6 +1382,47 @@ out:
 	return ret;
 }
 
+#ifdef RTE_ETH_RX_OFFLOAD_BUFFER_SPLIT
+/*
+ * Setup an rx queue with the packet split across two pools: the
+ * first rx_split_len bytes land in a small buffer from the header
+ * pool and anything beyond that in a buffer from the port's rx pool.
+ */
+static int
+eth_rx_split_queue_setup(portid_t portid, uint16_t queueid, int8_t socketid)
+{
+	struct port_alloc *port_alloc = &port_allocations[portid];
+	union rte_eth_rxseg rx_seg[2];
+	struct rte_eth_rxconf rx_conf = port_alloc->rx_conf;
+
+	memset(rx_seg, 0, sizeof(rx_seg));
+	rx_seg[0].split.mp = port_alloc->rx_hdr_pool;
+	rx_seg[0].split.length = port_alloc->rx_split_len;
+	rx_seg[1].split.mp = port_alloc->rx_pool;
+	rx_seg[1].split.length = 0;	/* rest of the packet */
+
+	rx_conf.offloads |= RTE_ETH_RX_OFFLOAD_BUFFER_SPLIT;
+	rx_conf.rx_seg = rx_seg;
+	rx_conf.rx_nseg = ARRAY_SIZE(rx_seg);
+
+	return rte_eth_rx_queue_setup(portid, queueid, port_alloc->rx_desc,
+				      socketid, &rx_conf, NULL);
+}
+#else
+static int
+eth_rx_split_queue_setup(portid_t portid __unused,
+			 uint16_t queueid __unused,
+			 int8_t socketid __unused)
+{
+	return -ENOTSUP;
+}
+#endif
+
+bool port_uses_rx_split(portid_t portid)
+{
+	return port_allocations[portid].rx_split_len != 0;
+}
+
 int
 eth_port_configure(portid_t portid, struct rte_eth_conf *dev_conf)
 {
@@ -1192,10 +1451,15 @@ eth_port_configure(portid_t portid, struct rte_eth_conf *dev_conf)
 	}
 
 	for (queueid = 0; queueid < port_alloc->rx_queues; ++queueid) {
-		ret = rte_eth_rx_queue_setup(portid, queueid,
-					     port_alloc->rx_desc,
-					     socketid, &port_alloc->rx_conf,
-					     port_alloc->rx_pool);
+		if (port_alloc->rx_split_len)
+			ret = eth_rx_split_queue_setup(portid, queueid,
+						       socketid);
+		else
+			ret = rte_eth_rx_queue_setup(portid, queueid,
+						     port_alloc->rx_desc,
+						     socketid,
+						     &port_alloc->rx_conf,
+						     port_alloc->rx_pool);
 		if (ret < 0) {
 			RTE_LOG(ERR, DATAPLANE,
 				 "rte_eth_rx_queue_setup: err=%d, port=%u\n",
@@ -1512,7 +1776,8 @@ static void stop_one_cpu(unsigned int lcore)
 	conf->running = false;
 }
 
-static void stop_cpus(void)
+/* Stop the lcores, of those given or else of all, left with no work */
+static void stop_idle_cpus(const bitmask_t *lcores)
 {
 	unsigned int lcore;
 	bool any_stopped = false;
@@ -1520,6 +1785,9 @@ static void stop_cpus(void)
 	FOREACH_FORWARD_LCORE(lcore) {
 		const struct lcore_conf *conf = lcore_conf[lcore];
 
+		if (lcores && !bitmask_isset(lcores, lcore))
+			continue;
+
 		if (forwarding_or_crypto_engine_lcore(conf) ||
 		    !conf->running || conf->ded_to_feature)
 			continue;
@@ -1531,6 +1799,11 @@ static void stop_cpus(void)
 		register_forwarding_cores();
 }
 
+static void stop_cpus(void)
+{
+	stop_idle_cpus(NULL);
+}
+
 static void unassign_port_transmit_queues(portid_t portid,
 					  struct lcore_conf *conf)
 {
@@ -1710,13 +1983,56 @@ static bitmask_t cpu_affinity_online(const bitmask_t *cpu_affinity_mask)
 	return mask;
 }
 
+/*
+ * Apply the QoS worker set to the lcores allowed for some work: only
+ * workers may run the scheduler of a QoS port, and workers do nothing
+ * else. The allowed set is left alone if no lcore would remain.
+ */
+static bitmask_t qos_worker_filter(const bitmask_t *allowed, bool qos)
+{
+	bitmask_t mask, online = online_lcores_mask();
+	unsigned int lcore;
+
+	if (bitmask_isempty(&qos_worker_cpus))
+		return *allowed;
+
+	if (qos) {
+		bitmask_and(&mask, allowed, &qos_worker_cpus);
+		if (bitmask_isempty(&mask))
+			bitmask_and(&mask, &online, &qos_worker_cpus);
+	} else {
+		mask = *allowed;
+		FOREACH_FORWARD_LCORE(lcore)
+			if (bitmask_isset(&qos_worker_cpus, lcore))
+				bitmask_clear(&mask, lcore);
+	}
+
+	return bitmask_isempty(&mask) ? *allowed : mask;
+}
+
+static bitmask_t port_receive_lcores(portid_t portid)
+{
+	const struct port_alloc *port_alloc = &port_allocations[portid];
+	bitmask_t allowed = cpu_affinity_online(&port_alloc->rx_cpu_affinity);
+
+	return qos_worker_filter(&allowed, false);
+}
+
+static bitmask_t port_transmit_lcores(portid_t portid)
+{
+	const struct port_alloc *port_alloc = &port_allocations[portid];
+	bitmask_t allowed = cpu_affinity_online(&port_alloc->tx_cpu_affinity);
+
+	return qos_worker_filter(&allowed, port_config[portid].qos_tx);
+}
+
 /* Assign all receive queues for a port */
 static int assign_port_receive_queues(portid_t portid)
 {
 	struct port_conf *port_conf = &port_config[portid];
 	struct port_alloc *port_alloc = &port_allocations[portid];
 	unsigned int q;
-	bitmask_t allowed = cpu_affinity_online(&port_alloc->rx_cpu_affinity);
+	bitmask_t allowed = port_receive_lcores(portid);
 
 	for (q = 0; q < port_alloc->rx_queues; q++) {
 		struct lcore_conf *conf;
@@ -1752,8 +2068,7 @@ static int assign_port_receive_queues(portid_t portid)
 found:
 		bitmask_clear(&allowed, lcore);
 		if (bitmask_isempty(&allowed))
-			allowed = cpu_affinity_online(		/* start over */
-				&port_alloc->rx_cpu_affinity);
+			allowed = port_receive_lcores(portid); /* start over */
 		_CMM_STORE_SHARED(conf->num_rxq, conf->num_rxq + 1);
 
 		DP_DEBUG(INIT, DEBUG, DATAPLANE,
@@ -1767,6 +2082,13 @@ found:
 
 		memset(&rxq->gov, 0, sizeof(rxq->gov));
 		rxq->packets = 0;
+		rxq->bursts = 0;
+		rxq->burst = RX_PKT_BURST;
+		rxq->backoff = 0;
+		rxq->skip = 0;
+		rxq->last_poll = 0;
+		rxq->polls = 0;
+		rxq->skipped = 0;
 		CMM_STORE_SHARED(rxq->queueid, q);
 		/* write queueid before writing portid */
 		cmm_smp_wmb();
@@ -1783,7 +2105,7 @@ static int assign_port_transmit_queues(portid_t portid)
 {
 	struct port_conf *port_conf = &port_config[portid];
 	struct port_alloc *port_alloc = &port_allocations[portid];
-	bitmask_t allowed = cpu_affinity_online(&port_alloc->tx_cpu_affinity);
+	bitmask_t allowed = port_transmit_lcores(portid);
 	struct ifnet *ifp = ifport_table[portid];
 	uint16_t q;
 	uint8_t r;
@@ -1829,8 +2151,7 @@ static int assign_port_transmit_queues(portid_t portid)
 found:
 		bitmask_clear(&allowed, lcore);
 		if (bitmask_isempty(&allowed))
-			allowed = cpu_affinity_online(		/* start over */
-				&port_alloc->tx_cpu_affinity);
+			allowed = port_transmit_lcores(portid); /* start over */
 		_CMM_STORE_SHARED(conf->num_txq, conf->num_txq + 1);
 
 		struct lcore_tx_queue *txq = &conf->tx_poll[i];
@@ -1846,6 +2167,7 @@ found:
 		 */
 		txq->tx_no_pkts = ifp->if_team;
 		txq->packets = 0;
+		txq->handoff_packets = 0;
 		txq->ringid = r;
 		r++;
 		CMM_STORE_SHARED(txq->queueid, q);
@@ -1965,6 +2287,144 @@ exit:
 	return rc;
 }
 
+/* Are the Tx queues of the port all on lcores they are allowed on? */
+static bool transmit_thread_placed(portid_t portid)
+{
+	bitmask_t allowed = port_transmit_lcores(portid);
+	unsigned int lcore;
+
+	FOREACH_FORWARD_LCORE(lcore) {
+		const struct lcore_conf *conf = lcore_conf[lcore];
+		unsigned int i;
+
+		for (i = 0; i < conf->high_txq; i++)
+			if (conf->tx_poll[i].portid == portid &&
+			    !bitmask_isset(&allowed, lcore))
+				return false;
+	}
+
+	return true;
+}
+
+/*
+ * Move the Tx queues of a port, e.g. onto or off the QoS workers. Only
+ * a worker that wasn't yet running needs to be started, and only the
+ * lcores the queues were taken from may have been left with nothing to
+ * do.
+ */
+static int reassign_port_transmit_queues(portid_t portid)
+{
+	bitmask_t owners;
+	unsigned int lcore;
+	int ret;
+
+	bitmask_zero(&owners);
+	FOREACH_FORWARD_LCORE(lcore) {
+		struct lcore_conf *conf = lcore_conf[lcore];
+		unsigned int i;
+
+		for (i = 0; i < conf->high_txq; i++)
+			if (conf->tx_poll[i].portid == portid)
+				bitmask_set(&owners, lcore);
+		unassign_port_transmit_queues(portid, conf);
+	}
+
+	dp_rcu_synchronize();
+	pkt_ring_empty(portid);
+
+	ret = assign_port_transmit_queues(portid);
+	if (ret == 0)
+		start_cpus();
+	stop_idle_cpus(&owners);
+
+	return ret;
+}
+
+static void qos_handoff_free(struct qos_handoff *qh)
+{
+	unsigned int i;
+
+	if (!qh)
+		return;
+
+	for (i = 0; i < qh->n; i++)
+		rte_free(qh->ring[i]);
+	rte_free(qh);
+}
+
+/* Once no forwarding thread can still enqueue, drop what they left */
+static void qos_handoff_free_rcu(void *arg)
+{
+	struct qos_handoff *qh = arg;
+	struct rte_mbuf *m;
+	unsigned int i;
+
+	for (i = 0; i < qh->n; i++)
+		while (qh->ring[i] &&
+		       rte_ring_sc_dequeue(qh->ring[i], (void **)&m) == 0)
+			rte_pktmbuf_free(m);
+	qos_handoff_free(qh);
+}
+
+/*
+ * Give each thread which may forward to a QoS port its own ring to the
+ * worker. Once created they are used until the port is removed, even
+ * if worker mode is turned off.
+ */
+static int qos_handoff_create(portid_t portid)
+{
+	struct port_conf *port_conf = &port_config[portid];
+	int socketid = port_allocations[portid].socketid;
+	unsigned int n = get_lcore_max() + 1;
+	char name[RTE_RING_NAMESIZE];
+	struct qos_handoff *qh;
+	unsigned int lcore;
+	unsigned int size;
+	ssize_t sz;
+
+	if (port_conf->qos_handoff)
+		return 0;
+
+	/* Share the capacity of the Tx ring between the producers */
+	size = rte_ring_get_capacity(port_conf->pkt_ring[0]) /
+		rte_lcore_count();
+	size = rte_align32pow2(RTE_MAX(size, 2u * QOS_PKT_BURST));
+	sz = rte_ring_get_memsize(size);
+	if (sz < 0)
+		return sz;
+
+	qh = rte_zmalloc_socket("qos_handoff",
+				sizeof(*qh) + n * sizeof(qh->ring[0]),
+				RTE_CACHE_LINE_SIZE, socketid);
+	if (!qh)
+		return -ENOMEM;
+	qh->n = n;
+
+	RTE_LCORE_FOREACH(lcore) {
+		struct rte_ring *ring;
+
+		ring = rte_zmalloc_socket("qos_handoff", sz,
+					  RTE_CACHE_LINE_SIZE, socketid);
+		if (!ring)
+			goto nomem;
+
+		snprintf(name, sizeof(name), "qos-ho-%u-%u", portid, lcore);
+		if (rte_ring_init(ring, name, size,
+				  RING_F_SP_ENQ | RING_F_SC_DEQ) < 0) {
+			rte_free(ring);
+			goto nomem;
+		}
+		qh->ring[lcore] = ring;
+	}
+
+	rcu_assign_pointer(port_conf->qos_handoff, qh);
+	return 0;
+
+nomem:
+	qos_handoff_free(qh);
+	return -ENOMEM;
+}
+
 /* Called from QoS when transmit needs to be activated. */
 int enable_transmit_thread(portid_t portid)
 {
@@ -1973,8 +2433,20 @@ int enable_transmit_thread(portid_t portid)
 	if (!dpdk_eth_if_port_started(portid))
 		return -1;
 
-	if (transmit_thread_running(portid))
-		return 0;
+	port_config[portid].qos_tx = true;
+
+	if (!bitmask_isempty(&qos_worker_cpus) &&
+	    qos_handoff_create(portid) < 0)
+		RTE_LOG(ERR, DATAPLANE,
+			"no memory for QoS handoff rings on port %u\n",
+			portid);
+
+	if (transmit_thread_running(portid)) {
+		if (transmit_thread_placed(portid))
+			return 0;
+
+		return reassign_port_transmit_queues(portid);
+	}
 
 	ret = assign_port_transmit_queues(portid);
 	if (ret == 0)
@@ -1988,9 +2460,14 @@ void disable_transmit_thread(portid_t portid)
 {
 	unsigned int lcore;
 
+	port_config[portid].qos_tx = false;
+
 	/* Still need tx thread on single queue devices */
-	if (!port_config[portid].percoreq)
+	if (!port_config[portid].percoreq) {
+		if (!transmit_thread_placed(portid))
+			reassign_port_transmit_queues(portid);
 		return;
+	}
 
 	FOREACH_FORWARD_LCORE(lcore) {
 		struct lcore_conf *conf = lcore_conf[lcore];
@@ -2150,6 +2627,8 @@ struct rte_mempool *mbuf_pool_create(const char *name,
 	return mp;
 }
 
+static int mbuf_hdr_pool_init_portid(const portid_t portid);
+
 /* Initialize per socket mbuf pool. */
 static uint16_t mbuf_pool_init(void)
 {
@@ -2249,11 +2728,82 @@ retry:
 		if (!bitmask_isset(&enabled_port_mask, portid))
 			continue;
 		port_alloc->rx_pool = numa_pool[port_alloc->socketid];
+
+		if (mbuf_hdr_pool_init_portid(portid) != 0)
+			port_alloc->rx_split_len = 0;
 	}
 
 	return max_mbuf_sz;
 }
 
+/*
+ * Free the rx split header pool of a port, unless some of its mbufs
+ * are still out (queued for tx, held by a feature, ...) in which case
+ * it is left for the next use of the port to retry.
+ */
+void mbuf_hdr_pool_release_portid(const portid_t portid)
+{
+	struct port_alloc *port_alloc = &port_allocations[portid];
+	struct rte_mempool *mp = port_alloc->rx_hdr_pool;
+
+	if (!mp || !rte_mempool_full(mp))
+		return;
+
+	port_alloc->rx_hdr_pool = NULL;
+	rte_mempool_free(mp);
+}
+
+/*
+ * Initialize the small buffer pool used for the first segment of
+ * packets on ports doing rx buffer split. A pool left from a previous
+ * use of the port is only reused if it has the same buffer size.
+ */
+static int mbuf_hdr_pool_init_portid(const portid_t portid)
+{
+	struct port_alloc *port_alloc = &port_allocations[portid];
+	unsigned int buf_size = port_alloc->rx_split_len + MBUF_OVERHEAD;
+
+	if (port_alloc->rx_hdr_pool &&
+	    rte_pktmbuf_data_room_size(port_alloc->rx_hdr_pool) != buf_size)
+		mbuf_hdr_pool_release_portid(portid);
+
+	if (!port_alloc->rx_split_len)
+		return 0;
+
+	if (port_alloc->rx_hdr_pool) {
+		if (rte_pktmbuf_data_room_size(port_alloc->rx_hdr_pool) ==
+		    buf_size)
+			return 0;
+
+		RTE_LOG(ERR, DATAPLANE,
+			"mbufs from old header pool still in use, rx split disabled for port %u\n",
+			portid);
+		return -1;
+	}
+
+	/* Align to optimum size for mempool */
+	unsigned int nbufs = rte_align32pow2(port_alloc->buffers) - 1;
+	char name[RTE_MEMPOOL_NAMESIZE];
+
+	snprintf(name, RTE_MEMPOOL_NAMESIZE, "mbuf_hdr_%u", portid);
+
+	port_alloc->rx_hdr_pool =
+		mbuf_pool_create(name, nbufs, MBUF_CACHE_SIZE_DEFAULT,
+				 buf_size, port_alloc->socketid);
+	if (port_alloc->rx_hdr_pool == NULL) {
+		RTE_LOG(ERR, DATAPLANE,
+			"could not create pool %s with %u bufs, rx split disabled for port %u\n",
+			name, nbufs, portid);
+		return -1;
+	}
+
+	DP_DEBUG(INIT, INFO, DATAPLANE,
+		 "Port %u rx split at %u bytes using pool %s (%u bufs)\n",
+		 portid, port_alloc->rx_split_len, name, nbufs);
+
+	return 0;
+}
+
 /* Initialize interface specific mbuf pool. */
 int mbuf_pool_init_portid(const portid_t portid)
 {
@@ -2288,6 +2838,9 @@ int mbuf_pool_init_portid(const portid_t portid)
 		}
 	}
 
+	if (mbuf_hdr_pool_init_portid(portid) != 0)
+		port_alloc->rx_split_len = 0;
+
 	return 0;
 }
 
@@ -2625,6 +3178,22 @@ static int port_conf_final(portid_t portid, struct rte_eth_conf *dev_conf)
 		}
 	}
 
+	/*
+	 * Fast free is only valid if every mbuf sent on the port comes
+	 * from one pool and has a refcnt of 1, so it is never enabled by
+	 * default, only when asked for in the driver config.
+	 */
+	if (port_alloc->tx_conf.offloads & DEV_TX_OFFLOAD_MBUF_FAST_FREE) {
+		if (!(dev_info.tx_offload_capa &
+		      DEV_TX_OFFLOAD_MBUF_FAST_FREE)) {
+			port_alloc->tx_conf.offloads &=
+						~DEV_TX_OFFLOAD_MBUF_FAST_FREE;
+			RTE_LOG(NOTICE, DATAPLANE,
+				"Driver %s missing mbuf fast free capability\n",
+				dev_info.driver_name);
+		}
+	}
+
 	dev_conf->txmode.offloads = port_alloc->tx_conf.offloads;
 
 	DP_DEBUG(INIT, INFO, DATAPLANE,
@@ -2838,6 +3407,30 @@ static int port_conf_init(portid_t portid)
 	if (parm->rx_mq_mode_set)
 		port_alloc->rx_mq_mode = parm->rx_mq_mode;
 
+	port_config[portid].rx_coalesce_cycles =
+		(uint64_t)parm->rx_coalesce_us * rte_get_tsc_hz() / USEC_PER_SEC;
+
+	/*
+	 * Split received packets into a small header buffer and a
+	 * buffer from the rx pool for the remainder, if the driver asks
+	 * for it and the device can do it.
+	 */
+	port_alloc->rx_split_len = 0;
+	if (parm->rx_split_len) {
+#ifdef RTE_ETH_RX_OFFLOAD_BUFFER_SPLIT
+		if ((dev_info.rx_offload_capa &
+		     RTE_ETH_RX_OFFLOAD_BUFFER_SPLIT) &&
+		    (dev_info.rx_offload_capa & DEV_RX_OFFLOAD_SCATTER)) {
+			port_alloc->rx_split_len = parm->rx_split_len;
+			port_alloc->rx_conf.offloads |= DEV_RX_OFFLOAD_SCATTER;
+		}
+#endif
+		if (!port_alloc->rx_split_len)
+			RTE_LOG(NOTICE, DATAPLANE,
+				"Port %u %s does not support rx buffer split\n",
+				portid, dev_info.driver_name);
+	}
+
 	/* Potentially restrict device capabilities */
 	port_alloc->dev_flags = dev->data->dev_flags;
 	port_alloc->dev_flags |= parm->dev_flags;
@@ -2893,6 +3486,14 @@ static void eth_port_uninit(portid_t portid)
 			port_conf->pkt_ring[q] = NULL;
 		}
 	}
+	if (port_conf->qos_handoff) {
+		struct qos_handoff *qh = port_conf->qos_handoff;
+
+		/* Forwarding threads may still be handing off to it */
+		rcu_assign_pointer(port_conf->qos_handoff, NULL);
+		defer_rcu(qos_handoff_free_rcu, qh);
+	}
+	port_conf->qos_tx = false;
 
 	rc = rte_eth_dev_owner_unset(portid, owner.id);
 	if (rc < 0)
@@ -3390,6 +3991,8 @@ static void pkt_ring_destroy(void)
 		for (q = 0; q < MAX_TX_QUEUE_PER_PORT; q++)
 			if (port_conf->pkt_ring[q])
 				rte_ring_free(port_conf->pkt_ring[q]);
+		qos_handoff_free(port_conf->qos_handoff);
+		port_conf->qos_handoff = NULL;
 	}
 }
 
@@ -3542,6 +4145,9 @@ main(int argc, char **argv)
 	if (ret < 0)
 		return -1;
 
+	rx_poll_backoff_cycles =
+		rte_get_tsc_hz() * RX_POLL_BACKOFF_MAX_US / USEC_PER_SEC;
+
 	ret = rte_eal_hpet_init(1);
 	if (ret < 0)
 		RTE_LOG(INFO, DATAPLANE,
@@ -3815,6 +4421,14 @@ void show_per_core(FILE *f)
 			jsonw_uint_field(wr, "queue", rxq->queueid);
 			jsonw_uint_field(wr, "packets", rxq->packets);
 			jsonw_uint_field(wr, "rate", rxq_stats->packet_rate);
+			jsonw_uint_field(wr, "burst", rxq->burst);
+			jsonw_uint_field(wr, "avg_burst", rxq->bursts ?
+					 rxq->packets / rxq->bursts : 0);
+			jsonw_uint_field(wr, "polls", rxq->polls);
+			jsonw_uint_field(wr, "empty_polls",
+					 rxq->polls - rxq->bursts);
+			jsonw_uint_field(wr, "skipped", rxq->skipped);
+			jsonw_uint_field(wr, "backoff", rxq->backoff);
 			if (bitmask_isset(&linkup_port_mask, rxq->portid))
 				nap = rxq->gov.nap;
 			else
@@ -3858,6 +4472,9 @@ void show_per_core(FILE *f)
 			jsonw_string_field(wr, "interface", ifp->if_name);
 			jsonw_uint_field(wr, "queue", txq->queueid);
 			jsonw_uint_field(wr, "packets", txq->packets);
+			if (port_config[txq->portid].qos_handoff)
+				jsonw_uint_field(wr, "handoff",
+						 txq->handoff_packets);
 			jsonw_uint_field(wr, "rate", txq_stats->packet_rate);
 			if (bitmask_isset(&linkup_port_mask, txq->portid))
 				nap = txq->gov.nap;
@@ -3913,6 +4530,8 @@ void show_per_core(FILE *f)
 	fwding_cores = fwding_core_mask();
 	bitmask_sprint(&fwding_cores, tmp, sizeof(tmp));
 	jsonw_string_field(wr, "forwarding_cores", tmp);
+	bitmask_sprint(&qos_worker_cpus, tmp, sizeof(tmp));
+	jsonw_string_field(wr, "qos_worker_cores", tmp);
 	jsonw_destroy(&wr);
 }
 
@@ -4017,6 +4636,72 @@ void set_port_affinity(portid_t portid, const bitmask_t *rx_mask,
 	}
 }
 
+/*
+ * Dedicate lcores to the QoS scheduler. The Tx threads of QoS ports,
+ * which classify, enqueue, dequeue and transmit, are placed on them
+ * and everything else is moved off. An empty set turns this off.
+ *
+ * The workers must be online forwarding lcores and, unless there is
+ * only the one, must leave at least one for everything else. Only the
+ * ports whose queues would now go to different lcores are reassigned.
+ */
+int set_qos_worker_cores(const bitmask_t *mask)
+{
+	/* Only called by main thread */
+	static bitmask_t rx_lcores[DATAPLANE_MAX_PORTS];
+	static bitmask_t tx_lcores[DATAPLANE_MAX_PORTS];
+	bitmask_t online = online_lcores_mask();
+	bitmask_t workers, rx, tx;
+	char tmp[BITMASK_STRSZ];
+	portid_t portid;
+
+	if (mask) {
+		bitmask_and(&workers, mask, &online);
+		if (!bitmask_equal(&workers, mask))
+			return -EINVAL;
+		if (!single_cpu && bitmask_equal(&workers, &online))
+			return -EINVAL;
+	} else {
+		bitmask_zero(&workers);
+	}
+
+	for (portid = 0; portid < DATAPLANE_MAX_PORTS; ++portid) {
+		if (!dpdk_eth_if_port_started(portid))
+			continue;
+
+		rx_lcores[portid] = port_receive_lcores(portid);
+		tx_lcores[portid] = port_transmit_lcores(portid);
+	}
+
+	qos_worker_cpus = workers;
+
+	bitmask_sprint(&qos_worker_cpus, tmp, sizeof(tmp));
+	DP_DEBUG(INIT, INFO, DATAPLANE, "QoS worker cores set: %s\n", tmp);
+
+	for (portid = 0; portid < DATAPLANE_MAX_PORTS; ++portid) {
+		if (!dpdk_eth_if_port_started(portid))
+			continue;
+
+		if (port_config[portid].qos_tx &&
+		    !bitmask_isempty(&qos_worker_cpus) &&
+		    qos_handoff_create(portid) < 0)
+			RTE_LOG(ERR, DATAPLANE,
+				"no memory for QoS handoff rings on port %u\n",
+				portid);
+
+		rx = port_receive_lcores(portid);
+		tx = port_transmit_lcores(portid);
+		if (bitmask_equal(&rx, &rx_lcores[portid]) &&
+		    bitmask_equal(&tx, &tx_lcores[portid]))
+			continue;
+
+		unassign_queues(portid);
+		assign_queues(portid);
+	}
+
+	return 0;
+}
+
 void set_packet_input_func(packet_input_t input_fn)
 {
 	if (input_fn)
@@ -4036,11 +4721,11 @@ bool dp_lcore_is_active(unsigned int lcore)
 {
 	const struct lcore_conf *conf;
 
-	if (lcore >= get_lcore_max())
+	if (lcore > get_lcore_max())
 		return false;
 
 	conf = lcore_conf[lcore];
-	if (CMM_LOAD_SHARED(conf->running))
+	if (conf && CMM_LOAD_SHARED(conf->running))
 		return true;
 
 	return false;
@@ -86,6 +86,7 @@ int show_affinity(FILE *f, int argc, char **argv);
 void set_port_affinity(portid_t portid, const bitmask_t *rx_mask,
 		       const bitmask_t *tx_mask);
 uint64_t get_link_modes(struct ifnet *ifp);
+int set_qos_worker_cores(const bitmask_t *mask);
 
 int assign_queues(portid_t portid);
 void unassign_queues(portid_t portid);
@@ -95,6 +96,7 @@ void set_port_queue_state(uint16_t port);
 void reset_port_all_queue_state(uint16_t port);
 bool port_uses_queue_state(uint16_t port);
 int mbuf_pool_init_portid(const portid_t portid);
+void mbuf_hdr_pool_release_portid(const portid_t portid);
 void pkt_ring_empty(portid_t portid);
 void pkt_ring_output(struct ifnet *ifp, struct rte_mbuf *m);
 int insert_port(portid_t port_id);
@@ -105,6 +107,7 @@ void device_server_init(void);
 void device_server_destroy(void);
 int eth_port_config(portid_t portid);
 int eth_port_configure(portid_t portid, struct rte_eth_conf *dev_conf);
+bool port_uses_rx_split(portid_t portid);
 unsigned int probe_crypto_engines(bool *sticky);
 int set_crypto_engines(const uint8_t *bytes, uint8_t len, bool *sticky);
 int crypto_assign_engine(int crypto_dev_id, int lcore);
@@ -148,6 +151,8 @@ struct rxtx_param {
 	uint64_t neg_dev_flags;
 	uint64_t rx_mq_mode;
 	bool rx_mq_mode_set;
+	uint16_t rx_coalesce_us;
+	uint16_t rx_split_len;
 };
 
 #define MAX_RX_QUEUE_PER_PORT	20
@@ -161,6 +166,13 @@ struct rxtx_param {
 
 #define MAX_TX_DESC_VM_MULTIPLIER 8
 
+/* Upper bound on the time spent topping up a partial rx burst */
+#define MAX_RX_COALESCE_US 100
+
+/* Bounds on the header segment length for rx buffer split */
+#define MIN_RX_SPLIT_LEN 128
+#define MAX_RX_SPLIT_LEN 1024
+
 #define MBUF_CACHE_SIZE_DEFAULT 32 /* per-core buffer cache size */
 
 void set_port_uses_queue_state(uint16_t portid, bool val);
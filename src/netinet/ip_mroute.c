@@ -108,6 +108,7 @@
 #include "pktmbuf_internal.h"
 #include "route_flags.h"
 #include "snmp_mib.h"
+#include "telemetry.h"
 #include "urcu.h"
 #include "util.h"
 #include "vplane_debug.h"
@@ -154,6 +155,13 @@ static void sg_cnt_update(struct vrf *vrf, struct mfc *rt,
 /* track the state of fal objects for the platform dependent show commands */
 static uint32_t mroute_hw_stats[PD_OBJ_STATE_LAST];
 
+/* Telemetry record for an mroute whose counters have changed */
+struct mfc_telemetry {
+	vrfid_t vrf_id;
+	struct in_addr origin;
+	struct in_addr group;
+};
+
 uint32_t *mroute_hw_stats_get(void)
 {
 	return mroute_hw_stats;
@@ -282,6 +290,24 @@ static void vif_free(struct rcu_head *head)
 	free(vifp);
 }
 
+/*
+ * Publish an mroute the first time its counters change after they
+ * were last sent to the controller, so the stats timer only has to
+ * send what has changed.
+ */
+static inline void mfc_mark_changed(struct mcast_vrf *mvrf, struct mfc *rt)
+{
+	struct mfc_telemetry rec;
+
+	if (!dp_telemetry_mark_changed(&rt->mfc_changed))
+		return;
+
+	rec.vrf_id = caa_container_of(mvrf, struct vrf, v_mvrf4)->v_id;
+	rec.origin = rt->mfc_origin;
+	rec.group = rt->mfc_mcastgrp;
+	dp_telemetry_publish(DP_TELEMETRY_MROUTE, &rec, sizeof(rec));
+}
+
 /*
  * Find a route for a given origin IP address and multicast group address.
  * Statistics must be updated by the caller.
@@ -1157,6 +1183,7 @@ static int ip_mdq(struct mcast_vrf *mvrf, struct rte_mbuf *m, struct ip *ip,
 	if (!vifp || (vifp->v_if_index != in_ifp->if_index)) {
 		MRTSTAT_INC(mvrf, mrts_wrong_if);
 		++rt->mfc_wrong_if;
+		mfc_mark_changed(mvrf, rt);
 
 		/* Rate limit this punted packet */
 		if (ip_punt_rate_limit(rt)) {
@@ -1181,6 +1208,7 @@ static int ip_mdq(struct mcast_vrf *mvrf, struct rte_mbuf *m, struct ip *ip,
 	vifp->v_bytes_in += plen;
 	rt->mfc_pkt_cnt++;
 	rt->mfc_byte_cnt += plen;
+	mfc_mark_changed(mvrf, rt);
 
 	/* Take a reference to the data portion of the packet (beyond the
 	 * IP header). This allows this to be shared over all replications
@@ -1239,6 +1267,9 @@ static void sg_cnt_update(struct vrf *vrf, struct mfc *rt,
 	uint64_t cntrs[ARRAY_SIZE(cntr_ids)];
 	int ret;
 
+	/* changes from here on are picked up at the next interval */
+	dp_telemetry_export_begin(&rt->mfc_changed);
+
 	ret = fal_ip_mcast_get_stats(rt->mfc_fal_obj, ARRAY_SIZE(cntr_ids),
 				     &cntr_ids[0], &cntrs[0]);
 	if (ret < 0) {
@@ -1258,6 +1289,7 @@ static void sg_cnt_update(struct vrf *vrf, struct mfc *rt,
 	req.pktcnt = rt->mfc_pkt_cnt + rt->mfc_hw_pkt_cnt;
 	req.bytecnt = rt->mfc_byte_cnt + rt->mfc_hw_byte_cnt;
 	req.wrong_if = rt->mfc_wrong_if;
+	rt->mfc_sent_cnt = rt->mfc_pkt_cnt + rt->mfc_wrong_if;
 
 	/*
 	 * Indicate if the last mroute in the VRF is about to be deleted
@@ -1274,10 +1306,12 @@ static void sg_cnt_update(struct vrf *vrf, struct mfc *rt,
 }
 
 /*
- * Called by handler for periodic stats timer; iterate over all VRFs and,
- * for each mroute in the VRF, send stats block to controller.
+ * Iterate over all VRFs and, for each mroute in the VRF, send stats
+ * block to controller. Used when changes may have been missed, and for
+ * mroutes in hardware whose counters are not seen by the forwarding
+ * path.
  */
-static void sg_cnt_dump(void)
+static void sg_cnt_dump(bool hw_only)
 {
 	struct cds_lfht_iter iter;
 	struct mfc *rt;
@@ -1287,15 +1321,83 @@ static void sg_cnt_dump(void)
 	VRF_FOREACH(vrf, vrf_id) {
 		struct mcast_vrf mvrf = vrf->v_mvrf4;
 		cds_lfht_for_each_entry(mvrf.mfchashtbl, &iter, rt, node) {
+			if (hw_only && !rt->mfc_fal_obj)
+				continue;
 			sg_cnt_update(vrf, rt, false);
 		}
 	}
 }
 
+/* Telemetry export: the mroute for a changed record, if it still exists */
+static struct mfc *mfc_telemetry_find(const void *key, struct vrf **vrfp)
+{
+	struct mfc_telemetry rec;
+	struct vrf *vrf;
+
+	memcpy(&rec, key, sizeof(rec));
+	vrf = vrf_get_rcu(rec.vrf_id);
+	if (!vrf || !vrf->v_mvrf4.mfchashtbl)
+		return NULL;
+
+	*vrfp = vrf;
+	return mfc_find(&vrf->v_mvrf4, &rec.origin, &rec.group);
+}
+
+static uint32_t *mfc_telemetry_changed(const void *key)
+{
+	struct vrf *vrf;
+	struct mfc *rt = mfc_telemetry_find(key, &vrf);
+
+	return rt ? &rt->mfc_changed : NULL;
+}
+
+/* Send stats for an mroute that has changed since the last interval */
+static bool mfc_telemetry_export(const void *key, bool recheck)
+{
+	struct vrf *vrf;
+	struct mfc *rt = mfc_telemetry_find(key, &vrf);
+
+	if (!rt)
+		return false;
+	if (recheck && rt->mfc_pkt_cnt + rt->mfc_wrong_if == rt->mfc_sent_cnt)
+		return false;
+
+	sg_cnt_update(vrf, rt, false);
+	return true;
+}
+
+static void mfc_telemetry_export_all(void)
+{
+	sg_cnt_dump(false);
+}
+
+static struct dp_telemetry_export mfc_telemetry = {
+	.type = DP_TELEMETRY_MROUTE,
+	.key_len = sizeof(struct mfc_telemetry),
+	.changed = mfc_telemetry_changed,
+	.export = mfc_telemetry_export,
+	.export_all = mfc_telemetry_export_all,
+};
+
+/*
+ * Send stats for the mroutes that have changed since the last
+ * interval, and for those in hardware. Returns the number of changed
+ * mroutes sent.
+ */
+unsigned int mrt_stats_export(void)
+{
+	if (!dp_telemetry_export(&mfc_telemetry) &&
+	    (mroute_hw_stats[PD_OBJ_STATE_FULL] ||
+	     mroute_hw_stats[PD_OBJ_STATE_PARTIAL]))
+		sg_cnt_dump(true);
+
+	return mfc_telemetry.sent;
+}
+
 static void mrt_stats(__unused struct rte_timer *rtetm,
 		      __unused void *arg)
 {
-	sg_cnt_dump();
+	mrt_stats_export();
 }
 
 
@@ -1583,6 +1685,7 @@ static void mcast_init_ipv4(void)
 	rte_timer_reset(&expire_upcalls_ch, EXPIRE_TIMEOUT, PERIODICAL,
 			rte_get_master_lcore(), expire_upcalls, NULL);
 #endif
+	dp_telemetry_export_register(&mfc_telemetry);
 	rte_timer_init(&mrt_stats_timer);
 	rte_timer_reset(&mrt_stats_timer, SG_CNT_INTERVAL, PERIODICAL,
 			rte_get_master_lcore(), mrt_stats, NULL);
@@ -163,12 +163,14 @@ struct mfc {
 	vifi_t		mfc_controller;		/* all packets to controller */
 	struct if_set	mfc_ifset;		/* set of outgoing IFs   */
 	unsigned char   mfc_olist_size;         /* number of intfs in olist  */
+	uint32_t	mfc_changed;		/* telemetry changed mark    */
 	struct rte_meter_srtcm meter;		/* punt rate meter           */
 	uint64_t	mfc_pkt_cnt;		/* pkt count for src-grp     */
 	uint64_t	mfc_byte_cnt;		/* byte count for src-grp    */
 	uint64_t	mfc_hw_pkt_cnt;		/* HW pkt count for src-grp  */
 	uint64_t	mfc_hw_byte_cnt;	/* HW byte count for src-grp */
 	uint64_t	mfc_wrong_if;		/* wrong if for src-grp	     */
+	uint64_t	mfc_sent_cnt;		/* sw pkt + wrong if sent    */
 	uint64_t	mfc_ctrl_pkts;		/* packets to controller     */
 	int		mfc_expire;		/* time to clean entry up    */
 	time_t		mfc_last_assert;	/* last time I sent an assert*/
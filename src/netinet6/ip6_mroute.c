@@ -133,6 +133,7 @@
 #include "pktmbuf_internal.h"
 #include "route_flags.h"
 #include "snmp_mib.h"
+#include "telemetry.h"
 #include "urcu.h"
 #include "util.h"
 #include "vplane_debug.h"
@@ -183,6 +184,13 @@ uint32_t *mroute6_hw_stats_get(void)
 	return mroute6_hw_stats;
 }
 
+/* Telemetry record for an mroute whose counters have changed */
+struct mf6c_telemetry {
+	vrfid_t vrf_id;
+	struct in6_addr origin;
+	struct in6_addr group;
+};
+
 struct rt_show_subset {
 	json_writer_t *json;
 	enum pd_obj_state subset;
@@ -309,6 +317,24 @@ static void mif6_free(struct rcu_head *head)
 	free(mifp);
 }
 
+/*
+ * Publish an mroute the first time its counters change after they
+ * were last sent to the controller.
+ */
+static inline void mf6c_mark_changed(struct mcast6_vrf *mvrf6,
+				     struct mf6c *rt)
+{
+	struct mf6c_telemetry rec;
+
+	if (!dp_telemetry_mark_changed(&rt->mf6c_changed))
+		return;
+
+	rec.vrf_id = caa_container_of(mvrf6, struct vrf, v_mvrf6)->v_id;
+	rec.origin = rt->mf6c_origin;
+	rec.group = rt->mf6c_mcastgrp;
+	dp_telemetry_publish(DP_TELEMETRY_MROUTE6, &rec, sizeof(rec));
+}
+
 /*
  * Find a route for a given origin IPv6 address and Multicast group address.
  */
@@ -1112,6 +1138,7 @@ static int ip6_mdq(struct mcast6_vrf *mvrf6, struct rte_mbuf *m,
 		/* if wrong iif */
 		MRT6STAT_INC(mvrf6, mrt6s_wrong_if);
 		rt->mf6c_wrong_if++;
+		mf6c_mark_changed(mvrf6, rt);
 
 		/* Rate limit this punted packet */
 		if (ip6_punt_rate_limit(rt)) {
@@ -1155,6 +1182,7 @@ static int ip6_mdq(struct mcast6_vrf *mvrf6, struct rte_mbuf *m,
 	mifp->m6_bytes_in += plen;
 	rt->mf6c_pkt_cnt++;
 	rt->mf6c_byte_cnt += plen;
+	mf6c_mark_changed(mvrf6, rt);
 
 	/* Take a reference to the data portion of the packet (beyond the
 	 *  IP header). This allows this to be shared over all replications
@@ -1210,6 +1238,9 @@ static void sg6_cnt_update(struct vrf *vrf, struct mf6c *rt,
 
 	memset(&sr, 0, sizeof(sr));
 
+	/* changes from here on are picked up at the next interval */
+	dp_telemetry_export_begin(&rt->mf6c_changed);
+
 	ret = fal_ip_mcast_get_stats(rt->mf6c_fal_obj, ARRAY_SIZE(cntr_ids),
 				     &cntr_ids[0], &cntrs[0]);
 	if (ret < 0) {
@@ -1229,6 +1260,7 @@ static void sg6_cnt_update(struct vrf *vrf, struct mf6c *rt,
 	sr.pktcnt = rt->mf6c_pkt_cnt + rt->mf6c_hw_pkt_cnt;
 	sr.bytecnt = rt->mf6c_byte_cnt + rt->mf6c_hw_byte_cnt;
 	sr.wrong_if = rt->mf6c_wrong_if;
+	rt->mf6c_sent_cnt = rt->mf6c_pkt_cnt + rt->mf6c_wrong_if;
 
 	/*
 	 * Indicate if the last mroute in the VRF is about to be deleted
@@ -1245,10 +1277,11 @@ static void sg6_cnt_update(struct vrf *vrf, struct mf6c *rt,
 }
 
 /*
- * Called by handler for periodic stats timer; iterate over all VRFs and,
- * for each mroute in the VRF, send stats block to controller.
+ * Iterate over all VRFs and, for each mroute in the VRF, send stats
+ * block to controller. Used when changes may have been missed, and for
+ * mroutes in hardware.
  */
-static void sg6_cnt_dump(void)
+static void sg6_cnt_dump(bool hw_only)
 {
 	struct cds_lfht_iter iter;
 	struct mf6c *rt;
@@ -1258,15 +1291,84 @@ static void sg6_cnt_dump(void)
 	VRF_FOREACH(vrf, vrf_id) {
 		struct mcast6_vrf mvrf6 = vrf->v_mvrf6;
 		cds_lfht_for_each_entry(mvrf6.mf6ctable, &iter, rt, node) {
+			if (hw_only && !rt->mf6c_fal_obj)
+				continue;
 			sg6_cnt_update(vrf, rt, false);
 		}
 	}
 }
 
+/* Telemetry export: the mroute for a changed record, if it still exists */
+static struct mf6c *mf6c_telemetry_find(const void *key, struct vrf **vrfp)
+{
+	struct mf6c_telemetry rec;
+	struct vrf *vrf;
+
+	memcpy(&rec, key, sizeof(rec));
+	vrf = vrf_get_rcu(rec.vrf_id);
+	if (!vrf || !vrf->v_mvrf6.mf6ctable)
+		return NULL;
+
+	*vrfp = vrf;
+	return mf6c_find(&vrf->v_mvrf6, &rec.origin, &rec.group);
+}
+
+static uint32_t *mf6c_telemetry_changed(const void *key)
+{
+	struct vrf *vrf;
+	struct mf6c *rt = mf6c_telemetry_find(key, &vrf);
+
+	return rt ? &rt->mf6c_changed : NULL;
+}
+
+/* Send stats for an mroute that has changed since the last interval */
+static bool mf6c_telemetry_export(const void *key, bool recheck)
+{
+	struct vrf *vrf;
+	struct mf6c *rt = mf6c_telemetry_find(key, &vrf);
+
+	if (!rt)
+		return false;
+	if (recheck &&
+	    rt->mf6c_pkt_cnt + rt->mf6c_wrong_if == rt->mf6c_sent_cnt)
+		return false;
+
+	sg6_cnt_update(vrf, rt, false);
+	return true;
+}
+
+static void mf6c_telemetry_export_all(void)
+{
+	sg6_cnt_dump(false);
+}
+
+static struct dp_telemetry_export mf6c_telemetry = {
+	.type = DP_TELEMETRY_MROUTE6,
+	.key_len = sizeof(struct mf6c_telemetry),
+	.changed = mf6c_telemetry_changed,
+	.export = mf6c_telemetry_export,
+	.export_all = mf6c_telemetry_export_all,
+};
+
+/*
+ * Send stats for the mroutes that have changed since the last
+ * interval, and for those in hardware. Returns the number of changed
+ * mroutes sent.
+ */
+unsigned int mrt6_stats_export(void)
+{
+	if (!dp_telemetry_export(&mf6c_telemetry) &&
+	    (mroute6_hw_stats[PD_OBJ_STATE_FULL] ||
+	     mroute6_hw_stats[PD_OBJ_STATE_PARTIAL]))
+		sg6_cnt_dump(true);
+
+	return mf6c_telemetry.sent;
+}
+
 static void mrt6_stats(__unused struct rte_timer *rtetm,
 		      __unused void *arg)
 {
-	sg6_cnt_dump();
+	mrt6_stats_export();
 }
 
 
@@ -1583,6 +1685,7 @@ static void mcast_init_ipv6(void)
 	rte_timer_reset(&expire_upcalls_ch, EXPIRE_TIMEOUT, PERIODICAL,
 			rte_get_master_lcore(), expire_upcalls, NULL);
 #endif
+	dp_telemetry_export_register(&mf6c_telemetry);
 	rte_timer_init(&mrt6_stats_timer);
 	rte_timer_reset(&mrt6_stats_timer, SG_CNT_INTERVAL, PERIODICAL,
 			rte_get_master_lcore(), mrt6_stats, NULL);
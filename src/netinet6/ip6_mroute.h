@@ -143,6 +143,7 @@ struct mf6c {
 	mifi_t			mf6c_parent;	 /* incoming IF              */
 	struct if_set		mf6c_ifset;	 /* set of outgoing IFs      */
 	unsigned char           mf6c_olist_size; /* number of intfs in olist  */
+	uint32_t		mf6c_changed;	 /* telemetry changed mark   */
 	struct rte_meter_srtcm  meter;		 /* punt rate meter          */
 	int			mf6c_controller; /* forward via controller   */
 	uint64_t		mf6c_pkt_cnt;	 /* pkt count for src-grp    */
@@ -150,6 +151,7 @@ struct mf6c {
 	uint64_t		mf6c_hw_pkt_cnt; /* HW pkt count for src-grp */
 	uint64_t		mf6c_hw_byte_cnt;/* HW byte count for src-grp */
 	uint64_t		mf6c_wrong_if;	 /* wrong if for src-grp     */
+	uint64_t		mf6c_sent_cnt;	 /* sw pkt + wrong if sent   */
 	int			mf6c_expire;	 /* time to clean entry up   */
 	time_t			mf6c_last_assert;/* last assert		     */
 	uint64_t		mf6c_punted;	 /* number packets punted    */
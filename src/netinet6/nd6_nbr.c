@@ -69,6 +69,7 @@
 #include "ether.h"
 #include "fal.h"
 #include "fal_plugin.h"
+#include "if/dpdk-eth/vhost.h"
 #include "if/macvlan.h"
 #include "if_ether.h"
 #include "if_llatbl.h"
@@ -1199,6 +1200,12 @@ resolved:
 	 * Incomplete ND cache entry. Queue packet on entry
 	 * Discard oldest if queue limit is exceeded
 	 */
+	m = vhost_zero_copy_unpin(m);
+	if (unlikely(!m)) {
+		ND6NBR_INC(dropped);
+		rte_spinlock_unlock(&la->ll_lock);
+		return -ENOMEM;
+	}
 	if (in_ifp)
 		pktmbuf_save_ifp(m, in_ifp);
 	if (la->la_numheld >= nd6_cfg.nd6_maxhold) {
@@ -73,7 +73,7 @@ ipv6_drop_process_common(struct pl_packet *pkt, void *context __unused,
 	if (pkt->in_ifp)
 		IP6STAT_INC_IFP(pkt->in_ifp, IPSTATS_MIB_INDISCARDS);
 
-	rte_pktmbuf_free(pkt->mbuf);
+	pktmbuf_free_deferred(pkt->mbuf);
 	pkt->mbuf = NULL;
 
 	return IPV6_DROP_ACCEPT;
@@ -96,35 +96,13 @@ no_vlan: __cold_label;
  * We support maximum three layers of interface nesting:
  *    dp0portx [vlan ] [macvlan]
  */
-ALWAYS_INLINE unsigned int
-ether_lookup_process_common(struct pl_packet *pkt, void *context __unused,
-			    enum pl_mode mode)
+static ALWAYS_INLINE unsigned int
+ether_lookup_resolve(struct pl_packet *pkt, struct ifnet *ifp)
 {
 	struct rte_mbuf *m = pkt->mbuf;
-	struct ifnet *ifp = pkt->in_ifp;
 	const struct rte_ether_hdr *eth;
 	struct if_data *ifstat;
 
-	switch (mode) {
-	case PL_MODE_FUSED:
-		if (!pipeline_fused_ether_lookup_features(
-			    pkt, ifp_to_ether_lookup_node(ifp)))
-			return ETHER_LOOKUP_FINISH;
-		break;
-	case PL_MODE_FUSED_NO_DYN_FEATS:
-		if (!pipeline_fused_ether_lookup_no_dyn_features(
-			    pkt, ifp_to_ether_lookup_node(ifp)))
-			return ETHER_LOOKUP_FINISH;
-		break;
-	case PL_MODE_REGULAR:
-		if (!pl_node_invoke_enabled_features(
-			    ether_lookup_node_ptr,
-			    ifp_to_ether_lookup_node(ifp),
-			    pkt))
-			return ETHER_LOOKUP_FINISH;
-		break;
-	}
-
 	eth = ethhdr(m);
 	if (unlikely(rte_is_multicast_ether_addr(&eth->d_addr))) {
 		ifstat = &ifp->if_data[dp_lcore_id()];
@@ -190,6 +168,53 @@ no_address: __cold_label;
 	return ETHER_LOOKUP_FINISH;
 }
 
+ALWAYS_INLINE unsigned int
+ether_lookup_process_common(struct pl_packet *pkt, void *context __unused,
+			    enum pl_mode mode)
+{
+	struct ifnet *ifp = pkt->in_ifp;
+
+	switch (mode) {
+	case PL_MODE_FUSED:
+		if (!pipeline_fused_ether_lookup_features(
+			    pkt, ifp_to_ether_lookup_node(ifp)))
+			return ETHER_LOOKUP_FINISH;
+		break;
+	case PL_MODE_FUSED_NO_DYN_FEATS:
+		if (!pipeline_fused_ether_lookup_no_dyn_features(
+			    pkt, ifp_to_ether_lookup_node(ifp)))
+			return ETHER_LOOKUP_FINISH;
+		break;
+	case PL_MODE_REGULAR:
+		if (!pl_node_invoke_enabled_features(
+			    ether_lookup_node_ptr,
+			    ifp_to_ether_lookup_node(ifp),
+			    pkt))
+			return ETHER_LOOKUP_FINISH;
+		break;
+	}
+
+	return ether_lookup_resolve(pkt, ifp);
+}
+
+/*
+ * Fused mode without dynamic features, in the graph specialised for
+ * the class of the receiving interface.
+ */
+ALWAYS_INLINE unsigned int
+ether_lookup_process_class_common(struct pl_packet *pkt,
+				  void *context __unused,
+				  enum pl_if_class if_class)
+{
+	struct ifnet *ifp = pkt->in_ifp;
+
+	if (!pipeline_fused_ether_lookup_class_features(
+		    pkt, ifp_to_ether_lookup_node(ifp), if_class))
+		return ETHER_LOOKUP_FINISH;
+
+	return ether_lookup_resolve(pkt, ifp);
+}
+
 ALWAYS_INLINE unsigned int
 ether_lookup_process(struct pl_packet *p, void *context)
 {
@@ -249,6 +274,7 @@ PL_REGISTER_NODE(ether_lookup_node) = {
 	.feat_change_all = ether_lookup_feat_change_all,
 	.feat_iterate = ether_lookup_feat_iterate,
 	.lookup_by_name = ether_lookup_node_lookup,
+	.node_to_input_ifp = ether_lookup_node_to_ifp,
 	.feat_reg_context = if_node_instance_register_storage,
 	.feat_unreg_context = if_node_instance_unregister_storage,
 	.feat_get_context = if_node_instance_get_storage,
@@ -0,0 +1,73 @@
+/*
+ * l3_gpc.c
+ *
+ * Copyright (c) 2021, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+#include <stdbool.h>
+
+#include "compiler.h"
+#include "gpc/gpc_sw.h"
+#include "pl_common.h"
+#include "pl_fused.h"
+
+/*
+ * Ingress GPC tables which the FAL has not taken, enabled on an
+ * interface by the GPC software path when it has tables to apply.
+ */
+ALWAYS_INLINE unsigned int
+ipv4_gpc_process_in(struct pl_packet *pkt, void *context __unused)
+{
+	if (!gpc_sw_input(pkt->in_ifp, pkt->mbuf, false))
+		return IPV4_GPC_IN_DROP;
+
+	return IPV4_GPC_IN_ACCEPT;
+}
+
+ALWAYS_INLINE unsigned int
+ipv6_gpc_process_in(struct pl_packet *pkt, void *context __unused)
+{
+	if (!gpc_sw_input(pkt->in_ifp, pkt->mbuf, true))
+		return IPV6_GPC_IN_DROP;
+
+	return IPV6_GPC_IN_ACCEPT;
+}
+
+/* Register Node */
+PL_REGISTER_NODE(ipv4_gpc_in_node) = {
+	.name = "vyatta:ipv4-gpc-in",
+	.type = PL_PROC,
+	.handler = ipv4_gpc_process_in,
+	.num_next = IPV4_GPC_IN_NUM,
+	.next = {
+		[IPV4_GPC_IN_ACCEPT] = "term-noop",
+		[IPV4_GPC_IN_DROP]   = "term-drop",
+	}
+};
+
+PL_REGISTER_NODE(ipv6_gpc_in_node) = {
+	.name = "vyatta:ipv6-gpc-in",
+	.type = PL_PROC,
+	.handler = ipv6_gpc_process_in,
+	.num_next = IPV6_GPC_IN_NUM,
+	.next = {
+		[IPV6_GPC_IN_ACCEPT] = "term-noop",
+		[IPV6_GPC_IN_DROP]   = "ipv6-drop",
+	}
+};
+
+/* Register Features */
+PL_REGISTER_FEATURE(ipv4_gpc_in_feat) = {
+	.name = "vyatta:ipv4-gpc-in",
+	.node_name = "ipv4-gpc-in",
+	.feature_point = "ipv4-validate",
+	.id = PL_L3_V4_IN_FUSED_FEAT_GPC,
+};
+
+PL_REGISTER_FEATURE(ipv6_gpc_in_feat) = {
+	.name = "vyatta:ipv6-gpc-in",
+	.node_name = "ipv6-gpc-in",
+	.feature_point = "ipv6-validate",
+	.id = PL_L3_V6_IN_FUSED_FEAT_GPC,
+};
@@ -0,0 +1,77 @@
+/*
+ * l3_ingress_police.c
+ *
+ * Copyright (c) 2021, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+#include <stdbool.h>
+
+#include "compiler.h"
+#include "pktmbuf_internal.h"
+#include "pl_common.h"
+#include "pl_fused.h"
+#include "qos_ingress_police.h"
+
+/*
+ * Subscriber policing, first on the interface so that out of profile
+ * traffic doesn't cost a firewall or NAT lookup. A yellow packet may be
+ * remarked, in which case the mbuf may have been replaced.
+ */
+ALWAYS_INLINE unsigned int
+ipv4_ingress_police_process(struct pl_packet *pkt, void *context __unused)
+{
+	if (!qos_ingress_police_input(pkt->in_ifp, &pkt->mbuf, false))
+		return IPV4_INGRESS_POLICE_DROP;
+
+	pkt->l3_hdr = dp_pktmbuf_mtol3(pkt->mbuf, void *);
+	return IPV4_INGRESS_POLICE_ACCEPT;
+}
+
+ALWAYS_INLINE unsigned int
+ipv6_ingress_police_process(struct pl_packet *pkt, void *context __unused)
+{
+	if (!qos_ingress_police_input(pkt->in_ifp, &pkt->mbuf, true))
+		return IPV6_INGRESS_POLICE_DROP;
+
+	pkt->l3_hdr = dp_pktmbuf_mtol3(pkt->mbuf, void *);
+	return IPV6_INGRESS_POLICE_ACCEPT;
+}
+
+/* Register Node */
+PL_REGISTER_NODE(ipv4_ingress_police_node) = {
+	.name = "vyatta:ipv4-ingress-police",
+	.type = PL_PROC,
+	.handler = ipv4_ingress_police_process,
+	.num_next = IPV4_INGRESS_POLICE_NUM,
+	.next = {
+		[IPV4_INGRESS_POLICE_ACCEPT] = "term-noop",
+		[IPV4_INGRESS_POLICE_DROP]   = "term-drop",
+	}
+};
+
+PL_REGISTER_NODE(ipv6_ingress_police_node) = {
+	.name = "vyatta:ipv6-ingress-police",
+	.type = PL_PROC,
+	.handler = ipv6_ingress_police_process,
+	.num_next = IPV6_INGRESS_POLICE_NUM,
+	.next = {
+		[IPV6_INGRESS_POLICE_ACCEPT] = "term-noop",
+		[IPV6_INGRESS_POLICE_DROP]   = "ipv6-drop",
+	}
+};
+
+/* Register Features */
+PL_REGISTER_FEATURE(ipv4_ingress_police_feat) = {
+	.name = "vyatta:ipv4-ingress-police",
+	.node_name = "ipv4-ingress-police",
+	.feature_point = "ipv4-validate",
+	.id = PL_L3_V4_IN_FUSED_FEAT_INGRESS_POLICE,
+};
+
+PL_REGISTER_FEATURE(ipv6_ingress_police_feat) = {
+	.name = "vyatta:ipv6-ingress-police",
+	.node_name = "ipv6-ingress-police",
+	.feature_point = "ipv6-validate",
+	.id = PL_L3_V6_IN_FUSED_FEAT_INGRESS_POLICE,
+};
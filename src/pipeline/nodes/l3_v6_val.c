@@ -146,6 +146,7 @@ PL_REGISTER_NODE(ipv6_validate_node) = {
 	.feat_change_all = ipv6_validate_feat_change_all,
 	.feat_iterate = ipv6_validate_feat_iterate,
 	.lookup_by_name = ipv6_validate_node_lookup,
+	.node_to_input_ifp = ipv6_val_node_to_ifp,
 	.feat_reg_context = if_node_instance_register_storage,
 	.feat_unreg_context = if_node_instance_unregister_storage,
 	.feat_get_context = if_node_instance_get_storage,
@@ -72,6 +72,12 @@ PL_DECLARE_FEATURE(ipv6_acl_out_feat);
 PL_DECLARE_FEATURE(ipv4_acl_out_spath_feat);
 PL_DECLARE_FEATURE(ipv6_acl_out_spath_feat);
 
+PL_DECLARE_FEATURE(ipv4_gpc_in_feat);
+PL_DECLARE_FEATURE(ipv6_gpc_in_feat);
+
+PL_DECLARE_FEATURE(ipv4_ingress_police_feat);
+PL_DECLARE_FEATURE(ipv6_ingress_police_feat);
+
 PL_DECLARE_FEATURE(ipv4_fw_in_feat);
 PL_DECLARE_FEATURE(ipv4_fw_out_feat);
 PL_DECLARE_FEATURE(ipv6_fw_in_feat);
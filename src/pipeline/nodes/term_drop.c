@@ -69,7 +69,7 @@ term_drop_process_common(struct pl_packet *pkt, void *context __unused,
 		break;
 	}
 
-	rte_pktmbuf_free(pkt->mbuf);
+	pktmbuf_free_deferred(pkt->mbuf);
 	pkt->mbuf = NULL;
 
 	return TERM_DROP_ACCEPT;
@@ -166,6 +166,50 @@ PL_REGISTER_OPCMD(pipeline_show_nodes) = {
 	.handler = cmd_pipeline_show_nodes,
 };
 
+static int
+cmd_pipeline_show_profile(struct pl_command *cmd)
+{
+	json_writer_t *json = jsonw_new(cmd->fp);
+	if (!json)
+		return 0;
+
+	jsonw_name(json, "pl-profile");
+	jsonw_start_object(json);
+
+	pl_dump_profile(json);
+
+	jsonw_end_object(json);
+	jsonw_destroy(&json);
+	return 0;
+}
+
+PL_REGISTER_OPCMD(pipeline_show_profile) = {
+	.cmd = "framework dump profile",
+	.handler = cmd_pipeline_show_profile,
+};
+
+static int
+cmd_pipeline_show_dyn_feats(struct pl_command *cmd)
+{
+	json_writer_t *json = jsonw_new(cmd->fp);
+	if (!json)
+		return 0;
+
+	jsonw_name(json, "pl-dyn-feat");
+	jsonw_start_object(json);
+
+	pl_dump_dyn_feats(json);
+
+	jsonw_end_object(json);
+	jsonw_destroy(&json);
+	return 0;
+}
+
+PL_REGISTER_OPCMD(pipeline_show_dyn_feats) = {
+	.cmd = "framework dump dyn-feat",
+	.handler = cmd_pipeline_show_dyn_feats,
+};
+
 /* pipeline statistics config commands
  */
 static int cmd_pipeline_stats_cfg(struct pb_msg *msg)
@@ -181,7 +225,15 @@ static int cmd_pipeline_stats_cfg(struct pb_msg *msg)
 			"failed to read pipeline stats protobuf command\n");
 		return -1;
 	}
-	g_stats_enabled = smsg->enable_stats;
+	if (smsg->has_enable_stats)
+		g_stats_enabled = smsg->enable_stats;
+	if (smsg->has_enable_profile &&
+	    pl_node_profile_enable(smsg->enable_profile) < 0) {
+		RTE_LOG(ERR, DATAPLANE,
+			"out of memory enabling pipeline profile\n");
+		pipeline_stats_config__free_unpacked(smsg, NULL);
+		return -1;
+	}
 
 	pipeline_stats_config__free_unpacked(smsg, NULL);
 
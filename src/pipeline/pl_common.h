@@ -126,6 +126,9 @@ typedef void *
 typedef int
 (pl_node_setup_cleanup_cb) (struct pl_feature_registration *feat);
 
+typedef struct ifnet *
+(pl_node_to_input_ifp_fn) (struct pl_node *node);
+
 typedef void *
 (pl_node_get_context) (struct pl_node *node,
 		       struct pl_feature_registration *feat);
@@ -145,6 +148,11 @@ struct pl_node_registration {
 	pl_node_unregister_context *feat_unreg_context;
 	pl_node_get_context *feat_get_context;
 	pl_node_setup_cleanup_cb *feat_setup_cleanup_cb;
+	/*
+	 * For ingress feature points, return the interface whose
+	 * received packets the node instance sees.
+	 */
+	pl_node_to_input_ifp_fn *node_to_input_ifp;
 	enum pl_node_type  type;
 	uint16_t           num_next;
 
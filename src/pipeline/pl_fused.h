@@ -32,8 +32,10 @@ enum pl_ether_lookup_fused_feat {
 };
 
 enum pl_l3_v4_in_fused_feat {
-	PL_L3_V4_IN_FUSED_FEAT_RPF = 1,
+	PL_L3_V4_IN_FUSED_FEAT_INGRESS_POLICE = 1,
+	PL_L3_V4_IN_FUSED_FEAT_RPF,
 	PL_L3_V4_IN_FUSED_FEAT_ACL,
+	PL_L3_V4_IN_FUSED_FEAT_GPC,
 	PL_L3_V4_IN_FUSED_FEAT_TCP_MSS,
 	PL_L3_V4_IN_FUSED_FEAT_DEFRAG,
 	PL_L3_V4_IN_FUSED_FEAT_FW,
@@ -50,7 +52,9 @@ enum pl_l3_v4_in_fused_feat {
 };
 
 enum pl_l3_v6_in_fused_feat {
-	PL_L3_V6_IN_FUSED_FEAT_ACL = 1,
+	PL_L3_V6_IN_FUSED_FEAT_INGRESS_POLICE = 1,
+	PL_L3_V6_IN_FUSED_FEAT_ACL,
+	PL_L3_V6_IN_FUSED_FEAT_GPC,
 	PL_L3_V6_IN_FUSED_FEAT_TCP_MSS,
 	PL_L3_V6_IN_FUSED_FEAT_DEFRAG,
 	PL_L3_V6_IN_FUSED_FEAT_FW,
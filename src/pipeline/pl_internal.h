@@ -11,12 +11,33 @@
 #ifndef PL_INTERNAL_H
 #define PL_INTERNAL_H
 
+#include <rte_common.h>
+#include <rte_cycles.h>
+#include <stdint.h>
+
 #include "compiler.h"
 #include "json_writer.h"
+#include "urcu.h"
 #include "util.h"
 
+/*
+ * Cycles spent in a node by one lcore. Histogram bucket i counts calls
+ * taking fewer than 2^(i + PL_PROFILE_HIST_SHIFT + 1) cycles, with the
+ * last bucket counting everything longer.
+ */
+#define PL_PROFILE_HIST_BUCKETS 16
+#define PL_PROFILE_HIST_SHIFT 4
+
+struct pl_node_profile {
+	uint64_t calls;
+	uint64_t cycles;
+	uint64_t hist[PL_PROFILE_HIST_BUCKETS];
+} __rte_cache_aligned;
+
 extern int g_stats_enabled __hot_data;
 extern uint64_t *g_pl_node_stats;
+extern int g_profile_enabled __hot_data;
+extern struct pl_node_profile *g_pl_node_profile;
 
 static ALWAYS_INLINE int
 pl_node_stats_id(int node_id, unsigned int lcore_id)
@@ -32,9 +53,53 @@ pl_inc_node_stat(int node_id)
 		     pl_node_stats_id(node_id, dp_lcore_id())));
 }
 
+/*
+ * Cycle accounting around a node handler. The timestamp is only read
+ * when profiling is enabled, so the cost when disabled is a single
+ * predicted branch. Time in features invoked by the node is included.
+ * The counts only exist while profiling is enabled, so a call that
+ * straddles it being disabled is not counted.
+ */
+static ALWAYS_INLINE uint64_t
+pl_node_profile_start(void)
+{
+	if (unlikely(g_profile_enabled))
+		return rte_rdtsc();
+	return 0;
+}
+
+static ALWAYS_INLINE void
+pl_node_profile_end(int node_id, uint64_t start)
+{
+	struct pl_node_profile *prof;
+	uint64_t cycles;
+	int bucket;
+
+	if (likely(!start))
+		return;
+
+	prof = rcu_dereference(g_pl_node_profile);
+	if (unlikely(!prof))
+		return;
+
+	cycles = rte_rdtsc() - start;
+	prof += pl_node_stats_id(node_id, dp_lcore_id());
+	prof->calls++;
+	prof->cycles += cycles;
+
+	bucket = 63 - __builtin_clzll(cycles | 1) - PL_PROFILE_HIST_SHIFT;
+	bucket = RTE_MAX(bucket, 0);
+	bucket = RTE_MIN(bucket, PL_PROFILE_HIST_BUCKETS - 1);
+	prof->hist[bucket]++;
+}
+
 void pl_graph_validate(void);
 
 uint64_t pl_get_node_stats(int id);
 
+int pl_node_profile_enable(bool enable);
+void pl_dump_profile(json_writer_t *json);
+void pl_dump_dyn_feats(json_writer_t *json);
+
 void pl_show_plugin_state(json_writer_t *json, const char *plugin_name);
 #endif /* PL_INTERNAL_H */
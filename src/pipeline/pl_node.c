@@ -18,6 +18,7 @@
 
 #include "compiler.h"
 #include "ether.h"
+#include "if_var.h"
 #include "pl_common.h"
 #include "pl_internal.h"
 #include "pl_node.h"
@@ -34,6 +35,9 @@ static int g_pl_storage_ct;
 static uint32_t dyn_feat_inst_count;
 /* enable packet counter per node */
 int g_stats_enabled __hot_data;
+/* enable cycle accounting per node */
+int g_profile_enabled __hot_data;
+struct pl_node_profile *g_pl_node_profile;
 /* packet counter per node */
 uint64_t *g_pl_node_stats __hot_data;
 
@@ -59,6 +63,122 @@ pl_register_storage(struct pl_node_storage *storage)
 	}
 }
 
+/*
+ * A dynamic feature at an ingress feature point of an interface only
+ * sees packets received on the port underneath it, so packets from
+ * other ports can keep using the pipeline without dynamic features.
+ * Returns that port's interface, or NULL if the instance may see
+ * packets from any port and the dynamic pipeline is needed for all.
+ */
+static struct ifnet *
+pl_node_dyn_feat_port(struct pl_feature_registration *feat, void *node)
+{
+	struct ifnet *ifp;
+
+	if (!feat->feature_point_node->node_to_input_ifp)
+		return NULL;
+
+	ifp = feat->feature_point_node->node_to_input_ifp(node);
+	while (ifp && ifp->if_parent)
+		ifp = ifp->if_parent;
+
+	if (!ifp || !ifp->if_local_port || is_team(ifp))
+		return NULL;
+
+	return ifp;
+}
+
+/*
+ * The instance's interface records whose count was taken, as by the
+ * time the feature is removed the interface may no longer be on that
+ * port, e.g. after an unplug, and the global count must not be
+ * released in its place. The port is recorded by ifindex, so that if
+ * it has been deleted in the meantime there is simply nothing left to
+ * release.
+ */
+static void
+pl_node_dyn_feat_inst_add(struct pl_feature_registration *feat, void *node)
+{
+	struct ifnet *ifp = pl_node_dyn_feat_port(feat, node);
+	struct ifnet *inst_ifp;
+
+	if (ifp) {
+		inst_ifp = feat->feature_point_node->node_to_input_ifp(node);
+		if (!inst_ifp->if_dyn_feat_port_refs ||
+		    inst_ifp->if_dyn_feat_port == ifp->if_index) {
+			inst_ifp->if_dyn_feat_port = ifp->if_index;
+			inst_ifp->if_dyn_feat_port_refs++;
+			uatomic_inc(&ifp->if_dyn_feat_count);
+			return;
+		}
+	}
+
+	if (uatomic_add_return(&dyn_feat_inst_count, 1) == 1)
+		set_packet_input_func(ether_input);
+}
+
+static void
+pl_node_dyn_feat_inst_remove(struct pl_feature_registration *feat,
+			     void *node)
+{
+	struct ifnet *inst_ifp = NULL;
+	struct ifnet *ifp;
+
+	if (feat->feature_point_node->node_to_input_ifp)
+		inst_ifp = feat->feature_point_node->node_to_input_ifp(node);
+
+	if (inst_ifp && inst_ifp->if_dyn_feat_port_refs) {
+		ifp = dp_ifnet_byifindex(inst_ifp->if_dyn_feat_port);
+		if (ifp)
+			uatomic_dec(&ifp->if_dyn_feat_count);
+		if (--inst_ifp->if_dyn_feat_port_refs == 0)
+			inst_ifp->if_dyn_feat_port = 0;
+		return;
+	}
+
+	if (uatomic_add_return(&dyn_feat_inst_count, -1) == 0)
+		set_packet_input_func(NULL);
+}
+
+static void
+pl_dump_dyn_feat_if(struct ifnet *ifp, void *arg)
+{
+	json_writer_t *json = arg;
+	struct ifnet *port;
+
+	if (!CMM_ACCESS_ONCE(ifp->if_dyn_feat_count) &&
+	    !ifp->if_dyn_feat_port_refs)
+		return;
+
+	jsonw_start_object(json);
+	jsonw_string_field(json, "name", ifp->if_name);
+	jsonw_uint_field(json, "count",
+			 CMM_ACCESS_ONCE(ifp->if_dyn_feat_count));
+	if (ifp->if_dyn_feat_port_refs) {
+		port = dp_ifnet_byifindex(ifp->if_dyn_feat_port);
+		if (port)
+			jsonw_string_field(json, "port", port->if_name);
+		jsonw_uint_field(json, "port-refs",
+				 ifp->if_dyn_feat_port_refs);
+	}
+	jsonw_end_object(json);
+}
+
+/*
+ * The dynamic feature instances counted globally, and for each
+ * interface those counted on it as a port and the port its own
+ * instances are counted on.
+ */
+void
+pl_dump_dyn_feats(json_writer_t *json)
+{
+	jsonw_uint_field(json, "count", CMM_ACCESS_ONCE(dyn_feat_inst_count));
+	jsonw_name(json, "interfaces");
+	jsonw_start_array(json);
+	dp_ifnet_walk(pl_dump_dyn_feat_if, json);
+	jsonw_end_array(json);
+}
+
 int
 pl_node_add_feature_by_inst(struct pl_feature_registration *feat, void *node)
 {
@@ -70,10 +190,8 @@ pl_node_add_feature_by_inst(struct pl_feature_registration *feat, void *node)
 	ret = feat->feature_point_node->feat_change(
 		node, feat, PL_NODE_FEAT_ADD);
 
-	if (ret == 0 && feat->dynamic) {
-		if (uatomic_add_return(&dyn_feat_inst_count, 1) == 1)
-			set_packet_input_func(ether_input);
-	}
+	if (ret == 0 && feat->dynamic)
+		pl_node_dyn_feat_inst_add(feat, node);
 
 	return ret;
 }
@@ -107,10 +225,8 @@ pl_node_remove_feature_by_inst(struct pl_feature_registration *feat, void *node)
 	ret = feat->feature_point_node->feat_change(
 		node, feat, PL_NODE_FEAT_REM);
 
-	if (ret == 0 && feat->dynamic) {
-		if (uatomic_add_return(&dyn_feat_inst_count, -1) == 0)
-			set_packet_input_func(NULL);
-	}
+	if (ret == 0 && feat->dynamic)
+		pl_node_dyn_feat_inst_remove(feat, node);
 
 	return ret;
 }
@@ -305,11 +421,14 @@ pl_graph_walk(struct pl_node_registration *node_reg,
 	      struct pl_packet *pkt,
 	      void *storage_ctx)
 {
+	uint64_t start;
 	int resp;
 
 	while (true) {
 		pl_inc_node_stat(node_reg->node_decl_id);
+		start = pl_node_profile_start();
 		resp = node_reg->handler(pkt, storage_ctx);
+		pl_node_profile_end(node_reg->node_decl_id, start);
 
 		switch (node_reg->type) {
 		case PL_OUTPUT:
@@ -8,7 +8,9 @@
  * SPDX-License-Identifier: LGPL-2.1-only
  */
 #include <czmq.h>
+#include <errno.h>
 #include <limits.h>
+#include <rte_cycles.h>
 #include <rte_debug.h>
 #include <rte_log.h>
 #include <stdbool.h>
@@ -431,6 +433,108 @@ pl_graph_validate(void)
 		rte_panic("out of memory allocating pipeline stats\n");
 }
 
+/*
+ * Turn per-node cycle accounting on or off. The counts are allocated
+ * when it is turned on, so that each profiling run starts afresh, and
+ * freed when it is turned off.
+ */
+int
+pl_node_profile_enable(bool enable)
+{
+	struct pl_node_profile *prof = g_pl_node_profile;
+
+	if (enable) {
+		if (prof)
+			return 0;
+
+		prof = zmalloc_aligned(sizeof(struct pl_node_profile) *
+				       RTE_MAX_LCORE * next_dyn_node_id);
+		if (!prof)
+			return -ENOMEM;
+
+		rcu_assign_pointer(g_pl_node_profile, prof);
+		CMM_STORE_SHARED(g_profile_enabled, true);
+		return 0;
+	}
+
+	if (!prof)
+		return 0;
+
+	CMM_STORE_SHARED(g_profile_enabled, false);
+	rcu_assign_pointer(g_pl_node_profile, NULL);
+	defer_rcu(free, prof);
+	return 0;
+}
+
+static void
+pl_dump_profile_counts(json_writer_t *json, const struct pl_node_profile *prof)
+{
+	int i;
+
+	jsonw_uint_field(json, "packets", prof->calls);
+	jsonw_uint_field(json, "cycles", prof->cycles);
+	jsonw_uint_field(json, "cycles-per-pkt",
+			 prof->calls ? prof->cycles / prof->calls : 0);
+	jsonw_name(json, "histogram");
+	jsonw_start_array(json);
+	for (i = 0; i < PL_PROFILE_HIST_BUCKETS; i++)
+		jsonw_uint(json, prof->hist[i]);
+	jsonw_end_array(json);
+}
+
+void
+pl_dump_profile(json_writer_t *json)
+{
+	struct pl_node_registration *node;
+	unsigned int lcore;
+	int i;
+
+	jsonw_bool_field(json, "enabled", g_profile_enabled);
+	jsonw_uint_field(json, "tsc-hz", rte_get_tsc_hz());
+	jsonw_uint_field(json, "histogram-shift", PL_PROFILE_HIST_SHIFT);
+
+	if (!g_pl_node_profile)
+		return;
+
+	jsonw_name(json, "node");
+	jsonw_start_object(json);
+	TAILQ_FOREACH(node, &pl_node_reg_list, links) {
+		struct pl_node_profile total = { 0 };
+		const struct pl_node_profile *prof;
+
+		FOREACH_DP_LCORE(lcore) {
+			prof = g_pl_node_profile +
+				pl_node_stats_id(node->node_decl_id, lcore);
+			total.calls += prof->calls;
+			total.cycles += prof->cycles;
+			for (i = 0; i < PL_PROFILE_HIST_BUCKETS; i++)
+				total.hist[i] += prof->hist[i];
+		}
+		if (!total.calls)
+			continue;
+
+		jsonw_name(json, node->name);
+		jsonw_start_object(json);
+		pl_dump_profile_counts(json, &total);
+
+		jsonw_name(json, "lcores");
+		jsonw_start_array(json);
+		FOREACH_DP_LCORE(lcore) {
+			prof = g_pl_node_profile +
+				pl_node_stats_id(node->node_decl_id, lcore);
+			if (!prof->calls)
+				continue;
+			jsonw_start_object(json);
+			jsonw_uint_field(json, "lcore", lcore);
+			pl_dump_profile_counts(json, prof);
+			jsonw_end_object(json);
+		}
+		jsonw_end_array(json);
+		jsonw_end_object(json);
+	}
+	jsonw_end_object(json);
+}
+
 void
 pl_add_node_command(struct pl_node_command *cmd)
 {
@@ -0,0 +1,308 @@
+/*
+ * Copyright (c) 2021, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * Sampled rx to tx packet latency histograms.
+ */
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <urcu/system.h>
+#include <urcu/uatomic.h>
+
+#include <rte_common.h>
+#include <rte_cycles.h>
+#include <rte_ethdev.h>
+#include <rte_lcore.h>
+#include <rte_malloc.h>
+
+#include "if_var.h"
+#include "json_writer.h"
+#include "pkt_latency.h"
+#include "util.h"
+
+uint32_t pkt_latency_sample __hot_data;
+
+RTE_DEFINE_PER_LCORE(uint32_t, pkt_latency_skip);
+
+/*
+ * Per lcore array of stats indexed by port and traffic class.
+ * Allocated the first time sampling is enabled and kept from then on,
+ * so the forwarding threads never see it go away.
+ */
+static struct pkt_latency_stats *pkt_latency_lcore[RTE_MAX_LCORE];
+
+/*
+ * Set to have the lcore zero its stats before it next accounts any.
+ * Until then its stats count as zero.
+ */
+static unsigned int pkt_latency_clear_req[RTE_MAX_LCORE];
+
+#define PKT_LATENCY_STATS_SZ \
+	(sizeof(struct pkt_latency_stats) * DATAPLANE_MAX_PORTS * PKT_LATENCY_TC)
+
+static void
+pkt_latency_account(struct pkt_latency_stats *stats, uint64_t cycles)
+{
+	int bucket;
+
+	stats->count++;
+	stats->cycles += cycles;
+	if (cycles > stats->max)
+		stats->max = cycles;
+
+	bucket = 63 - __builtin_clzll(cycles | 1) - PKT_LATENCY_HIST_SHIFT;
+	bucket = RTE_MAX(bucket, 0);
+	bucket = RTE_MIN(bucket, PKT_LATENCY_HIST_BUCKETS - 1);
+	stats->hist[bucket]++;
+}
+
+uint16_t pkt_latency_tx_burst(const struct ifnet *ifp, uint16_t queue_id,
+			      struct rte_mbuf **pkts, uint16_t n)
+{
+	unsigned int lcore_id = rte_lcore_id();
+	struct pkt_latency_stats *stats = NULL;
+	struct {
+		uint16_t idx;
+		uint16_t tc;
+		uint64_t rx_tsc;
+	} stamped[n];
+	uint16_t i, nb_stamped = 0, sent;
+	uint64_t now;
+
+	if (lcore_id < RTE_MAX_LCORE)
+		stats = pkt_latency_lcore[lcore_id];
+	if (!stats)
+		return rte_eth_tx_burst(ifp->if_port, queue_id, pkts, n);
+
+	/* A show skips the stats until the request is dropped */
+	if (unlikely(uatomic_read(&pkt_latency_clear_req[lcore_id]))) {
+		memset(stats, 0, PKT_LATENCY_STATS_SZ);
+		cmm_smp_wmb();
+		uatomic_set(&pkt_latency_clear_req[lcore_id], 0);
+	}
+	stats += ifp->if_port * PKT_LATENCY_TC;
+
+	/*
+	 * The device owns the packets it takes, so note the stamps
+	 * beforehand. A stamp is cleared so a sent mbuf doesn't carry it
+	 * on, and put back if the packet is left for a retry.
+	 */
+	for (i = 0; i < n; i++) {
+		struct rte_mbuf *m = pkts[i];
+
+		if (!pktmbuf_mdata_invar_exists(m, PKT_MDATA_INVAR_RX_TSC))
+			continue;
+		pktmbuf_mdata_invar_clear(m, PKT_MDATA_INVAR_RX_TSC);
+
+		stamped[nb_stamped].idx = i;
+		stamped[nb_stamped].rx_tsc = pktmbuf_mdata(m)->md_rx_tsc;
+		/* Traffic class is only known once QoS has classified it */
+		if (ifp->qos_software_fwd &&
+		    m->hash.sched.traffic_class < PKT_LATENCY_TC)
+			stamped[nb_stamped].tc = m->hash.sched.traffic_class;
+		else
+			stamped[nb_stamped].tc = 0;
+		nb_stamped++;
+	}
+
+	sent = rte_eth_tx_burst(ifp->if_port, queue_id, pkts, n);
+	if (!nb_stamped)
+		return sent;
+
+	now = rte_rdtsc();
+	for (i = 0; i < nb_stamped; i++) {
+		if (stamped[i].idx < sent)
+			pkt_latency_account(&stats[stamped[i].tc],
+					    now - stamped[i].rx_tsc);
+		else
+			pktmbuf_mdata_invar_set(pkts[stamped[i].idx],
+						PKT_MDATA_INVAR_RX_TSC);
+	}
+
+	return sent;
+}
+
+static int pkt_latency_enable(uint32_t sample)
+{
+	unsigned int lcore_id;
+
+	RTE_LCORE_FOREACH(lcore_id) {
+		if (pkt_latency_lcore[lcore_id])
+			continue;
+
+		pkt_latency_lcore[lcore_id] =
+			rte_zmalloc_socket("latency", PKT_LATENCY_STATS_SZ,
+					   RTE_CACHE_LINE_SIZE,
+					   rte_lcore_to_socket_id(lcore_id));
+		if (!pkt_latency_lcore[lcore_id])
+			return -ENOMEM;
+	}
+
+	/* make the stats visible before the forwarding threads sample */
+	rte_smp_wmb();
+	CMM_STORE_SHARED(pkt_latency_sample, sample);
+	return 0;
+}
+
+static void pkt_latency_clear(void)
+{
+	unsigned int lcore_id;
+
+	RTE_LCORE_FOREACH(lcore_id) {
+		if (pkt_latency_lcore[lcore_id])
+			uatomic_set(&pkt_latency_clear_req[lcore_id], 1);
+	}
+}
+
+static uint64_t pkt_latency_ns(uint64_t cycles, uint64_t hz)
+{
+	return (double)cycles * 1e9 / hz;
+}
+
+static void pkt_latency_show_tc(json_writer_t *wr, unsigned int tc,
+				const struct pkt_latency_stats *sum,
+				uint64_t hz)
+{
+	unsigned int i;
+
+	jsonw_start_object(wr);
+	jsonw_uint_field(wr, "tc", tc);
+	jsonw_uint_field(wr, "count", sum->count);
+	jsonw_uint_field(wr, "avg_ns",
+			 pkt_latency_ns(sum->cycles / sum->count, hz));
+	jsonw_uint_field(wr, "max_ns", pkt_latency_ns(sum->max, hz));
+
+	jsonw_name(wr, "hist");
+	jsonw_start_array(wr);
+	for (i = 0; i < PKT_LATENCY_HIST_BUCKETS; i++) {
+		if (!sum->hist[i])
+			continue;
+		jsonw_start_object(wr);
+		if (i < PKT_LATENCY_HIST_BUCKETS - 1)
+			jsonw_uint_field(wr, "lt_ns", pkt_latency_ns(
+				 1ull << (i + PKT_LATENCY_HIST_SHIFT + 1), hz));
+		jsonw_uint_field(wr, "count", sum->hist[i]);
+		jsonw_end_object(wr);
+	}
+	jsonw_end_array(wr);
+	jsonw_end_object(wr);
+}
+
+static void pkt_latency_show(FILE *f)
+{
+	uint64_t hz = rte_get_tsc_hz();
+	json_writer_t *wr;
+	unsigned int port;
+
+	wr = jsonw_new(f);
+	if (!wr)
+		return;
+
+	jsonw_name(wr, "latency");
+	jsonw_start_object(wr);
+	jsonw_uint_field(wr, "sample", pkt_latency_sample);
+	jsonw_name(wr, "interfaces");
+	jsonw_start_array(wr);
+
+	for (port = 0; port < DATAPLANE_MAX_PORTS; port++) {
+		const struct ifnet *ifp = ifnet_byport(port);
+		bool started = false;
+		unsigned int tc;
+
+		if (!ifp)
+			continue;
+
+		for (tc = 0; tc < PKT_LATENCY_TC; tc++) {
+			struct pkt_latency_stats sum = { 0 };
+			unsigned int lcore_id, i;
+
+			RTE_LCORE_FOREACH(lcore_id) {
+				const struct pkt_latency_stats *stats =
+					pkt_latency_lcore[lcore_id];
+
+				if (!stats || uatomic_read(
+					    &pkt_latency_clear_req[lcore_id]))
+					continue;
+				stats += port * PKT_LATENCY_TC + tc;
+
+				sum.count += stats->count;
+				sum.cycles += stats->cycles;
+				sum.max = RTE_MAX(sum.max, stats->max);
+				for (i = 0; i < PKT_LATENCY_HIST_BUCKETS; i++)
+					sum.hist[i] += stats->hist[i];
+			}
+
+			if (!sum.count)
+				continue;
+
+			if (!started) {
+				jsonw_start_object(wr);
+				jsonw_string_field(wr, "name", ifp->if_name);
+				jsonw_name(wr, "tc");
+				jsonw_start_array(wr);
+				started = true;
+			}
+			pkt_latency_show_tc(wr, tc, &sum, hz);
+		}
+
+		if (started) {
+			jsonw_end_array(wr);
+			jsonw_end_object(wr);
+		}
+	}
+
+	jsonw_end_array(wr);
+	jsonw_end_object(wr);
+	jsonw_destroy(&wr);
+}
+
+/*
+ * latency show
+ * latency enable <N>	- sample 1 in N received packets
+ * latency disable
+ * latency clear
+ */
+int cmd_latency(FILE *f, int argc, char **argv)
+{
+	unsigned long sample;
+	char *end;
+
+	if (argc < 2 || strcmp(argv[1], "show") == 0) {
+		pkt_latency_show(f);
+		return 0;
+	}
+
+	if (strcmp(argv[1], "enable") == 0) {
+		if (argc != 3)
+			goto usage;
+
+		sample = strtoul(argv[2], &end, 0);
+		if (*end || sample == 0 || sample > UINT32_MAX) {
+			fprintf(f, "invalid sample rate %s\n", argv[2]);
+			return -1;
+		}
+		if (pkt_latency_enable(sample) < 0) {
+			fprintf(f, "latency: out of memory\n");
+			return -1;
+		}
+		return 0;
+	}
+
+	if (strcmp(argv[1], "disable") == 0) {
+		CMM_STORE_SHARED(pkt_latency_sample, 0);
+		return 0;
+	}
+
+	if (strcmp(argv[1], "clear") == 0) {
+		pkt_latency_clear();
+		return 0;
+	}
+
+usage:
+	fprintf(f, "usage: latency [show|enable <N>|disable|clear]\n");
+	return -1;
+}
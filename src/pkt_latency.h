@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2021, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+
+#ifndef PKT_LATENCY_H
+#define PKT_LATENCY_H
+
+/*
+ * Sampled rx to tx latency of forwarded packets.
+ *
+ * When enabled, one in every pkt_latency_sample received packets has
+ * the TSC at rx recorded in its metadata. When it is handed to the
+ * device for transmit the elapsed cycles are added to a histogram for
+ * the output port and traffic class. Each lcore keeps its own counts,
+ * so nothing is shared on the forwarding path. Clearing them is left to
+ * the lcore too, on its next transmit.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <rte_branch_prediction.h>
+#include <rte_mbuf.h>
+#include <rte_per_lcore.h>
+#include <rte_sched.h>
+#include <urcu/compiler.h>
+
+#include "compiler.h"
+#include "pktmbuf_internal.h"
+
+struct ifnet;
+
+/*
+ * Bucket i counts packets taking fewer than
+ * 2^(i + PKT_LATENCY_HIST_SHIFT + 1) cycles, the last one everything
+ * longer.
+ */
+#define PKT_LATENCY_HIST_BUCKETS 20
+#define PKT_LATENCY_HIST_SHIFT 8
+
+#define PKT_LATENCY_TC RTE_SCHED_TRAFFIC_CLASSES_PER_PIPE
+
+struct pkt_latency_stats {
+	uint64_t count;
+	uint64_t cycles;
+	uint64_t max;
+	uint64_t hist[PKT_LATENCY_HIST_BUCKETS];
+};
+
+/* 0 when disabled, otherwise sample 1 in N packets */
+extern uint32_t pkt_latency_sample __hot_data;
+
+RTE_DECLARE_PER_LCORE(uint32_t, pkt_latency_skip);
+
+/* Stamp a received packet if it is the one to be sampled */
+static ALWAYS_INLINE void
+pkt_latency_rx(struct rte_mbuf *m, uint64_t rx_tsc, uint32_t sample)
+{
+	uint32_t *skip = &RTE_PER_LCORE(pkt_latency_skip);
+
+	/* sample rate may have been lowered since the countdown started */
+	if (likely(*skip > 0 && *skip < sample)) {
+		(*skip)--;
+		return;
+	}
+	*skip = sample - 1;
+
+	pktmbuf_mdata(m)->md_rx_tsc = rx_tsc;
+	pktmbuf_mdata_invar_set(m, PKT_MDATA_INVAR_RX_TSC);
+}
+
+/*
+ * rte_eth_tx_burst, accounting the sampled packets the device took.
+ * Only called when sampling is enabled.
+ */
+uint16_t pkt_latency_tx_burst(const struct ifnet *ifp, uint16_t queue_id,
+			      struct rte_mbuf **pkts, uint16_t n);
+
+int cmd_latency(FILE *f, int argc, char **argv);
+
+#endif /* PKT_LATENCY_H */
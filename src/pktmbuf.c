@@ -13,6 +13,7 @@
 #include <rte_ether.h>
 #include <rte_mbuf.h>
 #include <rte_memcpy.h>
+#include <rte_mempool.h>
 #include <string.h>
 
 #include "debug.h"
@@ -24,12 +25,61 @@
 
 struct rte_mempool;
 
+RTE_DEFINE_PER_LCORE(struct pktmbuf_free_list, pktmbuf_free_list);
+
+/*
+ * Free an array of mbufs, returning the segments to their mempools in
+ * bulk. Consecutive segments from the same pool are batched into a
+ * single put.
+ */
 void pktmbuf_free_bulk(struct rte_mbuf *pkts[], unsigned int n)
 {
-	unsigned int i;
+	void *pending[PKTMBUF_FREE_LIST_SIZE];
+	struct rte_mempool *mp = NULL;
+	unsigned int i, nb_pending = 0;
+
+	for (i = 0; i < n; i++) {
+		struct rte_mbuf *m = pkts[i], *next;
+
+		while (m != NULL) {
+			__rte_mbuf_sanity_check(m, 0);
+
+			next = m->next;
+			m = rte_pktmbuf_prefree_seg(m);
+			if (likely(m != NULL)) {
+				if (nb_pending == PKTMBUF_FREE_LIST_SIZE ||
+				    m->pool != mp) {
+					if (nb_pending)
+						rte_mempool_put_bulk(
+							mp, pending,
+							nb_pending);
+					nb_pending = 0;
+					mp = m->pool;
+				}
+				pending[nb_pending++] = m;
+			}
+			m = next;
+		}
+	}
+
+	if (nb_pending)
+		rte_mempool_put_bulk(mp, pending, nb_pending);
+}
+
+void pktmbuf_free_list_enable(void)
+{
+	struct pktmbuf_free_list *fl = &RTE_PER_LCORE(pktmbuf_free_list);
+
+	fl->count = 0;
+	fl->active = true;
+}
+
+void pktmbuf_free_list_disable(void)
+{
+	struct pktmbuf_free_list *fl = &RTE_PER_LCORE(pktmbuf_free_list);
 
-	for (i = 0; i < n; i++)
-		rte_pktmbuf_free(pkts[i]);
+	pktmbuf_free_deferred_flush();
+	fl->active = false;
 }
 
 struct rte_mbuf *pktmbuf_allocseg(struct rte_mempool *mpool, vrfid_t vrf_id,
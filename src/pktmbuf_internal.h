@@ -24,6 +24,7 @@
 #include <rte_config.h>
 #include <rte_memcpy.h>
 #include <rte_mbuf.h>
+#include <rte_per_lcore.h>
 #include <rte_port.h>
 
 #include "compat.h"
@@ -78,6 +79,8 @@ enum pkt_mdata_invar_type {
 	PKT_MDATA_INVAR_BRIDGE		= (1 << 1),
 	PKT_MDATA_INVAR_NAT64		= (1 << 2),
 	PKT_MDATA_INVAR_FEATURE_PTRS	= (1 << 3),
+	/* Sampled for latency, rx timestamp valid */
+	PKT_MDATA_INVAR_RX_TSC		= (1 << 4),
 	PKT_MDATA_INVAR_MAX,
 };
 
@@ -139,6 +142,8 @@ struct pktmbuf_mdata {
 	/* Pointers that features can register for ownership of */
 	void *md_feature_ptrs[DP_PKTMBUF_MAX_INVAR_FEATURE_PTRS];
 
+	/* PKT_MDATA_INVAR_RX_TSC */
+	uint64_t md_rx_tsc;
 } __rte_aligned(RTE_CACHE_LINE_SIZE * 2);
 
 /* Ensure struct fits in two cache lines */
@@ -264,6 +269,61 @@ static inline struct rte_mbuf *pktmbuf_alloc(struct rte_mempool *mp,
  */
 void pktmbuf_free_bulk(struct rte_mbuf *pkts[], unsigned int n);
 
+/* Number of mbufs held back before a deferred free is forced */
+#define PKTMBUF_FREE_LIST_SIZE 64
+
+/*
+ * Per-lcore list of mbufs waiting to be freed. Only active on
+ * threads that periodically flush it, i.e. the forwarding threads.
+ */
+struct pktmbuf_free_list {
+	bool active;
+	uint16_t count;
+	struct rte_mbuf *pkts[PKTMBUF_FREE_LIST_SIZE];
+};
+
+RTE_DECLARE_PER_LCORE(struct pktmbuf_free_list, pktmbuf_free_list);
+
+void pktmbuf_free_list_enable(void);
+void pktmbuf_free_list_disable(void);
+
+/**
+ * Free all mbufs on this thread's deferred free list.
+ */
+static inline void pktmbuf_free_deferred_flush(void)
+{
+	struct pktmbuf_free_list *fl = &RTE_PER_LCORE(pktmbuf_free_list);
+
+	if (fl->count) {
+		pktmbuf_free_bulk(fl->pkts, fl->count);
+		fl->count = 0;
+	}
+}
+
+/**
+ * Free an mbuf, batching up the free with others when called on a
+ * thread that has a deferred free list active. The list is drained
+ * at the end of each burst, so drops cost one bulk mempool put
+ * rather than one per packet.
+ *
+ * @param m
+ *   The packet mbuf to be freed.
+ */
+static inline void pktmbuf_free_deferred(struct rte_mbuf *m)
+{
+	struct pktmbuf_free_list *fl = &RTE_PER_LCORE(pktmbuf_free_list);
+
+	if (unlikely(!fl->active)) {
+		rte_pktmbuf_free(m);
+		return;
+	}
+
+	if (unlikely(fl->count == PKTMBUF_FREE_LIST_SIZE))
+		pktmbuf_free_deferred_flush();
+
+	fl->pkts[fl->count++] = m;
+}
+
 /**
  * A macro to clear the header lengths in the given mbuf.
  *
@@ -12,7 +12,9 @@
 #include <netinet/in.h>
 #include <rte_branch_prediction.h>
 #include <rte_ether.h>
+#include <rte_lcore.h>
 #include <rte_mbuf.h>
+#include <rte_per_lcore.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <string.h>
@@ -34,6 +36,16 @@
 #include "portmonitor/portmonitor_hw.h"
 #include "urcu.h"
 
+/*
+ * Bytes at the start of a mirrored packet that are copied rather than
+ * shared with the original, so that either can have its headers pushed
+ * or rewritten without affecting the other.
+ */
+#define PORTMONITOR_COPY_LEN	128
+
+/* Per session countdown to the next packet to mirror when sampling */
+static RTE_DEFINE_PER_LCORE(uint32_t, portmonitor_skip[UINT8_MAX + 1]);
+
 /* Forward packet to SPAN port.
  * Returns 1 if packet was consumed.
  *         0 if span not enabled on port.
@@ -126,8 +138,10 @@ drop:
 
 static int portmonitor_encap_erspan_hdr(struct ifnet *ifp,
 					struct portmonitor_session *pmsess,
-					struct rte_mbuf *m, uint8_t direction)
+					struct rte_mbuf *m, uint8_t direction,
+					bool truncated)
 {
+	uint16_t t = truncated ? ERSPAN_TRUNCATED : 0;
 	struct erspan_v2_hdr *v2_hdr;
 	struct erspan_v3_hdr *v3_hdr;
 	struct timespec ts;
@@ -161,7 +175,7 @@ static int portmonitor_encap_erspan_hdr(struct ifnet *ifp,
 			en = ERSPAN_ORIG_FRAME_NO_VLAN;
 		}
 		v2_hdr->cos_en_t_id = htons((pktmbuf_get_vlan_pcp(m) << 13) |
-					    (en << 11) | pmsess->erspan_id);
+					    (en << 11) | t | pmsess->erspan_id);
 		v2_hdr->index = htonl((ifp->if_port << 4) | direction);
 	} else if (pmsess->erspan_hdr_type == ERSPAN_TYPE_III) {
 		if (clock_gettime(CLOCK_REALTIME, &ts))
@@ -188,16 +202,16 @@ static int portmonitor_encap_erspan_hdr(struct ifnet *ifp,
 			v3_hdr->cos_bso_t_id =
 				htons((pktmbuf_get_vlan_pcp(m) << 13) |
 				      (ERSPAN_ORIG_FRAME_SHORT << 11) |
-				      pmsess->erspan_id);
+				      t | pmsess->erspan_id);
 		} else if (frame_size > RTE_ETHER_MAX_LEN) {
 			v3_hdr->cos_bso_t_id =
 				htons((pktmbuf_get_vlan_pcp(m) << 13) |
 				      (ERSPAN_ORIG_FRAME_OVERSIZED << 11) |
-				      pmsess->erspan_id);
+				      t | pmsess->erspan_id);
 		} else {
 			v3_hdr->cos_bso_t_id =
 				htons((pktmbuf_get_vlan_pcp(m) << 13) |
-				      pmsess->erspan_id);
+				      t | pmsess->erspan_id);
 		}
 		v3_hdr->p_ft_hwid_d_gra_o = htons((1 << 15) |
 						(ERSPAN_HARDWARE_ID << 4) |
@@ -211,6 +225,121 @@ static int portmonitor_encap_erspan_hdr(struct ifnet *ifp,
 	return 1;
 }
 
+/* Is this the 1 in N packet of the session to mirror */
+static bool portmonitor_sample(const struct portmonitor_session *pmsess)
+{
+	uint32_t sample = CMM_ACCESS_ONCE(pmsess->sample_rate);
+	uint32_t *skip = &RTE_PER_LCORE(portmonitor_skip)[pmsess->session_id];
+
+	if (sample <= 1)
+		return true;
+
+	/* sample rate may have been lowered since the countdown started */
+	if (*skip > 0 && *skip < sample) {
+		(*skip)--;
+		return false;
+	}
+	*skip = sample - 1;
+	return true;
+}
+
+/* Cut a packet down to its first len bytes */
+static void portmonitor_truncate(struct rte_mbuf *m, uint32_t len)
+{
+	struct rte_mbuf *seg = m;
+	uint16_t nb_segs = 1;
+
+	m->pkt_len = len;
+	while (seg->data_len < len) {
+		len -= seg->data_len;
+		seg = seg->next;
+		nb_segs++;
+	}
+	seg->data_len = len;
+
+	if (seg->next) {
+		rte_pktmbuf_free(seg->next);
+		seg->next = NULL;
+	}
+	m->nb_segs = nb_segs;
+}
+
+/*
+ * Build the packet to mirror, cut down to the snap length of the
+ * session.
+ *
+ * On transmit nothing writes to the packet after it is mirrored, so
+ * only the first bytes are copied, into a new segment with the headroom
+ * for any encapsulation, and the rest is an indirect clone sharing the
+ * data of the original. On receive the packet has yet to be processed,
+ * and features that rewrite it in place (ESP, ALGs) would show through
+ * a clone, so all of it is copied.
+ */
+static struct rte_mbuf *
+portmonitor_mirror_pkt(struct rte_mbuf *m,
+		       const struct portmonitor_session *pmsess,
+		       uint8_t direction, bool *truncated)
+{
+	uint32_t snaplen = CMM_ACCESS_ONCE(pmsess->snaplen);
+	uint32_t len = rte_pktmbuf_pkt_len(m);
+	struct rte_mbuf *hdr, *rest;
+	const void *data;
+	uint32_t copy_len;
+	void *p;
+
+	*truncated = snaplen && snaplen < len;
+	if (*truncated)
+		len = snaplen;
+	if (direction == PORTMONITOR_DIRECTION_RX)
+		copy_len = len;
+	else
+		copy_len = RTE_MIN(len, PORTMONITOR_COPY_LEN);
+
+	/*
+	 * Copy segment by segment if there is more than fits in one, or
+	 * the first segment is short and not worth splitting.
+	 */
+	if (copy_len > rte_pktmbuf_data_room_size(m->pool) -
+	    RTE_PKTMBUF_HEADROOM ||
+	    unlikely(copy_len < len && rte_pktmbuf_data_len(m) <= copy_len)) {
+		hdr = pktmbuf_copy(m, m->pool);
+		if (hdr && *truncated)
+			portmonitor_truncate(hdr, len);
+		return hdr;
+	}
+
+	hdr = pktmbuf_alloc(m->pool, pktmbuf_get_vrf(m));
+	if (!hdr)
+		return NULL;
+
+	pktmbuf_copy_meta(hdr, m);
+	p = rte_pktmbuf_append(hdr, copy_len);
+	if (!p)
+		goto err;
+	data = rte_pktmbuf_read(m, 0, copy_len, p);
+	if (data != p)
+		memcpy(p, data, copy_len);
+
+	if (copy_len == len)
+		return hdr;
+
+	rest = pktmbuf_clone(m, m->pool);
+	if (!rest)
+		goto err;
+
+	rte_pktmbuf_adj(rest, copy_len);
+	portmonitor_truncate(rest, len - copy_len);
+	if (rte_pktmbuf_chain(hdr, rest) < 0) {
+		rte_pktmbuf_free(rest);
+		goto err;
+	}
+	return hdr;
+
+err:
+	rte_pktmbuf_free(hdr);
+	return NULL;
+}
+
 static void portmonitor_source_output(struct ifnet *ifp,
 					const struct portmonitor_info *pminfo,
 					struct rte_mbuf **m, uint8_t direction)
@@ -222,6 +351,7 @@ static void portmonitor_source_output(struct ifnet *ifp,
 	struct rte_mbuf *mirror_pkt;
 	struct ifnet *dest_ifp;
 	struct portmonitor_session *pmsess;
+	bool truncated;
 
 	if (!pminfo || pminfo->hw_mirroring)
 		return;
@@ -256,7 +386,10 @@ static void portmonitor_source_output(struct ifnet *ifp,
 			return;
 	}
 
-	mirror_pkt = pktmbuf_copy(*m, (*m)->pool);
+	if (!portmonitor_sample(pmsess))
+		return;
+
+	mirror_pkt = portmonitor_mirror_pkt(*m, pmsess, direction, &truncated);
 	if (!mirror_pkt)
 		return;
 
@@ -282,7 +415,7 @@ static void portmonitor_source_output(struct ifnet *ifp,
 		if (unlikely(dest_ifp->capturing))
 			capture_burst(dest_ifp, &mirror_pkt, 1);
 		if (!portmonitor_encap_erspan_hdr(ifp, pmsess, mirror_pkt,
-							direction)) {
+						  direction, truncated)) {
 			rte_pktmbuf_free(mirror_pkt);
 			return;
 		}
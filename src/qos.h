@@ -176,11 +176,17 @@ struct subport_info {
 	enum qos_queue_size_type qsize_type;
 	struct qos_red_params red_params[RTE_SCHED_TRAFFIC_CLASSES_PER_PIPE]
 					[RTE_COLORS];
-	bool pipe_configured[MAX_PIPES];
+	uint64_t pipe_configured[MAX_PIPES / 64]; /* bitmap */
 	struct qos_mark_map *mark_map;
 	bool auto_speed;
 };
 
+static inline bool qos_pipe_configured(const struct subport_info *sinfo,
+				       unsigned int pipe)
+{
+	return sinfo->pipe_configured[pipe / 64] & (1ull << (pipe % 64));
+}
+
 /* DSCP and PCP maps (per profile) */
 struct queue_map {
 	uint8_t pcp2q[MAX_PCP];	/* Priority Code Point -> queue */
@@ -194,6 +200,7 @@ struct queue_map {
 	uint8_t conf_ids[RTE_SCHED_QUEUES_PER_PIPE]; /* The configured Q ids */
 	struct qos_dscp_map *dscp_maps;
 	uint64_t reset_mask;
+	uint64_t fq_codel_mask;	/* Pipe queues with fq-codel enabled */
 };
 
 /* Egress map sub-port/VIF information */
@@ -224,6 +231,61 @@ enum ingress_map_type {
 #define	NUM_DPS			3
 #define	MAX_DP			2
 
+/*
+ * CoDel with heavy-flow drop selection on a leaf queue, configured as
+ * "fq-codel".
+ *
+ * This is not fq_codel (RFC 8290): the rte_sched leaf queues are FIFOs,
+ * so there are no queues per flow to schedule between. Instead packets
+ * are stamped on enqueue with their arrival time and a hash of their
+ * flow. On dequeue CoDel (RFC 8289) decides from the time spent queued
+ * when to drop, and the drop is taken from a flow that has had at least
+ * its fair share of the queue over the last interval, so sparse flows
+ * aren't penalised for a bulk flow's backlog.
+ */
+#define QOS_FQ_FLOW_BITS	6
+#define QOS_FQ_FLOWS		(1 << QOS_FQ_FLOW_BITS)
+#define QOS_FQ_CODEL_FLAG	0x80000000u	/* in mbuf seqn */
+
+struct qos_fq_codel_params {
+	uint32_t target_us;		/* 0 if not enabled */
+	uint32_t interval_us;
+};
+
+struct qos_fq_codel {
+	uint64_t target;		/* in TSC cycles, 0 if not enabled */
+	uint64_t interval;
+	uint64_t first_above;
+	uint64_t drop_next;
+	uint32_t count;
+	uint32_t lastcount;
+	bool dropping;
+	uint16_t active;		/* flows dequeued this window */
+	uint32_t total;			/* packets dequeued this window */
+	uint64_t window;
+	uint64_t drops;			/* written by the transmit thread */
+	uint64_t drops_read;		/* protected by stats_lock */
+	uint32_t flow_pkts[QOS_FQ_FLOWS];
+} __rte_cache_aligned;
+
+bool qos_codel_heavy_drop(struct qos_fq_codel *fq,
+			  const struct rte_mbuf *m, uint64_t now);
+
+/*
+ * Occupancy of a leaf queue, kept by the transmit thread running the
+ * port's scheduler as it enqueues and dequeues, so it is the only writer
+ * of qlen. The estimate is corrected, through adjust, each time the main
+ * thread reads the scheduler's own queue length. The high-water mark
+ * catches bursts that come and go between those reads, and is only
+ * reset when the queue's counters are cleared.
+ */
+struct qos_queue_hwm {
+	uint16_t qlen;			/* packets, as estimated */
+	uint16_t limit;			/* tail drop at this length */
+	uint32_t hwm;			/* max qlen since last clear */
+	int32_t adjust;			/* correction still to apply to qlen */
+};
+
 /* Qos queue counters (one per queue) */
 struct queue_stats {
 	/* The ever-increasing counts */
@@ -264,6 +326,7 @@ struct qos_pipe_params {
 	uint8_t		designation[INGRESS_DESIGNATORS];
 	uint8_t		des_set;
 	SLIST_HEAD(red_head, qos_red_pipe_params) red_head;
+	struct qos_fq_codel_params fq_codel[RTE_SCHED_QUEUES_PER_PIPE];
 };
 
 struct qos_port_params {
@@ -285,6 +348,7 @@ struct sched_info {
 	union _dev_info {
 		struct _dpdk {
 			struct rte_sched_port *port;	/* DPDK object */
+			uint32_t tm_levels;	/* non-zero if rte_tm offload */
 		} dpdk;
 		struct _fal {
 			fal_object_t hw_port_sched_group; /* FAL object */
@@ -306,8 +370,13 @@ struct sched_info {
 
 	uint16_t vlan_map[VLAN_N_VID];	/* Vlan vid to sub-port policy */
 	struct queue_map *queue_map;
-	struct queue_stats *queue_stats;
+	struct queue_stats **pipe_stats; /* per pipe, allocated on first use */
 	rte_spinlock_t stats_lock;      /* To control access to queue-stats */
+	struct qos_fq_codel *fq_codel;	/* DPDK only, indexed by qid */
+	struct qos_queue_hwm *queue_hwm; /* DPDK only, indexed by qid */
+	uint32_t port_hwm;		/* max of queue_hwm since last sample */
+	uint32_t port_hwm_last;		/* port_hwm of the last sample */
+	uint32_t port_hwm_max;		/* max of the samples since clear */
 	SLIST_ENTRY(sched_info) list;
 };
 
@@ -382,7 +451,8 @@ fal_object_t qos_global_map_obj;
 			qos_devices[qinfo->dev_id].qos_dscp_resgrp_json
 #define QOS_CHECK_RATE(qinfo) qos_devices[qinfo->dev_id].qos_check_rate
 #define QOS_CONFIGURED(qinfo) \
-	(qinfo->dev_info.dpdk.port || qinfo->dev_info.fal.hw_port_id)
+	(qinfo->dev_id == QOS_DPDK_ID ? qinfo->dev_info.dpdk.port != NULL : \
+	 qinfo->dev_info.fal.hw_port_id != 0)
 
 /*
  * Given an interface walk back to the parent device (if a vlan)
@@ -491,7 +561,7 @@ static inline void qos_sched_pipe_check(struct sched_info *qinfo,
 			struct subport_info *sinfo = qinfo->subport + subport;
 
 			for (pipe = 0; pipe < MAX_PIPES; pipe++) {
-				if (sinfo->pipe_configured[pipe] &&
+				if (qos_pipe_configured(sinfo, pipe) &&
 				    sinfo->profile_map[pipe] == profile) {
 					parent_rate = sinfo->params.tb_rate;
 					break;
@@ -561,6 +631,10 @@ void qos_sched_stop(struct ifnet *ifp);
 uint32_t qos_sched_calc_qindex(struct sched_info *qinfo, unsigned int subport,
 			       unsigned int pipe, unsigned int tc,
 			       unsigned int q);
+struct queue_stats *qos_sched_queue_stats(struct sched_info *qinfo,
+					  uint32_t qid);
+struct queue_stats *qos_sched_queue_stats_find(struct sched_info *qinfo,
+					       uint32_t qid);
 bool qos_wred_threshold_get(struct qos_red_params *wred_params,
 		uint64_t rate, uint32_t *wred_min_th, uint32_t *wred_max_th);
 uint32_t qos_queue_size_get(uint32_t qsize,
@@ -620,6 +694,11 @@ int qos_dpdk_queue_read_stats(struct sched_info *qinfo, uint32_t subport,
 int qos_dpdk_queue_clear_stats(struct sched_info *qinfo,
 			       uint32_t subport, uint32_t pipe,
 			       uint32_t tc, uint32_t q);
+uint32_t qos_dpdk_queue_read_hwm(struct sched_info *qinfo, uint32_t qid);
+uint32_t qos_dpdk_port_read_hwm(struct sched_info *qinfo);
+void qos_dpdk_port_sample_hwm(struct sched_info *qinfo);
+void qos_dpdk_port_clear_hwm(struct sched_info *qinfo);
+void qos_sw_buf_sample(void);
 void qos_dpdk_free(struct sched_info *qinfo);
 int qos_dpdk_port(struct ifnet *ifp,
 		  unsigned int subports, unsigned int pipes,
@@ -627,11 +706,15 @@ int qos_dpdk_port(struct ifnet *ifp,
 int qos_dpdk_disable(struct ifnet *ifp, struct sched_info *qinfo);
 int qos_dpdk_enable(struct ifnet *ifp,
 		    struct sched_info *qinfo);
-int qos_dpdk_stop(__unused struct ifnet *ifp, struct sched_info *qinfo);
+int qos_dpdk_stop(struct ifnet *ifp, struct sched_info *qinfo);
 int qos_dpdk_start(struct ifnet *ifp, struct sched_info *qinfo,
 		   uint64_t bps, uint16_t max_pkt_len);
 uint64_t qos_dpdk_check_rate(uint64_t rate, uint64_t parent_bw);
 
+/* The DPDK plugin's rte_tm offload */
+int qos_tm_start(struct ifnet *ifp, struct sched_info *qinfo, uint64_t bps);
+int qos_tm_stop(struct ifnet *ifp, struct sched_info *qinfo);
+
 /* The HW forwarding plugin functions */
 fal_object_t
 qos_hw_get_ingress_map(uint32_t port_obj_id, uint32_t subport_id,
@@ -5,21 +5,29 @@
  * SPDX-License-Identifier: LGPL-2.1-only
  */
 
+#include <assert.h>
+#include <rte_cycles.h>
 #include <rte_ethdev.h>
 #include <rte_ether.h>
+#include <rte_jhash.h>
 #include <rte_lcore.h>
 #include <rte_log.h>
+#include <rte_malloc.h>
 #include <rte_mbuf.h>
 #include <rte_red.h>
 #include <rte_sched.h>
+#include <string.h>
+#include <urcu/uatomic.h>
 #include "qos.h"
 #include "json_writer.h"
 #include "netinet6/ip6_funcs.h"
 #include "npf/config/npf_config.h"
 #include "npf_shim.h"
+#include "util.h"
 #include "vplane_debug.h"
 #include "vplane_log.h"
 #include "ether.h"
+#include "if/dpdk-eth/vhost.h"
 
 /*
  * Only allow a child shaper to use 99.6% of the parent bandwidth so when we
@@ -31,6 +39,9 @@
 #define	MAX_RATE_FLOAT	99.6
 #define	MAX_RATE_SCALED	996
 
+static_assert(RTE_SCHED_QUEUES_PER_PIPE <= 64,
+	      "fq_codel_mask is too small");
+
 uint64_t qos_dpdk_check_rate(uint64_t rate, uint64_t parent_bw)
 {
 	/*
@@ -195,6 +206,33 @@ int qos_dpdk_queue_read_stats(struct sched_info *qinfo,
 			queue_stats->n_pkts_red_dscp_dropped[i] +=
 				stats.n_pkts_red_dscp_dropped[i];
 		*qlen = qlen_16;
+
+		/*
+		 * Correct the transmit thread's estimate of the queue length,
+		 * which can drift when drops are charged to the wrong queue.
+		 * It may have moved on since the scheduler's was read, but any
+		 * error that leaves is small and corrected on the next read.
+		 */
+		struct qos_queue_hwm *qhwm = rcu_dereference(qinfo->queue_hwm);
+
+		if (qhwm) {
+			struct qos_queue_hwm *qh = &qhwm[qid];
+			int32_t err = CMM_LOAD_SHARED(qh->qlen) +
+				uatomic_read(&qh->adjust) - qlen_16;
+
+			if (err)
+				uatomic_add(&qh->adjust, -err);
+		}
+
+		/* CoDel drops are made after the scheduler has counted them */
+		struct qos_fq_codel *fqc = rcu_dereference(qinfo->fq_codel);
+
+		if (fqc) {
+			uint64_t drops = CMM_LOAD_SHARED(fqc[qid].drops);
+
+			queue_stats->n_pkts_dropped += drops - fqc[qid].drops_read;
+			fqc[qid].drops_read = drops;
+		}
 	}
 	rte_spinlock_unlock(&qinfo->stats_lock);
 
@@ -206,15 +244,27 @@ int qos_dpdk_queue_clear_stats(struct sched_info *qinfo,
 			       uint32_t tc, uint32_t q)
 {
 	uint32_t qid = qos_sched_calc_qindex(qinfo, subport, pipe, tc, q);
-	struct queue_stats *queue_stats = qinfo->queue_stats + qid;
+	struct queue_stats *queue_stats =
+		qos_sched_queue_stats_find(qinfo, qid);
+	struct queue_stats unused = { 0 };
 	bool qlen_in_pkts;
 	uint64_t qlen;
 	uint32_t i;
 	int rv;
 
+	/* Whatever a never used pipe has counted since is cleared with it */
+	if (!queue_stats)
+		queue_stats = &unused;
+
 	rv = qos_dpdk_queue_read_stats(qinfo, subport, pipe, tc, q, queue_stats,
 				       &qlen, &qlen_in_pkts);
 	if (rv == 0) {
+		struct qos_queue_hwm *qhwm = rcu_dereference(qinfo->queue_hwm);
+
+		/* Start the mark again from the queue as it is now */
+		if (qhwm)
+			uatomic_set(&qhwm[qid].hwm, qlen);
+
 		/*
 		 * Remember the value the dataplane's counters when they were
 		 * cleared.
@@ -233,10 +283,55 @@ int qos_dpdk_queue_clear_stats(struct sched_info *qinfo,
 	return rv;
 }
 
+/*
+ * Read the high-water marks, which are left as they are so that showing
+ * them doesn't lose a burst from whoever looks next.
+ */
+uint32_t qos_dpdk_queue_read_hwm(struct sched_info *qinfo, uint32_t qid)
+{
+	struct qos_queue_hwm *qhwm = rcu_dereference(qinfo->queue_hwm);
+
+	if (!qhwm)
+		return 0;
+	return CMM_LOAD_SHARED(qhwm[qid].hwm);
+}
+
+uint32_t qos_dpdk_port_read_hwm(struct sched_info *qinfo)
+{
+	return RTE_MAX(qinfo->port_hwm_max, CMM_LOAD_SHARED(qinfo->port_hwm));
+}
+
+/*
+ * Called by the buffer monitor each sample interval to take the port's
+ * mark for that interval, resetting it with a single exchange so that
+ * no burst is counted in two intervals or lost between them.
+ */
+void qos_dpdk_port_sample_hwm(struct sched_info *qinfo)
+{
+	uint32_t hwm = uatomic_xchg(&qinfo->port_hwm, 0);
+
+	qinfo->port_hwm_last = hwm;
+	if (hwm > qinfo->port_hwm_max)
+		qinfo->port_hwm_max = hwm;
+}
+
+/*
+ * The transmit thread may be raising the mark as we do so, in which case
+ * it may survive the reset, but that needs no lock between us.
+ */
+void qos_dpdk_port_clear_hwm(struct sched_info *qinfo)
+{
+	uatomic_set(&qinfo->port_hwm, 0);
+	qinfo->port_hwm_last = 0;
+	qinfo->port_hwm_max = 0;
+}
+
 void qos_dpdk_free(struct sched_info *qinfo)
 {
 	if (qinfo->dev_info.dpdk.port)
 		rte_sched_port_free(qinfo->dev_info.dpdk.port);
+	rte_free(qinfo->fq_codel);
+	rte_free(qinfo->queue_hwm);
 }
 
 int qos_dpdk_port(struct ifnet *ifp,
@@ -344,6 +439,105 @@ static void qos_dpdk_port_free_rcu(void *arg)
 	rte_sched_port_free(arg);
 }
 
+static void qos_dpdk_mem_free_rcu(void *arg)
+{
+	rte_free(arg);
+}
+
+static bool qos_dpdk_fq_codel_wanted(struct sched_info *qinfo)
+{
+	uint32_t profile;
+
+	for (profile = 0; profile < qinfo->port_params.n_pipe_profiles;
+	     profile++)
+		if (qinfo->queue_map[profile].fq_codel_mask)
+			return true;
+	return false;
+}
+
+/* Allocate the CoDel state for every queue of the port */
+static struct qos_fq_codel *
+qos_dpdk_fq_codel_alloc(struct sched_info *qinfo, int socketid)
+{
+	struct qos_port_params *pp = &qinfo->port_params;
+	uint64_t us_hz = rte_get_tsc_hz() / USEC_PER_SEC;
+	struct qos_fq_codel *fqc;
+	unsigned int subport, pipe, qindex;
+	uint32_t profile;
+
+	fqc = rte_zmalloc_socket("qos_fq_codel",
+				 sizeof(*fqc) * pp->n_subports_per_port *
+				 pp->n_pipes_per_subport *
+				 RTE_SCHED_QUEUES_PER_PIPE,
+				 RTE_CACHE_LINE_SIZE, socketid);
+	if (!fqc)
+		return NULL;
+
+	for (subport = 0; subport < qinfo->n_subports; subport++) {
+		struct subport_info *sinfo = &qinfo->subport[subport];
+
+		for (pipe = 0; pipe < qinfo->n_pipes; pipe++) {
+			struct qos_pipe_params *params;
+			uint64_t mask;
+
+			profile = sinfo->profile_map[pipe];
+			mask = qinfo->queue_map[profile].fq_codel_mask;
+			params = pp->pipe_profiles + profile;
+
+			for (qindex = 0; qindex < RTE_SCHED_QUEUES_PER_PIPE;
+			     qindex++) {
+				struct qos_fq_codel *fq;
+
+				if (!(mask & (1ull << qindex)))
+					continue;
+
+				fq = &fqc[(subport * pp->n_pipes_per_subport +
+					   pipe) * RTE_SCHED_QUEUES_PER_PIPE +
+					  qindex];
+				fq->target = us_hz *
+					params->fq_codel[qindex].target_us;
+				fq->interval = us_hz *
+					params->fq_codel[qindex].interval_us;
+			}
+		}
+	}
+	return fqc;
+}
+
+/* Allocate the occupancy state for every queue of the port */
+static struct qos_queue_hwm *
+qos_dpdk_queue_hwm_alloc(struct sched_info *qinfo, int socketid)
+{
+	struct qos_port_params *pp = &qinfo->port_params;
+	struct qos_queue_hwm *qhwm;
+	unsigned int subport, pipe, qindex;
+
+	qhwm = rte_zmalloc_socket("qos_queue_hwm",
+				  sizeof(*qhwm) * pp->n_subports_per_port *
+				  pp->n_pipes_per_subport *
+				  RTE_SCHED_QUEUES_PER_PIPE,
+				  RTE_CACHE_LINE_SIZE, socketid);
+	if (!qhwm)
+		return NULL;
+
+	for (subport = 0; subport < qinfo->n_subports; subport++) {
+		struct subport_info *sinfo = &qinfo->subport[subport];
+
+		for (pipe = 0; pipe < qinfo->n_pipes; pipe++) {
+			struct qos_queue_hwm *q;
+
+			q = &qhwm[(subport * pp->n_pipes_per_subport + pipe) *
+				  RTE_SCHED_QUEUES_PER_PIPE];
+			for (qindex = 0; qindex < RTE_SCHED_QUEUES_PER_PIPE;
+			     qindex++)
+				q[qindex].limit = qos_sp_qsize_get(pp, sinfo,
+					qindex /
+					RTE_SCHED_QUEUES_PER_TRAFFIC_CLASS);
+		}
+	}
+	return qhwm;
+}
+
 /* Return the total queue-array length for the subport.
  * If the subport doesn't have its TC queue-limits explicitly defined inherit
  * the port's queue-limits.
@@ -481,6 +675,33 @@ static void qos_dpdk_free_params(struct rte_sched_port_params *dpdk_port_params)
 	free(dpdk_port_params->pipe_profiles);
 }
 
+/* Take down the software scheduler, if running */
+static void qos_dpdk_sched_stop(struct ifnet *ifp, struct sched_info *qinfo)
+{
+	struct rte_sched_port *port = qinfo->dev_info.dpdk.port;
+
+	if (port == NULL)
+		return; /* qos not started */
+
+	rcu_assign_pointer(qinfo->dev_info.dpdk.port, NULL);
+	defer_rcu(qos_dpdk_port_free_rcu, port);
+	if (qinfo->fq_codel) {
+		struct qos_fq_codel *fqc = qinfo->fq_codel;
+
+		rcu_assign_pointer(qinfo->fq_codel, NULL);
+		defer_rcu(qos_dpdk_mem_free_rcu, fqc);
+	}
+	if (qinfo->queue_hwm) {
+		struct qos_queue_hwm *qhwm = qinfo->queue_hwm;
+
+		rcu_assign_pointer(qinfo->queue_hwm, NULL);
+		defer_rcu(qos_dpdk_mem_free_rcu, qhwm);
+	}
+
+	ifp->qos_software_fwd = 0;
+	disable_transmit_thread(ifp->if_port);
+}
+
 /* Allocate and initialize a handle to QoS scheduler.
  * Only called by main thread.
  */
@@ -488,25 +709,19 @@ int qos_dpdk_start(struct ifnet *ifp, struct sched_info *qinfo,
 		   uint64_t bps, uint16_t max_pkt_len)
 {
 	struct rte_sched_port *port, *old_port = NULL;
+	struct qos_fq_codel *fqc, *old_fqc;
+	struct qos_queue_hwm *qhwm, *old_qhwm;
 	unsigned int subport, pipe;
 	int ret;
 	uint32_t q_array_size;
 	struct rte_sched_port_params dpdk_port_params = {0};
 	const uint32_t max_burst_size = QOS_MAX_BURST_SIZE_DPDK;
 
-	if (enable_transmit_thread(ifp->if_port) < 0) {
-		DP_DEBUG(QOS_DP, ERR, DATAPLANE,
-			 "Transmit thread setup failed on %s, portid %u\n",
-			 ifp->if_name, ifp->if_port);
-		qinfo->enabled = false;
-		return -ENODEV;
-	}
-
-	ifp->qos_software_fwd = 1;
-
 	/*
 	 * Allow subports to inherit their queue sizes from the port, and
 	 * calculate the total size of queue array this port will need.
+	 * rte_sched indexes its queue array by pipe, so this covers every
+	 * pipe of every subport whether or not it is configured.
 	 */
 	q_array_size = 0;
 	for (subport = 0; subport < qinfo->n_subports; subport++) {
@@ -534,6 +749,33 @@ int qos_dpdk_start(struct ifnet *ifp, struct sched_info *qinfo,
 
 	qos_sched_pipe_check(qinfo, max_pkt_len, max_burst_size, bps);
 
+	/*
+	 * Prefer the NIC's own shapers if it has them and the policy
+	 * needs nothing else, which frees the transmit thread. A hierarchy
+	 * left from before, or by a failed offload, that can't be removed
+	 * fails the start, rather than shaping the port twice.
+	 */
+	ret = qos_tm_stop(ifp, qinfo);
+	if (ret < 0)
+		return ret;
+	if (qos_tm_start(ifp, qinfo, bps) == 0) {
+		qos_dpdk_sched_stop(ifp, qinfo);
+		return 0;
+	}
+	ret = qos_tm_stop(ifp, qinfo);
+	if (ret < 0)
+		return ret;
+
+	if (enable_transmit_thread(ifp->if_port) < 0) {
+		DP_DEBUG(QOS_DP, ERR, DATAPLANE,
+			 "Transmit thread setup failed on %s, portid %u\n",
+			 ifp->if_name, ifp->if_port);
+		qinfo->enabled = false;
+		return -ENODEV;
+	}
+
+	ifp->qos_software_fwd = 1;
+
 	if (qos_dpdk_setup_params(ifp, qinfo, &dpdk_port_params)) {
 		qos_dpdk_free_params(&dpdk_port_params);
 		DP_DEBUG(QOS_DP, ERR, DATAPLANE,
@@ -594,14 +836,38 @@ int qos_dpdk_start(struct ifnet *ifp, struct sched_info *qinfo,
 		npf_cfg_commit_all();
 	}
 
+	fqc = NULL;
+	if (qos_dpdk_fq_codel_wanted(qinfo)) {
+		fqc = qos_dpdk_fq_codel_alloc(qinfo, dpdk_port_params.socket);
+		if (!fqc) {
+			DP_DEBUG(QOS_DP, ERR, DATAPLANE,
+				 "QoS fq-codel allocation failed\n");
+			goto out_free_sched;
+		}
+	}
+
+	qhwm = qos_dpdk_queue_hwm_alloc(qinfo, dpdk_port_params.socket);
+	if (!qhwm) {
+		DP_DEBUG(QOS_DP, ERR, DATAPLANE,
+			 "QoS queue occupancy allocation failed\n");
+		rte_free(fqc);
+		goto out_free_sched;
+	}
+
 	/* Use RCU to set the pointer because changed by main thread
 	 * but referenced by Tx thread
 	 */
 	DP_DEBUG(QOS_DP, DEBUG, DATAPLANE,  "QoS on port %s enabled\n",
 		 ifp->if_name);
+	old_fqc = qinfo->fq_codel;
+	rcu_assign_pointer(qinfo->fq_codel, fqc);
+	old_qhwm = qinfo->queue_hwm;
+	rcu_assign_pointer(qinfo->queue_hwm, qhwm);
 	old_port = qinfo->dev_info.dpdk.port;
 	rcu_assign_pointer(qinfo->dev_info.dpdk.port, port);
 	defer_rcu(qos_dpdk_port_free_rcu, old_port);
+	defer_rcu(qos_dpdk_mem_free_rcu, old_fqc);
+	defer_rcu(qos_dpdk_mem_free_rcu, old_qhwm);
 	qos_dpdk_free_params(&dpdk_port_params);
 	return 0;
 
@@ -616,18 +882,10 @@ int qos_dpdk_start(struct ifnet *ifp, struct sched_info *qinfo,
 
 int qos_dpdk_stop(struct ifnet *ifp, struct sched_info *qinfo)
 {
-	struct rte_sched_port *port = qinfo->dev_info.dpdk.port;
-
-	if (port == NULL)
-		return 0; /* qos not started */
-
-	rcu_assign_pointer(qinfo->dev_info.dpdk.port, NULL);
-	defer_rcu(qos_dpdk_port_free_rcu, port);
+	int ret = qos_tm_stop(ifp, qinfo);
 
-	ifp->qos_software_fwd = 0;
-	disable_transmit_thread(ifp->if_port);
-
-	return 0;
+	qos_dpdk_sched_stop(ifp, qinfo);
+	return ret;
 }
 
 /* Classify packet for QoS
@@ -638,9 +896,63 @@ int qos_dpdk_stop(struct ifnet *ifp, struct sched_info *qinfo)
  *    hash    => queue
  * Non IP traffic, default to best effort and no flow
  */
+/* The ports of a TCP, UDP or SCTP header at off, if there is one */
+static void qos_fq_l4_ports(const struct rte_mbuf *m, uint32_t off,
+			    uint8_t proto, uint32_t *ports)
+{
+	const uint32_t *p;
+
+	switch (proto) {
+	case IPPROTO_TCP:
+	case IPPROTO_UDP:
+	case IPPROTO_UDPLITE:
+	case IPPROTO_SCTP:
+		p = rte_pktmbuf_read(m, off, sizeof(*p), ports);
+		if (p)
+			*ports = *p;
+		break;
+	}
+}
+
+static void qos_fq_codel_stamp(struct rte_mbuf *m,
+			       const struct queue_map *qmap, uint8_t q,
+			       uint16_t ether_type, uint64_t now)
+{
+	uint32_t hash;
+
+	if (!(qmap->fq_codel_mask & (1ull << q_from_mask(q))))
+		return;
+
+	/* The low bits of the RSS hash already chose the receive queue */
+	if (m->ol_flags & PKT_RX_RSS_HASH) {
+		hash = m->hash.rss;
+	} else if (ether_type == htons(RTE_ETHER_TYPE_IPV4)) {
+		const struct iphdr *ip = iphdr(m);
+		uint32_t ports = 0;
+
+		/* Fragments all hash as the datagram's first */
+		if (!ip_is_fragment(ip))
+			qos_fq_l4_ports(m, dp_pktmbuf_l2_len(m) + (ip->ihl << 2),
+					ip->protocol, &ports);
+		hash = rte_jhash_3words(ip->saddr, ip->daddr, ports,
+					ip->protocol);
+	} else if (ether_type == htons(RTE_ETHER_TYPE_IPV6)) {
+		const struct ip6_hdr *ip6 = ip6hdr(m);
+
+		hash = rte_jhash_32b((const uint32_t *)&ip6->ip6_src,
+				     2 * sizeof(struct in6_addr) /
+				     sizeof(uint32_t), ip6->ip6_nxt);
+	} else {
+		hash = 0;
+	}
+
+	m->seqn = QOS_FQ_CODEL_FLAG | (hash >> (32 - QOS_FQ_FLOW_BITS));
+	m->timestamp = now;
+}
+
 static
 int qos_npf_classify(struct ifnet *ifp, const struct sched_info *qinfo,
-		     struct rte_mbuf **m)
+		     struct rte_mbuf **m, uint64_t now)
 {
 	uint16_t ether_type = ethtype(*m, RTE_ETHER_TYPE_VLAN);
 	uint32_t subport, pipe = 0, q = DEFAULT_Q;
@@ -713,6 +1025,15 @@ int qos_npf_classify(struct ifnet *ifp, const struct sched_info *qinfo,
 		}
 	}
 
+	/*
+	 * The seqn may have been set by whatever had the mbuf last, so is
+	 * cleared for every packet, and the stamp must be made before the
+	 * scheduler's fields overwrite the RSS hash.
+	 */
+	(*m)->seqn = 0;
+	if (unlikely(now))
+		qos_fq_codel_stamp(*m, qmap, q, ether_type, now);
+
 	rte_sched_port_pkt_write_v2(*m, subport, pipe,
 				 qmap_to_tc(q), qmap_to_wrr(q),
 				 RTE_COLOR_GREEN, dscp);
@@ -720,7 +1041,8 @@ int qos_npf_classify(struct ifnet *ifp, const struct sched_info *qinfo,
 }
 
 static int qos_classify(struct ifnet *ifp, struct sched_info *qinfo,
-			struct rte_mbuf *enq_pkts[], uint32_t n_pkts)
+			struct rte_mbuf *enq_pkts[], uint32_t n_pkts,
+			uint64_t now)
 {
 	uint32_t i, j;
 
@@ -731,8 +1053,8 @@ static int qos_classify(struct ifnet *ifp, struct sched_info *qinfo,
 	 * dropped via policing and repack the array.
 	 */
 	for (i = j = 0; i < n_pkts; i++) {
-		if (qos_npf_classify(ifp, qinfo,
-				     &(enq_pkts[i])) == NPF_DECISION_BLOCK) {
+		if (qos_npf_classify(ifp, qinfo, &(enq_pkts[i]),
+				     now) == NPF_DECISION_BLOCK) {
 			rte_pktmbuf_free(enq_pkts[i]);
 			continue;
 		}
@@ -748,6 +1070,218 @@ static int qos_classify(struct ifnet *ifp, struct sched_info *qinfo,
 	return j;
 }
 
+static uint64_t qos_isqrt(uint64_t x)
+{
+	uint64_t r = 0, b = 1ull << 62;
+
+	while (b > x)
+		b >>= 2;
+	while (b) {
+		if (x >= r + b) {
+			x -= r + b;
+			r = (r >> 1) + b;
+		} else {
+			r >>= 1;
+		}
+		b >>= 2;
+	}
+	return r;
+}
+
+/* t + interval / sqrt(count) */
+static uint64_t qos_codel_control_law(uint64_t t, uint64_t interval,
+				      uint32_t count)
+{
+	return t + (interval << 8) / qos_isqrt((uint64_t)count << 16);
+}
+
+/*
+ * CoDel with heavy-flow drop selection: decide whether a packet being
+ * dequeued is dropped. CoDel's control law decides when a drop is due,
+ * but it is only taken from a packet of a flow which has had at least
+ * its fair share of the queue's packets in the current interval. A
+ * packet of a lighter flow is sent and the drop carried over to the
+ * next heavy one.
+ */
+bool qos_codel_heavy_drop(struct qos_fq_codel *fq,
+			  const struct rte_mbuf *m, uint64_t now)
+{
+	uint32_t flow = m->seqn & (QOS_FQ_FLOWS - 1);
+	uint64_t sojourn = now - m->timestamp;
+	bool ok_to_drop = false;
+	bool heavy;
+	uint32_t delta;
+
+	if (unlikely(!fq->target))
+		return false;
+
+	/* The share of the queue each flow has had over the last interval */
+	if (now - fq->window > fq->interval) {
+		memset(fq->flow_pkts, 0, sizeof(fq->flow_pkts));
+		fq->active = 0;
+		fq->total = 0;
+		fq->window = now;
+	}
+	if (fq->flow_pkts[flow]++ == 0)
+		fq->active++;
+	fq->total++;
+	heavy = (uint64_t)fq->flow_pkts[flow] * fq->active >= fq->total;
+
+	if (sojourn < fq->target)
+		fq->first_above = 0;
+	else if (!fq->first_above)
+		fq->first_above = now + fq->interval;
+	else if (now >= fq->first_above)
+		ok_to_drop = true;
+
+	/*
+	 * When a drop is due but the packet is from a light flow, it is
+	 * sent and the drop falls on the next packet from a heavy one.
+	 */
+	if (fq->dropping) {
+		if (!ok_to_drop) {
+			fq->dropping = false;
+			return false;
+		}
+		if (now < fq->drop_next || !heavy)
+			return false;
+		fq->count++;
+		fq->drop_next = qos_codel_control_law(fq->drop_next,
+						      fq->interval, fq->count);
+	} else {
+		if (!ok_to_drop || !heavy)
+			return false;
+		fq->dropping = true;
+		delta = fq->count - fq->lastcount;
+		if (delta > 1 && now - fq->drop_next < 16 * fq->interval)
+			fq->count = delta;
+		else
+			fq->count = 1;
+		fq->drop_next = qos_codel_control_law(now, fq->interval,
+						      fq->count);
+		fq->lastcount = fq->count;
+	}
+
+	CMM_STORE_SHARED(fq->drops, fq->drops + 1);
+	return true;
+}
+
+static unsigned int qos_fq_codel_dequeue(struct sched_info *qinfo,
+					 struct rte_sched_port *port,
+					 struct qos_fq_codel *fqc,
+					 struct rte_mbuf *pkts[],
+					 unsigned int n_pkts)
+{
+	uint64_t now = rte_rdtsc();
+	unsigned int i, j;
+
+	for (i = j = 0; i < n_pkts; i++) {
+		struct rte_mbuf *m = pkts[i];
+
+		if (m->seqn & QOS_FQ_CODEL_FLAG) {
+			uint32_t subport, pipe, tc, q, qid;
+
+			rte_sched_port_pkt_read_tree_path(port, m, &subport,
+							  &pipe, &tc, &q);
+			qid = qos_sched_calc_qindex(qinfo, subport, pipe,
+						    tc, q);
+			if (qos_codel_heavy_drop(&fqc[qid], m, now)) {
+				rte_pktmbuf_free(m);
+				continue;
+			}
+		}
+		pkts[j++] = m;
+	}
+	return j;
+}
+
+/*
+ * Count the packets going into each queue and return how many the
+ * scheduler would tail drop, because their queue is already full.
+ * This has to be done before the enqueue, after which the mbufs of
+ * dropped packets are no longer ours to look at.
+ */
+static uint32_t qos_queue_hwm_enqueue(struct sched_info *qinfo,
+				      struct rte_sched_port *port,
+				      struct qos_queue_hwm *qhwm,
+				      struct rte_mbuf *pkts[], uint32_t n_pkts,
+				      struct qos_queue_hwm *touched[])
+{
+	uint32_t i, tail = 0;
+
+	for (i = 0; i < n_pkts; i++) {
+		uint32_t subport, pipe, tc, q;
+		struct qos_queue_hwm *qh;
+
+		rte_sched_port_pkt_read_tree_path(port, pkts[i], &subport,
+						  &pipe, &tc, &q);
+		qh = &qhwm[qos_sched_calc_qindex(qinfo, subport, pipe, tc, q)];
+		if (unlikely(CMM_LOAD_SHARED(qh->adjust))) {
+			int32_t adjust = uatomic_xchg(&qh->adjust, 0);
+
+			qh->qlen = RTE_MAX(RTE_MIN((int32_t)qh->qlen + adjust,
+						   (int32_t)qh->limit), 0);
+		}
+		if (qh->qlen < qh->limit)
+			qh->qlen++;
+		else
+			tail++;
+		touched[i] = qh;
+	}
+	return tail;
+}
+
+/*
+ * Any drops beyond the tail drops are RED drops, which we can't tell
+ * apart, so charge them to the fullest queue seen as that is the one
+ * most likely to have made them. Fewer drops than expected means our
+ * count of that queue had drifted high. Then raise the high-water marks.
+ */
+static void qos_queue_hwm_update(struct sched_info *qinfo,
+				 struct qos_queue_hwm *touched[],
+				 uint32_t n_pkts, int32_t excess)
+{
+	struct qos_queue_hwm *top = touched[0];
+	uint32_t i;
+
+	for (i = 1; i < n_pkts; i++)
+		if (touched[i]->qlen > top->qlen)
+			top = touched[i];
+
+	if (excess > 0)
+		top->qlen -= RTE_MIN((uint32_t)excess, top->qlen);
+	else
+		top->qlen = RTE_MIN(top->qlen - excess, top->limit);
+
+	for (i = 0; i < n_pkts; i++) {
+		struct qos_queue_hwm *qh = touched[i];
+
+		if (qh->qlen > CMM_LOAD_SHARED(qh->hwm))
+			CMM_STORE_SHARED(qh->hwm, qh->qlen);
+	}
+	if (top->qlen > CMM_LOAD_SHARED(qinfo->port_hwm))
+		CMM_STORE_SHARED(qinfo->port_hwm, top->qlen);
+}
+
+static void qos_queue_hwm_dequeue(struct sched_info *qinfo,
+				  struct rte_sched_port *port,
+				  struct qos_queue_hwm *qhwm,
+				  struct rte_mbuf *pkts[], uint32_t n_pkts)
+{
+	uint32_t i;
+
+	for (i = 0; i < n_pkts; i++) {
+		uint32_t subport, pipe, tc, q;
+		struct qos_queue_hwm *qh;
+
+		rte_sched_port_pkt_read_tree_path(port, pkts[i], &subport,
+						  &pipe, &tc, &q);
+		qh = &qhwm[qos_sched_calc_qindex(qinfo, subport, pipe, tc, q)];
+		if (qh->qlen)
+			qh->qlen--;
+	}
+}
+
 /* Put/get packets currently ready to send from DPDK */
 int qos_sched(struct ifnet *ifp, struct sched_info *qinfo,
 	      struct rte_mbuf *enq_pkts[], uint32_t n_pkts,
@@ -755,6 +1289,9 @@ int qos_sched(struct ifnet *ifp, struct sched_info *qinfo,
 {
 	struct rte_sched_port *port =
 		rcu_dereference(qinfo->dev_info.dpdk.port);
+	struct qos_fq_codel *fqc = rcu_dereference(qinfo->fq_codel);
+	struct qos_queue_hwm *qhwm = rcu_dereference(qinfo->queue_hwm);
+	unsigned int n_deq;
 
 	if (unlikely(port == NULL)) {
 		/* qos not started, because link down or race */
@@ -763,17 +1300,39 @@ int qos_sched(struct ifnet *ifp, struct sched_info *qinfo,
 	}
 
 	if (n_pkts > 0) {
-		n_pkts = qos_classify(ifp, qinfo, enq_pkts, n_pkts);
+		/* packets wait in the queues, so must not pin guest memory */
+		n_pkts = vhost_zero_copy_unpin_bulk(enq_pkts, n_pkts);
+		n_pkts = qos_classify(ifp, qinfo, enq_pkts, n_pkts,
+				      fqc ? rte_rdtsc() : 0);
 
 		/*
 		 * In case we've dropped the packets whilst policing
 		 */
-		if (n_pkts)
-			rte_sched_port_enqueue(port, enq_pkts, n_pkts);
+		if (n_pkts) {
+			struct qos_queue_hwm *touched[n_pkts];
+			uint32_t tail = 0, n_enq;
+
+			if (qhwm)
+				tail = qos_queue_hwm_enqueue(qinfo, port, qhwm,
+							     enq_pkts, n_pkts,
+							     touched);
+			n_enq = rte_sched_port_enqueue(port, enq_pkts, n_pkts);
+			if (qhwm)
+				qos_queue_hwm_update(qinfo, touched, n_pkts,
+						     (int32_t)(n_pkts - n_enq) -
+						     (int32_t)tail);
+		}
 	}
 
 	/* Get what is available to send */
-	if (space > 0)
-		return rte_sched_port_dequeue(port, deq_pkts, space);
-	return 0;
+	if (space == 0)
+		return 0;
+
+	n_deq = rte_sched_port_dequeue(port, deq_pkts, space);
+	if (qhwm)
+		qos_queue_hwm_dequeue(qinfo, port, qhwm, deq_pkts, n_deq);
+	if (unlikely(fqc != NULL) && n_deq)
+		n_deq = qos_fq_codel_dequeue(qinfo, port, fqc, deq_pkts,
+					     n_deq);
+	return n_deq;
 }
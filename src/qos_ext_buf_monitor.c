@@ -34,6 +34,7 @@ struct qos_ext_buf_notification_set {
 
 struct qos_external_buffer_congest_stats buf_stats;
 static struct rte_timer qos_external_buf_timer;
+static struct rte_timer qos_sw_buf_timer;
 
 static const struct qos_ext_buf_notification_set
 notifi_mode_set[EXT_BUF_EVT_NOTIFY_MODE_NUM] = {
@@ -390,12 +391,29 @@ qos_external_buffer_congestion_tmr_hdlr(struct rte_timer *tim __rte_unused,
 		values[FAL_QOS_EXTERNAL_BUFFER_PKT_REJECT]);
 }
 
+/*
+ * Software scheduled ports keep their own high-water marks as packets
+ * are enqueued; sample them on the same interval as the external buffer.
+ */
+static void
+qos_sw_buf_tmr_hdlr(struct rte_timer *tim __rte_unused,
+	void *arg __rte_unused)
+{
+	qos_sw_buf_sample();
+}
+
 void
 qos_external_buf_monitor_init(void)
 {
 	int ret;
 	struct fal_attribute_t max_buffers;
 
+	rte_timer_init(&qos_sw_buf_timer);
+	rte_timer_reset(&qos_sw_buf_timer,
+		EXT_BUF_STATUS_SAMPLE_INTERVAL * rte_get_timer_hz(),
+		PERIODICAL, rte_get_master_lcore(),
+		qos_sw_buf_tmr_hdlr, NULL);
+
 	if (!fal_plugins_present()) {
 		DP_DEBUG(QOS, DEBUG, DATAPLANE,
 			"FAL plugins not present, external buffer monitor init failed.");
@@ -1012,7 +1012,15 @@ qos_hw_process_queue_stats(struct sched_info *qinfo, uint32_t subport,
 		 * in question.
 		 */
 		qid = qos_sched_calc_qindex(qinfo, subport, pipe, tc, q);
-		queue_stats = qinfo->queue_stats + qid;
+		queue_stats = qos_sched_queue_stats_find(qinfo, qid);
+		if (!queue_stats) {
+			/* Nothing to add from a pipe that has never been used */
+			if (!(values[0] | values[1] | values[2] | values[3]))
+				return 0;
+			queue_stats = qos_sched_queue_stats(qinfo, qid);
+			if (!queue_stats)
+				return -ENOMEM;
+		}
 
 		/*
 		 * Every time we read the FAL's queue counters, we just get
@@ -1275,12 +1283,18 @@ int qos_hw_queue_clear_stats(struct sched_info *qinfo, uint32_t subport,
 			    uint32_t pipe, uint32_t tc, uint32_t q)
 {
 	uint32_t qid = qos_sched_calc_qindex(qinfo, subport, pipe, tc, q);
-	struct queue_stats *queue_stats = qinfo->queue_stats + qid;
+	struct queue_stats *queue_stats =
+		qos_sched_queue_stats_find(qinfo, qid);
+	struct queue_stats unused = { 0 };
 	bool qlen_in_pkts;
 	uint64_t qlen;
 	uint32_t i;
 	int rv;
 
+	/* Whatever a never used pipe has counted since is cleared with it */
+	if (!queue_stats)
+		queue_stats = &unused;
+
 	rv = qos_hw_queue_read_stats(qinfo, subport, pipe, tc, q, queue_stats,
 				     &qlen, &qlen_in_pkts);
 	if (!rv) {
@@ -2648,10 +2662,9 @@ qos_hw_new_subport(uint32_t subport_id, fal_object_t port_sched_obj,
 
 	qos_obj_db_sw_set(db_obj, QOS_OBJ_SW_STATE_HW_PROG_IN_PROGRESS);
 
-	for (pipe_id = 0; pipe_id < MAX_PIPES; pipe_id++) {
-		if (sinfo->pipe_configured[pipe_id])
-			pipe_count++;
-	}
+	for (pipe_id = 0; pipe_id < MAX_PIPES / 64; pipe_id++)
+		pipe_count += __builtin_popcountll(
+			sinfo->pipe_configured[pipe_id]);
 
 	ret = qos_hw_create_group_and_sched(db_obj, subport_id, port_sched_obj,
 					    FAL_QOS_SCHED_GROUP_LEVEL_SUBPORT,
@@ -2663,7 +2676,7 @@ qos_hw_new_subport(uint32_t subport_id, fal_object_t port_sched_obj,
 					    INGRESS_DESIGNATORS);
 
 	for (pipe_id = 0; !ret && pipe_id < MAX_PIPES; pipe_id++) {
-		if (sinfo->pipe_configured[pipe_id]) {
+		if (qos_pipe_configured(sinfo, pipe_id)) {
 			uint8_t profile_id = sinfo->profile_map[pipe_id];
 			struct qos_pipe_params *pipe_params =
 				qinfo->port_params.pipe_profiles + profile_id;
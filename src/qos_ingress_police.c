@@ -0,0 +1,992 @@
+/*
+ * Copyright (c) 2021, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * Ingress policing of subscribers, ahead of the firewall and NAT.
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/ip.h>
+#include <netinet/ip6.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <rte_branch_prediction.h>
+#include <rte_common.h>
+#include <rte_cycles.h>
+#include <rte_ether.h>
+#include <rte_jhash.h>
+#include <rte_log.h>
+#include <rte_malloc.h>
+#include <rte_mbuf.h>
+#include <urcu/uatomic.h>
+
+#include "compiler.h"
+#include "dp_event.h"
+#include "if_var.h"
+#include "in_cksum.h"
+#include "ip_funcs.h"
+#include "json_writer.h"
+#include "lcore_sched.h"
+#include "netinet6/ip6_funcs.h"
+#include "pipeline/nodes/pl_nodes_common.h"
+#include "pktmbuf_internal.h"
+#include "pl_node.h"
+#include "qos_ingress_police.h"
+#include "urcu.h"
+#include "util.h"
+#include "vplane_debug.h"
+#include "vplane_log.h"
+
+/* Buckets are kept in cycles, fixed point with this shift */
+#define QOS_IPOL_SHIFT 16
+
+/*
+ * A forwarding thread takes credit from a shared bucket in chunks of
+ * this fraction of the burst, so that the shared state is only written
+ * once every few packets. Credit it hasn't spent by the time the chunk
+ * would have taken to refill at the rate is forfeited, so that threads
+ * that go idle can't hold on to it and later exceed the burst together.
+ */
+#define QOS_IPOL_CHUNK_SHIFT 4
+
+#define QOS_IPOL_HASH_MIN 8
+#define QOS_IPOL_HASH_MAX 0	/* unlimited */
+
+enum qos_ipol_colour {
+	QOS_IPOL_GREEN,
+	QOS_IPOL_YELLOW,
+	QOS_IPOL_RED,
+	QOS_IPOL_COLOURS
+};
+
+static const char * const qos_ipol_colour_names[QOS_IPOL_COLOURS] = {
+	[QOS_IPOL_GREEN] = "green",
+	[QOS_IPOL_YELLOW] = "yellow",
+	[QOS_IPOL_RED] = "red",
+};
+
+enum qos_ipol_bkt {
+	QOS_IPOL_CBKT,		/* committed */
+	QOS_IPOL_PBKT,		/* peak */
+	QOS_IPOL_BKTS
+};
+
+/* Rates in bytes per second, bursts in bytes */
+struct qos_ipol_params {
+	uint64_t	cir;
+	uint64_t	cbs;
+	uint64_t	pir;	/* 0 for a single rate meter */
+	uint64_t	pbs;
+};
+
+/*
+ * Virtual scheduling token bucket shared by all forwarding threads,
+ * tat being the time at which it would next be full.
+ */
+struct qos_ipol_bucket {
+	uint64_t	tat;
+	uint64_t	cycles_per_byte;	/* << QOS_IPOL_SHIFT */
+	uint64_t	burst_cycles;
+	uint64_t	chunk_cycles;
+	uint32_t	chunk;
+} __rte_cache_aligned;
+
+/* Bytes taken from a shared bucket, to be spent by the expiry time */
+struct qos_ipol_credit {
+	uint64_t	bytes;
+	uint64_t	expiry;
+};
+
+/* Credit taken from the shared buckets, and the results, per thread */
+struct qos_ipol_lcore {
+	struct qos_ipol_credit	credit[QOS_IPOL_BKTS];
+	uint64_t	pkts[QOS_IPOL_COLOURS];
+	uint64_t	bytes[QOS_IPOL_COLOURS];
+} __rte_cache_aligned;
+
+struct qos_ipol_meter {
+	struct qos_ipol_params	params;
+	struct qos_ipol_bucket	bkt[QOS_IPOL_BKTS];
+	struct qos_ipol_lcore	*lc;		/* by dp_lcore_id() */
+	uint64_t		pkts_base[QOS_IPOL_COLOURS];
+	uint64_t		bytes_base[QOS_IPOL_COLOURS];
+	struct rcu_head		rcu;
+};
+
+struct qos_ipol_key {
+	uint8_t		v6;
+	uint8_t		plen;
+	uint8_t		pad[2];
+	uint8_t		addr[16];	/* masked to plen */
+};
+
+struct qos_ipol_sub {
+	struct cds_lfht_node	node;
+	struct qos_ipol_key	key;
+	struct qos_ipol_meter	meter;
+};
+
+#define QOS_IPOL_PLEN_WORDS ((128 + 1 + 63) / 64)
+
+struct qos_ipol_if {
+	struct ifnet		*ifp;
+	struct qos_ipol_meter	*aggregate;
+	struct cds_lfht		*subs;
+	int			yellow_dscp;	/* -1 if not remarked */
+	bool			colour_aware;
+	bool			feat;
+	uint32_t		n_subs;
+	/* subscriber prefix lengths in use, read by the forwarding path */
+	uint64_t		plen_map[2][QOS_IPOL_PLEN_WORDS];
+	uint32_t		plen_refs[2][128 + 1];
+};
+
+/*
+ * Meters
+ */
+
+static void
+qos_ipol_bucket_set(struct qos_ipol_bucket *b, uint64_t rate, uint64_t burst)
+{
+	uint64_t hz = rte_get_tsc_hz();
+	uint64_t cpb, chunk;
+
+	rate = RTE_MAX(rate, 1ul);
+	burst = RTE_MAX(burst, (uint64_t)RTE_ETHER_MAX_LEN);
+	cpb = (hz << QOS_IPOL_SHIFT) / rate;
+	chunk = RTE_MAX(burst >> QOS_IPOL_CHUNK_SHIFT,
+			(uint64_t)RTE_ETHER_MAX_LEN);
+
+	/* May change under the forwarding threads, each field is consistent */
+	CMM_STORE_SHARED(b->cycles_per_byte, cpb);
+	CMM_STORE_SHARED(b->burst_cycles, (burst * cpb) >> QOS_IPOL_SHIFT);
+	CMM_STORE_SHARED(b->chunk_cycles, (chunk * cpb) >> QOS_IPOL_SHIFT);
+	CMM_STORE_SHARED(b->chunk, chunk);
+}
+
+static void
+qos_ipol_meter_set(struct qos_ipol_meter *meter,
+		   struct qos_ipol_params const *params)
+{
+	meter->params = *params;
+	qos_ipol_bucket_set(&meter->bkt[QOS_IPOL_CBKT],
+			    params->cir, params->cbs);
+	if (params->pir)
+		qos_ipol_bucket_set(&meter->bkt[QOS_IPOL_PBKT],
+				    params->pir, params->pbs);
+}
+
+static int
+qos_ipol_meter_init(struct qos_ipol_meter *meter,
+		    struct qos_ipol_params const *params)
+{
+	memset(meter, 0, sizeof(*meter));
+	meter->lc = rte_zmalloc("qos_ipol",
+				(get_lcore_max() + 1) *
+				sizeof(struct qos_ipol_lcore),
+				RTE_CACHE_LINE_SIZE);
+	if (!meter->lc)
+		return -ENOMEM;
+
+	qos_ipol_meter_set(meter, params);
+	return 0;
+}
+
+static void
+qos_ipol_meter_uninit(struct qos_ipol_meter *meter)
+{
+	rte_free(meter->lc);
+}
+
+/* Take n bytes of credit from a shared bucket */
+static bool
+qos_ipol_bucket_draw(struct qos_ipol_bucket *b, uint64_t n, uint64_t now)
+{
+	uint64_t cost = (n * CMM_LOAD_SHARED(b->cycles_per_byte)) >>
+		QOS_IPOL_SHIFT;
+	uint64_t burst = CMM_LOAD_SHARED(b->burst_cycles);
+	uint64_t tat = CMM_LOAD_SHARED(b->tat);
+	uint64_t start, old;
+
+	for (;;) {
+		start = RTE_MAX(tat, now);
+		if (start + cost - now > burst)
+			return false;
+
+		old = uatomic_cmpxchg(&b->tat, tat, start + cost);
+		if (old == tat)
+			return true;
+		tat = old;
+	}
+}
+
+/*
+ * Take len bytes from this thread's credit, topping it up from the
+ * shared bucket a chunk at a time. When a whole chunk isn't available
+ * try for just what is missing, so that the full burst can be used.
+ * The credit left over is never more than a chunk.
+ */
+static bool
+qos_ipol_take(struct qos_ipol_bucket *b, struct qos_ipol_credit *credit,
+	      uint32_t len, uint64_t now)
+{
+	uint64_t need, chunk;
+
+	if (unlikely(now >= credit->expiry))
+		credit->bytes = 0;
+
+	if (likely(credit->bytes >= len)) {
+		credit->bytes -= len;
+		return true;
+	}
+
+	need = len - credit->bytes;
+	chunk = RTE_MAX(need, (uint64_t)CMM_LOAD_SHARED(b->chunk));
+	if (qos_ipol_bucket_draw(b, chunk, now)) {
+		credit->bytes += chunk - len;
+		credit->expiry = now + CMM_LOAD_SHARED(b->chunk_cycles);
+		return true;
+	}
+
+	if (qos_ipol_bucket_draw(b, need, now)) {
+		credit->bytes = 0;
+		return true;
+	}
+
+	return false;
+}
+
+/*
+ * RFC 2698 two rate three colour marker, colour aware when given a
+ * yellow packet. Without a peak rate it is a two colour marker.
+ */
+static enum qos_ipol_colour
+qos_ipol_meter(struct qos_ipol_meter *meter, enum qos_ipol_colour colour,
+	       uint32_t len, uint64_t now)
+{
+	struct qos_ipol_lcore *lc = &meter->lc[dp_lcore_id()];
+
+	if (meter->params.pir) {
+		if (!qos_ipol_take(&meter->bkt[QOS_IPOL_PBKT],
+				   &lc->credit[QOS_IPOL_PBKT], len, now))
+			colour = QOS_IPOL_RED;
+		else if (colour == QOS_IPOL_GREEN &&
+			 !qos_ipol_take(&meter->bkt[QOS_IPOL_CBKT],
+					&lc->credit[QOS_IPOL_CBKT], len, now))
+			colour = QOS_IPOL_YELLOW;
+	} else if (!qos_ipol_take(&meter->bkt[QOS_IPOL_CBKT],
+				  &lc->credit[QOS_IPOL_CBKT], len, now)) {
+		colour = QOS_IPOL_RED;
+	}
+
+	lc->pkts[colour]++;
+	lc->bytes[colour] += len;
+	return colour;
+}
+
+static void
+qos_ipol_meter_read(struct qos_ipol_meter const *meter,
+		    uint64_t pkts[QOS_IPOL_COLOURS],
+		    uint64_t bytes[QOS_IPOL_COLOURS])
+{
+	unsigned int lcore, c;
+
+	for (c = 0; c < QOS_IPOL_COLOURS; c++) {
+		pkts[c] = 0;
+		bytes[c] = 0;
+	}
+
+	FOREACH_DP_LCORE(lcore) {
+		for (c = 0; c < QOS_IPOL_COLOURS; c++) {
+			pkts[c] += CMM_LOAD_SHARED(meter->lc[lcore].pkts[c]);
+			bytes[c] += CMM_LOAD_SHARED(meter->lc[lcore].bytes[c]);
+		}
+	}
+}
+
+static void
+qos_ipol_meter_clear(struct qos_ipol_meter *meter)
+{
+	qos_ipol_meter_read(meter, meter->pkts_base, meter->bytes_base);
+}
+
+/*
+ * Subscribers
+ */
+
+static void
+qos_ipol_key_init(struct qos_ipol_key *key, bool v6, uint8_t plen,
+		  const void *addr)
+{
+	unsigned int i;
+
+	memset(key, 0, sizeof(*key));
+	key->v6 = v6;
+	key->plen = plen;
+	memcpy(key->addr, addr, v6 ? 16 : 4);
+
+	for (i = 0; i < 16; i++) {
+		if (plen >= 8) {
+			plen -= 8;
+			continue;
+		}
+		key->addr[i] &= (uint8_t)(0xff00 >> plen);
+		plen = 0;
+	}
+}
+
+static unsigned long
+qos_ipol_key_hash(struct qos_ipol_key const *key)
+{
+	return rte_jhash(key, sizeof(*key), 0);
+}
+
+static int
+qos_ipol_sub_match(struct cds_lfht_node *node, const void *arg)
+{
+	struct qos_ipol_sub const *sub =
+		caa_container_of(node, struct qos_ipol_sub, node);
+
+	return !memcmp(&sub->key, arg, sizeof(sub->key));
+}
+
+static struct qos_ipol_sub *
+qos_ipol_sub_lookup(struct qos_ipol_if const *ipi,
+		    struct qos_ipol_key const *key)
+{
+	struct cds_lfht_iter iter;
+	struct cds_lfht_node *node;
+
+	cds_lfht_lookup(ipi->subs, qos_ipol_key_hash(key),
+			qos_ipol_sub_match, key, &iter);
+	node = cds_lfht_iter_get_node(&iter);
+
+	return node ? caa_container_of(node, struct qos_ipol_sub, node) : NULL;
+}
+
+/* Longest configured prefix matching the source address */
+static struct qos_ipol_sub *
+qos_ipol_sub_find(struct qos_ipol_if const *ipi, bool v6, const void *src)
+{
+	struct qos_ipol_key key;
+	struct qos_ipol_sub *sub;
+	unsigned int word;
+	uint64_t map;
+	int plen;
+
+	for (word = QOS_IPOL_PLEN_WORDS; word-- > 0; ) {
+		map = CMM_LOAD_SHARED(ipi->plen_map[v6][word]);
+		while (map) {
+			plen = 63 - __builtin_clzll(map);
+			map &= ~(1ull << plen);
+
+			qos_ipol_key_init(&key, v6, word * 64 + plen, src);
+			sub = qos_ipol_sub_lookup(ipi, &key);
+			if (sub)
+				return sub;
+		}
+	}
+
+	return NULL;
+}
+
+static void
+qos_ipol_sub_free(struct rcu_head *head)
+{
+	struct qos_ipol_sub *sub =
+		caa_container_of(head, struct qos_ipol_sub, meter.rcu);
+
+	qos_ipol_meter_uninit(&sub->meter);
+	free(sub);
+}
+
+static void
+qos_ipol_plen_ref(struct qos_ipol_if *ipi, struct qos_ipol_key const *key,
+		  bool add)
+{
+	uint32_t *refs = &ipi->plen_refs[key->v6][key->plen];
+	uint64_t *word = &ipi->plen_map[key->v6][key->plen / 64];
+	uint64_t bit = 1ull << (key->plen % 64);
+
+	if (add && (*refs)++ == 0)
+		CMM_STORE_SHARED(*word, *word | bit);
+	else if (!add && --(*refs) == 0)
+		CMM_STORE_SHARED(*word, *word & ~bit);
+}
+
+static void
+qos_ipol_sub_del(struct qos_ipol_if *ipi, struct qos_ipol_sub *sub)
+{
+	cds_lfht_del(ipi->subs, &sub->node);
+	qos_ipol_plen_ref(ipi, &sub->key, false);
+	CMM_STORE_SHARED(ipi->n_subs, ipi->n_subs - 1);
+	call_rcu(&sub->meter.rcu, qos_ipol_sub_free);
+}
+
+/*
+ * Interface state
+ */
+
+static void
+qos_ipol_if_feat(struct qos_ipol_if *ipi, bool active)
+{
+	if (active == ipi->feat)
+		return;
+
+	if (active) {
+		pl_node_add_feature_by_inst(&ipv4_ingress_police_feat,
+					    ipi->ifp);
+		pl_node_add_feature_by_inst(&ipv6_ingress_police_feat,
+					    ipi->ifp);
+	} else {
+		pl_node_remove_feature_by_inst(&ipv4_ingress_police_feat,
+					       ipi->ifp);
+		pl_node_remove_feature_by_inst(&ipv6_ingress_police_feat,
+					       ipi->ifp);
+	}
+	ipi->feat = active;
+}
+
+/* Only apply the features while there is something to police */
+static void
+qos_ipol_if_update(struct qos_ipol_if *ipi)
+{
+	qos_ipol_if_feat(ipi, ipi->aggregate || ipi->n_subs);
+}
+
+static struct qos_ipol_if *
+qos_ipol_if_get(struct ifnet *ifp)
+{
+	struct qos_ipol_if *ipi = ifp->if_qos_ipol;
+
+	if (ipi)
+		return ipi;
+
+	ipi = calloc(1, sizeof(*ipi));
+	if (!ipi)
+		return NULL;
+
+	ipi->subs = cds_lfht_new(QOS_IPOL_HASH_MIN, QOS_IPOL_HASH_MIN,
+				 QOS_IPOL_HASH_MAX,
+				 CDS_LFHT_AUTO_RESIZE | CDS_LFHT_ACCOUNTING,
+				 NULL);
+	if (!ipi->subs) {
+		free(ipi);
+		return NULL;
+	}
+	ipi->ifp = ifp;
+	ipi->yellow_dscp = -1;
+
+	rcu_assign_pointer(ifp->if_qos_ipol, ipi);
+	return ipi;
+}
+
+static void
+qos_ipol_aggregate_free(struct rcu_head *head)
+{
+	struct qos_ipol_meter *meter =
+		caa_container_of(head, struct qos_ipol_meter, rcu);
+
+	qos_ipol_meter_uninit(meter);
+	free(meter);
+}
+
+/* Called once no forwarding thread can see the interface state */
+static void
+qos_ipol_if_free(void *arg)
+{
+	struct qos_ipol_if *ipi = arg;
+	struct cds_lfht_iter iter;
+	struct qos_ipol_sub *sub;
+
+	cds_lfht_for_each_entry(ipi->subs, &iter, sub, node) {
+		cds_lfht_del(ipi->subs, &sub->node);
+		qos_ipol_meter_uninit(&sub->meter);
+		free(sub);
+	}
+	cds_lfht_destroy(ipi->subs, NULL);
+
+	if (ipi->aggregate) {
+		qos_ipol_meter_uninit(ipi->aggregate);
+		free(ipi->aggregate);
+	}
+	free(ipi);
+}
+
+static void
+qos_ipol_if_delete(struct ifnet *ifp)
+{
+	struct qos_ipol_if *ipi = ifp->if_qos_ipol;
+
+	if (!ipi)
+		return;
+
+	qos_ipol_if_feat(ipi, false);
+
+	rcu_assign_pointer(ifp->if_qos_ipol, NULL);
+	defer_rcu(qos_ipol_if_free, ipi);
+}
+
+/*
+ * Forwarding path
+ */
+
+static void
+qos_ipol_remark(struct rte_mbuf **m, bool v6, uint8_t dscp)
+{
+	if (pktmbuf_prepare_for_header_change(m, dp_pktmbuf_l2_len(*m) +
+					      (v6 ? sizeof(struct ip6_hdr) :
+					       sizeof(struct iphdr))))
+		return;
+
+	if (v6) {
+		struct ip6_hdr *ip6 = ip6hdr(*m);
+		uint32_t flow = ntohl(ip6->ip6_flow) & 0xF03FFFFF;
+
+		ip6->ip6_flow = htonl(flow | (0x0FC00000 & (dscp << 22)));
+	} else {
+		struct iphdr *ip = iphdr(*m);
+		uint16_t old = *(uint16_t *)ip;
+
+		ip_dscp_set(dscp << 2, ip);
+		ip->check = ip_fixup16_cksum(ip->check, old, *(uint16_t *)ip);
+	}
+}
+
+bool
+qos_ingress_police_input(struct ifnet *ifp, struct rte_mbuf **m, bool v6)
+{
+	struct qos_ipol_if *ipi = rcu_dereference(ifp->if_qos_ipol);
+	enum qos_ipol_colour colour = QOS_IPOL_GREEN;
+	struct qos_ipol_meter *aggregate;
+	struct qos_ipol_sub *sub = NULL;
+	uint64_t now;
+	uint32_t len;
+	uint8_t dscp;
+	int yellow;
+
+	if (unlikely(!ipi))
+		return true;
+
+	if (v6) {
+		struct ip6_hdr *ip6 = ip6hdr(*m);
+
+		dscp = ip6_dscp_get(ip6);
+		if (CMM_LOAD_SHARED(ipi->n_subs))
+			sub = qos_ipol_sub_find(ipi, true, &ip6->ip6_src);
+	} else {
+		struct iphdr *ip = iphdr(*m);
+
+		dscp = ip_dscp_get(ip);
+		if (CMM_LOAD_SHARED(ipi->n_subs))
+			sub = qos_ipol_sub_find(ipi, false, &ip->saddr);
+	}
+
+	yellow = CMM_LOAD_SHARED(ipi->yellow_dscp);
+	if (CMM_LOAD_SHARED(ipi->colour_aware) && dscp == yellow)
+		colour = QOS_IPOL_YELLOW;
+
+	len = rte_pktmbuf_pkt_len(*m) - dp_pktmbuf_l2_len(*m);
+	now = rte_rdtsc();
+
+	if (sub)
+		colour = qos_ipol_meter(&sub->meter, colour, len, now);
+
+	aggregate = rcu_dereference(ipi->aggregate);
+	if (aggregate && colour != QOS_IPOL_RED)
+		colour = qos_ipol_meter(aggregate, colour, len, now);
+
+	if (colour == QOS_IPOL_RED)
+		return false;
+
+	if (colour == QOS_IPOL_YELLOW && yellow >= 0 && dscp != yellow)
+		qos_ipol_remark(m, v6, yellow);
+
+	return true;
+}
+
+/*
+ * Configuration
+ *
+ * qos <ifname> ingress-police aggregate <cir> <cbs> [<pir> <pbs>]
+ * qos <ifname> ingress-police aggregate delete
+ * qos <ifname> ingress-police subscriber <prefix> <cir> <cbs> [<pir> <pbs>]
+ * qos <ifname> ingress-police subscriber <prefix> delete
+ * qos <ifname> ingress-police yellow-dscp <0..63>|none
+ * qos <ifname> ingress-police colour-aware on|off
+ * qos <ifname> ingress-police delete
+ *
+ * Rates are in bytes per second and bursts in bytes.
+ */
+
+static int
+qos_ipol_parse_params(int argc, char **argv, struct qos_ipol_params *params)
+{
+	unsigned long val[4] = { 0, 0, 0, 0 };
+	int i;
+
+	if (argc != 2 && argc != 4)
+		return -EINVAL;
+
+	for (i = 0; i < argc; i++)
+		if (get_unsigned_long(argv[i], &val[i]) < 0)
+			return -EINVAL;
+
+	params->cir = val[0];
+	params->cbs = val[1];
+	params->pir = val[2];
+	params->pbs = val[3];
+
+	if (!params->cir || !params->cbs)
+		return -EINVAL;
+	if (argc == 4 && (params->pir < params->cir || !params->pbs))
+		return -EINVAL;
+
+	return 0;
+}
+
+static int
+qos_ipol_parse_prefix(const char *str, struct qos_ipol_key *key)
+{
+	char addrstr[INET6_ADDRSTRLEN];
+	uint8_t addr[16];
+	unsigned int plen;
+	const char *slash;
+	bool v6;
+
+	slash = strchr(str, '/');
+	if (!slash || (size_t)(slash - str) >= sizeof(addrstr))
+		return -EINVAL;
+	memcpy(addrstr, str, slash - str);
+	addrstr[slash - str] = '\0';
+
+	if (inet_pton(AF_INET, addrstr, addr) == 1)
+		v6 = false;
+	else if (inet_pton(AF_INET6, addrstr, addr) == 1)
+		v6 = true;
+	else
+		return -EINVAL;
+
+	if (get_unsigned(slash + 1, &plen) < 0 || plen > (v6 ? 128u : 32u))
+		return -EINVAL;
+
+	qos_ipol_key_init(key, v6, plen, addr);
+	return 0;
+}
+
+static int
+cmd_qos_ipol_aggregate(struct ifnet *ifp, int argc, char **argv)
+{
+	struct qos_ipol_if *ipi = ifp->if_qos_ipol;
+	struct qos_ipol_params params;
+	struct qos_ipol_meter *meter;
+
+	if (argc == 1 && !strcmp(argv[0], "delete")) {
+		meter = ipi ? ipi->aggregate : NULL;
+		if (!meter)
+			return 0;
+		rcu_assign_pointer(ipi->aggregate, NULL);
+		qos_ipol_if_update(ipi);
+		call_rcu(&meter->rcu, qos_ipol_aggregate_free);
+		return 0;
+	}
+
+	if (qos_ipol_parse_params(argc, argv, &params) < 0)
+		return -EINVAL;
+
+	ipi = qos_ipol_if_get(ifp);
+	if (!ipi)
+		return -ENOMEM;
+
+	meter = ipi->aggregate;
+	if (meter) {
+		qos_ipol_meter_set(meter, &params);
+		return 0;
+	}
+
+	meter = malloc(sizeof(*meter));
+	if (!meter || qos_ipol_meter_init(meter, &params) < 0) {
+		free(meter);
+		return -ENOMEM;
+	}
+
+	rcu_assign_pointer(ipi->aggregate, meter);
+	qos_ipol_if_update(ipi);
+	return 0;
+}
+
+static int
+cmd_qos_ipol_subscriber(struct ifnet *ifp, int argc, char **argv)
+{
+	struct qos_ipol_if *ipi = ifp->if_qos_ipol;
+	struct qos_ipol_params params;
+	struct qos_ipol_key key;
+	struct qos_ipol_sub *sub;
+
+	if (argc < 2 || qos_ipol_parse_prefix(argv[0], &key) < 0)
+		return -EINVAL;
+
+	if (argc == 2 && !strcmp(argv[1], "delete")) {
+		sub = ipi ? qos_ipol_sub_lookup(ipi, &key) : NULL;
+		if (sub) {
+			qos_ipol_sub_del(ipi, sub);
+			qos_ipol_if_update(ipi);
+		}
+		return 0;
+	}
+
+	if (qos_ipol_parse_params(argc - 1, argv + 1, &params) < 0)
+		return -EINVAL;
+
+	ipi = qos_ipol_if_get(ifp);
+	if (!ipi)
+		return -ENOMEM;
+
+	sub = qos_ipol_sub_lookup(ipi, &key);
+	if (sub) {
+		qos_ipol_meter_set(&sub->meter, &params);
+		return 0;
+	}
+
+	sub = malloc(sizeof(*sub));
+	if (!sub || qos_ipol_meter_init(&sub->meter, &params) < 0) {
+		free(sub);
+		return -ENOMEM;
+	}
+	sub->key = key;
+	cds_lfht_node_init(&sub->node);
+	cds_lfht_add(ipi->subs, qos_ipol_key_hash(&key), &sub->node);
+
+	qos_ipol_plen_ref(ipi, &key, true);
+	CMM_STORE_SHARED(ipi->n_subs, ipi->n_subs + 1);
+	qos_ipol_if_update(ipi);
+	return 0;
+}
+
+static int
+cmd_qos_ipol_yellow_dscp(struct ifnet *ifp, const char *arg)
+{
+	struct qos_ipol_if *ipi;
+	unsigned int dscp;
+	int yellow;
+
+	if (!strcmp(arg, "none"))
+		yellow = -1;
+	else if (get_unsigned(arg, &dscp) == 0 && dscp < 64)
+		yellow = dscp;
+	else
+		return -EINVAL;
+
+	ipi = qos_ipol_if_get(ifp);
+	if (!ipi)
+		return -ENOMEM;
+
+	CMM_STORE_SHARED(ipi->yellow_dscp, yellow);
+	return 0;
+}
+
+static int
+cmd_qos_ipol_colour_aware(struct ifnet *ifp, const char *arg)
+{
+	struct qos_ipol_if *ipi;
+	bool on;
+
+	if (!strcmp(arg, "on"))
+		on = true;
+	else if (!strcmp(arg, "off"))
+		on = false;
+	else
+		return -EINVAL;
+
+	ipi = qos_ipol_if_get(ifp);
+	if (!ipi)
+		return -ENOMEM;
+
+	CMM_STORE_SHARED(ipi->colour_aware, on);
+	return 0;
+}
+
+/*
+ * Each command is parsed and checked before the interface state is
+ * created, so that a bad command leaves nothing behind.
+ */
+int cmd_qos_ingress_police(struct ifnet *ifp, int argc, char **argv)
+{
+	int rv = -EINVAL;
+
+	--argc, ++argv; /* skip "ingress-police" */
+	if (argc < 1)
+		goto usage;
+
+	if (!strcmp(argv[0], "delete")) {
+		qos_ipol_if_delete(ifp);
+		return 0;
+	}
+
+	if (!strcmp(argv[0], "aggregate"))
+		rv = cmd_qos_ipol_aggregate(ifp, argc - 1, argv + 1);
+	else if (!strcmp(argv[0], "subscriber"))
+		rv = cmd_qos_ipol_subscriber(ifp, argc - 1, argv + 1);
+	else if (argc == 2 && !strcmp(argv[0], "yellow-dscp"))
+		rv = cmd_qos_ipol_yellow_dscp(ifp, argv[1]);
+	else if (argc == 2 && !strcmp(argv[0], "colour-aware"))
+		rv = cmd_qos_ipol_colour_aware(ifp, argv[1]);
+
+	if (rv != -EINVAL)
+		return rv;
+usage:
+	DP_DEBUG(QOS, ERR, DATAPLANE,
+		 "usage: qos <ifname> ingress-police "
+		 "aggregate|subscriber|yellow-dscp|colour-aware|delete ...\n");
+	return rv;
+}
+
+/*
+ * Op-mode
+ *
+ * qos ingress-police show [<ifname>]
+ * qos ingress-police clear [<ifname>]
+ */
+
+static void
+qos_ipol_meter_show(json_writer_t *wr, struct qos_ipol_meter const *meter)
+{
+	uint64_t pkts[QOS_IPOL_COLOURS], bytes[QOS_IPOL_COLOURS];
+	unsigned int c;
+	char name[16];
+
+	qos_ipol_meter_read(meter, pkts, bytes);
+
+	jsonw_uint_field(wr, "cir", meter->params.cir);
+	jsonw_uint_field(wr, "cbs", meter->params.cbs);
+	if (meter->params.pir) {
+		jsonw_uint_field(wr, "pir", meter->params.pir);
+		jsonw_uint_field(wr, "pbs", meter->params.pbs);
+	}
+	for (c = 0; c < QOS_IPOL_COLOURS; c++) {
+		snprintf(name, sizeof(name), "%s-packets",
+			 qos_ipol_colour_names[c]);
+		jsonw_uint_field(wr, name, pkts[c] - meter->pkts_base[c]);
+		snprintf(name, sizeof(name), "%s-bytes",
+			 qos_ipol_colour_names[c]);
+		jsonw_uint_field(wr, name, bytes[c] - meter->bytes_base[c]);
+	}
+}
+
+static void
+qos_ipol_if_show(struct ifnet *ifp, void *arg)
+{
+	struct qos_ipol_if *ipi = ifp->if_qos_ipol;
+	char buf[INET6_ADDRSTRLEN + 5];
+	json_writer_t *wr = arg;
+	struct cds_lfht_iter iter;
+	struct qos_ipol_sub *sub;
+	size_t len;
+
+	if (!ipi)
+		return;
+
+	jsonw_start_object(wr);
+	jsonw_string_field(wr, "ifname", ifp->if_name);
+	jsonw_bool_field(wr, "colour-aware", ipi->colour_aware);
+	if (ipi->yellow_dscp >= 0)
+		jsonw_uint_field(wr, "yellow-dscp", ipi->yellow_dscp);
+
+	if (ipi->aggregate) {
+		jsonw_name(wr, "aggregate");
+		jsonw_start_object(wr);
+		qos_ipol_meter_show(wr, ipi->aggregate);
+		jsonw_end_object(wr);
+	}
+
+	jsonw_name(wr, "subscribers");
+	jsonw_start_array(wr);
+	cds_lfht_for_each_entry(ipi->subs, &iter, sub, node) {
+		inet_ntop(sub->key.v6 ? AF_INET6 : AF_INET, sub->key.addr,
+			  buf, sizeof(buf));
+		len = strlen(buf);
+		snprintf(buf + len, sizeof(buf) - len, "/%u", sub->key.plen);
+
+		jsonw_start_object(wr);
+		jsonw_string_field(wr, "prefix", buf);
+		qos_ipol_meter_show(wr, &sub->meter);
+		jsonw_end_object(wr);
+	}
+	jsonw_end_array(wr);
+
+	jsonw_end_object(wr);
+}
+
+static void
+qos_ipol_if_clear(struct ifnet *ifp, void *arg __unused)
+{
+	struct qos_ipol_if *ipi = ifp->if_qos_ipol;
+	struct cds_lfht_iter iter;
+	struct qos_ipol_sub *sub;
+
+	if (!ipi)
+		return;
+
+	if (ipi->aggregate)
+		qos_ipol_meter_clear(ipi->aggregate);
+	cds_lfht_for_each_entry(ipi->subs, &iter, sub, node)
+		qos_ipol_meter_clear(&sub->meter);
+}
+
+int cmd_qos_ingress_police_op(FILE *f, int argc, char **argv)
+{
+	struct ifnet *ifp = NULL;
+	json_writer_t *wr;
+
+	--argc, ++argv; /* skip "ingress-police" */
+	if (argc < 1 || argc > 2) {
+		fprintf(f, "usage: qos ingress-police show|clear [<ifname>]\n");
+		return -1;
+	}
+
+	if (argc == 2) {
+		ifp = dp_ifnet_byifname(argv[1]);
+		if (!ifp) {
+			fprintf(f, "unknown interface: %s\n", argv[1]);
+			return -1;
+		}
+	}
+
+	if (!strcmp(argv[0], "clear")) {
+		if (ifp)
+			qos_ipol_if_clear(ifp, NULL);
+		else
+			dp_ifnet_walk(qos_ipol_if_clear, NULL);
+		return 0;
+	}
+
+	if (strcmp(argv[0], "show")) {
+		fprintf(f, "unknown ingress-police command: %s\n", argv[0]);
+		return -1;
+	}
+
+	wr = jsonw_new(f);
+	if (!wr)
+		return -1;
+
+	jsonw_name(wr, "ingress-police");
+	jsonw_start_array(wr);
+	if (ifp)
+		qos_ipol_if_show(ifp, wr);
+	else
+		dp_ifnet_walk(qos_ipol_if_show, wr);
+	jsonw_end_array(wr);
+	jsonw_destroy(&wr);
+
+	return 0;
+}
+
+static const struct dp_event_ops qos_ipol_events = {
+	.if_delete = qos_ipol_if_delete,
+};
+
+DP_STARTUP_EVENT_REGISTER(qos_ipol_events);
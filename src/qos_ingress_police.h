@@ -0,0 +1,38 @@
+/*
+ * Copyright (c) 2021, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+
+#ifndef QOS_INGRESS_POLICE_H
+#define QOS_INGRESS_POLICE_H
+
+/*
+ * Ingress policing of subscribers.
+ *
+ * Traffic received on an interface is metered with a two rate three
+ * colour marker (RFC 2698), first against the bucket of the subscriber
+ * it is from, identified by the longest configured prefix matching its
+ * source address, and then against the aggregate for the interface.
+ * Per VLAN subscribers are configured as the aggregate of the VLAN
+ * interface. Red packets are dropped and yellow packets may be
+ * remarked, before the firewall and NAT features see them.
+ *
+ * This is independent of, and much cheaper than, the egress scheduler
+ * and can be used on any interface type.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+
+struct ifnet;
+struct rte_mbuf;
+
+/* Returns false if the packet is out of profile and must be dropped */
+bool qos_ingress_police_input(struct ifnet *ifp, struct rte_mbuf **m,
+			      bool v6);
+
+int cmd_qos_ingress_police(struct ifnet *ifp, int argc, char **argv);
+int cmd_qos_ingress_police_op(FILE *f, int argc, char **argv);
+
+#endif /* QOS_INGRESS_POLICE_H */
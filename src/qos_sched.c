@@ -55,6 +55,7 @@
 #include "pktmbuf_internal.h"
 #include "qos.h"
 #include "qos_ext_buf_monitor.h"
+#include "qos_ingress_police.h"
 #include "qos_obj_db.h"
 #include "qos_public.h"
 #include "urcu.h"
@@ -981,7 +982,14 @@ void qos_sched_free(struct sched_info *qinfo)
 		qos_subport_free(qinfo);
 
 	free(qinfo->queue_map);
-	free(qinfo->queue_stats);
+	if (qinfo->pipe_stats) {
+		unsigned int pipes = qinfo->port_params.n_subports_per_port *
+			qinfo->port_params.n_pipes_per_subport;
+
+		for (i = 0; i < pipes; i++)
+			free(qinfo->pipe_stats[i]);
+		free(qinfo->pipe_stats);
+	}
 	QOS_FREE(qinfo)(qinfo);
 	free(qinfo);
 }
@@ -1006,7 +1014,6 @@ struct sched_info *qos_sched_new(struct ifnet *ifp,
 	struct qos_pipe_params *pipe_params;
 	struct qos_rate_info *profile_rates;
 	struct qos_tc_rate_info *profile_tc_rates;
-	unsigned int queues;
 
 	qinfo = zmalloc_aligned(sizeof(struct sched_info));
 	if (!qinfo)
@@ -1016,9 +1023,13 @@ struct sched_info *qos_sched_new(struct ifnet *ifp,
 	if (!qinfo->queue_map)
 		goto nomem1;
 
-	queues = RTE_SCHED_QUEUES_PER_PIPE * pipes * subports;
-	qinfo->queue_stats = calloc(queues, sizeof(struct queue_stats));
-	if (!qinfo->queue_stats)
+	/*
+	 * Most pipes of a large hierarchy are never used, so only their
+	 * pointers are allocated up front.
+	 */
+	qinfo->pipe_stats = calloc(pipes * subports,
+				   sizeof(struct queue_stats *));
+	if (!qinfo->pipe_stats)
 		goto nomem1;
 
 	qinfo->subport = calloc(subports, sizeof(struct subport_info));
@@ -1405,6 +1416,45 @@ uint32_t qos_sched_calc_qindex(struct sched_info *qinfo, unsigned int subport,
 	return qid;
 }
 
+/*
+ * The counters of a queue, allocating those of its pipe on first use.
+ * Only called by main thread.
+ */
+struct queue_stats *qos_sched_queue_stats(struct sched_info *qinfo,
+					  uint32_t qid)
+{
+	struct queue_stats **ps =
+		&qinfo->pipe_stats[qid / RTE_SCHED_QUEUES_PER_PIPE];
+
+	if (!*ps) {
+		*ps = calloc(RTE_SCHED_QUEUES_PER_PIPE, sizeof(**ps));
+		if (!*ps)
+			return NULL;
+	}
+	return *ps + qid % RTE_SCHED_QUEUES_PER_PIPE;
+}
+
+/*
+ * The counters of a queue, or NULL if its pipe has never counted
+ * anything, which saves allocating them for every pipe on being shown
+ * or cleared.
+ */
+struct queue_stats *qos_sched_queue_stats_find(struct sched_info *qinfo,
+					       uint32_t qid)
+{
+	struct queue_stats *ps =
+		qinfo->pipe_stats[qid / RTE_SCHED_QUEUES_PER_PIPE];
+
+	return ps ? ps + qid % RTE_SCHED_QUEUES_PER_PIPE : NULL;
+}
+
+static bool qos_queue_stats_used(const struct queue_stats *queue_stats)
+{
+	return queue_stats->n_pkts || queue_stats->n_bytes ||
+		queue_stats->n_pkts_dropped || queue_stats->n_bytes_dropped ||
+		queue_stats->n_pkts_red_dropped;
+}
+
 static void qos_do_random_dscp_stats(uint64_t *random_dscp_drop,
 				     struct queue_stats *queue_stats)
 {
@@ -1434,7 +1484,7 @@ static void qos_show_stats(json_writer_t *wr, struct sched_info *qinfo,
 			uint32_t qid;
 			uint64_t qlen;
 			bool qlen_in_pkts;
-			struct queue_stats *queue_stats;
+			struct queue_stats *queue_stats, unused;
 
 			/*
 			 * If the returned JSON is being optimised, only return
@@ -1449,7 +1499,11 @@ static void qos_show_stats(json_writer_t *wr, struct sched_info *qinfo,
 
 			qid = qos_sched_calc_qindex(qinfo, subport, pipe, tc,
 						    q);
-			queue_stats = qinfo->queue_stats + qid;
+			queue_stats = qos_sched_queue_stats_find(qinfo, qid);
+			if (!queue_stats) {
+				memset(&unused, 0, sizeof(unused));
+				queue_stats = &unused;
+			}
 
 			if (QOS_QUEUE_RD_STATS(qinfo)(qinfo, subport, pipe,
 						      tc, q, queue_stats,
@@ -1457,6 +1511,16 @@ static void qos_show_stats(json_writer_t *wr, struct sched_info *qinfo,
 						      &qlen_in_pkts) != 0)
 				continue;
 
+			/* Only keep the counters once there are some */
+			if (queue_stats == &unused &&
+			    qos_queue_stats_used(&unused)) {
+				queue_stats = qos_sched_queue_stats(qinfo, qid);
+				if (queue_stats)
+					*queue_stats = unused;
+				else
+					queue_stats = &unused;
+			}
+
 			jsonw_start_object(wr);
 			if (queue_used && !(qmap->conf_ids[QMAP(tc, q)] &
 					    CONF_ID_Q_DEFAULT)) {
@@ -1511,6 +1575,9 @@ static void qos_show_stats(json_writer_t *wr, struct sched_info *qinfo,
 				jsonw_uint_field(wr, "qlen", (uint16_t)qlen);
 			else
 				jsonw_uint_field(wr, "qlen-bytes", qlen);
+			if (qinfo->dev_id == QOS_DPDK_ID)
+				jsonw_uint_field(wr, "qlen-hwm",
+					qos_dpdk_queue_read_hwm(qinfo, qid));
 			jsonw_bool_field(wr, "prio_local",
 					 qmap->local_priority &&
 					 (QMAP(tc, q) ==
@@ -1751,6 +1818,10 @@ static void show_ifp_qos(struct ifnet *ifp, void *arg)
 	jsonw_name(wr, "shaper");
 	jsonw_start_object(wr);
 
+	if (qinfo->dev_id == QOS_DPDK_ID)
+		jsonw_bool_field(wr, "tm-offload",
+				 qinfo->dev_info.dpdk.tm_levels != 0);
+
 	/* Show VLAN to subport mapping - skip default slots */
 	jsonw_name(wr, "vlans");
 	jsonw_start_array(wr);
@@ -1956,6 +2027,44 @@ static void show_qos_buf_threshold(
 	jsonw_end_object(wr);
 }
 
+/* Take the high-water mark of each software scheduled port */
+void qos_sw_buf_sample(void)
+{
+	struct sched_info *qinfo;
+
+	SLIST_FOREACH(qinfo, &qos_qinfos.qinfo_head, list) {
+		if (qinfo->dev_id != QOS_DPDK_ID || !qinfo->queue_hwm)
+			continue;
+
+		qos_dpdk_port_sample_hwm(qinfo);
+	}
+}
+
+/*
+ * The deepest any queue of each software scheduled port has been since
+ * its counters were last cleared, and in the last sample interval.
+ */
+static void show_qos_sw_buf_utilization(json_writer_t *wr)
+{
+	struct sched_info *qinfo;
+
+	jsonw_name(wr, "sw-buf-stats");
+	jsonw_start_array(wr);
+	SLIST_FOREACH(qinfo, &qos_qinfos.qinfo_head, list) {
+		if (qinfo->dev_id != QOS_DPDK_ID || !qinfo->queue_hwm)
+			continue;
+
+		jsonw_start_object(wr);
+		jsonw_string_field(wr, "ifname", qinfo->ifp->if_name);
+		jsonw_uint_field(wr, "qlen-hwm",
+				 qos_dpdk_port_read_hwm(qinfo));
+		jsonw_uint_field(wr, "last-sample-hwm",
+				 qinfo->port_hwm_last);
+		jsonw_end_object(wr);
+	}
+	jsonw_end_array(wr);
+}
+
 static void show_qos_buf_utilization(
 	struct qos_show_context *context)
 {
@@ -1964,6 +2073,8 @@ static void show_qos_buf_utilization(
 	struct qos_external_buffer_sample *samples = 0;
 	enum qos_ext_buf_evt_notify_mode n_mode = 0;
 
+	show_qos_sw_buf_utilization(wr);
+
 	if (!qos_ext_buf_get_stats(&buf_stats)) {
 		DP_DEBUG(QOS, DEBUG, DATAPLANE,
 			"failed to get buffer-utilization\n");
@@ -2416,6 +2527,8 @@ static void clear_ifp_qos_stats(struct ifnet *ifp, void *arg)
 		 */
 		for (subport = 0; subport < qinfo->n_subports; ++subport)
 			qos_clear_subport_stats(qinfo, subport);
+		if (qinfo->dev_id == QOS_DPDK_ID)
+			qos_dpdk_port_clear_hwm(qinfo);
 
 	} else {
 		/*
@@ -2426,6 +2539,10 @@ static void clear_ifp_qos_stats(struct ifnet *ifp, void *arg)
 		vid = strtoul(viftag, NULL, 10);
 		subport = qinfo->vlan_map[vid];
 		qos_clear_subport_stats(qinfo, subport);
+
+		/* The port's mark is cleared with its trunk's counters */
+		if (!vid && qinfo->dev_id == QOS_DPDK_ID)
+			qos_dpdk_port_clear_hwm(qinfo);
 	}
 }
 
@@ -2927,7 +3044,8 @@ static int cmd_qos_pipe(struct ifnet *ifp, int argc, char **argv)
 		struct queue_map *qmap = &qinfo->queue_map[profile];
 
 		qinfo->subport[subport].profile_map[pipe]  = profile;
-		qinfo->subport[subport].pipe_configured[pipe] = true;
+		qinfo->subport[subport].pipe_configured[pipe / 64] |=
+			1ull << (pipe % 64);
 		/* Default map is DSCP */
 		if (!qmap->pcp_enabled && !qmap->designation)
 			qmap->dscp_enabled = 1;
@@ -2977,6 +3095,7 @@ static int cmd_qos_profile_queue(struct sched_info *qinfo, unsigned int profile,
 	 * "queue <d> dscp-group <f> <m> <g> <h> <i>"
 	 * "queue <d> drop-prec  <l> <m> <g> <h> <i>"
 	 * "queue <d> wred-weight <j>"
+	 * "queue <d> fq-codel <n> <o>"
 	 *
 	 * <a> - traffic-class-id (0..3)
 	 * <b> - traffic-class shaper bandwidth rate
@@ -2991,6 +3110,8 @@ static int cmd_qos_profile_queue(struct sched_info *qinfo, unsigned int profile,
 	 * <k> - traffic-class shaper percentage bandwidth rate
 	 * <l> - drop precedence; "green", "yellow" or "red"
 	 * <m> - units ("bytes", "packets" or "usec")
+	 * <n> - fq-codel target queueing delay in usec, 0 to disable
+	 * <o> - fq-codel interval in usec
 	 */
 	struct qos_pipe_params *pipe
 		= qinfo->port_params.pipe_profiles + profile;
@@ -3173,6 +3294,32 @@ static int cmd_qos_profile_queue(struct sched_info *qinfo, unsigned int profile,
 				qred->qparams[i].wq_log2 = wred_weight;
 		}
 		qred->filter_weight = wred_weight;
+	} else if (strcmp(argv[2], "fq-codel") == 0) {
+		unsigned int target, interval;
+		unsigned int qindex;
+		struct queue_map *qmap = &qinfo->queue_map[profile];
+
+		qindex = q_from_mask(value);
+		if (qindex >= RTE_SCHED_QUEUES_PER_PIPE) {
+			DP_DEBUG(QOS, ERR, DATAPLANE,
+				 "q mask 0x%x out of range\n", value);
+			return -EINVAL;
+		}
+		if (argc < 5 ||
+		    get_unsigned(argv[3], &target) < 0 ||
+		    get_unsigned(argv[4], &interval) < 0 ||
+		    (target && interval < target)) {
+			DP_DEBUG(QOS, ERR, DATAPLANE,
+				 "Invalid fq-codel parameters\n");
+			return -EINVAL;
+		}
+
+		pipe->fq_codel[qindex].target_us = target;
+		pipe->fq_codel[qindex].interval_us = interval;
+		if (target)
+			qmap->fq_codel_mask |= 1ull << qindex;
+		else
+			qmap->fq_codel_mask &= ~(1ull << qindex);
 	} else {
 		DP_DEBUG(QOS, ERR, DATAPLANE,
 			 "unknown profile queue parameter: '%s'\n", argv[2]);
@@ -3956,6 +4103,36 @@ static int cmd_qos_platform_buf_threshold(int argc, char **argv)
 	return 0;
 }
 
+static int cmd_qos_platform_worker_cores(int argc, char **argv)
+{
+	bitmask_t mask;
+
+	/*
+	 * Expected command format:
+	 *
+	 * "worker-cores <cpumask>"
+	 * "worker-cores delete"
+	 */
+	--argc, ++argv; /* skip "worker-cores" */
+	if (argc != 1) {
+		DP_DEBUG(QOS, ERR, DATAPLANE,
+			 "worker-cores missing cpu mask\n");
+		return -EINVAL;
+	}
+
+	if (strcmp(argv[0], "delete") == 0)
+		return set_qos_worker_cores(NULL);
+
+	if (bitmask_parse(&mask, argv[0]) < 0 ||
+	    set_qos_worker_cores(&mask) < 0) {
+		DP_DEBUG(QOS, ERR, DATAPLANE,
+			 "worker-cores invalid cpu mask: %s\n", argv[0]);
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
 static int cmd_qos_platform(int argc, char **argv)
 {
 	--argc, ++argv; /* skip "platform" */
@@ -3966,6 +4143,8 @@ static int cmd_qos_platform(int argc, char **argv)
 
 	if (strcmp(argv[0], "buffer-threshold") == 0)
 		return cmd_qos_platform_buf_threshold(argc, argv);
+	if (strcmp(argv[0], "worker-cores") == 0)
+		return cmd_qos_platform_worker_cores(argc, argv);
 
 	return 0;
 }
@@ -4050,6 +4229,8 @@ int cmd_qos_op(FILE *f, int argc, char **argv)
 		return cmd_qos_hw(f, argc, argv);
 	if (strcmp(argv[0], "obj-db") == 0)
 		return cmd_qos_obj_db(f);
+	if (strcmp(argv[0], "ingress-police") == 0)
+		return cmd_qos_ingress_police_op(f, argc, argv);
 
 	fprintf(f, "unknown qos command: %s\n", argv[0]);
 	return -1;
@@ -4799,8 +4980,11 @@ int cmd_qos_cfg(__unused FILE * f, int argc, char **argv)
 
 	/*
 	 * Egress-map is still supported on VIF although its part of
-	 * policymap
+	 * policymap, and ingress policing is independent of the scheduler.
 	 */
+	if (strcmp(argv[0], "ingress-police") == 0)
+		return cmd_qos_ingress_police(ifp, argc, argv);
+
 	if ((ifp->if_type != IFT_ETHER) &&
 			(strcmp(argv[0], "egress-map") != 0)) {
 		DP_DEBUG(QOS, ERR, DATAPLANE,
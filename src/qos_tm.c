@@ -0,0 +1,311 @@
+/*-
+ * Copyright (c) 2021, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+
+/*
+ * Offload of the DPDK QoS scheduler to NICs supporting the DPDK Traffic
+ * Management API.
+ *
+ * The rte_tm leaf nodes are the NIC's transmit queues, and the forwarding
+ * threads each transmit on their own queue, so a packet's traffic class
+ * or pipe can't be chosen by steering it to a queue. A policy can only be
+ * given to the NIC when it doesn't need to choose: a single subport and
+ * pipe whose packets all go to one queue, with no classification rules,
+ * marking, RED or CoDel. Everything else, or a NIC that can't take the
+ * hierarchy, falls back to rte_sched on a transmit thread.
+ *
+ * The port, subport and pipe shapers become a chain of non-leaf nodes
+ * with every transmit queue under the last of them. If the NIC has fewer
+ * levels than that, the innermost shapers are folded into the deepest
+ * level available, by taking the lowest of their rates.
+ *
+ * The hierarchy belongs to the port rather than to the policy, as it
+ * outlives the policy if it can't be removed. Until it has been, the
+ * port can't be given another policy, which rte_sched would shape a
+ * second time.
+ */
+
+#include <rte_ethdev.h>
+#include <rte_tm.h>
+#include "if_var.h"
+#include "qos.h"
+#include "vplane_debug.h"
+#include "vplane_log.h"
+
+enum qos_tm_level {
+	QOS_TM_PORT,
+	QOS_TM_SUBPORT,
+	QOS_TM_PIPE,
+	QOS_TM_LEVELS
+};
+
+/* Clear of the leaf node ids, which are the transmit queue ids */
+#define QOS_TM_NODE_ID(level)	(RTE_MAX_QUEUES_PER_PORT + (level))
+#define QOS_TM_PROFILE_ID(level)	((level) + 1)
+
+/* Our nodes in each port's hierarchy, counted down as they are removed */
+static struct qos_tm_port {
+	uint32_t n_levels;
+	uint32_t n_leaves;
+	bool committed;		/* the NIC may be shaping with them */
+} qos_tm_ports[DATAPLANE_MAX_PORTS];
+
+static bool qos_tm_qmap_single(const uint8_t *map, unsigned int n)
+{
+	unsigned int i;
+
+	for (i = 1; i < n; i++)
+		if ((map[i] & RTE_SCHED_TC_WRR_MASK) !=
+		    (map[0] & RTE_SCHED_TC_WRR_MASK))
+			return false;
+	return true;
+}
+
+/*
+ * Can the policy be implemented by shaping alone? If so return the
+ * traffic class that all of its packets are queued on.
+ */
+static bool qos_tm_policy_fits(struct sched_info *qinfo, unsigned int *tc)
+{
+	struct subport_info *sinfo = &qinfo->subport[0];
+	struct qos_pipe_params *params;
+	struct queue_map *qmap;
+	uint8_t profile;
+
+	if (qinfo->n_subports != 1 || qinfo->n_pipes != 1)
+		return false;
+
+	if (sinfo->npf_config || sinfo->marks || sinfo->mark_map)
+		return false;
+
+	profile = sinfo->profile_map[0];
+	params = &qinfo->port_params.pipe_profiles[profile];
+	qmap = &qinfo->queue_map[profile];
+
+	if (qmap->local_priority || qmap->designation ||
+	    qmap->fq_codel_mask || !SLIST_EMPTY(&params->red_head))
+		return false;
+
+	if (qmap->pcp_enabled) {
+		if (!qos_tm_qmap_single(qmap->pcp2q, MAX_PCP))
+			return false;
+		*tc = qmap_to_tc(qmap->pcp2q[0]);
+	} else {
+		if (!qos_tm_qmap_single(qmap->dscp2q, MAX_DSCP))
+			return false;
+		*tc = qmap_to_tc(qmap->dscp2q[0]);
+	}
+	return true;
+}
+
+static void qos_tm_error(struct ifnet *ifp, const char *what, int ret,
+			 struct rte_tm_error *error)
+{
+	DP_DEBUG(QOS_DP, DEBUG, DATAPLANE,
+		 "rte_tm %s failed on %s: %d (%s)\n", what, ifp->if_name, ret,
+		 error->message ? error->message : "no reason given");
+}
+
+/*
+ * Remove whatever of our hierarchy has been added, counting down the
+ * nodes left so that a failure can be retried from where it stopped.
+ */
+static int qos_tm_delete(struct ifnet *ifp, uint32_t *n_levels,
+			 uint32_t *n_leaves)
+{
+	struct rte_tm_error error;
+	int ret;
+
+	for (; *n_leaves; (*n_leaves)--) {
+		ret = rte_tm_node_delete(ifp->if_port, *n_leaves - 1, &error);
+		if (ret < 0) {
+			qos_tm_error(ifp, "leaf delete", ret, &error);
+			return ret;
+		}
+	}
+
+	for (; *n_levels; (*n_levels)--) {
+		uint32_t level = *n_levels - 1;
+
+		ret = rte_tm_node_delete(ifp->if_port, QOS_TM_NODE_ID(level),
+					 &error);
+		if (ret < 0) {
+			qos_tm_error(ifp, "node delete", ret, &error);
+			return ret;
+		}
+
+		/* Unused by any node, so a profile left behind shapes nothing */
+		ret = rte_tm_shaper_profile_delete(ifp->if_port,
+						   QOS_TM_PROFILE_ID(level),
+						   &error);
+		if (ret < 0)
+			qos_tm_error(ifp, "shaper profile delete", ret, &error);
+	}
+	return 0;
+}
+
+/*
+ * Undo a failed start. Nodes that can't be removed are left to
+ * qos_tm_stop as if committed, so rte_sched can't shape the port too.
+ */
+static void qos_tm_abort(struct ifnet *ifp, uint32_t n_levels,
+			 uint32_t n_leaves)
+{
+	if (qos_tm_delete(ifp, &n_levels, &n_leaves) < 0)
+		qos_tm_ports[ifp->if_port] = (struct qos_tm_port) {
+			.n_levels = n_levels,
+			.n_leaves = n_leaves,
+			.committed = true,
+		};
+}
+
+/*
+ * Only called by main thread, with the policy's parameters already
+ * checked against the port rate.
+ */
+int qos_tm_start(struct ifnet *ifp, struct sched_info *qinfo, uint64_t bps)
+{
+	struct rte_tm_shaper_params shaper[QOS_TM_LEVELS] = { 0 };
+	struct rte_tm_capabilities cap;
+	struct rte_tm_error error;
+	struct qos_shaper_conf *sp, *pp;
+	uint32_t n_levels, level, n_leaves, q;
+	unsigned int tc;
+	int ret;
+
+	if (!qos_tm_policy_fits(qinfo, &tc))
+		return -ENOTSUP;
+
+	ret = rte_tm_capabilities_get(ifp->if_port, &cap, &error);
+	if (ret < 0)
+		return ret;
+
+	ret = rte_tm_get_number_of_leaf_nodes(ifp->if_port, &n_leaves,
+					      &error);
+	if (ret < 0)
+		return ret;
+
+	/* At least one non-leaf level above the transmit queues */
+	if (cap.n_levels_max < 2 || n_leaves == 0)
+		return -ENOTSUP;
+	n_levels = RTE_MIN(cap.n_levels_max - 1, (uint32_t)QOS_TM_LEVELS);
+
+	sp = &qinfo->subport[0].params;
+	pp = &qinfo->port_params.pipe_profiles[
+		qinfo->subport[0].profile_map[0]].shaper;
+
+	shaper[QOS_TM_PORT].peak.rate = bps;
+	shaper[QOS_TM_PORT].peak.size = sp->tb_size;
+	shaper[QOS_TM_SUBPORT].peak.rate = RTE_MIN(sp->tb_rate,
+						   sp->tc_rate[tc]);
+	shaper[QOS_TM_SUBPORT].peak.size = sp->tb_size;
+	shaper[QOS_TM_PIPE].peak.rate = RTE_MIN(pp->tb_rate, pp->tc_rate[tc]);
+	shaper[QOS_TM_PIPE].peak.size = pp->tb_size;
+
+	for (level = n_levels; level < QOS_TM_LEVELS; level++) {
+		struct rte_tm_shaper_params *last = &shaper[n_levels - 1];
+
+		last->peak.rate = RTE_MIN(last->peak.rate,
+					  shaper[level].peak.rate);
+		last->peak.size = RTE_MIN(last->peak.size,
+					  shaper[level].peak.size);
+	}
+
+	for (level = 0; level < n_levels; level++) {
+		struct rte_tm_node_params np = {
+			.shaper_profile_id = QOS_TM_PROFILE_ID(level),
+			.nonleaf.n_sp_priorities = 1,
+		};
+
+		shaper[level].pkt_length_adjust =
+			qinfo->port_params.frame_overhead;
+		ret = rte_tm_shaper_profile_add(ifp->if_port,
+						QOS_TM_PROFILE_ID(level),
+						&shaper[level], &error);
+		if (ret < 0) {
+			qos_tm_error(ifp, "shaper profile add", ret, &error);
+			qos_tm_abort(ifp, level, 0);
+			return ret;
+		}
+
+		ret = rte_tm_node_add(ifp->if_port, QOS_TM_NODE_ID(level),
+				      level ? QOS_TM_NODE_ID(level - 1) :
+				      RTE_TM_NODE_ID_NULL,
+				      0, 1, level, &np, &error);
+		if (ret < 0) {
+			qos_tm_error(ifp, "node add", ret, &error);
+			rte_tm_shaper_profile_delete(ifp->if_port,
+						     QOS_TM_PROFILE_ID(level),
+						     &error);
+			qos_tm_abort(ifp, level, 0);
+			return ret;
+		}
+	}
+
+	for (q = 0; q < n_leaves; q++) {
+		struct rte_tm_node_params np = {
+			.shaper_profile_id = RTE_TM_SHAPER_PROFILE_ID_NONE,
+			.leaf.wred.wred_profile_id = RTE_TM_WRED_PROFILE_ID_NONE,
+		};
+
+		ret = rte_tm_node_add(ifp->if_port, q,
+				      QOS_TM_NODE_ID(n_levels - 1), 0, 1,
+				      n_levels, &np, &error);
+		if (ret < 0) {
+			qos_tm_error(ifp, "leaf add", ret, &error);
+			qos_tm_abort(ifp, n_levels, q);
+			return ret;
+		}
+	}
+
+	/* Which clears the hierarchy if it fails */
+	ret = rte_tm_hierarchy_commit(ifp->if_port, 1, &error);
+	if (ret < 0) {
+		qos_tm_error(ifp, "hierarchy commit", ret, &error);
+		return ret;
+	}
+
+	qos_tm_ports[ifp->if_port] = (struct qos_tm_port) {
+		.n_levels = n_levels,
+		.n_leaves = n_leaves,
+		.committed = true,
+	};
+	qinfo->dev_info.dpdk.tm_levels = n_levels;
+	DP_DEBUG(QOS_DP, DEBUG, DATAPLANE,
+		 "QoS on port %s offloaded to %u rte_tm levels\n",
+		 ifp->if_name, n_levels);
+	return 0;
+}
+
+/*
+ * Remove the port's hierarchy, or what a previous failed attempt left of
+ * it, which has to succeed before rte_sched can shape the port.
+ */
+int qos_tm_stop(struct ifnet *ifp, struct sched_info *qinfo)
+{
+	struct qos_tm_port *tp = &qos_tm_ports[ifp->if_port];
+	struct rte_tm_error error;
+	int ret;
+
+	qinfo->dev_info.dpdk.tm_levels = 0;
+	if (!tp->committed)
+		return 0;
+
+	ret = qos_tm_delete(ifp, &tp->n_levels, &tp->n_leaves);
+	if (ret == 0) {
+		ret = rte_tm_hierarchy_commit(ifp->if_port, 0, &error);
+		if (ret < 0)
+			qos_tm_error(ifp, "hierarchy commit", ret, &error);
+	}
+	if (ret < 0) {
+		RTE_LOG(ERR, QOS,
+			"%s: rte_tm hierarchy not cleared, port remains shaped by the NIC\n",
+			ifp->if_name);
+		return ret;
+	}
+
+	tp->committed = false;
+	return 0;
+}
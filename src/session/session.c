@@ -205,11 +205,14 @@ static void session_rcu_free(struct rcu_head *h)
 	struct session *s = caa_container_of(h, struct session, se_rcu_head);
 
 	/*
-	 * Feature destroy references sessions, so just requeue if
-	 * features are outstanding
+	 * Feature destroy and deferred session watch events reference
+	 * sessions, so just requeue if either is outstanding
 	 */
-	if (rte_atomic16_read(&s->se_feature_count))
+	if (rte_atomic16_read(&s->se_feature_count) ||
+	    rte_atomic32_read(&s->se_watch_cnt)) {
 		call_rcu(&s->se_rcu_head, session_rcu_free);
+		return;
+	}
 
 	rte_atomic32_dec(&session_rcu_counter);
 	free(s->se_link);
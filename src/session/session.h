@@ -212,6 +212,8 @@ struct session {
 	rte_atomic64_t		se_pkts_out;
 	rte_atomic64_t		se_bytes_out;
 	void			*se_private;
+	rte_atomic32_t		se_watch_cnt;	/* # queued watch events */
+	uint8_t			se_watch_stats;	/* stats update queued */
 };
 
 static_assert(offsetof(struct session, se_rcu_head) == 64,
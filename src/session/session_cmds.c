@@ -27,6 +27,7 @@
 #include "session_feature.h"
 #include "session_op.h"
 #include "session_private.h"
+#include "session_watch.h"
 #include "urcu.h"
 #include "util.h"
 #include "vplane_log.h"
@@ -1080,6 +1081,7 @@ enum cmd_op {
 	OP_LIST,
 	OP_SHOW_DP_SESSIONS,
 	OP_CLEAR_DP_SESSIONS,
+	OP_SHOW_SESSION_WATCH,
 };
 
 enum cmd_cfg {
@@ -1128,6 +1130,10 @@ static const struct session_command session_cmd_op[] = {
 		.tokens = "clear dataplane sessions",
 		.handler = cmd_op_clear_dp_sessions,
 	},
+	[OP_SHOW_SESSION_WATCH] = {
+		.tokens = "show session watch",
+		.handler = cmd_op_show_session_watch,
+	},
 };
 
 static const struct session_command session_cmd_cfg[] = {
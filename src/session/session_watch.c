@@ -4,16 +4,55 @@
  * SPDX-License-Identifier: LGPL-2.1-only
  */
 #include <errno.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <unistd.h>
 #include <urcu-qsbr.h>
+#include <urcu/uatomic.h>
+
+#include <rte_atomic.h>
+#include <rte_errno.h>
+#include <rte_lcore.h>
+#include <rte_log.h>
+#include <rte_ring.h>
 
 #include "dp_session.h"
+#include "json_writer.h"
 #include "npf/npf_state.h"
+#include "rcu.h"
 #include "session/session.h"
 #include "session/session_watch.h"
+#include "util.h"
+#include "vplane_log.h"
+
+/*
+ * Deferred watchers get events through a single producer ring per
+ * lcore, plus one multi producer ring shared by the non-dataplane
+ * threads. Each ring entry is a session pointer with the hook in the
+ * low bits, and holds a reference on the session until delivered.
+ *
+ * Stats updates come with every packet, so only one is queued for a
+ * session at a time. The flag is cleared before the watcher is called,
+ * so it is always told about the latest stats.
+ */
+#define SESSION_WATCH_RING_SZ	4096
+#define SESSION_WATCH_BURST	64
+#define SESSION_WATCH_IDLE_US	1000
+#define SESSION_WATCH_OTHER	RTE_MAX_LCORE
+
+#define SESSION_WATCH_HOOK_MASK	0x3ul
+
+static_assert(SESSION_MAX <= SESSION_WATCH_HOOK_MASK + 1,
+	      "session hooks do not fit in session pointer");
+
+struct session_watch_ring {
+	struct rte_ring *ring;
+	uint64_t queued;	/* atomic on the shared ring */
+	uint64_t dropped;	/* atomic on the shared ring */
+	uint64_t delivered;	/* watch thread only */
+} __rte_cache_aligned;
 
 /*
  * Hold session watch pointer.
@@ -21,28 +60,189 @@
 struct session_watch_info {
 	struct session_watch *watch;
 	bool watch_on;
+	bool deferred;
+	bool running;
+	pthread_t thread;
+	struct session_watch_ring rings[RTE_MAX_LCORE + 1];
 };
 
 static struct session_watch_info watch_ctx;
 
-int dp_session_watch_register(struct session_watch *se_watch)
+static struct session_watch *session_watch_get(void);
+
+/* Deliver a burst of queued events, returns the number delivered */
+static unsigned int session_watch_ring_drain(struct session_watch_ring *swr,
+					     struct session_watch *wt)
+{
+	void *events[SESSION_WATCH_BURST];
+	unsigned int i, n;
+
+	n = rte_ring_sc_dequeue_burst(swr->ring, events, SESSION_WATCH_BURST,
+				      NULL);
+	for (i = 0; i < n; i++) {
+		uintptr_t ev = (uintptr_t)events[i];
+		struct session *s =
+			(struct session *)(ev & ~SESSION_WATCH_HOOK_MASK);
+		enum dp_session_hook hook = ev & SESSION_WATCH_HOOK_MASK;
+
+		if (hook == SESSION_STATS_UPDATE)
+			CMM_STORE_SHARED(s->se_watch_stats, 0);
+		if (wt && wt->fn)
+			wt->fn(s, hook, wt->data);
+		rte_atomic32_dec(&s->se_watch_cnt);
+	}
+	swr->delivered += n;
+	return n;
+}
+
+static unsigned int session_watch_drain(struct session_watch *wt)
+{
+	unsigned int i, n = 0;
+
+	for (i = 0; i < ARRAY_SIZE(watch_ctx.rings); i++)
+		if (watch_ctx.rings[i].ring)
+			n += session_watch_ring_drain(&watch_ctx.rings[i], wt);
+	return n;
+}
+
+static void *session_watch_thread(void *arg __unused)
+{
+	dp_rcu_register_thread();
+
+	while (CMM_LOAD_SHARED(watch_ctx.running)) {
+		if (session_watch_drain(session_watch_get())) {
+			rcu_quiescent_state();
+			continue;
+		}
+
+		rcu_thread_offline();
+		usleep(SESSION_WATCH_IDLE_US);
+		rcu_thread_online();
+	}
+
+	/* release the references held by anything left queued */
+	while (session_watch_drain(NULL))
+		;
+
+	dp_rcu_unregister_thread();
+	return NULL;
+}
+
+static int session_watch_rings_create(void)
+{
+	char name[RTE_RING_NAMESIZE];
+	unsigned int lcore_id;
+	struct rte_ring *ring;
+
+	for (lcore_id = 0; lcore_id <= SESSION_WATCH_OTHER; lcore_id++) {
+		unsigned int socket = SOCKET_ID_ANY;
+		unsigned int flags = RING_F_SC_DEQ;
+
+		if (watch_ctx.rings[lcore_id].ring)
+			continue;
+
+		if (lcore_id < SESSION_WATCH_OTHER) {
+			if (!rte_lcore_is_enabled(lcore_id))
+				continue;
+			socket = rte_lcore_to_socket_id(lcore_id);
+			flags |= RING_F_SP_ENQ;
+		}
+
+		snprintf(name, sizeof(name), "sewatch-%u", lcore_id);
+		ring = rte_ring_create(name, SESSION_WATCH_RING_SZ, socket,
+				       flags);
+		if (!ring) {
+			RTE_LOG(ERR, DATAPLANE,
+				"session watch ring create failed: %s\n",
+				rte_strerror(rte_errno));
+			return -ENOMEM;
+		}
+		watch_ctx.rings[lcore_id].ring = ring;
+	}
+	return 0;
+}
+
+static int session_watch_thread_start(void)
+{
+	unsigned int i;
+	int rc;
+
+	rc = session_watch_rings_create();
+	if (rc)
+		return rc;
+
+	/* the rings were emptied when the last watcher went */
+	for (i = 0; i < ARRAY_SIZE(watch_ctx.rings); i++) {
+		watch_ctx.rings[i].queued = 0;
+		watch_ctx.rings[i].dropped = 0;
+		watch_ctx.rings[i].delivered = 0;
+	}
+
+	CMM_STORE_SHARED(watch_ctx.running, true);
+	rc = pthread_create(&watch_ctx.thread, NULL, session_watch_thread,
+			    NULL);
+	if (rc) {
+		CMM_STORE_SHARED(watch_ctx.running, false);
+		return -rc;
+	}
+	pthread_setname_np(watch_ctx.thread, "dataplane/watch");
+	return 0;
+}
+
+static void session_watch_thread_stop(void)
+{
+	CMM_STORE_SHARED(watch_ctx.running, false);
+	pthread_join(watch_ctx.thread, NULL);
+}
+
+int dp_session_watch_register_flags(struct session_watch *se_watch,
+				    unsigned int flags)
 {
+	bool deferred = flags & SESSION_WATCH_F_DEFERRED;
+
+	if (flags & ~SESSION_WATCH_F_DEFERRED)
+		return -EINVAL;
+
+	if (rcu_dereference(watch_ctx.watch))
+		return -EBUSY;
+
+	/* Set up delivery before the forwarding threads see the watcher */
+	if (deferred && session_watch_thread_start() < 0)
+		return -ENOMEM;
+	watch_ctx.deferred = deferred;
+
 	if (!rcu_cmpxchg_pointer(&watch_ctx.watch, NULL, se_watch)) {
 		watch_ctx.watch_on = true;
 		return 0;
 	}
 
+	if (deferred) {
+		session_watch_thread_stop();
+		watch_ctx.deferred = false;
+	}
 	return -EBUSY;
 }
 
+int dp_session_watch_register(struct session_watch *se_watch)
+{
+	return dp_session_watch_register_flags(se_watch, 0);
+}
+
 int dp_session_watch_unregister(int watcher_id __unused)
 {
 	struct session_watch **p = &watch_ctx.watch;
 	uint8_t old = watch_ctx.watch_on;
 
 	watch_ctx.watch_on = false;
-	if (rcu_xchg_pointer(p, NULL) != NULL)
+	if (rcu_xchg_pointer(p, NULL) != NULL) {
+		/* no new events once all readers have seen the change */
+		if (watch_ctx.deferred) {
+			synchronize_rcu();
+			session_watch_thread_stop();
+			watch_ctx.deferred = false;
+		}
 		return 0;
+	}
 	watch_ctx.watch_on = old;
 	return -ENOENT;
 }
@@ -74,6 +274,59 @@ static bool check_session_type(struct session *session, unsigned int flags)
 	return false;
 }
 
+/* Count an event, atomically if other threads share the ring */
+static inline void session_watch_count(struct session_watch_ring *swr,
+				       uint64_t *cnt)
+{
+	if (swr == &watch_ctx.rings[SESSION_WATCH_OTHER])
+		uatomic_inc(cnt);
+	else
+		(*cnt)++;
+}
+
+/*
+ * Queue an event for the session watch thread, taking a reference on
+ * the session that is dropped once the event has been delivered.
+ */
+static void session_watch_defer(struct session *session,
+				enum dp_session_hook hook)
+{
+	unsigned int lcore_id = rte_lcore_id();
+	struct session_watch_ring *swr;
+	void *ev;
+
+	/* a stats update already queued covers this one */
+	if (hook == SESSION_STATS_UPDATE) {
+		if (CMM_LOAD_SHARED(session->se_watch_stats))
+			return;
+		CMM_STORE_SHARED(session->se_watch_stats, 1);
+	}
+
+	if (lcore_id >= RTE_MAX_LCORE)
+		lcore_id = SESSION_WATCH_OTHER;
+	swr = &watch_ctx.rings[lcore_id];
+	if (unlikely(!swr->ring)) {
+		swr = &watch_ctx.rings[SESSION_WATCH_OTHER];
+		if (!swr->ring)
+			goto drop;
+	}
+
+	ev = (void *)((uintptr_t)session | hook);
+	rte_atomic32_inc(&session->se_watch_cnt);
+
+	if (rte_ring_enqueue(swr->ring, ev) != 0) {
+		rte_atomic32_dec(&session->se_watch_cnt);
+		session_watch_count(swr, &swr->dropped);
+		goto drop;
+	}
+	session_watch_count(swr, &swr->queued);
+	return;
+
+drop:
+	if (hook == SESSION_STATS_UPDATE)
+		CMM_STORE_SHARED(session->se_watch_stats, 0);
+}
+
 /*
  * call notfication function for established sessions.
  * The call back function is called unconditionally.
@@ -88,10 +341,64 @@ void session_do_watch(struct session *session, enum dp_session_hook hook)
 	if (!check_session_type(session, wt->types))
 		return;
 
-	if (wt->fn)
+	if (watch_ctx.deferred)
+		session_watch_defer(session, hook);
+	else if (wt->fn)
 		wt->fn(session, hook, wt->data);
 }
 
+int cmd_op_show_session_watch(FILE *f, int argc __unused,
+			      char **argv __unused)
+{
+	struct session_watch *wt = session_watch_get();
+	uint64_t queued = 0, dropped = 0, delivered = 0;
+	json_writer_t *json;
+	unsigned int i;
+
+	json = jsonw_new(f);
+	if (!json)
+		return -ENOMEM;
+
+	jsonw_name(json, "session_watch");
+	jsonw_start_object(json);
+	if (wt) {
+		jsonw_string_field(json, "name", wt->name ? wt->name : "");
+		jsonw_bool_field(json, "deferred", watch_ctx.deferred);
+	}
+
+	jsonw_name(json, "queues");
+	jsonw_start_array(json);
+	for (i = 0; i < ARRAY_SIZE(watch_ctx.rings); i++) {
+		const struct session_watch_ring *swr = &watch_ctx.rings[i];
+
+		if (!swr->ring)
+			continue;
+
+		jsonw_start_object(json);
+		if (i == SESSION_WATCH_OTHER)
+			jsonw_string_field(json, "lcore", "other");
+		else
+			jsonw_uint_field(json, "lcore", i);
+		jsonw_uint_field(json, "queued", swr->queued);
+		jsonw_uint_field(json, "dropped", swr->dropped);
+		jsonw_uint_field(json, "delivered", swr->delivered);
+		jsonw_uint_field(json, "pending", rte_ring_count(swr->ring));
+		jsonw_end_object(json);
+
+		queued += swr->queued;
+		dropped += swr->dropped;
+		delivered += swr->delivered;
+	}
+	jsonw_end_array(json);
+
+	jsonw_uint_field(json, "queued", queued);
+	jsonw_uint_field(json, "dropped", dropped);
+	jsonw_uint_field(json, "delivered", delivered);
+	jsonw_end_object(json);
+	jsonw_destroy(&json);
+	return 0;
+}
+
 struct dp_session_walk_data {
 	unsigned int types;
 	dp_session_walk_t *fn;
@@ -7,6 +7,7 @@
 #define SESSION_WATCH_H
 
 #include <stdbool.h>
+#include <stdio.h>
 #include "dp_session.h"
 
 bool is_watch_on(void);
@@ -18,5 +19,7 @@ bool is_watch_on(void);
  * Skip session with pending acks.
  */
 void session_do_watch(struct session *session, enum dp_session_hook hook);
+
+int cmd_op_show_session_watch(FILE *f, int argc, char **argv);
 #endif
 
@@ -26,6 +26,7 @@
 #include <linux/if_tun.h>
 #include <netinet/in.h>
 #include <netinet/ip.h>
+#include <netinet/tcp.h>
 #include <pthread.h>
 #include <rte_branch_prediction.h>
 #include <rte_common.h>
@@ -33,6 +34,7 @@
 #include <rte_debug.h>
 #include <rte_ethdev.h>
 #include <rte_ether.h>
+#include <rte_gro.h>
 #include <rte_lcore.h>
 #include <rte_log.h>
 #include <rte_malloc.h>
@@ -48,12 +50,15 @@
 #include "compat.h"
 #include "compiler.h"
 #include "config_internal.h"
+#include "cpp_rate_limiter.h"
 #include "crypto/crypto_forward.h"
 #include "crypto/vti.h"
 #include "dp_event.h"
 #include "ether.h"
 #include "if/gre.h"
 #include "if_var.h"
+#include "in_cksum.h"
+#include "ip_checksum.h"
 #include "ip_funcs.h"
 #include "json_writer.h"
 #include "lag.h"
@@ -72,7 +77,7 @@
 #define DATAPLANE_SPATH_PORT (DATAPLANE_MAX_PORTS)
 
 #define SHADOW_IO_RING_HWM	32
-#define SHADOW_IO_RING_BURST	8
+#define SHADOW_IO_RING_BURST	32
 
 /* to be fair with the tun/tap reader */
 #define SHADOW_WRITE_POLLS 1
@@ -154,6 +159,9 @@ void local_packet_internal(struct ifnet *ifp, struct rte_mbuf *m)
 	if (!local_packet_filter(ifp, m))
 		goto drop;
 
+	if (!cpp_rl_sw_accept(m))
+		goto drop;
+
 	struct shadow_if_info *sii = local_shadow_if(m, ifp);
 	if (unlikely(!sii)) {
 		RTE_LOG(ERR, DATAPLANE,
@@ -241,7 +249,7 @@ static void shadow_io_write(struct shadow_if_info *sii, struct rte_mbuf *m)
 {
 	int rc;
 
-	rc = tuntap_write(sii->fd, m, pktmbuf_restore_ifp(m));
+	rc = tuntap_write(sii->fd, m, pktmbuf_restore_ifp(m), sii->vnet_hdr);
 
 	if (rc < 0) {
 		if (errno == ENOBUFS || errno == EWOULDBLOCK || errno == EAGAIN)
@@ -254,18 +262,209 @@ static void shadow_io_write(struct shadow_if_info *sii, struct rte_mbuf *m)
 	rte_pktmbuf_free(m);
 }
 
+/*
+ * Can GRO coalesce the packet? Only untagged, unfragmented TCP/IPv4
+ * data segments flagged ACK, or ACK and PSH, without options, padding
+ * or slowpath meta data are considered, so that the merged packet needs
+ * nothing from the mbufs absorbed into it, and GRO processes every one
+ * of them. Merging hides a bad TCP checksum from the kernel, so the
+ * checksum must have been verified, by the NIC or here.
+ *
+ * The candidate's payload length is kept in tso_segsz, which GRO leaves
+ * alone, to tell afterwards whether it was merged.
+ */
+static bool shadow_gro_prepare(struct rte_mbuf *m)
+{
+	const struct rte_ether_hdr *eh;
+	const struct iphdr *ip;
+	const struct tcphdr *tcp;
+	unsigned int hlen = RTE_ETHER_HDR_LEN + sizeof(struct iphdr);
+	unsigned int l4_len;
+
+	if ((m->ol_flags & PKT_RX_VLAN) ||
+	    pktmbuf_mdata_invar_exists(m, PKT_MDATA_INVAR_SPATH) ||
+	    pktmbuf_mdata_invar_exists(m, PKT_MDATA_INVAR_BRIDGE))
+		return false;
+
+	if (rte_pktmbuf_data_len(m) < hlen + sizeof(struct tcphdr))
+		return false;
+
+	eh = rte_pktmbuf_mtod(m, const struct rte_ether_hdr *);
+	if (eh->ether_type != htons(RTE_ETHER_TYPE_IPV4))
+		return false;
+
+	ip = (const struct iphdr *)(eh + 1);
+	if (ip->ihl != 5 || ip->protocol != IPPROTO_TCP ||
+	    (ip->frag_off & htons(IP_MF | IP_OFFMASK)) ||
+	    rte_pktmbuf_pkt_len(m) != RTE_ETHER_HDR_LEN + ntohs(ip->tot_len))
+		return false;
+
+	tcp = (const struct tcphdr *)(ip + 1);
+	l4_len = tcp->doff << 2;
+	if (tcp->doff < 5 || rte_pktmbuf_data_len(m) < hlen + l4_len ||
+	    ntohs(ip->tot_len) <= sizeof(struct iphdr) + l4_len ||
+	    (tcp->th_flags & ~TH_PUSH) != TH_ACK)
+		return false;
+
+	switch (m->ol_flags & PKT_RX_L4_CKSUM_MASK) {
+	case PKT_RX_L4_CKSUM_GOOD:
+		break;
+	case PKT_RX_L4_CKSUM_BAD:
+		return false;
+	default:
+		if (dp_in4_cksum_mbuf(m, ip, tcp) != 0)
+			return false;
+		break;
+	}
+
+	m->l2_len = RTE_ETHER_HDR_LEN;
+	m->l3_len = sizeof(struct iphdr);
+	m->l4_len = l4_len;
+	m->tso_segsz = ntohs(ip->tot_len) - sizeof(struct iphdr) - l4_len;
+	m->packet_type = RTE_PTYPE_L2_ETHER | RTE_PTYPE_L3_IPV4 |
+		RTE_PTYPE_L4_TCP;
+	return true;
+}
+
+static struct tcphdr *shadow_gro_tcp(struct rte_mbuf *m)
+{
+	return rte_pktmbuf_mtod_offset(m, struct tcphdr *,
+				       m->l2_len + m->l3_len);
+}
+
+/*
+ * GRO only takes pure ACKs, so PSH is cleared from the last segment of
+ * a run while GRO runs and then put back on whichever packet its data
+ * ended up in. The run ends there, so it is the last segment merged.
+ */
+static void shadow_gro_push(struct rte_mbuf **pkts, unsigned int n,
+			    const struct iphdr *psh_ip,
+			    const struct tcphdr *psh_tcp)
+{
+	const struct iphdr *ip;
+	struct tcphdr *tcp;
+	unsigned int i;
+	uint32_t len;
+
+	for (i = 0; i < n; i++) {
+		ip = dp_pktmbuf_mtol3(pkts[i], const struct iphdr *);
+		tcp = shadow_gro_tcp(pkts[i]);
+		if (ip->saddr != psh_ip->saddr || ip->daddr != psh_ip->daddr ||
+		    tcp->source != psh_tcp->source ||
+		    tcp->dest != psh_tcp->dest)
+			continue;
+
+		len = ntohs(ip->tot_len) - (ip->ihl << 2) - (tcp->doff << 2);
+		if (ntohl(psh_tcp->seq) - ntohl(tcp->seq) < len) {
+			tcp->th_flags |= TH_PUSH;
+			return;
+		}
+	}
+}
+
+/*
+ * GRO updates the lengths of a merged packet but not its checksums,
+ * so recalculate both the IP and TCP checksums. The packet is then
+ * flagged for the kernel to treat it as a GSO packet of the original
+ * segment size.
+ */
+static void shadow_gro_fixup(struct rte_mbuf *m)
+{
+	struct iphdr *ip;
+	struct tcphdr *tcp;
+
+	if (rte_pktmbuf_pkt_len(m) ==
+	    m->l2_len + m->l3_len + m->l4_len + m->tso_segsz)
+		return;
+
+	ip = dp_pktmbuf_mtol3(m, struct iphdr *);
+	dp_set_cksum_hdr(ip);
+	tcp = (struct tcphdr *)(ip + 1);
+	tcp->check = 0;
+	tcp->check = dp_in4_cksum_mbuf(m, ip, tcp);
+	m->ol_flags |= PKT_TX_TCP_SEG;
+}
+
+/*
+ * Coalesce TCP segments of the same flow within the burst, so that
+ * bulk transfers to the kernel (e.g. BGP table dumps) take fewer
+ * writes to the tap device. GRO is given each run of consecutive
+ * candidates in turn, so that nothing moves across the packets that
+ * it can't handle.
+ */
+unsigned int shadow_gro(struct rte_mbuf **pkts, unsigned int n)
+{
+	struct rte_gro_param gro_param = {
+		.gro_types = RTE_GRO_TCP_IPV4,
+		.max_flow_num = SHADOW_IO_RING_BURST,
+		.max_item_per_flow = 1,
+		.socket_id = SOCKET_ID_ANY,
+	};
+	bool candidate[SHADOW_IO_RING_BURST];
+	unsigned int i, j, start, nb_run, nb_out = 0;
+	struct tcphdr *tcp, psh_tcp;
+	struct rte_mbuf *psh;
+	struct iphdr psh_ip;
+	bool push;
+
+	for (i = 0; i < n; i++)
+		candidate[i] = shadow_gro_prepare(pkts[i]);
+
+	for (i = 0; i < n; ) {
+		if (!candidate[i]) {
+			pkts[nb_out++] = pkts[i++];
+			continue;
+		}
+
+		/* Nothing is merged after a PSH segment */
+		for (start = i; i < n && candidate[i]; )
+			if (shadow_gro_tcp(pkts[i++])->th_flags & TH_PUSH)
+				break;
+
+		nb_run = i - start;
+		if (nb_run > 1) {
+			psh = pkts[i - 1];
+			tcp = shadow_gro_tcp(psh);
+			push = tcp->th_flags & TH_PUSH;
+			tcp->th_flags &= ~TH_PUSH;
+			/* Its headers are gone if it is merged */
+			psh_ip = *dp_pktmbuf_mtol3(psh, struct iphdr *);
+			psh_tcp = *tcp;
+
+			nb_run = rte_gro_reassemble_burst(&pkts[start], nb_run,
+							  &gro_param);
+			if (push)
+				shadow_gro_push(&pkts[start], nb_run,
+						&psh_ip, &psh_tcp);
+		}
+
+		for (j = 0; j < nb_run; j++) {
+			shadow_gro_fixup(pkts[start + j]);
+			pkts[nb_out++] = pkts[start + j];
+		}
+	}
+
+	return nb_out;
+}
+
 /* Get a burst of packets from ring and forward them to kernel */
 static unsigned int shadow_io_burst(struct shadow_if_info *sii)
 {
 	struct rte_mbuf *s_pkts[SHADOW_IO_RING_BURST];
-	unsigned int i, n;
+	unsigned int i, n, nb_gro;
 
 	n = rte_ring_sc_dequeue_burst(sii->rx_slow_ring,
 				      (void **)s_pkts,
 				      SHADOW_IO_RING_BURST,
 				      NULL);
 
-	for (i = 0; i < n; i++)
+	if (sii->vnet_hdr) {
+		nb_gro = shadow_gro(s_pkts, n);
+		sii->rs_coalesced += n - nb_gro;
+	} else
+		nb_gro = n;
+
+	for (i = 0; i < nb_gro; i++)
 		shadow_io_write(sii, s_pkts[i]);
 
 	return n;
@@ -726,6 +925,16 @@ shadow_port_needed(portid_t port)
 	return (is_local_controller() || if_port_is_uplink(port));
 }
 
+/*
+ * Only the taps of ports whose traffic terminates on the local router
+ * get bulk TCP worth coalescing, so only they take a virtio_net_hdr.
+ */
+static bool
+shadow_port_gro(portid_t port)
+{
+	return (is_local_controller() && !if_port_is_uplink(port));
+}
+
 /* Initialize a shadow interface. */
 int shadow_init_port(portid_t port, const char *ifname,
 		     const struct rte_ether_addr *eth)
@@ -807,7 +1016,8 @@ int shadow_add_event(zloop_t *loop, portid_t port, const char *ifname)
 	sii->port = port;
 	sii->wake_me = true;
 
-	sii->fd = tap_attach(ifname);
+	sii->vnet_hdr = shadow_port_gro(port);
+	sii->fd = tap_attach(ifname, sii->vnet_hdr);
 	if (sii->fd < 0) {
 		ret = -errno;
 		goto fail_ring_free;
@@ -1051,6 +1261,7 @@ void shadow_show_summary(FILE *f, const char *name)
 		jsonw_uint_field(wr, "rx_errors", sii->rs_errors);
 		jsonw_uint_field(wr, "rx_overrun", sii->rs_overrun);
 		jsonw_uint_field(wr, "rx_congested", sii->rs_congested);
+		jsonw_uint_field(wr, "rx_coalesced", sii->rs_coalesced);
 
 		jsonw_uint_field(wr, "tx_packet", sii->ts_packets);
 		jsonw_uint_field(wr, "tx_errors", sii->ts_errors);
@@ -39,12 +39,14 @@ struct shadow_if_info {
 	int		 fd;
 	bool		 wake_me;
 	bool		 congested;
+	bool		 vnet_hdr;	/* tap takes a virtio_net_hdr */
 
 	uint64_t rs_packets;	/* pkts sent over tunnel */
 	uint64_t rs_infull;	/* pkts dropped because ring was full */
 	uint64_t rs_errors;	/* pkts dropped on write to tun dev */
 	uint64_t rs_overrun;	/* pkts dropped because of socket queue full */
 	uint64_t rs_congested;  /* pkts marked with congestion experienced */
+	uint64_t rs_coalesced;	/* pkts merged into others by GRO */
 	uint64_t ts_packets;	/* pkts from tunnel */
 	uint64_t ts_errors;	/* pkts dropped on read */
 	uint64_t ts_nobufs;	/* pkts dropped because no mbufs */
@@ -66,7 +68,10 @@ void shadow_show_summary(FILE *f, const char *name);
 
 struct ifnet *get_lo_ifp(enum cont_src_en cont_src);
 int shadow_add_event(zloop_t *loop, portid_t port, const char *ifname);
-int tap_attach(const char *ifname);
+int tap_attach(const char *ifname, bool vnet_hdr);
+
+/* For test only */
+unsigned int shadow_gro(struct rte_mbuf **pkts, unsigned int n);
 
 void shadow_init_spath_ring(int tun_fd);
 int slowpath_init(void);
@@ -80,7 +85,8 @@ int spath_receive(zmq_pollitem_t *item, struct tun_pi *pi,
 		  struct rte_mbuf **mbuf);
 int tap_reader(zloop_t *loop, zmq_pollitem_t *item, void *arg);
 int spath_reader(zloop_t *loop, zmq_pollitem_t *item, void *arg);
-int tuntap_write(int fd, struct rte_mbuf *m, struct ifnet *ifp);
+int tuntap_write(int fd, struct rte_mbuf *m, struct ifnet *ifp,
+		 bool vnet_hdr);
 bool local_packet_filter(const struct ifnet *ifp, struct rte_mbuf *m);
 struct shadow_if_info *get_port2shadowif(portid_t portid);
 struct shadow_if_info *get_fd2shadowif(int fd);
@@ -15,6 +15,7 @@
 #include <linux/if_tun.h>
 #include <linux/netlink.h>
 #include <linux/sockios.h>
+#include <linux/virtio_net.h>
 #include <netinet/in.h>
 #include <stdbool.h>
 #include <stdint.h>
@@ -112,6 +113,9 @@ int tap_receive(zloop_t *loop, zmq_pollitem_t *item,
 	struct ifnet *ifp = ifnet_byport(sii->port);
 	/* 8 is added to allow space for 2 VLAN headers (i.e. QinQ) */
 	const size_t max_pkt = ifp->if_mtu + RTE_ETHER_HDR_LEN + 8;
+	struct virtio_net_hdr vh;
+	struct iovec io[2];
+	unsigned int n;
 	void *base;
 	ssize_t len;
 	struct rte_mbuf *m = NULL;
@@ -133,7 +137,20 @@ int tap_receive(zloop_t *loop, zmq_pollitem_t *item,
 	else
 		base = alloca(max_pkt);
 
-	len = read(item->fd, base, max_pkt);
+	/*
+	 * No offloads are enabled on the tap, so the kernel never hands
+	 * us GSO or partially checksummed packets and any header can be
+	 * ignored.
+	 */
+	n = 0;
+	if (sii->vnet_hdr) {
+		io[n].iov_base = &vh;
+		io[n++].iov_len = sizeof(vh);
+	}
+	io[n].iov_base = base;
+	io[n++].iov_len = max_pkt;
+
+	len = readv(item->fd, io, n);
 	if (len < 0) {
 		if (m)
 			rte_pktmbuf_free(m);
@@ -154,6 +171,15 @@ int tap_receive(zloop_t *loop, zmq_pollitem_t *item,
 		return -1;
 	}
 
+	if (sii->vnet_hdr)
+		len -= sizeof(vh);
+	if (len <= 0) {
+		if (m)
+			rte_pktmbuf_free(m);
+		++sii->ts_errors;
+		return 0;
+	}
+
 	if (m)
 		rte_pktmbuf_pkt_len(m) = rte_pktmbuf_data_len(m) = len;
 	else {
@@ -278,8 +304,12 @@ int slowpath_init(void)
 	return fd;
 }
 
-/* Setup TUN/TAP device */
-int tap_attach(const char *ifname)
+/*
+ * Setup TUN/TAP device. With vnet_hdr, every packet read or written
+ * carries a virtio_net_hdr, so that GRO coalesced packets can be
+ * written as GSO packets.
+ */
+int tap_attach(const char *ifname, bool vnet_hdr)
 {
 	struct ifreq ifr;
 	int fd;
@@ -300,6 +330,8 @@ int tap_attach(const char *ifname)
 			ifname);
 	snprintf(ifr.ifr_name, IFNAMSIZ, "%s", ifname);
 	ifr.ifr_flags = IFF_TAP | IFF_NO_PI;
+	if (vnet_hdr)
+		ifr.ifr_flags |= IFF_VNET_HDR;
 
 	/* Set the name and type of new endpoint */
 	if (ioctl(fd, TUNSETIFF, &ifr) < 0) {
@@ -320,10 +352,29 @@ fail:
  * Note: this function builds meta data to send to TAP device
  *  onto stack by using alloca() before sending.
  */
-int tuntap_write(int fd, struct rte_mbuf *m, struct ifnet *ifp)
+int tuntap_write(int fd, struct rte_mbuf *m, struct ifnet *ifp,
+		 bool vnet_hdr)
 {
 	unsigned int n = 0;
-	struct iovec iov[m->nb_segs + 3];
+	struct iovec iov[m->nb_segs + 4];
+	struct virtio_net_hdr vh;
+
+	/*
+	 * A packet coalesced by GRO may be larger than the tap MTU, so
+	 * describe it to the kernel as GSO with the original segment size.
+	 */
+	if (vnet_hdr) {
+		memset(&vh, 0, sizeof(vh));
+		if (m->ol_flags & PKT_TX_TCP_SEG) {
+			vh.flags = VIRTIO_NET_HDR_F_DATA_VALID;
+			vh.gso_type = VIRTIO_NET_HDR_GSO_TCPV4;
+			vh.gso_size = m->tso_segsz;
+			vh.hdr_len = m->l2_len + m->l3_len + m->l4_len;
+		}
+		iov[n].iov_base = &vh;
+		iov[n].iov_len  = sizeof(vh);
+		++n;
+	}
 
 	/* When sending packets of .spathintf more information
 	 * needs to be passed.
@@ -8,8 +8,12 @@
  */
 
 #include <errno.h>
+#include <rte_cycles.h>
+#include <rte_ether.h>
 #include <rte_jhash.h>
+#include <rte_mbuf.h>
 #include <rte_timer.h>
+#include <urcu/uatomic.h>
 
 #include "control.h"
 #include "commands.h"
@@ -19,6 +23,7 @@
 #include "if/bridge/bridge_port.h"
 #include "if_var.h"
 #include "controller.h"
+#include "lcore_sched.h"
 #include "vplane_debug.h"
 #include "vplane_log.h"
 #include "zmq_dp.h"
@@ -66,6 +71,32 @@ struct storm_ctl_profile {
 
 #define STORM_CTL_ACTION_SHUTDOWN_INTF    0x01
 
+/* fixed point shift for the cycles per byte of a software policer */
+#define STORM_CTL_SW_SHIFT 16
+#define STORM_CTL_SW_BURST_MS 10
+
+struct storm_ctl_sw_lcore {
+	uint64_t cnt[FAL_POLICER_STAT_MAX];
+} __rte_cache_aligned;
+
+/*
+ * Software policer for one traffic type of an instance, used for the
+ * frames flooded by the software bridge that no FAL policer has seen.
+ *
+ * A virtual scheduling token bucket, tat being the time at which it
+ * would next be idle, shared by the forwarding threads so that the
+ * threshold applies to the interface as a whole. Only flooded frames
+ * get here, so the contention on it is low. Counts are per thread.
+ */
+struct storm_ctl_sw_policer {
+	uint64_t                   sw_tat __rte_cache_aligned;
+	uint64_t                   sw_cycles_per_byte; /* << SW_SHIFT */
+	uint64_t                   sw_burst_cycles;
+	uint64_t                   sw_cleared[FAL_POLICER_STAT_MAX];
+	struct rcu_head            sw_rcu;
+	struct storm_ctl_sw_lcore  sw_lcore[RTE_MAX_LCORE];
+};
+
 /* State for storm control applied to an interface, or a vlan on interface */
 struct storm_ctl_instance {
 	struct cds_lfht_node       sci_node;     /* node in instance table */
@@ -73,6 +104,7 @@ struct storm_ctl_instance {
 	uint64_t                   sci_pkt_drops[FAL_TRAFFIC_MAX];
 	struct dp_storm_ctl_policy sci_policy[FAL_TRAFFIC_MAX];
 	fal_object_t               sci_fal_obj[FAL_TRAFFIC_MAX];
+	struct storm_ctl_sw_policer *sci_sw[FAL_TRAFFIC_MAX];
 	struct storm_ctl_profile   *sci_profile;
 	struct ifnet               *sci_ifp;
 	struct rcu_head            sci_rcu;
@@ -83,6 +115,7 @@ struct if_storm_ctl_info {
 	struct rcu_head            sc_rcu;
 	struct rte_timer           sc_recovery_tmr;
 	struct cds_lfht            *sc_instance_tbl;
+	uint32_t                   sc_sw_policers;
 };
 
 static unsigned int storm_ctl_policy_cnt;
@@ -106,6 +139,25 @@ static void storm_ctl_trigger_actions(struct storm_ctl_instance *instance,
 
 static struct rte_timer storm_ctl_monitor_tmr;
 
+/* Sum of a software policer counter over all threads, since last clear */
+static uint64_t storm_ctl_sw_get_count(struct storm_ctl_instance *instance,
+				       enum fal_traffic_type tr_type,
+				       enum fal_policer_stat_type stat)
+{
+	struct storm_ctl_sw_policer *sw = rcu_dereference(
+		instance->sci_sw[tr_type]);
+	unsigned int lcore;
+	uint64_t cntr = 0;
+
+	if (!sw)
+		return 0;
+
+	for (lcore = 0; lcore < RTE_MAX_LCORE; lcore++)
+		cntr += CMM_LOAD_SHARED(sw->sw_lcore[lcore].cnt[stat]);
+
+	return cntr - sw->sw_cleared[stat];
+}
+
 static void storm_ctl_compare_stats(struct ifnet *ifp, void *arg __rte_unused)
 {
 	int rv;
@@ -128,20 +180,25 @@ static void storm_ctl_compare_stats(struct ifnet *ifp, void *arg __rte_unused)
 			if (!instance->sci_policy[tr_type].threshold_val)
 				continue;
 
+			cntr = storm_ctl_sw_get_count(instance, tr_type, stat);
+
 			fal_obj = rcu_dereference(
 				instance->sci_fal_obj[tr_type]);
-			if (fal_obj == FAL_NULL_OBJECT_ID)
-				continue;
-
-			rv = fal_policer_get_stats_ext(fal_obj, 1, &stat,
-						       FAL_STATS_MODE_READ,
-						       &cntr);
-			if (rv != 0) {
-				RTE_LOG(ERR, DATAPLANE,
-					"Could not retrieve %s storm control stats for %s\n",
-					fal_traffic_type_to_str(tr_type),
-					ifp->if_name);
-				continue;
+			if (fal_obj != FAL_NULL_OBJECT_ID) {
+				uint64_t fal_cntr;
+
+				rv = fal_policer_get_stats_ext(
+					fal_obj, 1, &stat,
+					FAL_STATS_MODE_READ, &fal_cntr);
+				if (rv != 0) {
+					RTE_LOG(ERR, DATAPLANE,
+						"Could not retrieve %s storm control stats for %s\n",
+						fal_traffic_type_to_str(
+							tr_type),
+						ifp->if_name);
+					continue;
+				}
+				cntr += fal_cntr;
 			}
 
 			if (cntr != instance->sci_pkt_drops[tr_type]) {
@@ -291,8 +348,12 @@ static void storm_ctl_free_instance(struct rcu_head *head)
 {
 	struct storm_ctl_instance *instance;
 
+	enum fal_traffic_type i;
+
 	instance = caa_container_of(head, struct storm_ctl_instance,
 				     sci_rcu);
+	for (i = FAL_TRAFFIC_UCAST; i < FAL_TRAFFIC_MAX; i++)
+		free(instance->sci_sw[i]);
 	free(instance);
 }
 
@@ -336,8 +397,13 @@ static void
 storm_ctl_del_instance_internal(struct cds_lfht *sc_instance_tbl,
 				struct storm_ctl_instance *instance)
 {
+	enum fal_traffic_type i;
+
 	cds_lfht_del(sc_instance_tbl, &instance->sci_node);
 	cds_list_del(&instance->sci_profile_list);
+	for (i = FAL_TRAFFIC_UCAST; i < FAL_TRAFFIC_MAX; i++)
+		if (instance->sci_sw[i])
+			instance->sci_ifp->sc_info->sc_sw_policers--;
 	if (!storm_ctl_cfg_check_profile(instance->sci_profile))
 		storm_ctl_delete_profile(instance->sci_profile);
 
@@ -716,6 +782,135 @@ static int fal_policer_modify_profile(struct storm_ctl_profile *profile,
 	return rv;
 }
 
+static void storm_ctl_sw_free(struct rcu_head *head)
+{
+	free(caa_container_of(head, struct storm_ctl_sw_policer, sw_rcu));
+}
+
+/*
+ * (Re)set the software policer for a traffic type from the policy of
+ * the instance. Counts are kept across rate changes.
+ */
+static void storm_ctl_sw_update(struct storm_ctl_instance *instance,
+				enum fal_traffic_type traf)
+{
+	struct storm_ctl_sw_policer *sw = instance->sci_sw[traf];
+	struct if_storm_ctl_info *sc_info = instance->sci_ifp->sc_info;
+	uint64_t hz = rte_get_tsc_hz();
+	uint64_t bytes;
+
+	bytes = METRIC_KBITS_TO_BYTES(
+		storm_ctl_policy_get_fal_rate(&instance->sci_policy[traf],
+					      instance->sci_ifp));
+	if (!bytes) {
+		if (sw) {
+			rcu_assign_pointer(instance->sci_sw[traf], NULL);
+			sc_info->sc_sw_policers--;
+			call_rcu(&sw->sw_rcu, storm_ctl_sw_free);
+		}
+		return;
+	}
+
+	if (!sw) {
+		sw = zmalloc_aligned(sizeof(*sw));
+		if (!sw) {
+			RTE_LOG(ERR, STORM_CTL,
+				"Could not allocate %s software policer for %s %d\n",
+				fal_traffic_type_to_str(traf),
+				instance->sci_ifp->if_name,
+				instance->sci_vlan);
+			return;
+		}
+	}
+
+	CMM_STORE_SHARED(sw->sw_cycles_per_byte,
+			 (hz << STORM_CTL_SW_SHIFT) / bytes);
+	CMM_STORE_SHARED(sw->sw_burst_cycles,
+			 hz * STORM_CTL_SW_BURST_MS / 1000);
+
+	if (!instance->sci_sw[traf]) {
+		rcu_assign_pointer(instance->sci_sw[traf], sw);
+		sc_info->sc_sw_policers++;
+	}
+}
+
+static bool
+storm_ctl_sw_police(struct storm_ctl_instance *instance,
+		    enum fal_traffic_type traf, uint32_t len, uint64_t now)
+{
+	struct storm_ctl_sw_policer *sw = rcu_dereference(
+		instance->sci_sw[traf]);
+	struct storm_ctl_sw_lcore *lc;
+	uint64_t tat, start, cost, old;
+
+	if (!sw)
+		return true;
+
+	lc = &sw->sw_lcore[dp_lcore_id()];
+	cost = (len * CMM_ACCESS_ONCE(sw->sw_cycles_per_byte)) >>
+		STORM_CTL_SW_SHIFT;
+	tat = CMM_LOAD_SHARED(sw->sw_tat);
+	for (;;) {
+		start = RTE_MAX(tat, now);
+		if (start - now > CMM_ACCESS_ONCE(sw->sw_burst_cycles)) {
+			lc->cnt[FAL_POLICER_STAT_RED_PACKETS]++;
+			lc->cnt[FAL_POLICER_STAT_RED_BYTES] += len;
+			return false;
+		}
+
+		old = uatomic_cmpxchg(&sw->sw_tat, tat, start + cost);
+		if (old == tat)
+			break;
+		tat = old;
+	}
+
+	lc->cnt[FAL_POLICER_STAT_GREEN_PACKETS]++;
+	lc->cnt[FAL_POLICER_STAT_GREEN_BYTES] += len;
+	return true;
+}
+
+/*
+ * Police a frame received on ifp that the software bridge is about to
+ * flood, against the policers for its vlan and for the whole interface.
+ * Returns false if it is over the threshold and must be dropped.
+ */
+bool storm_ctl_sw_accept(struct ifnet *ifp, struct rte_mbuf *m,
+			 uint16_t vlan)
+{
+	struct if_storm_ctl_info *sc_info = rcu_dereference(ifp->sc_info);
+	const struct rte_ether_hdr *eh;
+	struct storm_ctl_instance *instance;
+	enum fal_traffic_type traf;
+	uint32_t len;
+	uint64_t now;
+
+	if (!sc_info || !CMM_ACCESS_ONCE(sc_info->sc_sw_policers))
+		return true;
+
+	eh = rte_pktmbuf_mtod(m, const struct rte_ether_hdr *);
+	if (rte_is_broadcast_ether_addr(&eh->d_addr))
+		traf = FAL_TRAFFIC_BCAST;
+	else if (rte_is_multicast_ether_addr(&eh->d_addr))
+		traf = FAL_TRAFFIC_MCAST;
+	else
+		traf = FAL_TRAFFIC_UCAST;
+
+	len = rte_pktmbuf_pkt_len(m);
+	now = rte_rdtsc();
+
+	if (vlan) {
+		instance = storm_ctl_find_instance(sc_info, vlan);
+		if (instance && !storm_ctl_sw_police(instance, traf, len, now))
+			return false;
+	}
+
+	instance = storm_ctl_find_instance(sc_info, 0);
+	if (instance && !storm_ctl_sw_police(instance, traf, len, now))
+		return false;
+
+	return true;
+}
+
 static bool storm_ctl_fal_update_needed(struct dp_storm_ctl_policy *prof_pol,
 					struct dp_storm_ctl_policy *inst_pol)
 {
@@ -759,6 +954,7 @@ static void storm_ctl_fal_update_profile(struct storm_ctl_profile *profile)
 			}
 			instance->sci_policy[i] =
 				profile->scp_policies[i];
+			storm_ctl_sw_update(instance, i);
 		}
 	}
 }
@@ -908,6 +1104,8 @@ static void storm_ctl_set_policies(struct ifnet *ifp)
 			fal_policer_modify_profile(profile,
 						   instance->sci_vlan,
 						   instance, tr_type);
+			/* a percentage depends on the link speed */
+			storm_ctl_sw_update(instance, tr_type);
 
 		}
 	}
@@ -1298,6 +1496,7 @@ static int storm_ctl_set_profile_on_intf(bool set, struct ifnet *ifp,
 								  instance, i);
 				instance->sci_policy[i] =
 					profile->scp_policies[i];
+				storm_ctl_sw_update(instance, i);
 			}
 		}
 
@@ -1615,9 +1814,12 @@ static void storm_ctl_show_instance(json_writer_t *wr,
 		fal_policer_get_sc_stats(instance, num_stats, cntr_ids,
 					 cntrs, i);
 
-		for (j = 0; j < num_stats; j++)
+		for (j = 0; j < num_stats; j++) {
+			cntrs[j] += storm_ctl_sw_get_count(instance, i,
+							   cntr_ids[j]);
 			jsonw_uint_field(wr, fal_stat_strs[cntr_ids[j]],
 					 cntrs[j]);
+		}
 		jsonw_end_object(wr);
 	}
 	jsonw_end_object(wr);
@@ -1800,6 +2002,18 @@ static void storm_ctl_clear_intf_stats(struct ifnet *ifp, void *ctx __unused)
 		memset(instance->sci_pkt_drops, 0,
 		       sizeof(instance->sci_pkt_drops));
 		for (i = 0; i < FAL_TRAFFIC_MAX; i++) {
+			struct storm_ctl_sw_policer *sw = instance->sci_sw[i];
+
+			if (sw) {
+				enum fal_policer_stat_type stat;
+
+				for (stat = 0; stat < FAL_POLICER_STAT_MAX;
+				     stat++)
+					sw->sw_cleared[stat] +=
+						storm_ctl_sw_get_count(
+							instance, i, stat);
+			}
+
 			fal_obj = CMM_LOAD_SHARED(instance->sci_fal_obj[i]);
 			if (!fal_obj)
 				continue;
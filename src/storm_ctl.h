@@ -9,10 +9,18 @@
 #ifndef STORM_CTL_H
 #define STORM_CTL_H
 
+#include <stdbool.h>
+#include <stdint.h>
+
 #include "urcu.h"
 
+struct ifnet;
+struct rte_mbuf;
+
 int cmd_storm_ctl_cfg(FILE *f, int argc, char **argv);
 int cmd_storm_ctl_op(FILE *f, int argc, char **argv);
 const char *storm_ctl_traffic_type_to_str(enum fal_traffic_type tr_type);
+bool storm_ctl_sw_accept(struct ifnet *ifp, struct rte_mbuf *m,
+			 uint16_t vlan);
 
 #endif
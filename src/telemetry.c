@@ -0,0 +1,237 @@
+/*
+ * Copyright (c) 2021, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * Per lcore telemetry rings, drained on the main thread.
+ */
+
+#include <rte_cycles.h>
+#include <rte_debug.h>
+#include <rte_lcore.h>
+#include <rte_log.h>
+#include <rte_malloc.h>
+#include <rte_spinlock.h>
+#include <rte_timer.h>
+#include <stdlib.h>
+#include <urcu/arch.h>
+#include <urcu/system.h>
+#include <urcu/uatomic.h>
+
+#include "dp_event.h"
+#include "telemetry.h"
+#include "vplane_debug.h"
+#include "vplane_log.h"
+
+struct dp_telemetry_ring *dp_telemetry_rings[RTE_MAX_LCORE];
+bool dp_telemetry_lost;
+
+static struct dp_telemetry_export *dp_telemetry_exports[DP_TELEMETRY_TYPE_MAX];
+
+/*
+ * The rings have a single consumer, and the export queues are shared
+ * with it, but an export may be run on demand outside the timer.
+ */
+static rte_spinlock_t dp_telemetry_lock = RTE_SPINLOCK_INITIALIZER;
+
+static struct rte_timer dp_telemetry_timer;
+
+void dp_telemetry_export_register(struct dp_telemetry_export *exp)
+{
+	dp_telemetry_exports[exp->type] = exp;
+}
+
+static void dp_telemetry_resync(void)
+{
+	unsigned int type;
+
+	for (type = 0; type < DP_TELEMETRY_TYPE_MAX; type++)
+		if (dp_telemetry_exports[type])
+			dp_telemetry_exports[type]->resync = true;
+}
+
+/* Queue a changed object's key, once, for the next export */
+static void dp_telemetry_export_rec(struct dp_telemetry_export *exp,
+				    const void *key)
+{
+	uint32_t *changed = exp->changed(key);
+	uint32_t mark;
+
+	if (!changed) /* gone */
+		return;
+	/* sent since it was published, or already queued */
+	mark = CMM_LOAD_SHARED(*changed);
+	if (!mark || (mark & DP_TELEMETRY_QUEUED))
+		return;
+
+	if (exp->pending_cnt == exp->pending_max) {
+		unsigned int max = exp->pending_max ? exp->pending_max * 2 : 64;
+		uint8_t *pending;
+
+		pending = realloc(exp->pending, max * exp->key_len);
+		if (!pending) {
+			exp->resync = true;
+			return;
+		}
+		exp->pending = pending;
+		exp->pending_max = max;
+	}
+
+	uatomic_or(changed, DP_TELEMETRY_QUEUED);
+	memcpy(exp->pending + exp->pending_cnt++ * exp->key_len, key,
+	       exp->key_len);
+}
+
+static bool dp_telemetry_drain_ring(struct dp_telemetry_ring *ring)
+{
+	uint32_t head, tail;
+	bool lost;
+
+	lost = CMM_LOAD_SHARED(ring->lost);
+	if (lost)
+		CMM_STORE_SHARED(ring->lost, false);
+
+	head = CMM_LOAD_SHARED(ring->head);
+	/* read head before the records it covers */
+	cmm_smp_rmb();
+
+	for (tail = ring->tail; tail != head; tail++) {
+		const struct dp_telemetry_rec *rec =
+			&ring->recs[tail & (DP_TELEMETRY_RING_SZ - 1)];
+
+		if (rec->type < DP_TELEMETRY_TYPE_MAX &&
+		    dp_telemetry_exports[rec->type])
+			dp_telemetry_export_rec(dp_telemetry_exports[rec->type],
+						rec->data);
+	}
+
+	/* finish with the records before handing them back */
+	cmm_smp_mb();
+	CMM_STORE_SHARED(ring->tail, tail);
+
+	return lost;
+}
+
+static void dp_telemetry_drain_locked(void)
+{
+	unsigned int lcore_id;
+	bool lost = false;
+
+	if (CMM_LOAD_SHARED(dp_telemetry_lost)) {
+		CMM_STORE_SHARED(dp_telemetry_lost, false);
+		lost = true;
+	}
+
+	RTE_LCORE_FOREACH(lcore_id) {
+		struct dp_telemetry_ring *ring = dp_telemetry_rings[lcore_id];
+
+		if (ring && dp_telemetry_drain_ring(ring))
+			lost = true;
+	}
+
+	if (lost) {
+		DP_DEBUG(INIT, DEBUG, DATAPLANE,
+			 "telemetry records lost, resyncing\n");
+		dp_telemetry_resync();
+	}
+}
+
+void dp_telemetry_drain(void)
+{
+	rte_spinlock_lock(&dp_telemetry_lock);
+	dp_telemetry_drain_locked();
+	rte_spinlock_unlock(&dp_telemetry_lock);
+}
+
+bool dp_telemetry_export(struct dp_telemetry_export *exp)
+{
+	unsigned int i;
+	uint8_t *keys;
+	unsigned int max;
+	bool resync;
+
+	rte_spinlock_lock(&dp_telemetry_lock);
+	dp_telemetry_drain_locked();
+
+	exp->sent = 0;
+	resync = exp->resync;
+	if (resync) {
+		exp->resync = false;
+		exp->pending_cnt = 0;
+		exp->recheck_cnt = 0;
+		exp->export_all();
+	}
+
+	/*
+	 * Objects sent last time whose mark is still clear may have
+	 * changed without being published, if the change was seen late.
+	 * Those with the mark set are queued already.
+	 */
+	for (i = 0; i < exp->recheck_cnt; i++) {
+		const void *key = exp->recheck + i * exp->key_len;
+		uint32_t *changed = exp->changed(key);
+
+		if (changed && !CMM_LOAD_SHARED(*changed) &&
+		    exp->export(key, true))
+			exp->sent++;
+	}
+
+	for (i = 0; i < exp->pending_cnt; i++)
+		if (exp->export(exp->pending + i * exp->key_len, false))
+			exp->sent++;
+
+	/* what was sent now is checked again next time */
+	keys = exp->recheck;
+	max = exp->recheck_max;
+	exp->recheck = exp->pending;
+	exp->recheck_max = exp->pending_max;
+	exp->recheck_cnt = exp->pending_cnt;
+	exp->pending = keys;
+	exp->pending_max = max;
+	exp->pending_cnt = 0;
+
+	rte_spinlock_unlock(&dp_telemetry_lock);
+	return resync;
+}
+
+static void dp_telemetry_timer_cb(struct rte_timer *tim __rte_unused,
+				  void *arg __rte_unused)
+{
+	dp_telemetry_drain();
+}
+
+static void dp_telemetry_init(void)
+{
+	unsigned int lcore_id;
+
+	RTE_LCORE_FOREACH(lcore_id) {
+		if (dp_telemetry_rings[lcore_id])
+			continue;
+
+		dp_telemetry_rings[lcore_id] =
+			rte_zmalloc_socket("telemetry",
+					   sizeof(struct dp_telemetry_ring),
+					   RTE_CACHE_LINE_SIZE,
+					   rte_lcore_to_socket_id(lcore_id));
+		if (!dp_telemetry_rings[lcore_id])
+			rte_panic("Can't allocate telemetry ring for lcore %u\n",
+				  lcore_id);
+	}
+
+	rte_timer_init(&dp_telemetry_timer);
+	rte_timer_reset(&dp_telemetry_timer, rte_get_timer_hz(), PERIODICAL,
+			rte_get_master_lcore(), dp_telemetry_timer_cb, NULL);
+}
+
+/* Rings are left in place as forwarding threads may still publish */
+static void dp_telemetry_uninit(void)
+{
+	rte_timer_stop(&dp_telemetry_timer);
+}
+
+static const struct dp_event_ops dp_telemetry_events = {
+	.init = dp_telemetry_init,
+	.uninit = dp_telemetry_uninit,
+};
+
+DP_STARTUP_EVENT_REGISTER(dp_telemetry_events);
@@ -0,0 +1,183 @@
+/*
+ * Copyright (c) 2021, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ */
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+/*
+ * Per lcore telemetry rings.
+ *
+ * The forwarding path publishes small fixed size records (the key of
+ * an object whose counters changed) to a single producer single
+ * consumer ring owned by its lcore, with no locks or atomic operations.
+ * The main thread drains all the rings and hands each record to the
+ * export registered for its type, so consumers only do work for what
+ * has changed rather than walking their tables.
+ *
+ * An export is for objects whose changed counters are sent to the
+ * controller periodically. The object carries a changed mark, and the
+ * forwarding path publishes the object's key only when
+ * dp_telemetry_mark_changed() says it is the first change since the
+ * object was last sent. The drain queues the keys, and
+ * dp_telemetry_export() hands them to the consumer at its interval.
+ *
+ * The mark is tested and set without barriers, so the exporter may
+ * see a counter change late: after it has cleared the mark and sent
+ * the object, from a thread that saw the mark still set and so did
+ * not publish. Each object sent is therefore checked once more at the
+ * next interval and sent again if its counters have moved since.
+ *
+ * If a ring overflows, or a record is published from a thread that
+ * has no ring, every export falls back to sending all its objects.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <rte_branch_prediction.h>
+#include <rte_common.h>
+#include <rte_lcore.h>
+#include <urcu/arch.h>
+#include <urcu/system.h>
+#include <urcu/uatomic.h>
+
+#include "compiler.h"
+
+enum dp_telemetry_type {
+	DP_TELEMETRY_MROUTE,
+	DP_TELEMETRY_MROUTE6,
+	DP_TELEMETRY_TYPE_MAX
+};
+
+#define DP_TELEMETRY_DATA_SZ 48
+#define DP_TELEMETRY_RING_SZ 1024	/* must be a power of 2 */
+
+struct dp_telemetry_rec {
+	uint32_t type;
+	uint8_t data[DP_TELEMETRY_DATA_SZ];
+};
+
+struct dp_telemetry_ring {
+	uint32_t head;		/* written by producer */
+	bool lost;		/* written by producer */
+	uint64_t dropped;
+	uint32_t tail __rte_cache_aligned; /* written by consumer */
+	struct dp_telemetry_rec recs[DP_TELEMETRY_RING_SZ]
+		__rte_cache_aligned;
+};
+
+extern struct dp_telemetry_ring *dp_telemetry_rings[RTE_MAX_LCORE];
+extern bool dp_telemetry_lost;
+
+/*
+ * Publish a record from the forwarding path. Returns false if it
+ * could not be queued, in which case the consumer will be asked to
+ * resync.
+ */
+static ALWAYS_INLINE bool
+dp_telemetry_publish(enum dp_telemetry_type type, const void *data,
+		     size_t len)
+{
+	unsigned int lcore_id = rte_lcore_id();
+	struct dp_telemetry_ring *ring;
+	struct dp_telemetry_rec *rec;
+	uint32_t head;
+
+	if (unlikely(lcore_id >= RTE_MAX_LCORE) ||
+	    unlikely(!(ring = dp_telemetry_rings[lcore_id]))) {
+		CMM_STORE_SHARED(dp_telemetry_lost, true);
+		return false;
+	}
+
+	head = ring->head;
+	if (unlikely(head - CMM_LOAD_SHARED(ring->tail) ==
+		     DP_TELEMETRY_RING_SZ)) {
+		ring->dropped++;
+		CMM_STORE_SHARED(ring->lost, true);
+		return false;
+	}
+
+	rec = &ring->recs[head & (DP_TELEMETRY_RING_SZ - 1)];
+	rec->type = type;
+	memcpy(rec->data, data, RTE_MIN(len, sizeof(rec->data)));
+
+	/* record must be visible before the new head */
+	cmm_smp_wmb();
+	CMM_STORE_SHARED(ring->head, head + 1);
+	return true;
+}
+
+/* Set in a changed mark once its object's key has been queued */
+#define DP_TELEMETRY_QUEUED	(1u << 31)
+
+/*
+ * Mark an object changed after updating its counters. Returns true if
+ * the caller is the first to change it since it was last sent, and so
+ * must publish its key.
+ */
+static ALWAYS_INLINE bool dp_telemetry_mark_changed(uint32_t *changed)
+{
+	/*
+	 * Two lcores may both find the mark clear and both publish; the
+	 * drain only queues the key once.
+	 */
+	if (likely(CMM_LOAD_SHARED(*changed)))
+		return false;
+	CMM_STORE_SHARED(*changed, 1);
+	return true;
+}
+
+/*
+ * Clear an object's changed mark before reading the counters to send,
+ * so that changes from here on are picked up at the next interval.
+ */
+static inline void dp_telemetry_export_begin(uint32_t *changed)
+{
+	uatomic_set(changed, 0);
+	cmm_smp_mb();
+}
+
+struct dp_telemetry_export {
+	enum dp_telemetry_type type;
+	size_t key_len;		/* of the published record */
+	/* Changed mark of the object with this key, NULL if it has gone */
+	uint32_t *(*changed)(const void *key);
+	/*
+	 * Send the object with this key, if it still exists. On a recheck,
+	 * only if its counters have moved since it was last sent. Returns
+	 * true if it was sent.
+	 */
+	bool (*export)(const void *key, bool recheck);
+	/* Send every object, as changes may have been missed */
+	void (*export_all)(void);
+
+	/* Objects sent individually by the last export */
+	unsigned int sent;
+
+	/* Keys queued by the drain, under the telemetry lock */
+	uint8_t *pending;
+	unsigned int pending_cnt;
+	unsigned int pending_max;
+	/* Keys sent at the last interval, to check again at this one */
+	uint8_t *recheck;
+	unsigned int recheck_cnt;
+	unsigned int recheck_max;
+	bool resync;
+};
+
+void dp_telemetry_export_register(struct dp_telemetry_export *exp);
+
+/*
+ * Drain the rings and send what has changed since the last call.
+ * Returns true if everything was sent, as changes may have been missed.
+ */
+bool dp_telemetry_export(struct dp_telemetry_export *exp);
+
+/* Hand all queued records to their consumers */
+void dp_telemetry_drain(void);
+
+#endif /* TELEMETRY_H */
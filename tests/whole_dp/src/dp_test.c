@@ -308,6 +308,24 @@ dp_test_parse_args(int argc, char **argv)
 
 static SRunner *dp_test_runner;
 
+/* Suites that are only run when named by CK_RUN_SUITE */
+static const char * const dp_test_benchmark_suites[] = {
+	"dp_test_perf.c",
+};
+
+static bool
+dp_test_suite_skipped(const char *filename)
+{
+	const char *run_suite = getenv("CK_RUN_SUITE");
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(dp_test_benchmark_suites); i++)
+		if (strcmp(filename, dp_test_benchmark_suites[i]) == 0)
+			return !run_suite || strcmp(run_suite, filename) != 0;
+
+	return false;
+}
+
 Suite *
 dp_test_get_suite(const char *filename)
 {
@@ -319,6 +337,8 @@ dp_test_get_suite(const char *filename)
 		       dp_test_pname, filename);
 		return NULL;
 	}
+	if (dp_test_suite_skipped(filename))
+		return s;
 	if (!dp_test_runner)
 		dp_test_runner = srunner_create(s);
 	else
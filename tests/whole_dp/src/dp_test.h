@@ -69,6 +69,65 @@ int __real_rte_eal_init(int argc, char **argv);
 FILE *__wrap_popen(const char *command, const char *type);
 int __wrap_pclose(FILE *stream);
 
+struct rte_tm_capabilities;
+struct rte_tm_error;
+struct rte_tm_node_params;
+struct rte_tm_shaper_params;
+int __wrap_rte_tm_capabilities_get(uint16_t port_id,
+				   struct rte_tm_capabilities *cap,
+				   struct rte_tm_error *error);
+int __real_rte_tm_capabilities_get(uint16_t port_id,
+				   struct rte_tm_capabilities *cap,
+				   struct rte_tm_error *error);
+int __wrap_rte_tm_get_number_of_leaf_nodes(uint16_t port_id,
+					   uint32_t *n_leaf_nodes,
+					   struct rte_tm_error *error);
+int __real_rte_tm_get_number_of_leaf_nodes(uint16_t port_id,
+					   uint32_t *n_leaf_nodes,
+					   struct rte_tm_error *error);
+int __wrap_rte_tm_shaper_profile_add(uint16_t port_id,
+				     uint32_t shaper_profile_id,
+				     struct rte_tm_shaper_params *profile,
+				     struct rte_tm_error *error);
+int __real_rte_tm_shaper_profile_add(uint16_t port_id,
+				     uint32_t shaper_profile_id,
+				     struct rte_tm_shaper_params *profile,
+				     struct rte_tm_error *error);
+int __wrap_rte_tm_shaper_profile_delete(uint16_t port_id,
+					uint32_t shaper_profile_id,
+					struct rte_tm_error *error);
+int __real_rte_tm_shaper_profile_delete(uint16_t port_id,
+					uint32_t shaper_profile_id,
+					struct rte_tm_error *error);
+int __wrap_rte_tm_node_add(uint16_t port_id, uint32_t node_id,
+			   uint32_t parent_node_id, uint32_t priority,
+			   uint32_t weight, uint32_t level_id,
+			   struct rte_tm_node_params *params,
+			   struct rte_tm_error *error);
+int __real_rte_tm_node_add(uint16_t port_id, uint32_t node_id,
+			   uint32_t parent_node_id, uint32_t priority,
+			   uint32_t weight, uint32_t level_id,
+			   struct rte_tm_node_params *params,
+			   struct rte_tm_error *error);
+int __wrap_rte_tm_node_delete(uint16_t port_id, uint32_t node_id,
+			      struct rte_tm_error *error);
+int __real_rte_tm_node_delete(uint16_t port_id, uint32_t node_id,
+			      struct rte_tm_error *error);
+int __wrap_rte_tm_hierarchy_commit(uint16_t port_id, int clear_on_fail,
+				   struct rte_tm_error *error);
+int __real_rte_tm_hierarchy_commit(uint16_t port_id, int clear_on_fail,
+				   struct rte_tm_error *error);
+
+/*
+ * Give a port the rte_tm support of a NIC with its own shapers, whose
+ * node deletes and leaf adds can be made to fail.
+ */
+void dp_test_tm_emulate(const char *real_ifname, bool enable);
+void dp_test_tm_fail_delete(bool fail);
+void dp_test_tm_fail_leaf_add(bool fail);
+bool dp_test_tm_shaping(void);
+uint32_t dp_test_tm_nodes(void);
+
 extern bool from_external;
 extern char dp_ut_dummyfs_dir[PATH_MAX];
 
@@ -17,6 +17,8 @@
 #include "dp_test_pktmbuf_lib_internal.h"
 #include "dp_test_netlink_state_internal.h"
 
+#include "ether.h"
+#include "if_var.h"
 #include "ip_funcs.h"
 #include "in_cksum.h"
 
@@ -1492,3 +1494,80 @@ DP_START_TEST(bridge_flush, bridge_flush)
 	dp_test_intf_bridge_remove_port("br1", "dp2T1");
 	dp_test_intf_bridge_del("br1");
 } DP_END_TEST;
+
+/*
+ * Check the fused input graph an interface is given for its class
+ */
+static void
+_bridge_if_class_check(const char *ifname, enum pl_if_class if_class,
+		       const char *file, int line)
+{
+	char real[IFNAMSIZ];
+	struct ifnet *ifp;
+
+	dp_test_intf_real(ifname, real);
+	ifp = dp_ifnet_byifname(real);
+	_dp_test_fail_unless(ifp, file, line, "no interface %s", real);
+	_dp_test_fail_unless(ifp->if_pl_class == if_class, file, line,
+			     "%s class %u, expected %u", real,
+			     ifp->if_pl_class, if_class);
+	_dp_test_fail_unless(ether_if_input_func(ifp) ==
+			     ether_if_class_input[if_class], file, line,
+			     "%s input not through its class graph", real);
+}
+
+#define bridge_if_class_check(ifname, if_class) \
+	_bridge_if_class_check(ifname, if_class, __FILE__, __LINE__)
+
+/*
+ * Interfaces change class, and so input graph, as they are added to and
+ * removed from a bridge, which adds and removes the bridge-in feature,
+ * and frames are still bridged through the bridge port graph.
+ */
+DP_DECL_TEST_CASE(bridge_suite, bridge_if_class, NULL, NULL);
+DP_START_TEST(bridge_if_class, bridge_if_class)
+{
+	struct dp_test_expected *exp;
+	const char *mac_a, *mac_b;
+	struct rte_mbuf *test_pak;
+	int len = 64;
+
+	mac_a = "00:00:a4:00:00:aa";
+	mac_b = "00:00:a4:00:00:bb";
+
+	dp_test_intf_vxlan_create("vxl50", 50, "dp2T1");
+
+	bridge_if_class_check("dp1T0", PL_IF_CLASS_ROUTED);
+	bridge_if_class_check("vxl50", PL_IF_CLASS_TUNNEL);
+
+	dp_test_intf_bridge_create("br1");
+	dp_test_intf_bridge_add_port("br1", "dp1T0");
+	dp_test_intf_bridge_add_port("br1", "dp2T1");
+
+	bridge_if_class_check("dp1T0", PL_IF_CLASS_BRIDGE_PORT);
+	bridge_if_class_check("dp2T1", PL_IF_CLASS_BRIDGE_PORT);
+
+	test_pak = dp_test_create_l2_pak(mac_b, mac_a,
+					 DP_TEST_ET_LLDP, 1, &len);
+	exp = dp_test_exp_create(test_pak);
+	dp_test_exp_set_oif_name(exp, "dp2T1");
+	dp_test_pak_receive(test_pak, "dp1T0", exp);
+
+	dp_test_intf_bridge_add_port("br1", "vxl50");
+	bridge_if_class_check("vxl50", PL_IF_CLASS_BRIDGE_PORT);
+
+	dp_test_intf_bridge_remove_port("br1", "vxl50");
+	dp_test_intf_bridge_remove_port("br1", "dp1T0");
+
+	bridge_if_class_check("dp1T0", PL_IF_CLASS_ROUTED);
+	bridge_if_class_check("dp2T1", PL_IF_CLASS_BRIDGE_PORT);
+	bridge_if_class_check("vxl50", PL_IF_CLASS_TUNNEL);
+
+	dp_test_console_request_reply("bridge br1 macs clear", false);
+	dp_test_intf_bridge_remove_port("br1", "dp2T1");
+	dp_test_intf_bridge_del("br1");
+
+	bridge_if_class_check("dp2T1", PL_IF_CLASS_ROUTED);
+
+	dp_test_intf_vxlan_del("vxl50", 50);
+} DP_END_TEST;
@@ -15,6 +15,7 @@
 #include <netinet/in.h>
 #include <netinet/ip.h>
 #include <net/if_arp.h>
+#include <linux/mroute.h>
 #include <linux/if_ether.h>
 #include <libmnl/libmnl.h>
 #include <czmq.h>
@@ -612,10 +613,35 @@ stats_update(zmsg_t *msg)
 	/* nothing to do */
 }
 
+/* IPv4 mroute stats sent by the dataplane, for the tests to check */
+static pthread_mutex_t mrt_stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned int mrt_stats_cnt;
+static struct sioc_sg_req mrt_stats_last;
+
+void dp_test_mrt_stats_get(unsigned int *cnt, struct sioc_sg_req *last)
+{
+	pthread_mutex_lock(&mrt_stats_lock);
+	*cnt = mrt_stats_cnt;
+	*last = mrt_stats_last;
+	pthread_mutex_unlock(&mrt_stats_lock);
+}
+
 static void
 mrt_request(zsock_t *sock, zmsg_t *msg, zframe_t **envelope)
 {
-	/* nothing to do */
+	zframe_t *frame = zmsg_pop(msg);
+
+	if (!frame || zframe_size(frame) != sizeof(mrt_stats_last)) {
+		err("bad sg count in mroute stats message");
+		zframe_destroy(&frame);
+		return;
+	}
+
+	pthread_mutex_lock(&mrt_stats_lock);
+	mrt_stats_cnt++;
+	memcpy(&mrt_stats_last, zframe_data(frame), sizeof(mrt_stats_last));
+	pthread_mutex_unlock(&mrt_stats_lock);
+	zframe_destroy(&frame);
 }
 
 static void
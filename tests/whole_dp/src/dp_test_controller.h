@@ -41,4 +41,8 @@ void dp_test_send_config_src_pb(enum cont_src_en cont_src,
 				void *cmd, size_t cmd_len);
 void dp_test_set_config_err(int error);
 
+struct sioc_sg_req;
+/* Count of IPv4 mroute stats messages received, and the last of them */
+void dp_test_mrt_stats_get(unsigned int *cnt, struct sioc_sg_req *last);
+
 #endif /* _DP_TEST_CONTROLLER_H_ */
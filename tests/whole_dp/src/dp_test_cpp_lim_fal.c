@@ -25,6 +25,7 @@
 #include "dp_test_console.h"
 #include "dp_test_controller.h"
 #include "dp_test_json_utils.h"
+#include "protobuf/cpp_rl.pb-c.h"
 
 /* object where the limiter is stored in dp_test_cpp_lim.c */
 extern fal_object_t limiter_obj_id;
@@ -67,3 +68,105 @@ DP_START_TEST(cpp_lim_fal_basic, fal_basic_1)
 	/* remove the rate limiter */
 	remove_and_commit_cpp_rate_limiter();
 } DP_END_TEST;
+
+/*
+ * Configure a limiter for ICMP alone, at rate_pps. The test FAL plugin
+ * refuses a limiter without a default, so it is policed in software.
+ */
+static void cpp_lim_sw_icmp_cfg(uint32_t rate_pps)
+{
+	CppRl__CPPLimiter__CPPAttribute__CPPParameter param =
+		CPP_RL__CPP_LIMITER__CPP_ATTRIBUTE__CPP_PARAMETER__INIT;
+	CppRl__CPPLimiter__CPPAttribute__CPPParameter *params[] = { &param };
+	CppRl__CPPLimiter__CPPAttribute attr =
+		CPP_RL__CPP_LIMITER__CPP_ATTRIBUTE__INIT;
+	CppRl__CPPLimiter__CPPAttribute *attrs[] = { &attr };
+	CppRl__CPPLimiter cpp_msg = CPP_RL__CPP_LIMITER__INIT;
+	void *buf;
+	int len;
+
+	if (rate_pps) {
+		param.has_rate_pps = true;
+		param.rate_pps = rate_pps;
+		attr.has_attr = true;
+		attr.attr =
+		 CPP_RL__CPP_LIMITER__CPP_ATTRIBUTE__CPP_ATTR_EN__CPP_ATTR_ICMP;
+		attr.n_parameters = ARRAY_SIZE(params);
+		attr.parameters = params;
+		cpp_msg.n_attributes = ARRAY_SIZE(attrs);
+		cpp_msg.attributes = attrs;
+	}
+
+	len = cpp_rl__cpp_limiter__get_packed_size(&cpp_msg);
+	buf = malloc(len);
+	dp_test_assert_internal(buf);
+	cpp_rl__cpp_limiter__pack(&cpp_msg, buf);
+
+	dp_test_lib_pb_wrap_and_send_pb("vyatta:cpp-rate-limiter-cfg",
+					buf, len);
+}
+
+static void cpp_lim_sw_icmp_check(uint32_t rate_pps, uint64_t accepted,
+				  uint64_t dropped)
+{
+	json_object *jexp;
+
+	jexp = dp_test_json_create(
+		"{ \"limiter\": [ {"
+		"    \"limiter-type\": \"icmp\","
+		"    \"enforcement\": \"software\","
+		"    \"state\": {"
+		"      \"packets-accepted\": %" PRIu64 ","
+		"      \"packets-dropped\": %" PRIu64 " },"
+		"    \"packets-per-second\": {"
+		"      \"state\": { \"rate\": %u } }"
+		"} ] }", accepted, dropped, rate_pps);
+	dp_test_check_json_state("cpp-rl-op get-state", jexp,
+				 DP_TEST_JSON_CHECK_SUBSET, false);
+	json_object_put(jexp);
+}
+
+DP_DECL_TEST_CASE(cpp_lim_fal, cpp_lim_sw, NULL, NULL);
+
+/*
+ * A flood of pings to a local address, with the limiter at 1 pps and a
+ * 100ms burst: the first is punted and the rest of the flood, sent well
+ * within a second, are dropped.
+ */
+DP_START_TEST(cpp_lim_sw, sw_flood)
+{
+	struct dp_test_expected *exp;
+	struct rte_mbuf *test_pak;
+	int len = 64;
+	int i;
+
+#define CPP_LIM_SW_FLOOD 10
+	dp_test_nl_add_ip_addr_and_connected("dp1T1", "1.1.1.1/24");
+
+	cpp_lim_sw_icmp_cfg(1);
+	cpp_lim_sw_icmp_check(1, 0, 0);
+
+	for (i = 0; i < CPP_LIM_SW_FLOOD; i++) {
+		test_pak = dp_test_create_icmp_ipv4_pak(
+			"1.1.1.2", "1.1.1.1", ICMP_ECHO, 0,
+			DPT_ICMP_ECHO_DATA(0xac9, i), 1, &len,
+			NULL, NULL, NULL);
+		(void)dp_test_pktmbuf_eth_init(
+			test_pak, dp_test_intf_name2mac_str("dp1T1"),
+			"aa:bb:cc:dd:ee:ff", RTE_ETHER_TYPE_IPV4);
+
+		exp = dp_test_exp_create(test_pak);
+		dp_test_exp_set_fwd_status(exp, i == 0 ? DP_TEST_FWD_LOCAL :
+					   DP_TEST_FWD_DROPPED);
+		dp_test_pak_receive(test_pak, "dp1T1", exp);
+	}
+
+	cpp_lim_sw_icmp_check(1, 1, CPP_LIM_SW_FLOOD - 1);
+
+	dp_test_console_request_reply("cpp-rl-op clear-stats icmp", false);
+	cpp_lim_sw_icmp_check(1, 0, 0);
+
+	/* Clean Up */
+	cpp_lim_sw_icmp_cfg(0);
+	dp_test_nl_del_ip_addr_and_connected("dp1T1", "1.1.1.1/24");
+} DP_END_TEST;
@@ -11,7 +11,11 @@
 #include "dp_test_controller.h"
 #include "dp_test_console.h"
 #include "dp_test_json_utils.h"
+#include "dp_test_lib.h"
 #include "dp_test_lib_internal.h"
+#include "dp_test_lib_intf.h"
+#include "dp_test_netlink_state.h"
+#include "dp_test_pktmbuf_lib.h"
 
 #include "protobuf/GPCConfig.pb-c.h"
 #include "protobuf/IPAddress.pb-c.h"
@@ -318,7 +322,7 @@ dp_test_gpc_setup_table(GPCTable *table, const char *ifname,
 			TrafficType traffic_type, Rules *rules,
 			uint32_t n_table_names, char **table_names)
 {
-	table->ifname = "dp1T0";
+	table->ifname = (char *)ifname;
 	table->has_location = true;
 	table->location = location;
 	table->has_traffic_type = true;
@@ -599,3 +603,219 @@ DP_START_TEST(gpc_pb_parsing, test1)
 	dp_test_gpc_check_state(expected_reply_2);
 
 } DP_END_TEST;
+
+/*
+ * Without ACL tables in the test FAL the tables are classified by the
+ * software path, so their actions can be seen on forwarded packets.
+ */
+#define GPC_SW_NH_MAC "aa:bb:cc:dd:2:b1"
+
+static void
+dp_test_gpc_sw_setup(void)
+{
+	dp_test_nl_add_ip_addr_and_connected("dp1T0", "1.1.1.1/24");
+	dp_test_nl_add_ip_addr_and_connected("dp2T1", "2.2.2.2/24");
+	dp_test_netlink_add_neigh("dp1T0", "1.1.1.2", "aa:bb:cc:dd:1:a1");
+	dp_test_netlink_add_neigh("dp2T1", "2.2.2.1", GPC_SW_NH_MAC);
+}
+
+static void
+dp_test_gpc_sw_teardown(void)
+{
+	dp_test_create_and_send_gpc_delete_msg();
+	dp_test_gpc_check_state(expected_reply_2);
+	dp_test_wait_for_pl_feat_gone("dp1T0", "vyatta:ipv4-gpc-in",
+				      "ipv4-validate");
+
+	dp_test_netlink_del_neigh("dp1T0", "1.1.1.2", "aa:bb:cc:dd:1:a1");
+	dp_test_netlink_del_neigh("dp2T1", "2.2.2.1", GPC_SW_NH_MAC);
+	dp_test_nl_del_ip_addr_and_connected("dp1T0", "1.1.1.1/24");
+	dp_test_nl_del_ip_addr_and_connected("dp2T1", "2.2.2.2/24");
+}
+
+/* An ingress table on dp1T0 with one counted rule matching UDP */
+static void
+dp_test_gpc_sw_send_config(RuleAction *action)
+{
+	TrafficType traffic_type = TRAFFIC_TYPE__IPV4;
+	RuleMatch match = RULE_MATCH__INIT;
+	RuleMatch *match_array[] = { &match };
+	RuleAction *action_array[] = { action };
+	RuleCounter counter = RULE_COUNTER__INIT;
+	Rule rule = RULE__INIT;
+	Rule *rules_array[] = { &rule };
+	Rules rules = RULES__INIT;
+	GPCTable table = GPCTABLE__INIT;
+	GPCTable *table_array[] = { &table };
+	char *table_names[] = { "gpc-sw-table" };
+	GPCConfig config = GPCCONFIG__INIT;
+	char real_ifname[IFNAMSIZ];
+
+	dp_test_gpc_setup_match_proto_final(&match, IPPROTO_UDP);
+
+	counter.has_counter_type = true;
+	counter.counter_type = RULE_COUNTER__COUNTER_TYPE__AUTO;
+
+	dp_test_gpc_setup_rule(&rule, 1, ARRAY_SIZE(match_array),
+			       match_array, ARRAY_SIZE(action_array),
+			       action_array, &counter);
+	dp_test_gpc_setup_rules(&rules, traffic_type, ARRAY_SIZE(rules_array),
+				rules_array);
+	dp_test_gpc_setup_table(&table,
+				dp_test_intf_real("dp1T0", real_ifname),
+				GPCTABLE__FEATURE_LOCATION__INGRESS,
+				traffic_type, &rules,
+				ARRAY_SIZE(table_names), table_names);
+
+	config.has_feature_type = true;
+	config.feature_type = GPCCONFIG__FEATURE_TYPE__QOS;
+	config.n_tables = 1;
+	config.tables = table_array;
+
+	size_t len = gpcconfig__get_packed_size(&config);
+	void *buf = malloc(len);
+	dp_test_assert_internal(buf);
+
+	gpcconfig__pack(&config, buf);
+
+	dp_test_lib_pb_wrap_and_send_pb("vyatta:gpc-config", buf, len);
+
+	dp_test_wait_for_pl_feat("dp1T0", "vyatta:ipv4-gpc-in",
+				 "ipv4-validate");
+}
+
+/* Send a UDP packet in on dp1T0, either forwarded to dp2T1 or dropped */
+static void
+dp_test_gpc_sw_send_pak(int len, bool forwarded)
+{
+	struct dp_test_expected *exp;
+	struct rte_mbuf *test_pak;
+
+	test_pak = dp_test_create_ipv4_pak("1.1.1.2", "2.2.2.1", 1, &len);
+	dp_test_pktmbuf_eth_init(test_pak,
+				 dp_test_intf_name2mac_str("dp1T0"),
+				 DP_TEST_INTF_DEF_SRC_MAC,
+				 RTE_ETHER_TYPE_IPV4);
+
+	exp = dp_test_exp_create(test_pak);
+	if (forwarded) {
+		dp_test_exp_set_oif_name(exp, "dp2T1");
+		dp_test_pktmbuf_eth_init(dp_test_exp_get_pak(exp),
+					 GPC_SW_NH_MAC,
+					 dp_test_intf_name2mac_str("dp2T1"),
+					 RTE_ETHER_TYPE_IPV4);
+		dp_test_ipv4_decrement_ttl(dp_test_exp_get_pak(exp));
+	} else {
+		dp_test_exp_set_fwd_status(exp, DP_TEST_FWD_DROPPED);
+	}
+
+	dp_test_pak_receive(test_pak, "dp1T0", exp);
+}
+
+static void
+dp_test_gpc_sw_check_rule(const char *actions, uint64_t packets,
+			  uint64_t bytes)
+{
+	char expected[TEST_MAX_REPLY_LEN];
+
+	snprintf(expected, sizeof(expected),
+		 "{"
+		 "  \"gpc\":{"
+		 "    \"features\":["
+		 "      {"
+		 "        \"type\":\"qos\","
+		 "        \"tables\":["
+		 "          {"
+		 "            \"rules\":["
+		 "              {"
+		 "                \"rule-number\":1,"
+		 "                %s"
+		 "                \"counter\":{"
+		 "                  \"packets\":%" PRIu64 ","
+		 "                  \"bytes\":%" PRIu64
+		 "                }"
+		 "              }"
+		 "            ]"
+		 "          }"
+		 "        ]"
+		 "      }"
+		 "    ]"
+		 "  }"
+		 "}", actions, packets, bytes);
+	dp_test_gpc_check_state(expected);
+}
+
+DP_DECL_TEST_CASE(gpc_pb_suite, gpc_pb_sw, NULL, NULL);
+
+/* Matching packets are counted and forwarded */
+DP_START_TEST(gpc_pb_sw, count)
+{
+	RuleAction action = RULE_ACTION__INIT;
+	int len = 22;
+
+	dp_test_gpc_sw_setup();
+
+	dp_test_gpc_setup_action(&action, NULL,
+				 RULE_ACTION__ACTION_VALUE_DECISION,
+				 RULE_ACTION__PACKET_DECISION__PASS);
+	dp_test_gpc_sw_send_config(&action);
+
+	dp_test_gpc_sw_send_pak(len, true);
+	dp_test_gpc_sw_send_pak(len, true);
+
+	/* L3 bytes: IP and UDP headers plus the payload */
+	dp_test_gpc_sw_check_rule("\"decision\":\"pass\",", 2,
+				  2 * (20 + 8 + len));
+
+	dp_test_gpc_sw_teardown();
+} DP_END_TEST;
+
+/* Matching packets are counted and dropped */
+DP_START_TEST(gpc_pb_sw, drop)
+{
+	RuleAction action = RULE_ACTION__INIT;
+	int len = 22;
+
+	dp_test_gpc_sw_setup();
+
+	dp_test_gpc_setup_action(&action, NULL,
+				 RULE_ACTION__ACTION_VALUE_DECISION,
+				 RULE_ACTION__PACKET_DECISION__DROP);
+	dp_test_gpc_sw_send_config(&action);
+
+	dp_test_gpc_sw_send_pak(len, false);
+
+	dp_test_gpc_sw_check_rule("\"decision\":\"drop\",", 1,
+				  20 + 8 + len);
+
+	dp_test_gpc_sw_teardown();
+} DP_END_TEST;
+
+/*
+ * A policer of 1000 bytes/sec with the minimum burst of one full frame
+ * lets two 1042 byte frames through back to back, but not a third.
+ */
+DP_START_TEST(gpc_pb_sw, police)
+{
+	RuleAction action = RULE_ACTION__INIT;
+	PolicerParams policer = POLICER_PARAMS__INIT;
+	int len = 1000;
+
+	dp_test_gpc_sw_setup();
+
+	dp_test_gpc_setup_action(&action, &policer,
+				 RULE_ACTION__ACTION_VALUE_POLICER, 1000);
+	dp_test_gpc_sw_send_config(&action);
+
+	dp_test_gpc_sw_send_pak(len, true);
+	dp_test_gpc_sw_send_pak(len, true);
+	dp_test_gpc_sw_send_pak(len, false);
+
+	/* All are counted, the counter comes before the policer */
+	dp_test_gpc_sw_check_rule("\"police\":{"
+				  "  \"bandwidth\":1000,"
+				  "  \"drops\":1"
+				  "},", 3, 3 * (20 + 8 + len));
+
+	dp_test_gpc_sw_teardown();
+} DP_END_TEST;
@@ -14,6 +14,7 @@
 
 #include <netinet/ip.h>
 #include <netinet/ip_icmp.h>
+#include <netinet/tcp.h>
 #include "ip_funcs.h"
 #include "in_cksum.h"
 #include "if/gre.h"
@@ -529,6 +530,78 @@ DP_START_TEST(gre_encap, simple_encap)
 	dp_test_gre_teardown_tunnel(VRF_DEFAULT_ID, "1.1.2.1", "1.1.2.2");
 } DP_END_TEST;
 
+/*
+ * The TCP segment expected for plen bytes at off into the payload of
+ * an oversize TCP packet, numbered seg.
+ */
+static struct rte_mbuf *
+gre_test_tcp_seg(struct rte_mbuf *orig, unsigned int seg, int off, int plen,
+		 uint8_t flags)
+{
+	const struct iphdr *oip = iphdr(orig);
+	const struct tcphdr *otcp = (const struct tcphdr *)(oip + 1);
+	struct rte_mbuf *m;
+	struct tcphdr *tcp;
+	struct iphdr *ip;
+
+	m = dp_test_create_tcp_ipv4_pak("1.1.1.2", "10.0.0.1", 1000, 80, flags,
+					ntohl(otcp->seq) + off,
+					ntohl(otcp->ack_seq), ntohs(otcp->window),
+					NULL, 1, &plen);
+	dp_test_assert_internal(m != NULL);
+
+	ip = iphdr(m);
+	tcp = (struct tcphdr *)(ip + 1);
+	memcpy(tcp + 1, (const char *)(otcp + 1) + off, plen);
+
+	/* each segment takes the next IP id */
+	dp_test_set_pak_ip_field(ip, DP_TEST_SET_IP_ID, ntohs(oip->id) + seg);
+	tcp->check = 0;
+	tcp->check = dp_test_ipv4_udptcp_cksum(m, ip, tcp);
+	return m;
+}
+
+/*
+ * An oversize TCP packet without DF is segmented to fit the tunnel,
+ * rather than fragmented, with PSH on the last segment only.
+ */
+DP_START_TEST(gre_encap, tcp_segment)
+{
+	struct iphdr *exp_ip_outer[DP_TEST_MAX_EXPECTED_PAKS] = { 0 };
+	struct dp_test_expected *exp;
+	struct rte_mbuf *seg_m[2];
+	struct iphdr *seg_ip[2];
+	struct rte_mbuf *m;
+	int seg0_len = 1476 - sizeof(struct iphdr) - sizeof(struct tcphdr);
+	int len = seg0_len + 100;
+
+	dp_test_gre_setup_tunnel(VRF_DEFAULT_ID, "1.1.2.1", "1.1.2.2");
+
+	m = dp_test_create_tcp_ipv4_pak("1.1.1.2", "10.0.0.1", 1000, 80,
+					TH_ACK | TH_PUSH, 12345, 54321, 8192,
+					NULL, 1, &len);
+	(void)dp_test_pktmbuf_eth_init(m, dp_test_intf_name2mac_str("dp1T1"),
+				       DP_TEST_INTF_DEF_SRC_MAC,
+				       RTE_ETHER_TYPE_IPV4);
+
+	seg_m[0] = gre_test_tcp_seg(m, 0, 0, seg0_len, TH_ACK);
+	seg_m[1] = gre_test_tcp_seg(m, 1, seg0_len, 100, TH_ACK | TH_PUSH);
+	seg_ip[0] = iphdr(seg_m[0]);
+	seg_ip[1] = iphdr(seg_m[1]);
+	dp_test_fail_unless(ntohs(seg_ip[0]->tot_len) == 1476,
+			    "first segment is %u bytes, expected 1476",
+			    ntohs(seg_ip[0]->tot_len));
+
+	gre_test_build_expected_pak(&exp, seg_ip, exp_ip_outer, 2);
+	dp_test_assert_internal(exp != NULL);
+	rte_pktmbuf_free(seg_m[0]);
+	rte_pktmbuf_free(seg_m[1]);
+
+	dp_test_pak_receive(m, "dp1T1", exp);
+
+	dp_test_gre_teardown_tunnel(VRF_DEFAULT_ID, "1.1.2.1", "1.1.2.2");
+} DP_END_TEST;
+
 DP_START_TEST(gre_encap, simple_encap_ipv6)
 {
 	struct rte_mbuf *m;
@@ -8,7 +8,9 @@
  * dataplane UT Multicast IP tests
  */
 #include "ip_funcs.h"
+#include "ip_mcast.h"
 #include "in_cksum.h"
+#include "rcu.h"
 
 #include "dp_test_lib_exp.h"
 #include "dp_test/dp_test_macros.h"
@@ -16,6 +18,7 @@
 #include "dp_test_pktmbuf_lib_internal.h"
 #include "dp_test_console.h"
 #include "dp_test_cmd_check.h"
+#include "dp_test_controller.h"
 
 DP_DECL_TEST_SUITE(ip_msuite);
 
@@ -184,6 +187,136 @@ DP_START_TEST(ip_mfwd_4, dp_forwarding)
 
 } DP_END_TEST;
 
+static void ip_mfwd_sg_cnt_fwd(void)
+{
+	const char *grp_mac = "01:00:5e:00:01:01";
+	struct dp_test_expected *exp;
+	struct rte_mbuf *test_pak;
+	int len = 22;
+
+	test_pak = dp_test_create_ipv4_pak("10.73.1.1", "224.0.1.1", 1, &len);
+	dp_test_pktmbuf_eth_init(test_pak, dp_test_intf_name2mac_str("dp1T0"),
+				 DP_TEST_INTF_DEF_SRC_MAC, RTE_ETHER_TYPE_IPV4);
+
+	exp = dp_test_exp_create_m(test_pak, 2);
+	dp_test_exp_set_oif_name_m(exp, 0, "dp2T1");
+	dp_test_exp_set_oif_name_m(exp, 1, "dp2T2");
+
+	(void)dp_test_pktmbuf_eth_init(dp_test_exp_get_pak_m(exp, 0),
+				       grp_mac,
+				       dp_test_intf_name2mac_str("dp2T1"),
+				       RTE_ETHER_TYPE_IPV4);
+	dp_test_ipv4_decrement_ttl(dp_test_exp_get_pak_m(exp, 0));
+
+	(void)dp_test_pktmbuf_eth_init(dp_test_exp_get_pak_m(exp, 1),
+				       grp_mac,
+				       dp_test_intf_name2mac_str("dp2T2"),
+				       RTE_ETHER_TYPE_IPV4);
+	dp_test_ipv4_decrement_ttl(dp_test_exp_get_pak_m(exp, 1));
+
+	dp_test_pak_receive(test_pak, "dp1T0", exp);
+}
+
+/*
+ * Run the stats interval now, and check that it sends the expected
+ * number of mroutes. *cnt is the number of mroute stats messages the
+ * controller has had so far.
+ */
+static void ip_mfwd_sg_cnt_check(unsigned int *cnt, unsigned int sent,
+				 unsigned long pktcnt)
+{
+	struct sioc_sg_req last;
+	unsigned int got;
+	int i;
+
+	dp_rcu_register_thread();
+	dp_rcu_thread_online();
+	got = mrt_stats_export();
+	dp_rcu_thread_offline();
+	dp_rcu_unregister_thread();
+
+	dp_test_fail_unless(got == sent,
+			    "expected %u mroutes sent, got %u", sent, got);
+	if (!sent)
+		return;
+
+	/* The messages reach the controller asynchronously */
+	*cnt += sent;
+	for (i = 0; i < 1000; i++) {
+		dp_test_mrt_stats_get(&got, &last);
+		if (got >= *cnt)
+			break;
+		usleep(1000);
+	}
+
+	dp_test_fail_unless(got == *cnt,
+			    "expected %u mroute stats messages, got %u",
+			    *cnt, got);
+	dp_test_fail_unless(last.pktcnt == pktcnt,
+			    "expected mroute pktcnt %lu, got %lu",
+			    pktcnt, last.pktcnt);
+}
+
+/*
+ * Only mroutes whose counters have changed are sent at the stats
+ * interval.
+ */
+DP_DECL_TEST_CASE(ip_msuite, ip_mfwd_sg_cnt, NULL, NULL);
+DP_START_TEST(ip_mfwd_sg_cnt, changed_only)
+{
+	struct sioc_sg_req last;
+	unsigned int cnt;
+
+	dp_test_nl_add_ip_addr_and_connected("dp1T0", "1.1.1.1/24");
+	dp_test_netlink_netconf_mcast("dp1T0", AF_INET, true);
+
+	dp_test_nl_add_ip_addr_and_connected("dp2T1", "2.2.2.2/24");
+	dp_test_netlink_netconf_mcast("dp2T1", AF_INET, true);
+
+	dp_test_nl_add_ip_addr_and_connected("dp2T2", "3.3.3.3/24");
+	dp_test_netlink_netconf_mcast("dp2T2", AF_INET, true);
+
+	dp_test_mroute_nl(RTM_NEWROUTE, "10.73.1.1", "dp1T0",
+			  "224.0.1.1/32 nh int:dp2T1 nh int:dp2T2");
+
+	dp_test_wait_for_mroute("10.73.1.1", "224.0.1.1",
+				"dpT10", "dpT21 dpT22", false);
+
+	dp_test_mrt_stats_get(&cnt, &last);
+
+	/* Nothing forwarded, so nothing to send */
+	ip_mfwd_sg_cnt_check(&cnt, 0, 0);
+
+	ip_mfwd_sg_cnt_fwd();
+	ip_mfwd_sg_cnt_check(&cnt, 1, 1);
+
+	/* Sent, and unchanged since, so not sent again on the recheck */
+	ip_mfwd_sg_cnt_check(&cnt, 0, 0);
+
+	/* Each packet changes it again, but it is sent once */
+	ip_mfwd_sg_cnt_fwd();
+	ip_mfwd_sg_cnt_fwd();
+	ip_mfwd_sg_cnt_check(&cnt, 1, 3);
+	ip_mfwd_sg_cnt_check(&cnt, 0, 0);
+
+	/* Clean Up */
+	dp_test_mroute_nl(RTM_DELROUTE, "10.73.1.1", "dp1T0",
+			  "224.0.1.1/32 nh int:dp2T1 nh int:dp2T2");
+
+	dp_test_wait_for_mroute("10.73.1.1", "224.0.1.1",
+				"dpT10", "dpT21 dpT22", true);
+
+	dp_test_netlink_netconf_mcast("dp1T0", AF_INET, false);
+	dp_test_nl_del_ip_addr_and_connected("dp1T0", "1.1.1.1/24");
+
+	dp_test_netlink_netconf_mcast("dp2T1", AF_INET, false);
+	dp_test_nl_del_ip_addr_and_connected("dp2T1", "2.2.2.2/24");
+
+	dp_test_netlink_netconf_mcast("dp2T2", AF_INET, false);
+	dp_test_nl_del_ip_addr_and_connected("dp2T2", "3.3.3.3/24");
+
+} DP_END_TEST;
+
 /*
  * IPv6 multicast forwarding
  */
@@ -1067,19 +1067,20 @@ dp_test_pak_verify(struct rte_mbuf *m, struct ifnet *ifp,
 	uint diff_cnt = 0;
 	struct rte_mbuf *exp_seg = expected->exp_pak[check];
 	struct rte_mbuf *rcv_seg = m;
-	unsigned int exp_seg_offset = check_start;
-	unsigned int rcv_seg_offset = check_start;
+	/* offsets of the current segments, relative to check_start */
+	int exp_seg_offset = -(int)check_start;
+	int rcv_seg_offset = -(int)check_start;
 	bool short_rcv = false;
 
 	for (i = 0; i < check_len; i++) {
-		while (i - exp_seg_offset == exp_seg->data_len) {
+		while ((int)i - exp_seg_offset == exp_seg->data_len) {
 			exp_seg_offset = i;
 			exp_seg = exp_seg->next;
 			exp = rte_pktmbuf_mtod(exp_seg, unsigned char *);
 		}
 
 		while (!short_rcv &&
-		       (i - rcv_seg_offset == rcv_seg->data_len)) {
+		       ((int)i - rcv_seg_offset == rcv_seg->data_len)) {
 			rcv_seg_offset = i;
 			rcv_seg = rcv_seg->next;
 			if (!rcv_seg)
@@ -1214,6 +1215,25 @@ int dp_test_pak_get_from_ring(const char *if_name,
 	return count;
 }
 
+/*
+ * Enqueue up to count packets on the rx ring of the given interface
+ * without waiting for them to be processed, returning the number
+ * enqueued. Any that do not fit are still owned by the caller.
+ */
+int dp_test_pak_put_on_ring(const char *if_name,
+			    struct rte_mbuf **bufs,
+			    int count)
+{
+	struct rte_ring *ring;
+
+	ring = dp_test_intf_name2rx_ring(if_name);
+	count = rte_ring_mp_enqueue_burst(ring,
+					  (void **)bufs,
+					  count,
+					  NULL);
+	return count;
+}
+
 /*
  * Loop over all the tx rings checking for packets. For any that are
  * received, run the verify cb and then free the mbuf.
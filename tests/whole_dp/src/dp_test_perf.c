@@ -0,0 +1,466 @@
+/*
+ * Copyright (c) 2021, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * Forwarding performance benchmarks.
+ *
+ * These are not part of the check_tests list, but are registered with
+ * meson as benchmarks and so are run by "meson test --benchmark" (or
+ * "ninja benchmark").  The suite is built into dataplane_test but is
+ * skipped unless selected with CK_RUN_SUITE=dp_test_perf.c.  Each
+ * scenario pushes a fixed number of packets through the forwarding
+ * lcore and reports the TSC cycles per packet and the packet rate.
+ * One JSON object per scenario is written to stdout and appended to
+ * the file named by DP_TEST_PERF_RESULTS (default "dp_test_perf.json"
+ * in the working directory).
+ *
+ * The test binary is built without optimisation and packets pass
+ * through ring PMDs, so the numbers are only meaningful when compared
+ * with other runs on the same machine.
+ *
+ * Environment:
+ *   DP_TEST_PERF_RESULTS  results file
+ *   DP_TEST_PERF_PKTS     packets per measured run
+ *   DP_TEST_PERF_ROUTES   number of /24 routes for the routing scenario
+ */
+
+#include <stdlib.h>
+#include <linux/xfrm.h>
+#include <json-c/json.h>
+#include <rte_cycles.h>
+
+#include "ip_funcs.h"
+#include "if_var.h"
+#include "main.h"
+
+#include "dp_test.h"
+#include "dp_test_lib_internal.h"
+#include "dp_test_lib_intf_internal.h"
+#include "dp_test_lib_pkt.h"
+#include "dp_test_pktmbuf_lib_internal.h"
+#include "dp_test_netlink_state_internal.h"
+#include "dp_test_crypto_utils.h"
+#include "dp_test_npf_lib.h"
+#include "dp_test_npf_fw_lib.h"
+
+#define PERF_BURST		32
+#define PERF_CHUNK		2048
+#define PERF_FLOWS		256
+#define PERF_PKTS		(1024 * 1024)
+#define PERF_WARMUP_PKTS	(16 * 1024)
+#define PERF_ROUTES		(1024 * 1024)
+#define PERF_ROUTE_CHUNK	4096
+#define PERF_TIMEOUT_SECS	30
+
+/* 60 byte frames, 64 on the wire */
+#define PERF_UDP_PAYLOAD	18
+
+static unsigned long
+dp_test_perf_env(const char *name, unsigned long dflt)
+{
+	const char *val = getenv(name);
+	unsigned long ul;
+	char *end;
+
+	if (!val || !*val)
+		return dflt;
+
+	ul = strtoul(val, &end, 0);
+	if (*end != '\0' || ul == 0)
+		return dflt;
+
+	return ul;
+}
+
+static void
+dp_test_perf_report(const char *scenario, uint64_t pkts, uint64_t cycles)
+{
+	const char *fname = getenv("DP_TEST_PERF_RESULTS");
+	uint64_t hz = rte_get_tsc_hz();
+	json_object *jobj;
+	FILE *f;
+
+	jobj = json_object_new_object();
+	json_object_object_add(jobj, "scenario",
+			       json_object_new_string(scenario));
+	json_object_object_add(jobj, "packets", json_object_new_int64(pkts));
+	json_object_object_add(jobj, "cycles", json_object_new_int64(cycles));
+	json_object_object_add(jobj, "tsc-hz", json_object_new_int64(hz));
+	json_object_object_add(jobj, "cycles-per-pkt",
+			       json_object_new_double((double)cycles / pkts));
+	json_object_object_add(jobj, "mpps",
+			       json_object_new_double((double)pkts * hz /
+						      cycles / 1e6));
+
+	printf("%s\n", json_object_to_json_string_ext(jobj,
+						      JSON_C_TO_STRING_PLAIN));
+
+	f = fopen(fname ? fname : "dp_test_perf.json", "a");
+	if (f) {
+		fprintf(f, "%s\n",
+			json_object_to_json_string_ext(jobj,
+						       JSON_C_TO_STRING_PLAIN));
+		fclose(f);
+	}
+	json_object_put(jobj);
+}
+
+/*
+ * Send a chunk of packets into rx_intf, keeping the rx ring topped up a
+ * burst at a time so the forwarding lcore is never idle, and drain
+ * tx_intf until they have all come out or the deadline passes.
+ */
+static void
+dp_test_perf_send_chunk(struct rte_mbuf **chunk, unsigned int n,
+			const char *rx_intf, const char *tx_intf,
+			uint64_t deadline, uint64_t *rcvd)
+{
+	struct rte_mbuf *out[PERF_BURST];
+	unsigned int sent = 0, done = 0;
+	int i, nb;
+
+	while (done < n) {
+		if (sent < n)
+			sent += dp_test_pak_put_on_ring(
+				rx_intf, &chunk[sent],
+				RTE_MIN(PERF_BURST, n - sent));
+
+		nb = dp_test_pak_get_from_ring(tx_intf, out, PERF_BURST);
+		for (i = 0; i < nb; i++)
+			rte_pktmbuf_free(out[i]);
+		done += nb;
+
+		if (rte_rdtsc() > deadline)
+			break;
+	}
+
+	for (; sent < n; sent++)
+		rte_pktmbuf_free(chunk[sent]);
+	*rcvd += done;
+}
+
+/*
+ * Send npkts copies of the template packets, round robin, a chunk at a
+ * time.  The copies of each chunk are made before it is timed, so the
+ * returned cycle count is just the time spent forwarding.
+ */
+static uint64_t
+dp_test_perf_run(struct rte_mbuf **tmpl, unsigned int ntmpl,
+		 const char *rx_intf, const char *tx_intf,
+		 uint64_t npkts, uint64_t *rcvd)
+{
+	static struct rte_mbuf *chunk[PERF_CHUNK];
+	uint64_t start, deadline, cycles = 0, sent = 0;
+	unsigned int i, n;
+
+	*rcvd = 0;
+	deadline = rte_rdtsc() + rte_get_tsc_hz() * PERF_TIMEOUT_SECS;
+
+	while (sent < npkts && *rcvd == sent) {
+		n = RTE_MIN(PERF_CHUNK, npkts - sent);
+		for (i = 0; i < n; i++)
+			chunk[i] = dp_test_cp_pak(tmpl[(sent + i) % ntmpl]);
+
+		start = rte_rdtsc();
+		dp_test_perf_send_chunk(chunk, n, rx_intf, tx_intf,
+					deadline, rcvd);
+		cycles += rte_rdtsc() - start;
+		sent += n;
+	}
+
+	return cycles;
+}
+
+/*
+ * Warm up (creating any sessions, filling caches), then do the
+ * measured run and report it.  The templates are freed.
+ */
+static void
+dp_test_perf_measure(const char *scenario, struct rte_mbuf **tmpl,
+		     unsigned int ntmpl, const char *rx_intf,
+		     const char *tx_intf)
+{
+	uint64_t npkts = dp_test_perf_env("DP_TEST_PERF_PKTS", PERF_PKTS);
+	uint64_t cycles, rcvd;
+	unsigned int i;
+
+	dp_test_perf_run(tmpl, ntmpl, rx_intf, tx_intf,
+			 PERF_WARMUP_PKTS, &rcvd);
+	dp_test_fail_unless(rcvd == PERF_WARMUP_PKTS,
+			    "%s: warmup forwarded %lu of %u packets",
+			    scenario, rcvd, PERF_WARMUP_PKTS);
+
+	cycles = dp_test_perf_run(tmpl, ntmpl, rx_intf, tx_intf,
+				  npkts, &rcvd);
+	dp_test_fail_unless(rcvd == npkts,
+			    "%s: forwarded %lu of %lu packets",
+			    scenario, rcvd, npkts);
+
+	dp_test_perf_report(scenario, npkts, cycles);
+
+	for (i = 0; i < ntmpl; i++)
+		rte_pktmbuf_free(tmpl[i]);
+}
+
+/*
+ * Build PERF_FLOWS UDP templates from desc, varying the source port
+ * and, if dst_base is non-zero, the destination address by dst_step.
+ */
+static void
+dp_test_perf_flows(struct dp_test_pkt_desc_t *desc, struct rte_mbuf **tmpl,
+		   uint32_t dst_base, uint32_t dst_step)
+{
+	char dst[INET_ADDRSTRLEN];
+	uint16_t sport = desc->l4.udp.sport;
+	unsigned int i;
+
+	for (i = 0; i < PERF_FLOWS; i++) {
+		if (dst_base) {
+			uint32_t addr = htonl(dst_base + i * dst_step);
+
+			inet_ntop(AF_INET, &addr, dst, sizeof(dst));
+			desc->l3_dst = dst;
+		}
+		desc->l4.udp.sport = sport + i;
+		tmpl[i] = dp_test_v4_pkt_from_desc(desc);
+		dp_test_fail_unless(tmpl[i], "failed to build template %u", i);
+	}
+	desc->l4.udp.sport = sport;
+}
+
+/*
+ * Common topology for the routing, firewall and CGNAT scenarios:
+ *
+ *   1.1.1.2 --- dp1T0 [1.1.1.1/24] UUT [2.2.2.2/24] dp2T1 --- 2.2.2.1
+ */
+static struct dp_test_pkt_desc_t perf_udp_desc = {
+	.text       = "perf UDP",
+	.len        = PERF_UDP_PAYLOAD,
+	.ether_type = RTE_ETHER_TYPE_IPV4,
+	.l3_src     = "1.1.1.2",
+	.l2_src     = "aa:bb:cc:dd:1:a1",
+	.l3_dst     = "2.2.2.1",
+	.l2_dst     = "aa:bb:cc:dd:2:b1",
+	.proto      = IPPROTO_UDP,
+	.l4         = {
+		.udp = {
+			.sport = 10000,
+			.dport = 80
+		}
+	},
+	.rx_intf    = "dp1T0",
+	.tx_intf    = "dp2T1"
+};
+
+static void dp_test_perf_setup(void)
+{
+	dp_test_nl_add_ip_addr_and_connected("dp1T0", "1.1.1.1/24");
+	dp_test_nl_add_ip_addr_and_connected("dp2T1", "2.2.2.2/24");
+	dp_test_netlink_add_neigh("dp1T0", "1.1.1.2", "aa:bb:cc:dd:1:a1");
+	dp_test_netlink_add_neigh("dp2T1", "2.2.2.1", "aa:bb:cc:dd:2:b1");
+}
+
+static void dp_test_perf_teardown(void)
+{
+	dp_test_netlink_del_neigh("dp1T0", "1.1.1.2", "aa:bb:cc:dd:1:a1");
+	dp_test_netlink_del_neigh("dp2T1", "2.2.2.1", "aa:bb:cc:dd:2:b1");
+	dp_test_nl_del_ip_addr_and_connected("dp1T0", "1.1.1.1/24");
+	dp_test_nl_del_ip_addr_and_connected("dp2T1", "2.2.2.2/24");
+	dp_test_npf_cleanup();
+}
+
+DP_DECL_TEST_SUITE(perf);
+
+DP_DECL_TEST_CASE(perf, perf_fwd, dp_test_perf_setup, dp_test_perf_teardown);
+
+/*
+ * Routes are 16.0.0.0/24 upwards, so up to 1M of them fit in 16.0.0.0/4.
+ * They are added without verification in chunks, waiting for the last
+ * of each chunk so the netlink backlog stays bounded.
+ */
+static void
+dp_test_perf_routes(uint32_t nroutes, bool add)
+{
+	char route[DP_TEST_MAX_ROUTE_STRING_LEN];
+	uint32_t i, addr;
+
+	for (i = 0; i < nroutes; i++) {
+		addr = (16 << 24) | (i << 8);
+		snprintf(route, sizeof(route),
+			 "%u.%u.%u.0/24 nh 2.2.2.1 int:dp2T1",
+			 addr >> 24, (addr >> 16) & 0xff, (addr >> 8) & 0xff);
+
+		if (add)
+			dp_test_netlink_add_route_nv(route);
+		else
+			dp_test_netlink_del_route_nv(route);
+
+		if ((i + 1) % PERF_ROUTE_CHUNK && i + 1 != nroutes)
+			continue;
+
+		if (add)
+			dp_test_wait_for_route_lookup(route, true);
+		else
+			dp_test_wait_for_route_gone(route, true, __FILE__,
+						    __func__, __LINE__);
+	}
+}
+
+/*
+ * IPv4 forwarding with a large routing table.  Flows are spread evenly
+ * across the table so lookups do not all hit the same tbl8.
+ */
+DP_START_TEST(perf_fwd, ipv4_routes)
+{
+	struct dp_test_pkt_desc_t desc = perf_udp_desc;
+	struct rte_mbuf *tmpl[PERF_FLOWS];
+	uint32_t nroutes;
+	char name[64];
+
+	nroutes = dp_test_perf_env("DP_TEST_PERF_ROUTES", PERF_ROUTES);
+	nroutes = RTE_MAX(RTE_MIN(nroutes, (uint32_t)PERF_ROUTES),
+			  (uint32_t)PERF_FLOWS);
+	dp_test_perf_routes(nroutes, true);
+
+	dp_test_perf_flows(&desc, tmpl, (16 << 24) | 1,
+			   (nroutes / PERF_FLOWS) << 8);
+
+	snprintf(name, sizeof(name), "ipv4-fwd-%u-routes", nroutes);
+	dp_test_perf_measure(name, tmpl, PERF_FLOWS, "dp1T0", "dp2T1");
+
+	dp_test_perf_routes(nroutes, false);
+} DP_END_TEST;
+
+/*
+ * Stateful firewall on input.  Every flow has a session after warmup,
+ * so this measures the session hit path.
+ */
+DP_START_TEST(perf_fwd, stateful_fw)
+{
+	struct dp_test_pkt_desc_t desc = perf_udp_desc;
+	struct rte_mbuf *tmpl[PERF_FLOWS];
+	struct dp_test_npf_rule_t rules[] = {
+		RULE_10_PASS_UDP_SF,
+		RULE_DEF_BLOCK,
+		NULL_RULE
+	};
+	struct dp_test_npf_ruleset_t fw = {
+		.rstype = "fw-in",
+		.name = "PERF_FW",
+		.enable = 1,
+		.attach_point = "dp1T0",
+		.fwd = FWD,
+		.dir = "in",
+		.rules = rules
+	};
+
+	dp_test_npf_fw_add(&fw, false);
+
+	dp_test_perf_flows(&desc, tmpl, 0, 0);
+	dp_test_perf_measure("stateful-fw", tmpl, PERF_FLOWS,
+			     "dp1T0", "dp2T1");
+
+	dp_test_npf_fw_del(&fw, false);
+} DP_END_TEST;
+
+/*
+ * CGNAT from 100.64.0.0/16 out of dp2T1.  Each flow has a mapping after
+ * warmup.
+ */
+DP_START_TEST(perf_fwd, cgnat)
+{
+	struct dp_test_pkt_desc_t desc = perf_udp_desc;
+	struct rte_mbuf *tmpl[PERF_FLOWS];
+
+	dp_test_nl_add_ip_addr_and_connected("dp1T0", "100.64.0.254/16");
+	dp_test_netlink_add_neigh("dp1T0", "100.64.0.1", "aa:bb:cc:dd:1:a1");
+
+	dp_test_npf_cmd_fmt(false,
+			    "nat-ut pool add POOL1 type=cgnat "
+			    "address-range=RANGE1/2.2.2.11-2.2.2.20");
+	cgnat_policy_add("POLICY1", 10, "100.64.0.0/16", "POOL1",
+			 "dp2T1", CGN_MAP_EIM, CGN_FLTR_EIF, CGN_3TUPLE, true);
+
+	desc.l3_src = "100.64.0.1";
+	dp_test_perf_flows(&desc, tmpl, 0, 0);
+	dp_test_perf_measure("cgnat", tmpl, PERF_FLOWS, "dp1T0", "dp2T1");
+
+	cgnat_policy_del("POLICY1", 10, "dp2T1");
+	dp_test_npf_cmd_fmt(false, "nat-ut pool delete POOL1");
+
+	dp_test_netlink_del_neigh("dp1T0", "100.64.0.1", "aa:bb:cc:dd:1:a1");
+	dp_test_nl_del_ip_addr_and_connected("dp1T0", "100.64.0.254/16");
+} DP_END_TEST;
+
+/*
+ * IPsec site-to-site encrypt, AES-CBC / HMAC-SHA1 tunnel mode:
+ *
+ *   10.10.1.1 --- dp1T1 [10.10.1.2/24] UUT [10.10.2.2/24] dp2T2 ---
+ *     10.10.2.3 (peer) === 10.10.3.0/24
+ */
+#define PERF_IPSEC_PEER		"10.10.2.3"
+#define PERF_IPSEC_LOCAL	"10.10.2.2"
+#define PERF_IPSEC_REQID	1234
+
+static struct dp_test_crypto_policy perf_ipsec_policy = {
+	.d_prefix = "10.10.3.0/24",
+	.s_prefix = "10.10.1.0/24",
+	.proto = 0,
+	.dst = PERF_IPSEC_PEER,
+	.dst_family = AF_INET,
+	.dir = XFRM_POLICY_OUT,
+	.family = AF_INET,
+	.reqid = PERF_IPSEC_REQID,
+	.priority = 1,
+	.rule_no = 1,
+	.mark = 0,
+	.vrfid = VRF_DEFAULT_ID
+};
+
+static struct dp_test_crypto_sa perf_ipsec_sa = {
+	.cipher_algo = CRYPTO_CIPHER_AES_CBC,
+	.auth_algo = CRYPTO_AUTH_HMAC_SHA1,
+	.spi = 0xd43d87c7,
+	.d_addr = PERF_IPSEC_PEER,
+	.s_addr = PERF_IPSEC_LOCAL,
+	.family = AF_INET,
+	.mode = XFRM_MODE_TUNNEL,
+	.reqid = PERF_IPSEC_REQID,
+	.mark = 0,
+	.vrfid = VRF_DEFAULT_ID
+};
+
+DP_START_TEST(perf_fwd, ipsec_encrypt)
+{
+	struct dp_test_pkt_desc_t desc = perf_udp_desc;
+	struct rte_mbuf *tmpl[PERF_FLOWS];
+
+	dp_test_nl_add_ip_addr_and_connected("dp1T1", "10.10.1.2/24");
+	dp_test_netlink_add_neigh("dp1T1", "10.10.1.1", "aa:bb:cc:dd:1:1");
+	dp_test_nl_add_ip_addr_and_connected("dp2T2", "10.10.2.2/24");
+	dp_test_netlink_add_neigh("dp2T2", PERF_IPSEC_PEER, "aa:bb:cc:dd:2:3");
+	dp_test_netlink_add_route("10.10.3.0/24 nh 10.10.2.3 int:dp2T2");
+
+	dp_test_crypto_create_policy(&perf_ipsec_policy);
+	dp_test_crypto_create_sa(&perf_ipsec_sa);
+
+	desc.l3_src = "10.10.1.1";
+	desc.l2_src = "aa:bb:cc:dd:1:1";
+	desc.l3_dst = "10.10.3.4";
+	desc.l2_dst = "aa:bb:cc:dd:2:3";
+	desc.rx_intf = "dp1T1";
+	desc.tx_intf = "dp2T2";
+	dp_test_perf_flows(&desc, tmpl, 0, 0);
+	dp_test_perf_measure("ipsec-encrypt", tmpl, PERF_FLOWS,
+			     "dp1T1", "dp2T2");
+
+	dp_test_crypto_delete_sa(&perf_ipsec_sa);
+	dp_test_crypto_delete_policy(&perf_ipsec_policy);
+
+	dp_test_netlink_del_route("10.10.3.0/24 nh 10.10.2.3 int:dp2T2");
+	dp_test_netlink_del_neigh("dp2T2", PERF_IPSEC_PEER, "aa:bb:cc:dd:2:3");
+	dp_test_nl_del_ip_addr_and_connected("dp2T2", "10.10.2.2/24");
+	dp_test_netlink_del_neigh("dp1T1", "10.10.1.1", "aa:bb:cc:dd:1:1");
+	dp_test_nl_del_ip_addr_and_connected("dp1T1", "10.10.1.2/24");
+} DP_END_TEST;
@@ -19,6 +19,7 @@
 #include "SampleFeatConfig.pb-c.h"
 #include "SampleFeatOp.pb-c.h"
 #include "protobuf/DataplaneEnvelope.pb-c.h"
+#include "protobuf/PipelineStatsConfig.pb-c.h"
 
 DP_DECL_TEST_SUITE(pipeline);
 
@@ -237,6 +238,144 @@ DP_START_TEST(dyn_feat, dyn_feat_ipv4)
 
 } DP_END_TEST;
 
+/*
+ * A dynamic feature on an interface is counted on the port underneath
+ * it rather than globally, so that only that port uses the pipeline
+ * with dynamic features, and removing the feature releases that count.
+ */
+DP_START_TEST(dyn_feat, dyn_feat_port)
+{
+	char real_ifname[IFNAMSIZ];
+	json_object *expected_json;
+
+	dp_test_intf_real("dp1T0", real_ifname);
+
+	dp_test_create_and_send_sample_feat_msg(true, real_ifname);
+	dp_test_wait_for_pl_feat("dp1T0", "sample:sample",
+				 "ipv4-validate");
+
+	expected_json = dp_test_json_create(
+		"{ \"pl-dyn-feat\": "
+		"  { \"count\": 0, "
+		"    \"interfaces\": "
+		"    [ { \"name\": \"%s\", "
+		"        \"count\": 1, "
+		"        \"port\": \"%s\", "
+		"        \"port-refs\": 1 } ] "
+		"  } "
+		"}", real_ifname, real_ifname);
+	dp_test_check_json_state("pipeline framework dump dyn-feat",
+				 expected_json, DP_TEST_JSON_CHECK_SUBSET,
+				 false);
+	json_object_put(expected_json);
+
+	dp_test_create_and_send_sample_feat_msg(false, real_ifname);
+	dp_test_wait_for_pl_feat_gone("dp1T0", "sample:sample",
+				      "ipv4-validate");
+
+	expected_json = dp_test_json_create(
+		"{ \"pl-dyn-feat\": "
+		"  { \"count\": 0, "
+		"    \"interfaces\": [ ] "
+		"  } "
+		"}");
+	dp_test_check_json_state("pipeline framework dump dyn-feat",
+				 expected_json, DP_TEST_JSON_CHECK_EXACT,
+				 false);
+	json_object_put(expected_json);
+
+} DP_END_TEST;
+
+DP_DECL_TEST_CASE(pipeline, pl_profile, NULL, NULL);
+
+static void
+dp_test_pl_profile_enable(bool enable)
+{
+	PipelineStatsConfig cfg = PIPELINE_STATS_CONFIG__INIT;
+	void *buf;
+	int len;
+
+	cfg.has_enable_profile = true;
+	cfg.enable_profile = enable;
+
+	len = pipeline_stats_config__get_packed_size(&cfg);
+	buf = malloc(len);
+	assert(buf);
+
+	pipeline_stats_config__pack(&cfg, buf);
+	dp_test_lib_pb_wrap_and_send_pb("vyatta:pipeline-stats", buf, len);
+}
+
+/*
+ * Check that node cycle accounting sees a forwarded packet once
+ * enabled, and that enabling it again starts the counts afresh. The
+ * counts are freed when it is disabled.
+ */
+DP_START_TEST(pl_profile, pl_profile_fwd)
+{
+	struct dp_test_expected *exp;
+	struct rte_mbuf *test_pak;
+	json_object *expected_json;
+	const char *nh_mac_str;
+	int i, len = 22;
+
+	dp_test_nl_add_ip_addr_and_connected("dp1T0", "1.1.1.1/24");
+	dp_test_nl_add_ip_addr_and_connected("dp2T1", "2.2.2.2/24");
+	dp_test_netlink_add_route("10.73.2.0/24 nh 2.2.2.1 int:dp2T1");
+	nh_mac_str = "aa:bb:cc:dd:ee:ff";
+	dp_test_netlink_add_neigh("dp2T1", "2.2.2.1", nh_mac_str);
+
+	for (i = 0; i < 2; i++) {
+		dp_test_pl_profile_enable(true);
+
+		test_pak = dp_test_create_ipv4_pak("10.73.1.1", "10.73.2.1",
+						   1, &len);
+		dp_test_pktmbuf_eth_init(test_pak,
+					 dp_test_intf_name2mac_str("dp1T0"),
+					 DP_TEST_INTF_DEF_SRC_MAC,
+					 RTE_ETHER_TYPE_IPV4);
+
+		exp = dp_test_exp_create(test_pak);
+		dp_test_exp_set_oif_name(exp, "dp2T1");
+		(void)dp_test_pktmbuf_eth_init(
+			dp_test_exp_get_pak(exp), nh_mac_str,
+			dp_test_intf_name2mac_str("dp2T1"),
+			RTE_ETHER_TYPE_IPV4);
+		dp_test_ipv4_decrement_ttl(dp_test_exp_get_pak(exp));
+
+		dp_test_pak_receive(test_pak, "dp1T0", exp);
+
+		expected_json = dp_test_json_create(
+			"{ \"pl-profile\": "
+			"  { \"enabled\": true, "
+			"    \"node\": "
+			"    { \"vyatta:ipv4-validate\": "
+			"      { \"packets\": 1 } "
+			"    } "
+			"  } "
+			"}");
+		dp_test_check_json_state("pipeline framework dump profile",
+					 expected_json,
+					 DP_TEST_JSON_CHECK_SUBSET, false);
+		json_object_put(expected_json);
+
+		dp_test_pl_profile_enable(false);
+	}
+
+	expected_json = dp_test_json_create(
+		"{ \"pl-profile\": { \"enabled\": false } }");
+	dp_test_check_json_state("pipeline framework dump profile",
+				 expected_json, DP_TEST_JSON_CHECK_SUBSET,
+				 false);
+	json_object_put(expected_json);
+
+	/* Clean Up */
+	dp_test_netlink_del_neigh("dp2T1", "2.2.2.1", nh_mac_str);
+	dp_test_netlink_del_route("10.73.2.0/24 nh 2.2.2.1 int:dp2T1");
+	dp_test_nl_del_ip_addr_and_connected("dp1T0", "1.1.1.1/24");
+	dp_test_nl_del_ip_addr_and_connected("dp2T1", "2.2.2.2/24");
+} DP_END_TEST;
+
 static const char *plugin_name = "dp_test_pipeline";
 
 int dp_ut_plugin_init(const char **name)
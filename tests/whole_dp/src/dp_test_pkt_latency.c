@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2021, AT&T Intellectual Property.  All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * dataplane UT packet latency sampling tests
+ */
+
+#include "ip_funcs.h"
+#include "if_var.h"
+#include "main.h"
+
+#include "dp_test.h"
+#include "dp_test_console.h"
+#include "dp_test_controller.h"
+#include "dp_test_netlink_state_internal.h"
+#include "dp_test_lib_internal.h"
+#include "dp_test_lib_intf_internal.h"
+#include "dp_test_lib_exp.h"
+
+#include "dp_test_pktmbuf_lib_internal.h"
+
+#define NH_MAC_STR "aa:bb:cc:dd:ee:ff"
+
+static void latency_setup(void)
+{
+	dp_test_nl_add_ip_addr_and_connected("dp1T0", "1.1.1.1/24");
+	dp_test_nl_add_ip_addr_and_connected("dp2T1", "2.2.2.2/24");
+	dp_test_netlink_add_route("10.73.2.0/24 nh 2.2.2.1 int:dp2T1");
+	dp_test_netlink_add_neigh("dp2T1", "2.2.2.1", NH_MAC_STR);
+}
+
+static void latency_teardown(void)
+{
+	dp_test_netlink_del_neigh("dp2T1", "2.2.2.1", NH_MAC_STR);
+	dp_test_netlink_del_route("10.73.2.0/24 nh 2.2.2.1 int:dp2T1");
+	dp_test_nl_del_ip_addr_and_connected("dp1T0", "1.1.1.1/24");
+	dp_test_nl_del_ip_addr_and_connected("dp2T1", "2.2.2.2/24");
+}
+
+/* Forward one packet from dp1T0 out of dp2T1 */
+static void latency_fwd(void)
+{
+	struct dp_test_expected *exp;
+	struct rte_mbuf *test_pak;
+	int len = 22;
+
+	test_pak = dp_test_create_ipv4_pak("10.73.1.1", "10.73.2.1", 1, &len);
+	dp_test_pktmbuf_eth_init(test_pak,
+				 dp_test_intf_name2mac_str("dp1T0"),
+				 DP_TEST_INTF_DEF_SRC_MAC,
+				 RTE_ETHER_TYPE_IPV4);
+
+	exp = dp_test_exp_create(test_pak);
+	dp_test_exp_set_oif_name(exp, "dp2T1");
+	(void)dp_test_pktmbuf_eth_init(dp_test_exp_get_pak(exp), NH_MAC_STR,
+				       dp_test_intf_name2mac_str("dp2T1"),
+				       RTE_ETHER_TYPE_IPV4);
+	dp_test_ipv4_decrement_ttl(dp_test_exp_get_pak(exp));
+
+	dp_test_pak_receive(test_pak, "dp1T0", exp);
+}
+
+/* Check the sample rate and the count for tc 0 on dp2T1 */
+static void latency_check(unsigned int sample, unsigned int count)
+{
+	char real_ifname[IFNAMSIZ];
+	json_object *expected_json;
+
+	if (!count) {
+		expected_json = dp_test_json_create(
+			"{ \"latency\": "
+			"  { \"sample\": %u, \"interfaces\": [ ] } "
+			"}", sample);
+		dp_test_check_json_state("latency show", expected_json,
+					 DP_TEST_JSON_CHECK_EXACT, false);
+		json_object_put(expected_json);
+		return;
+	}
+
+	expected_json = dp_test_json_create(
+		"{ \"latency\": "
+		"  { \"sample\": %u, "
+		"    \"interfaces\": "
+		"    [ { \"name\": \"%s\", "
+		"        \"tc\": [ { \"tc\": 0, \"count\": %u } ] "
+		"    } ] "
+		"  } "
+		"}", sample, dp_test_intf_real("dp2T1", real_ifname), count);
+	dp_test_check_json_state("latency show", expected_json,
+				 DP_TEST_JSON_CHECK_SUBSET, false);
+	json_object_put(expected_json);
+}
+
+DP_DECL_TEST_SUITE(pkt_latency_suite);
+
+DP_DECL_TEST_CASE(pkt_latency_suite, pkt_latency, NULL, NULL);
+
+/*
+ * Check that a forwarded packet is sampled for latency on its output
+ * interface when sampling every packet, and that clear resets it.
+ */
+DP_START_TEST(pkt_latency, fwd)
+{
+	latency_setup();
+
+	dp_test_console_request_reply("latency enable 1", false);
+	latency_fwd();
+	latency_check(1, 1);
+
+	dp_test_console_request_reply("latency disable", false);
+	dp_test_console_request_reply("latency clear", false);
+	latency_check(0, 0);
+
+	latency_teardown();
+} DP_END_TEST;
+
+/*
+ * A clear while sampling is left to the forwarding lcore, which starts
+ * counting again from zero on its next transmit.
+ */
+DP_START_TEST(pkt_latency, clear_enabled)
+{
+	latency_setup();
+
+	dp_test_console_request_reply("latency enable 1", false);
+	latency_fwd();
+	latency_fwd();
+	latency_check(1, 2);
+
+	dp_test_console_request_reply("latency clear", false);
+	latency_check(1, 0);
+
+	latency_fwd();
+	latency_check(1, 1);
+
+	dp_test_console_request_reply("latency disable", false);
+	dp_test_console_request_reply("latency clear", false);
+	latency_check(0, 0);
+
+	latency_teardown();
+} DP_END_TEST;
@@ -337,16 +337,24 @@ dp_test_portmonitor_teardown_erspan(uint32_t vrfid)
 	dp_test_netlink_set_interface_vrf("dp2T1", VRF_DEFAULT_ID);
 }
 
+/* Truncated bit of the ERSPAN type II header, in its session id word */
+#define ERSPAN_II_TRUNCATED	(1 << 10)
+
+/*
+ * Build the mirrored packet expected for tpak, cut down to snaplen if
+ * that is non-zero and shorter than the packet.
+ */
 static void
 erspan_build_expected_pak(struct dp_test_expected **expected,
 			  struct rte_mbuf *tpak,
 			  uint16_t gre_prot, uint16_t erspanid,
-			  uint8_t srcidx, uint8_t dir)
+			  uint8_t srcidx, uint8_t dir, uint16_t snaplen)
 {
 	int len;
 	struct dp_test_expected *exp;
 	struct iphdr *inner_ip;
-	struct rte_ether_hdr *payload;
+	struct erspan_type2_hdr *erspan;
+	const void *payload;
 	void *erspan_payload;
 	struct rte_mbuf *m;
 	uint8_t *dont_care_start;
@@ -359,21 +367,29 @@ erspan_build_expected_pak(struct dp_test_expected **expected,
 
 	inner_ip = iphdr(tpak);
 	len = ntohs(inner_ip->tot_len) + RTE_ETHER_HDR_LEN;
+	if (snaplen && snaplen < len)
+		len = snaplen;
+	else
+		snaplen = 0;
 	m = dp_test_create_erspan_ipv4_pak("1.1.2.1", "1.1.2.2",
 					   &len, gre_prot, erspanid, srcidx,
 					   tpak->vlan_tci, dir,
 					   &erspan_payload);
 	if (!m)
 		return;
-	payload = rte_pktmbuf_mtod(tpak, struct rte_ether_hdr *);
-	memcpy(erspan_payload, payload, len);
+	payload = rte_pktmbuf_read(tpak, 0, len, erspan_payload);
+	if (payload != erspan_payload)
+		memcpy(erspan_payload, payload, len);
+	if (snaplen) {
+		erspan = (struct erspan_type2_hdr *)erspan_payload - 1;
+		erspan->ver_sid |= htonl(ERSPAN_II_TRUNCATED);
+	}
 	rte_pktmbuf_free(exp->exp_pak[1]);
 	exp->exp_pak[1] = m;
 
 	/* Check packet after ether hdr */
 	exp->check_start[1] = dp_pktmbuf_l2_len(exp->exp_pak[1]);
-	exp->check_len[1] = rte_pktmbuf_data_len(exp->exp_pak[0]) -
-				exp->check_start[1];
+	exp->check_len[1] = rte_pktmbuf_pkt_len(m) - exp->check_start[1];
 
 	/* Ignore GRE sequence number */
 	dont_care_len = m->l2_len + m->l3_len + 4;
@@ -412,7 +428,7 @@ DP_START_TEST(mirroring, erspan_source)
 	dp_test_exp_set_fwd_status_m(exp, 0, DP_TEST_FWD_LOCAL);
 
 	erspan_build_expected_pak(&exp, test_pak, ETH_P_ERSPAN_TYPEII,
-				  20, 1, 1);
+				  20, 1, 1, 0);
 
 	dp_test_pak_receive(test_pak, "dp1T1", exp);
 
@@ -510,7 +526,7 @@ DP_START_TEST(mirroring, erspan_vlan_source)
 	dp_test_exp_set_fwd_status_m(exp, 0, DP_TEST_FWD_LOCAL);
 
 	erspan_build_expected_pak(&exp, test_pak, ETH_P_ERSPAN_TYPEII,
-				  20, 1, 1);
+				  20, 1, 1, 0);
 
 	dp_test_pak_receive(test_pak, "dp1T1", exp);
 
@@ -537,7 +553,7 @@ DP_START_TEST(mirroring, erspan_vlan_source)
 	dp_test_exp_set_vlan_tci_m(exp, 0, 10);
 
 	erspan_build_expected_pak(&exp, dp_test_exp_get_pak_m(exp, 0),
-				  ETH_P_ERSPAN_TYPEII, 20, 1, 2);
+				  ETH_P_ERSPAN_TYPEII, 20, 1, 2, 0);
 	dp_test_ipv4_decrement_ttl(dp_test_exp_get_pak_m(exp, 1));
 
 	dp_test_pak_receive(test_pak, "dp2T1", exp);
@@ -552,6 +568,219 @@ DP_START_TEST(mirroring, erspan_vlan_source)
 	dp_test_portmonitor_teardown_erspan(VRF_DEFAULT_ID);
 } DP_END_TEST;
 
+/*
+ * A snap length shorter than the packet mirrors only its first bytes,
+ * and marks the ERSPAN header as truncated.
+ */
+DP_START_TEST(mirroring, erspan_snaplen)
+{
+	struct dp_test_expected *exp;
+	struct rte_mbuf *test_pak;
+	int len = 100;
+
+	/* Set up the interface addresses */
+	dp_test_portmonitor_setup_erspan(VRF_DEFAULT_ID);
+
+	/* Create erspan source session, mirroring 64 bytes of each packet */
+	dp_test_portmonitor_create_erspansrc(1, "dp1T1", "erspan1",
+						20, 1, NULL, NULL);
+	dp_test_portmonitor_request("portmonitor set session 1 snaplen 64 0 0",
+				    false);
+
+	test_pak = dp_test_create_ipv4_pak("1.1.1.1", "2.2.2.2",
+					   1, &len);
+	/* Ingress dp1T1 */
+	(void)dp_test_pktmbuf_eth_init(test_pak,
+				       dp_test_intf_name2mac_str("dp1T1"),
+				       DP_TEST_INTF_DEF_SRC_MAC,
+				       RTE_ETHER_TYPE_IPV4);
+
+	/* We expect 2 packets, one local and one mirrored and truncated */
+	exp = dp_test_exp_create_m(test_pak, 2);
+	dp_test_exp_set_fwd_status_m(exp, 0, DP_TEST_FWD_LOCAL);
+
+	erspan_build_expected_pak(&exp, test_pak, ETH_P_ERSPAN_TYPEII,
+				  20, 1, 1, 64);
+
+	dp_test_pak_receive(test_pak, "dp1T1", exp);
+
+	/* Delete ERSPAN session */
+	dp_test_portmonitor_delete_session(1);
+
+	/* Teardown setup */
+	dp_test_portmonitor_teardown_erspan(VRF_DEFAULT_ID);
+} DP_END_TEST;
+
+/*
+ * Sampling 1 in 3 mirrors the first packet and then every third one.
+ */
+DP_START_TEST(mirroring, erspan_sample)
+{
+	struct dp_test_expected *exp;
+	struct rte_mbuf *test_pak;
+	int len = 22;
+	int i;
+
+	/* Set up the interface addresses */
+	dp_test_portmonitor_setup_erspan(VRF_DEFAULT_ID);
+
+	/* Create erspan source session, mirroring 1 in 3 packets */
+	dp_test_portmonitor_create_erspansrc(1, "dp1T1", "erspan1",
+						20, 1, NULL, NULL);
+	dp_test_portmonitor_request("portmonitor set session 1 sample 3 0 0",
+				    false);
+
+	for (i = 0; i < 6; i++) {
+		test_pak = dp_test_create_ipv4_pak("1.1.1.1", "2.2.2.2",
+						   1, &len);
+		/* Ingress dp1T1 */
+		(void)dp_test_pktmbuf_eth_init(
+			test_pak, dp_test_intf_name2mac_str("dp1T1"),
+			DP_TEST_INTF_DEF_SRC_MAC, RTE_ETHER_TYPE_IPV4);
+
+		if (i % 3) {
+			/* Only the local packet */
+			exp = dp_test_exp_create(test_pak);
+			dp_test_exp_set_fwd_status(exp, DP_TEST_FWD_LOCAL);
+		} else {
+			/* One local and one mirrored */
+			exp = dp_test_exp_create_m(test_pak, 2);
+			dp_test_exp_set_fwd_status_m(exp, 0,
+						     DP_TEST_FWD_LOCAL);
+			erspan_build_expected_pak(&exp, test_pak,
+						  ETH_P_ERSPAN_TYPEII,
+						  20, 1, 1, 0);
+		}
+
+		dp_test_pak_receive(test_pak, "dp1T1", exp);
+	}
+
+	/* Delete ERSPAN session */
+	dp_test_portmonitor_delete_session(1);
+
+	/* Teardown setup */
+	dp_test_portmonitor_teardown_erspan(VRF_DEFAULT_ID);
+} DP_END_TEST;
+
+/*
+ * A packet with a first segment shorter than the bytes copied into the
+ * mirrored packet is copied whole rather than split, with and without
+ * a snap length cutting it.
+ */
+DP_START_TEST(mirroring, erspan_short_first_seg)
+{
+	struct dp_test_expected *exp;
+	struct rte_mbuf *test_pak;
+	int len[] = { 22, 200 };
+	uint16_t snaplen[] = { 0, 160 };
+	char cmd[TEST_MAX_CMD_LEN];
+	unsigned int i;
+
+	/* Set up the interface addresses */
+	dp_test_portmonitor_setup_erspan(VRF_DEFAULT_ID);
+
+	/* Create erspan source session */
+	dp_test_portmonitor_create_erspansrc(1, "dp1T1", "erspan1",
+						20, 1, NULL, NULL);
+
+	for (i = 0; i < ARRAY_SIZE(snaplen); i++) {
+		if (snaplen[i]) {
+			snprintf(cmd, sizeof(cmd),
+				 "portmonitor set session 1 snaplen %u 0 0",
+				 snaplen[i]);
+			dp_test_portmonitor_request(cmd, false);
+		}
+
+		/* 64 bytes in the first segment, 264 in all */
+		test_pak = dp_test_create_ipv4_pak("1.1.1.1", "2.2.2.2",
+						   ARRAY_SIZE(len), len);
+		/* Ingress dp1T1 */
+		(void)dp_test_pktmbuf_eth_init(
+			test_pak, dp_test_intf_name2mac_str("dp1T1"),
+			DP_TEST_INTF_DEF_SRC_MAC, RTE_ETHER_TYPE_IPV4);
+
+		/* We expect 2 packets, one local and one mirrored */
+		exp = dp_test_exp_create_m(test_pak, 2);
+		dp_test_exp_set_fwd_status_m(exp, 0, DP_TEST_FWD_LOCAL);
+
+		erspan_build_expected_pak(&exp, test_pak, ETH_P_ERSPAN_TYPEII,
+					  20, 1, 1, snaplen[i]);
+
+		dp_test_pak_receive(test_pak, "dp1T1", exp);
+	}
+
+	/* Delete ERSPAN session */
+	dp_test_portmonitor_delete_session(1);
+
+	/* Teardown setup */
+	dp_test_portmonitor_teardown_erspan(VRF_DEFAULT_ID);
+} DP_END_TEST;
+
+/*
+ * A packet longer than the bytes copied into the mirrored packet, all
+ * in its first segment. Received packets are copied whole, transmitted
+ * ones are split into a copied header and a clone of the rest.
+ */
+DP_START_TEST(mirroring, erspan_long_first_seg)
+{
+	const char *nh_mac_str = "aa:bb:cc:dd:ee:ff";
+	struct dp_test_expected *exp;
+	struct rte_mbuf *test_pak;
+	int len = 300;
+
+	/* Set up the interface addresses */
+	dp_test_portmonitor_setup_erspan(VRF_DEFAULT_ID);
+
+	/* Create erspan source session */
+	dp_test_portmonitor_create_erspansrc(1, "dp1T1", "erspan1",
+						20, 1, NULL, NULL);
+
+	/* RX port monitor */
+	test_pak = dp_test_create_ipv4_pak("1.1.1.2", "1.1.1.1",
+					   1, &len);
+	(void)dp_test_pktmbuf_eth_init(test_pak,
+				       dp_test_intf_name2mac_str("dp1T1"),
+				       DP_TEST_INTF_DEF_SRC_MAC,
+				       RTE_ETHER_TYPE_IPV4);
+
+	exp = dp_test_exp_create_m(test_pak, 2);
+	dp_test_exp_set_fwd_status_m(exp, 0, DP_TEST_FWD_LOCAL);
+
+	erspan_build_expected_pak(&exp, test_pak, ETH_P_ERSPAN_TYPEII,
+				  20, 1, 1, 0);
+
+	dp_test_pak_receive(test_pak, "dp1T1", exp);
+
+	/* TX port monitor */
+	test_pak = dp_test_create_ipv4_pak("2.2.2.1", "1.1.1.2",
+					   1, &len);
+	(void)dp_test_pktmbuf_eth_init(test_pak,
+				       dp_test_intf_name2mac_str("dp2T1"),
+				       DP_TEST_INTF_DEF_SRC_MAC,
+				       RTE_ETHER_TYPE_IPV4);
+
+	exp = dp_test_exp_create_m(test_pak, 2);
+	dp_test_exp_set_fwd_status_m(exp, 0, DP_TEST_FWD_FORWARDED);
+	dp_test_exp_set_oif_name_m(exp, 0, "dp1T1");
+	dp_test_pktmbuf_eth_init(dp_test_exp_get_pak_m(exp, 0),
+				 nh_mac_str,
+				 dp_test_intf_name2mac_str("dp1T1"),
+				 RTE_ETHER_TYPE_IPV4);
+	dp_test_ipv4_decrement_ttl(dp_test_exp_get_pak_m(exp, 0));
+
+	erspan_build_expected_pak(&exp, dp_test_exp_get_pak_m(exp, 0),
+				  ETH_P_ERSPAN_TYPEII, 20, 1, 2, 0);
+	dp_test_ipv4_decrement_ttl(dp_test_exp_get_pak_m(exp, 1));
+
+	dp_test_pak_receive(test_pak, "dp2T1", exp);
+
+	/* Delete ERSPAN session */
+	dp_test_portmonitor_delete_session(1);
+
+	/* Teardown setup */
+	dp_test_portmonitor_teardown_erspan(VRF_DEFAULT_ID);
+} DP_END_TEST;
+
 DP_DECL_TEST_CASE(portmonitor_suite, pmcleanup, NULL, NULL);
 
 DP_START_TEST(pmcleanup, erspan_destif_del)
@@ -8,6 +8,7 @@
  * @brief Basic QoS dataplane unit-tests
  */
 
+#include <inttypes.h>
 #include <libmnl/libmnl.h>
 #include <rte_sched.h>
 
@@ -16,6 +17,7 @@
 #include "in_cksum.h"
 #include "if_var.h"
 #include "main.h"
+#include "qos.h"
 
 #include "dp_test.h"
 #include "dp_test_str.h"
@@ -403,6 +405,164 @@ DP_START_TEST(qos_basic_ipv4, basic_pkt_fwd)
 
 } DP_END_TEST;
 
+/*
+ * basic_pipe_stats gives the trunk two pipes, of which only pipe 0 has
+ * any traffic classified to it. A pipe's queue counters are only
+ * allocated once it has counted something, so showing and clearing
+ * the counters of both pipes allocates nothing until pipe 0 forwards a
+ * packet, and never anything for pipe 1.
+ */
+
+const char *basic_pipe_stats_cmds[] = {
+	"port subports 1 pipes 2 profiles 1 overhead 24 ql_packets",
+	"subport 0 rate 1250000000 size 5000000 period 40",
+	"subport 0 queue 0 rate 1250000000 size 5000000",
+	"subport 0 queue 1 rate 1250000000 size 5000000",
+	"subport 0 queue 2 rate 1250000000 size 5000000",
+	"subport 0 queue 3 rate 1250000000 size 5000000",
+	"vlan 0 0",
+	"profile 0 rate 12500000 size 50000 period 10",
+	"profile 0 queue 0 rate 12500000 size 50000",
+	"profile 0 queue 1 rate 12500000 size 50000",
+	"profile 0 queue 2 rate 12500000 size 50000",
+	"profile 0 queue 3 rate 12500000 size 50000",
+	"pipe 0 0 0",
+	"pipe 0 1 0",
+	"enable"
+};
+
+static void
+basic_pipe_stats_check(const char *ifname, bool pipe0)
+{
+	char real[IFNAMSIZ];
+	struct sched_info *qinfo;
+	struct ifnet *ifp;
+
+	ifp = dp_ifnet_byifname(dp_test_intf_real(ifname, real));
+	dp_test_fail_unless(ifp && ifp->if_qos, "no QoS on %s", ifname);
+	qinfo = ifp->if_qos;
+
+	dp_test_fail_unless(!qinfo->pipe_stats[0] == !pipe0,
+			    "pipe 0 counters %sallocated",
+			    pipe0 ? "not " : "");
+	dp_test_fail_unless(!qinfo->pipe_stats[1],
+			    "unused pipe 1 counters allocated");
+}
+
+DP_START_TEST(qos_basic_ipv4, basic_pipe_stats)
+{
+	bool debug = (dp_test_debug_get() == 2 ? true : false);
+
+	qos_lib_test_setup();
+
+	dp_test_qos_debug(debug);
+
+	dp_test_qos_attach_config_to_if("dp2T1", basic_pipe_stats_cmds,
+					debug);
+	basic_pipe_stats_check("dp2T1", false);
+
+	dp_test_qos_check_for_zero_counters("dp2T1", debug);
+	dp_test_qos_clear_counters("dp2T1", debug);
+	basic_pipe_stats_check("dp2T1", false);
+
+	dp_test_qos_pkt_forw_test("dp2T1", 0, "1.1.1.11", "2.2.2.11",
+				  0, 0, 0, 3, 0, debug);
+	basic_pipe_stats_check("dp2T1", true);
+
+	dp_test_qos_clear_counters("dp2T1", debug);
+	dp_test_qos_check_for_zero_counters("dp2T1", debug);
+	basic_pipe_stats_check("dp2T1", true);
+
+	/* Cleanup */
+	dp_test_qos_delete_config_from_if("dp2T1", debug);
+	dp_test_qos_debug(false);
+
+	qos_lib_test_teardown();
+
+} DP_END_TEST;
+
+/*
+ * Check how many packets the Tx queue of a port has taken from the
+ * QoS handoff rings.
+ */
+static void
+basic_worker_handoff_check(const char *ifname, uint64_t handoff)
+{
+	char real[IFNAMSIZ];
+	json_object *jexp;
+
+	dp_test_intf_real(ifname, real);
+	jexp = dp_test_json_create(
+		"{ \"lcore\": [ { \"tx\": [ {"
+		"    \"interface\": \"%s\","
+		"    \"handoff\": %" PRIu64 " } ] } ] }", real, handoff);
+	dp_test_check_json_state("cpu", jexp, DP_TEST_JSON_CHECK_SUBSET,
+				 false);
+	json_object_put(jexp);
+}
+
+/*
+ * basic_worker_pkt_fwd repeats basic_pkt_fwd with the QoS scheduler
+ * moved onto a dedicated worker core, so that forwarded packets are
+ * handed off to the worker's scheduler, and then moves it back again.
+ *
+ * The test dataplane has a single lcore, which is made the worker and
+ * so keeps forwarding as well.
+ */
+DP_START_TEST(qos_basic_ipv4, basic_worker_pkt_fwd)
+{
+	bool debug = (dp_test_debug_get() == 2 ? true : false);
+	char mask[BITMASK_STRSZ];
+	char cmd[TEST_MAX_CMD_LEN];
+	char json[TEST_MAX_REPLY_LEN];
+	bitmask_t workers;
+
+	qos_lib_test_setup();
+
+	dp_test_qos_debug(debug);
+
+	/* Set up QoS config on dp2T1 */
+	dp_test_qos_attach_config_to_if("dp2T1", basic_pkt_fwd_cmds, debug);
+
+	/* An lcore that isn't there is refused */
+	bitmask_zero(&workers);
+	bitmask_set(&workers, RTE_MAX_LCORE - 1);
+	bitmask_sprint(&workers, mask, sizeof(mask));
+	snprintf(cmd, sizeof(cmd), "platform worker-cores %s", mask);
+	dp_test_set_config_err(-EINVAL);
+	dp_test_qos_send_cmd(cmd, "{ \"qos_worker_cores\": \"0\" }", "cpu",
+			     debug);
+
+	bitmask_zero(&workers);
+	bitmask_set(&workers, rte_get_master_lcore());
+	bitmask_sprint(&workers, mask, sizeof(mask));
+	snprintf(cmd, sizeof(cmd), "platform worker-cores %s", mask);
+	snprintf(json, sizeof(json), "{ \"qos_worker_cores\": \"%s\" }",
+		 mask);
+	dp_test_qos_send_cmd(cmd, json, "cpu", debug);
+	basic_worker_handoff_check("dp2T1", 0);
+
+	dp_test_qos_pkt_forw_test("dp2T1", 0, "1.1.1.11", "2.2.2.11",
+				  48, 0, 0, 0, 0, debug);
+	dp_test_qos_pkt_forw_test("dp2T1", 0, "1.1.1.11", "2.2.2.11",
+				  0, 0, 0, 3, 0, debug);
+	basic_worker_handoff_check("dp2T1", 2);
+
+	/* Back to the forwarding threads, with the port still shaped */
+	dp_test_qos_send_cmd("platform worker-cores delete",
+			     "{ \"qos_worker_cores\": \"0\" }", "cpu", debug);
+
+	dp_test_qos_pkt_forw_test("dp2T1", 0, "1.1.1.11", "2.2.2.11",
+				  16, 0, 0, 2, 0, debug);
+
+	/* Cleanup */
+	dp_test_qos_delete_config_from_if("dp2T1", debug);
+	dp_test_qos_debug(false);
+
+	qos_lib_test_teardown();
+
+} DP_END_TEST;
+
 /*
  * basic_pkt_classify extends basic_pkt_fwd by adding a simple QoS
  * classification.  Matching the source address of the packets against
@@ -1084,6 +1244,26 @@ const char *basic_pkt_drop_cmds[] = {
 	"enable"
 };
 
+/*
+ * Check a port's high-water marks in the software buffer utilization
+ */
+static void
+basic_sw_buf_check(const char *ifname, uint32_t hwm, uint32_t last)
+{
+	char real[IFNAMSIZ];
+	json_object *jexp;
+
+	dp_test_intf_real(ifname, real);
+	jexp = dp_test_json_create(
+		"{ \"sw-buf-stats\": [ {"
+		"    \"ifname\": \"%s\","
+		"    \"qlen-hwm\": %u,"
+		"    \"last-sample-hwm\": %u } ] }", real, hwm, last);
+	dp_test_check_json_state("qos show buf-utilization", jexp,
+				 DP_TEST_JSON_CHECK_SUBSET, false);
+	json_object_put(jexp);
+}
+
 DP_START_TEST(qos_basic_ipv4, basic_pkt_drop)
 {
 	bool debug = (dp_test_debug_get() == 2 ? true : false);
@@ -1098,6 +1278,26 @@ DP_START_TEST(qos_basic_ipv4, basic_pkt_drop)
 	dp_test_qos_pkt_force_drop("dp2T1", 0, "1.1.1.11", "2.2.2.11", 63,
 				   1, 0, 0, 0, 0, debug);
 
+	/* The full queue's high-water mark survives being shown */
+	dp_test_qos_check_queue_counter("dp2T1", 0, 0, 0, 0, "qlen-hwm", 1,
+					debug);
+	dp_test_qos_check_queue_counter("dp2T1", 0, 0, 0, 0, "qlen-hwm", 1,
+					debug);
+
+	/*
+	 * The port's mark is taken each sample interval, and is still shown
+	 * once an interval without any enqueues has been sampled.
+	 */
+	qos_sw_buf_sample();
+	qos_sw_buf_sample();
+	basic_sw_buf_check("dp2T1", 1, 0);
+
+	/* and is reset to the now empty queue's length by a clear */
+	dp_test_qos_clear_counters("dp2T1", debug);
+	dp_test_qos_check_queue_counter("dp2T1", 0, 0, 0, 0, "qlen-hwm", 0,
+					debug);
+	basic_sw_buf_check("dp2T1", 0, 0);
+
 	dp_test_qos_pkt_force_drop("dp2T1", 0, "1.1.1.11", "2.2.2.11", 47,
 				   2, 0, 0, 1, 0, debug);
 
@@ -1115,6 +1315,276 @@ DP_START_TEST(qos_basic_ipv4, basic_pkt_drop)
 
 } DP_END_TEST;
 
+/*
+ * basic_fq_codel enables fq-codel on the first queue of traffic-classes 0
+ * and 3.  Packets that don't wait longer than the target are not dropped
+ * by CoDel, and tail-drops on a queue using fq-codel are still counted.
+ *
+ * basic_fq_codel_cmds created from basic_pkt_drop_cmds and:
+ *
+ *   set policy qos name trunk-policy shaper profile profile-1 queue 0
+ *     fq-codel target 5000 interval 100000
+ *   set policy qos name trunk-policy shaper profile profile-1 queue 3
+ *     fq-codel target 5000 interval 100000
+ */
+
+const char *basic_fq_codel_cmds[] = {
+	"port subports 1 pipes 1 profiles 1 overhead 24 ql_packets",
+	"subport 0 rate 1250000000 size 5000000 period 40",
+	"subport 0 queue 0 rate 1250000000 size 5000000",
+	"param 0 limit packets  1",
+	"subport 0 queue 1 rate 1250000000 size 5000000",
+	"param 1 limit packets 2",
+	"subport 0 queue 2 rate 1250000000 size 5000000",
+	"param 2 limit packets 4",
+	"subport 0 queue 3 rate 1250000000 size 5000000",
+	"param 3 limit packets 8",
+	"vlan 0 0",
+	"profile 0 rate 1250000000 size 5000000 period 10",
+	"profile 0 queue 0 rate 1250000000 size 5000000",
+	"profile 0 queue 1 rate 1250000000 size 5000000",
+	"profile 0 queue 2 rate 1250000000 size 5000000",
+	"profile 0 queue 3 rate 1250000000 size 5000000",
+	"profile 0 queue 0x0 fq-codel 5000 100000",
+	"profile 0 queue 0x3 fq-codel 5000 100000",
+	"pipe 0 0 0",
+	"enable"
+};
+
+DP_START_TEST(qos_basic_ipv4, basic_fq_codel)
+{
+	bool debug = (dp_test_debug_get() == 2 ? true : false);
+
+	qos_lib_test_setup();
+
+	dp_test_qos_debug(debug);
+
+	/* Set up QoS config on dp2T1 */
+	dp_test_qos_attach_config_to_if("dp2T1", basic_fq_codel_cmds, debug);
+
+	dp_test_qos_pkt_forw_test("dp2T1", 0, "1.1.1.11", "2.2.2.11",
+				  48, 0, 0, 0, 0, debug);
+	dp_test_qos_pkt_forw_test("dp2T1", 0, "1.1.1.11", "2.2.2.11",
+				  32, 0, 0, 1, 0, debug);
+	dp_test_qos_pkt_forw_test("dp2T1", 0, "1.1.1.11", "2.2.2.11",
+				  0, 0, 0, 3, 0, debug);
+
+	dp_test_qos_clear_counters("dp2T1", debug);
+	dp_test_qos_check_for_zero_counters("dp2T1", debug);
+
+	dp_test_qos_pkt_force_drop("dp2T1", 0, "1.1.1.11", "2.2.2.11", 63,
+				   1, 0, 0, 0, 0, debug);
+
+	dp_test_qos_pkt_force_drop("dp2T1", 0, "1.1.1.11", "2.2.2.11", 0,
+				   8, 0, 0, 3, 0, debug);
+
+	/* Cleanup */
+	dp_test_qos_delete_config_from_if("dp2T1", debug);
+	dp_test_qos_debug(false);
+
+	qos_lib_test_teardown();
+
+} DP_END_TEST;
+
+/*
+ * basic_codel_heavy_drop drives CoDel's dequeue decision directly, with
+ * its own clock, through a queue held above the target for longer than
+ * the interval. Flow 1 sends most of the packets and flow 2 one. When
+ * the first drop becomes due on flow 2's packet, that is sent and the
+ * drop falls on flow 1's next packet instead.
+ */
+
+static bool
+basic_codel_dequeue(struct qos_fq_codel *fq, uint32_t flow,
+		    uint64_t arrived, uint64_t now)
+{
+	struct rte_mbuf m = { 0 };
+
+	m.seqn = QOS_FQ_CODEL_FLAG | flow;
+	m.timestamp = arrived;
+	return qos_codel_heavy_drop(fq, &m, now);
+}
+
+DP_START_TEST(qos_basic_ipv4, basic_codel_heavy_drop)
+{
+	struct qos_fq_codel fq = { .target = 5, .interval = 100 };
+
+	/* All queued since 0, so always above target, but not yet for long */
+	dp_test_fail_unless(!basic_codel_dequeue(&fq, 1, 0, 1000),
+			    "dropped before above target for an interval");
+	dp_test_fail_unless(!basic_codel_dequeue(&fq, 1, 0, 1030),
+			    "dropped before above target for an interval");
+	dp_test_fail_unless(!basic_codel_dequeue(&fq, 1, 0, 1060),
+			    "dropped before above target for an interval");
+	dp_test_fail_unless(!basic_codel_dequeue(&fq, 1, 0, 1090),
+			    "dropped before above target for an interval");
+
+	/* Above target for an interval, but flow 2 is light */
+	dp_test_fail_unless(!basic_codel_dequeue(&fq, 2, 0, 1100),
+			    "light flow dropped");
+	dp_test_fail_unless(!fq.dropping && fq.drops == 0,
+			    "drop taken without dropping a packet");
+
+	/* So the drop falls on heavy flow 1 */
+	dp_test_fail_unless(basic_codel_dequeue(&fq, 1, 0, 1100),
+			    "heavy flow not dropped");
+	dp_test_fail_unless(fq.dropping && fq.drops == 1,
+			    "dropping %d with %" PRIu64 " drops",
+			    fq.dropping, fq.drops);
+
+	/* Once the queue is back below target, CoDel stops dropping */
+	dp_test_fail_unless(!basic_codel_dequeue(&fq, 1, 1200, 1201),
+			    "dropped below target");
+	dp_test_fail_unless(!fq.dropping, "still dropping below target");
+
+} DP_END_TEST;
+
+/*
+ * tm_offload_stop gives dp2T1 the shapers of a NIC supporting rte_tm, and
+ * a policy with nothing but shaping, which is given to the NIC. When the
+ * NIC's hierarchy can't then be removed, the port mustn't be shaped by
+ * rte_sched as well, so a new policy fails to start until it has been.
+ *
+ * tm_offload_cmds created from:
+ *
+ *   set interfaces dataplane dp0s5 policy qos 'trunk-policy'
+ *   set policy qos name trunk-policy shaper default 'profile-1'
+ *   set policy qos name trunk-policy shaper profile profile-1
+ *     map pcp 0-7 to 3
+ */
+
+const char *tm_offload_cmds[] = {
+	"port subports 1 pipes 1 profiles 1 overhead 24 ql_packets",
+	"subport 0 rate 1250000000 size 5000000 period 40",
+	"subport 0 queue 0 rate 1250000000 size 5000000",
+	"subport 0 queue 1 rate 1250000000 size 5000000",
+	"subport 0 queue 2 rate 1250000000 size 5000000",
+	"subport 0 queue 3 rate 1250000000 size 5000000",
+	"vlan 0 0",
+	"profile 0 rate 1250000 size 5000 period 10",
+	"profile 0 queue 0 rate 1250000 size 5000",
+	"profile 0 queue 1 rate 1250000 size 5000",
+	"profile 0 queue 2 rate 1250000 size 5000",
+	"profile 0 queue 3 rate 1250000 size 5000",
+	"profile 0 pcp 0 0x3",
+	"profile 0 pcp 1 0x3",
+	"profile 0 pcp 2 0x3",
+	"profile 0 pcp 3 0x3",
+	"profile 0 pcp 4 0x3",
+	"profile 0 pcp 5 0x3",
+	"profile 0 pcp 6 0x3",
+	"profile 0 pcp 7 0x3",
+	"pipe 0 0 0",
+	"enable"
+};
+
+static void
+tm_offload_check(bool offloaded, bool debug)
+{
+	json_object *j_shaper;
+	json_object *j_offload;
+
+	j_shaper = dp_test_qos_get_json_shaper("dp2T1", debug);
+	dp_test_fail_unless(json_object_object_get_ex(j_shaper, "tm-offload",
+						      &j_offload),
+			    "no tm-offload in shaper");
+	dp_test_fail_unless(json_object_get_boolean(j_offload) == offloaded,
+			    "tm-offload is %s, expected %s",
+			    offloaded ? "false" : "true",
+			    offloaded ? "true" : "false");
+	json_object_put(j_shaper);
+}
+
+DP_START_TEST(qos_basic_ipv4, tm_offload_stop)
+{
+	bool debug = (dp_test_debug_get() == 2 ? true : false);
+	char real[IFNAMSIZ];
+
+	qos_lib_test_setup();
+
+	dp_test_qos_debug(debug);
+
+	dp_test_tm_emulate(dp_test_intf_real("dp2T1", real), true);
+
+	dp_test_qos_attach_config_to_if("dp2T1", tm_offload_cmds, debug);
+	tm_offload_check(true, debug);
+	dp_test_fail_unless(dp_test_tm_shaping(), "NIC not shaping");
+
+	/* The NIC's hierarchy outlives its policy */
+	dp_test_tm_fail_delete(true);
+	dp_test_qos_delete_config_from_if("dp2T1", debug);
+	dp_test_fail_unless(dp_test_tm_shaping(), "NIC hierarchy removed");
+
+	/* and stops another policy being shaped by rte_sched */
+	dp_test_qos_attach_config_to_if("dp2T1", basic_pkt_fwd_cmds, debug);
+	tm_offload_check(false, debug);
+	dp_test_fail_unless(dp_test_tm_shaping(), "NIC hierarchy removed");
+	dp_test_qos_delete_config_from_if("dp2T1", debug);
+
+	/* Until it can be removed */
+	dp_test_tm_fail_delete(false);
+	dp_test_qos_attach_config_to_if("dp2T1", basic_pkt_fwd_cmds, debug);
+	dp_test_fail_unless(!dp_test_tm_shaping(), "NIC still shaping");
+	tm_offload_check(false, debug);
+
+	dp_test_qos_pkt_forw_test("dp2T1", 0, "1.1.1.11", "2.2.2.11",
+				  0, 0, 0, 3, 0, debug);
+
+	/* Cleanup */
+	dp_test_qos_delete_config_from_if("dp2T1", debug);
+	dp_test_tm_emulate(real, false);
+	dp_test_qos_debug(false);
+
+	qos_lib_test_teardown();
+
+} DP_END_TEST;
+
+/*
+ * tm_offload_abort fails the offload part way through, leaving nodes
+ * that can't be removed, which stop rte_sched shaping the port until
+ * they have been.
+ */
+DP_START_TEST(qos_basic_ipv4, tm_offload_abort)
+{
+	bool debug = (dp_test_debug_get() == 2 ? true : false);
+	char real[IFNAMSIZ];
+
+	qos_lib_test_setup();
+
+	dp_test_qos_debug(debug);
+
+	dp_test_tm_emulate(dp_test_intf_real("dp2T1", real), true);
+
+	/* The shaping levels are added, but not the leaves */
+	dp_test_tm_fail_leaf_add(true);
+	dp_test_tm_fail_delete(true);
+	dp_test_qos_attach_config_to_if("dp2T1", tm_offload_cmds, debug);
+	tm_offload_check(false, debug);
+	dp_test_fail_unless(dp_test_tm_nodes() == 3,
+			    "%u rte_tm nodes left, expected 3",
+			    dp_test_tm_nodes());
+	dp_test_qos_delete_config_from_if("dp2T1", debug);
+	dp_test_fail_unless(dp_test_tm_nodes() == 3, "rte_tm nodes removed");
+
+	/* Once they are removed, the policy is offloaded */
+	dp_test_tm_fail_delete(false);
+	dp_test_tm_fail_leaf_add(false);
+	dp_test_qos_attach_config_to_if("dp2T1", tm_offload_cmds, debug);
+	tm_offload_check(true, debug);
+	dp_test_fail_unless(dp_test_tm_shaping(), "NIC not shaping");
+
+	/* Cleanup */
+	dp_test_qos_delete_config_from_if("dp2T1", debug);
+	dp_test_fail_unless(!dp_test_tm_shaping(), "NIC still shaping");
+	dp_test_fail_unless(dp_test_tm_nodes() == 0,
+			    "%u rte_tm nodes left", dp_test_tm_nodes());
+	dp_test_tm_emulate(real, false);
+	dp_test_qos_debug(false);
+
+	qos_lib_test_teardown();
+
+} DP_END_TEST;
+
 /*
  * vlan_subport_map checks that the vlan interfaces get associated with the
  * expected subport.
@@ -0,0 +1,346 @@
+/*
+ * Copyright (c) 2021, AT&T Intellectual Property. All rights reserved.
+ *
+ * SPDX-License-Identifier: LGPL-2.1-only
+ *
+ * Ingress policing tests.
+ */
+
+#include <libmnl/libmnl.h>
+
+#include "ip_funcs.h"
+#include "if_var.h"
+#include "main.h"
+
+#include "dp_test.h"
+#include "dp_test_str.h"
+#include "dp_test_lib_internal.h"
+#include "dp_test_lib_exp.h"
+#include "dp_test_lib_intf_internal.h"
+#include "dp_test_lib_pkt.h"
+#include "dp_test_pktmbuf_lib_internal.h"
+#include "dp_test_netlink_state_internal.h"
+#include "dp_test_console.h"
+#include "dp_test_controller.h"
+#include "dp_test_json_utils.h"
+
+#include "dp_test_qos_lib.h"
+
+/*
+ * The packets are received on dp1T0 and routed out of dp2T1, as in
+ * qos_lib_test_setup(). Each is 500 bytes from the IP header on, which
+ * is what the meters count.
+ *
+ * A committed burst of 1518 bytes, the smallest there is, at 1 byte per
+ * second lets 3 packets through and then no more for the rest of the
+ * test.
+ */
+#define IPOL_PKT_PAYLOAD	460
+
+static void
+ipol_pkt_test(uint dscp, int remark, enum dp_test_fwd_result_e fwd)
+{
+	struct dp_test_expected *exp;
+	struct rte_mbuf *test_pak;
+
+	struct dp_test_pkt_desc_t v4_pkt_desc = {
+		.text       = "TCP IPv4",
+		.len        = IPOL_PKT_PAYLOAD,
+		.ether_type = RTE_ETHER_TYPE_IPV4,
+		.l3_src     = "1.1.1.11",
+		.l2_src     = "aa:bb:cc:dd:1:a1",
+		.l3_dst     = "2.2.2.11",
+		.l2_dst     = "aa:bb:cc:dd:2:b1",
+		.proto      = IPPROTO_TCP,
+		.l4         = {
+			.tcp = {
+				.sport = 1000,
+				.dport = 1001,
+				.flags = 0
+			}
+		},
+		.rx_intf    = "dp1T0",
+		.tx_intf    = "dp2T1"
+	};
+
+	v4_pkt_desc.traf_class = dscp << 2;
+
+	test_pak = dp_test_v4_pkt_from_desc(&v4_pkt_desc);
+	exp = dp_test_exp_from_desc(test_pak, &v4_pkt_desc);
+
+	if (remark >= 0)
+		dp_test_ipv4_remark_tos(dp_test_exp_get_pak(exp), remark << 2);
+
+	dp_test_exp_set_fwd_status(exp, fwd);
+
+	dp_test_pak_receive(test_pak, v4_pkt_desc.rx_intf, exp);
+}
+
+static void
+ipol_cfg(const char *cmd)
+{
+	char real[IFNAMSIZ];
+
+	dp_test_send_config_src(dp_test_cont_src_get(),
+				"qos %s ingress-police %s",
+				dp_test_intf_real("dp1T0", real), cmd);
+}
+
+static void
+ipol_check(uint green, uint yellow, uint red)
+{
+	char real[IFNAMSIZ];
+	json_object *jexp;
+
+	dp_test_intf_real("dp1T0", real);
+	jexp = dp_test_json_create(
+		"{ \"ingress-police\": [ {"
+		"    \"ifname\": \"%s\","
+		"    \"aggregate\": {"
+		"      \"green-packets\": %u,"
+		"      \"green-bytes\": %u,"
+		"      \"yellow-packets\": %u,"
+		"      \"yellow-bytes\": %u,"
+		"      \"red-packets\": %u,"
+		"      \"red-bytes\": %u }"
+		"} ] }", real,
+		green, green * (IPOL_PKT_PAYLOAD + 40),
+		yellow, yellow * (IPOL_PKT_PAYLOAD + 40),
+		red, red * (IPOL_PKT_PAYLOAD + 40));
+	dp_test_check_json_state("qos ingress-police show", jexp,
+				 DP_TEST_JSON_CHECK_SUBSET, false);
+	json_object_put(jexp);
+}
+
+static void
+ipol_sub_check(const char *prefix, uint green, uint yellow, uint red)
+{
+	char real[IFNAMSIZ];
+	json_object *jexp;
+
+	dp_test_intf_real("dp1T0", real);
+	jexp = dp_test_json_create(
+		"{ \"ingress-police\": [ {"
+		"    \"ifname\": \"%s\","
+		"    \"subscribers\": [ {"
+		"      \"prefix\": \"%s\","
+		"      \"green-packets\": %u,"
+		"      \"green-bytes\": %u,"
+		"      \"yellow-packets\": %u,"
+		"      \"yellow-bytes\": %u,"
+		"      \"red-packets\": %u,"
+		"      \"red-bytes\": %u } ]"
+		"} ] }", real, prefix,
+		green, green * (IPOL_PKT_PAYLOAD + 40),
+		yellow, yellow * (IPOL_PKT_PAYLOAD + 40),
+		red, red * (IPOL_PKT_PAYLOAD + 40));
+	dp_test_check_json_state("qos ingress-police show", jexp,
+				 DP_TEST_JSON_CHECK_SUBSET, false);
+	json_object_put(jexp);
+}
+
+DP_DECL_TEST_SUITE(qos_ingress_police);
+
+DP_DECL_TEST_CASE(qos_ingress_police, ipol_aggregate, NULL, NULL);
+
+/*
+ * Packets within the committed rate are forwarded untouched.
+ */
+DP_START_TEST(ipol_aggregate, green)
+{
+	qos_lib_test_setup();
+
+	ipol_cfg("aggregate 1000000 100000");
+	ipol_check(0, 0, 0);
+
+	ipol_pkt_test(0, -1, DP_TEST_FWD_FORWARDED);
+	ipol_pkt_test(0, -1, DP_TEST_FWD_FORWARDED);
+	ipol_check(2, 0, 0);
+
+	dp_test_console_request_reply("qos ingress-police clear", false);
+	ipol_check(0, 0, 0);
+
+	ipol_cfg("delete");
+	qos_lib_test_teardown();
+} DP_END_TEST;
+
+/*
+ * With a peak rate, packets over the committed burst but within the
+ * peak are yellow and are remarked to the yellow DSCP.
+ */
+DP_START_TEST(ipol_aggregate, yellow_remark)
+{
+	qos_lib_test_setup();
+
+	ipol_cfg("aggregate 1 1518 100000000 1000000");
+	ipol_cfg("yellow-dscp 10");
+
+	ipol_pkt_test(0, -1, DP_TEST_FWD_FORWARDED);
+	ipol_pkt_test(0, -1, DP_TEST_FWD_FORWARDED);
+	ipol_pkt_test(0, -1, DP_TEST_FWD_FORWARDED);
+	ipol_check(3, 0, 0);
+
+	ipol_pkt_test(0, 10, DP_TEST_FWD_FORWARDED);
+	ipol_pkt_test(0, 10, DP_TEST_FWD_FORWARDED);
+	ipol_check(3, 2, 0);
+
+	ipol_cfg("delete");
+	qos_lib_test_teardown();
+} DP_END_TEST;
+
+/*
+ * Without a peak rate, packets over the committed burst are red and are
+ * dropped.
+ */
+DP_START_TEST(ipol_aggregate, red)
+{
+	qos_lib_test_setup();
+
+	ipol_cfg("aggregate 1 1518");
+
+	ipol_pkt_test(0, -1, DP_TEST_FWD_FORWARDED);
+	ipol_pkt_test(0, -1, DP_TEST_FWD_FORWARDED);
+	ipol_pkt_test(0, -1, DP_TEST_FWD_FORWARDED);
+	ipol_check(3, 0, 0);
+
+	ipol_pkt_test(0, -1, DP_TEST_FWD_DROPPED);
+	ipol_check(3, 0, 1);
+
+	ipol_cfg("delete");
+	qos_lib_test_teardown();
+} DP_END_TEST;
+
+/*
+ * A bad command is refused without leaving any state on the interface.
+ */
+DP_START_TEST(ipol_aggregate, bad_cmd)
+{
+	const char *cmds[] = {
+		"aggregate 0 1518",
+		"aggregate 1000 1518 1 1518",
+		"subscriber 1.1.1.0/33 1 1518",
+		"yellow-dscp 64",
+		"colour-aware maybe",
+	};
+	json_object *jexp;
+	unsigned int i;
+
+	qos_lib_test_setup();
+
+	jexp = dp_test_json_create("{ \"ingress-police\": [ ] }");
+	for (i = 0; i < ARRAY_SIZE(cmds); i++) {
+		dp_test_set_config_err(-EINVAL);
+		ipol_cfg(cmds[i]);
+		dp_test_check_json_state("qos ingress-police show", jexp,
+					 DP_TEST_JSON_CHECK_EXACT, false);
+	}
+	json_object_put(jexp);
+
+	qos_lib_test_teardown();
+} DP_END_TEST;
+
+DP_DECL_TEST_CASE(qos_ingress_police, ipol_subscriber, NULL, NULL);
+
+/*
+ * The packets are metered by the longest subscriber prefix matching
+ * their source address, and by the next longest once that is deleted.
+ */
+DP_START_TEST(ipol_subscriber, longest_match)
+{
+	qos_lib_test_setup();
+
+	ipol_cfg("subscriber 1.1.0.0/16 1000000 100000");
+	ipol_cfg("subscriber 1.1.1.0/24 1 1518");
+	ipol_cfg("subscriber 1.1.1.11/32 1000000 100000");
+
+	ipol_pkt_test(0, -1, DP_TEST_FWD_FORWARDED);
+	ipol_sub_check("1.1.1.11/32", 1, 0, 0);
+	ipol_sub_check("1.1.1.0/24", 0, 0, 0);
+	ipol_sub_check("1.1.0.0/16", 0, 0, 0);
+
+	ipol_cfg("subscriber 1.1.1.11/32 delete");
+
+	ipol_pkt_test(0, -1, DP_TEST_FWD_FORWARDED);
+	ipol_pkt_test(0, -1, DP_TEST_FWD_FORWARDED);
+	ipol_pkt_test(0, -1, DP_TEST_FWD_FORWARDED);
+	ipol_pkt_test(0, -1, DP_TEST_FWD_DROPPED);
+	ipol_sub_check("1.1.1.0/24", 3, 0, 1);
+	ipol_sub_check("1.1.0.0/16", 0, 0, 0);
+
+	ipol_cfg("subscriber 1.1.1.0/24 delete");
+
+	ipol_pkt_test(0, -1, DP_TEST_FWD_FORWARDED);
+	ipol_sub_check("1.1.0.0/16", 1, 0, 0);
+
+	ipol_cfg("delete");
+	qos_lib_test_teardown();
+} DP_END_TEST;
+
+/*
+ * A packet within its subscriber's rate is still dropped once the
+ * aggregate is used up, while one the subscriber drops is never seen by
+ * the aggregate.
+ */
+DP_START_TEST(ipol_subscriber, aggregate)
+{
+	qos_lib_test_setup();
+
+	ipol_cfg("subscriber 1.1.1.0/24 1000000 100000");
+	ipol_cfg("aggregate 1 1518");
+
+	ipol_pkt_test(0, -1, DP_TEST_FWD_FORWARDED);
+	ipol_pkt_test(0, -1, DP_TEST_FWD_FORWARDED);
+	ipol_pkt_test(0, -1, DP_TEST_FWD_FORWARDED);
+	ipol_pkt_test(0, -1, DP_TEST_FWD_DROPPED);
+	ipol_sub_check("1.1.1.0/24", 4, 0, 0);
+	ipol_check(3, 0, 1);
+
+	ipol_cfg("delete");
+
+	ipol_cfg("subscriber 1.1.1.0/24 1 1518");
+	ipol_cfg("aggregate 1000000 100000");
+
+	ipol_pkt_test(0, -1, DP_TEST_FWD_FORWARDED);
+	ipol_pkt_test(0, -1, DP_TEST_FWD_FORWARDED);
+	ipol_pkt_test(0, -1, DP_TEST_FWD_FORWARDED);
+	ipol_pkt_test(0, -1, DP_TEST_FWD_DROPPED);
+	ipol_sub_check("1.1.1.0/24", 3, 0, 1);
+	ipol_check(3, 0, 0);
+
+	ipol_cfg("delete");
+	qos_lib_test_teardown();
+} DP_END_TEST;
+
+DP_DECL_TEST_CASE(qos_ingress_police, ipol_colour_aware, NULL, NULL);
+
+/*
+ * When colour aware, packets already carrying the yellow DSCP stay
+ * yellow and don't use the committed rate; otherwise they are metered
+ * like any other packet.
+ */
+DP_START_TEST(ipol_colour_aware, yellow_in)
+{
+	qos_lib_test_setup();
+
+	ipol_cfg("aggregate 1 1518 100000000 1000000");
+	ipol_cfg("yellow-dscp 10");
+	ipol_cfg("colour-aware on");
+
+	ipol_pkt_test(10, -1, DP_TEST_FWD_FORWARDED);
+	ipol_pkt_test(0, -1, DP_TEST_FWD_FORWARDED);
+	ipol_check(1, 1, 0);
+
+	ipol_cfg("colour-aware off");
+
+	ipol_pkt_test(10, -1, DP_TEST_FWD_FORWARDED);
+	ipol_pkt_test(0, -1, DP_TEST_FWD_FORWARDED);
+	ipol_check(3, 1, 0);
+
+	/* The committed burst is used up, so now both are yellow */
+	ipol_pkt_test(10, -1, DP_TEST_FWD_FORWARDED);
+	ipol_pkt_test(0, 10, DP_TEST_FWD_FORWARDED);
+	ipol_check(3, 3, 0);
+
+	ipol_cfg("delete");
+	qos_lib_test_teardown();
+} DP_END_TEST;
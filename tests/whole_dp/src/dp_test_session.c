@@ -16,6 +16,7 @@
 #include <time.h>
 #include <sys/time.h>
 #include <sys/resource.h>
+#include <urcu/uatomic.h>
 
 
 #include "ip_funcs.h"
@@ -24,6 +25,7 @@
 #include "main.h"
 #include "session/session.h"
 #include "session/session_feature.h"
+#include "session/session_watch.h"
 #include "npf/npf.h"
 #include "npf/npf_if.h"
 #include "npf/npf_cache.h"
@@ -2337,3 +2339,249 @@ DP_START_TEST(ssync_pb2, test40)
 
 } DP_END_TEST;
 
+
+/*
+ * Deferred session watch events.
+ *
+ * The events are raised from the test thread, so go on the ring shared
+ * by the non-dataplane threads. The watcher can be held in its callback
+ * to let events build up behind it.
+ */
+#define WATCH_RING_SZ 4096	/* as in session_watch.c */
+
+static struct {
+	struct session *session;
+	unsigned int calls;
+	unsigned int held;	/* calls with a reference on the session */
+	bool entered;
+	bool blocked;
+} watch_test;
+
+static void watch_test_fn(struct session *s, enum dp_session_hook hook,
+			  void *data)
+{
+	if (s == watch_test.session &&
+	    rte_atomic32_read(&s->se_watch_cnt) > 0)
+		uatomic_inc(&watch_test.held);
+
+	CMM_STORE_SHARED(watch_test.entered, true);
+	while (CMM_LOAD_SHARED(watch_test.blocked))
+		usleep(100);
+	uatomic_inc(&watch_test.calls);
+}
+
+static struct session_watch watch_test_watch = {
+	.fn = watch_test_fn,
+	.types = SESSION_TYPE_FW,
+	.name = "dp_test",
+};
+
+static struct session *watch_test_setup(void)
+{
+	const struct ifnet *ifp;
+	char realname[IFNAMSIZ];
+	struct sentry_packet sp_forw, sp_back;
+	uint32_t saddr, daddr;
+	struct rte_mbuf *f;
+	struct session *s;
+	bool created;
+	int len = 22;
+	int rc;
+
+	dp_test_netlink_add_vrf(69, 1);
+	dp_test_nl_add_ip_addr_and_connected_vrf(IF_NAME, "1.1.1.1/24", 69);
+	dp_test_intf_real(IF_NAME, realname);
+	ifp = dp_ifnet_byifname(realname);
+
+	f = dp_test_create_udp_ipv4_pak("10.73.0.0", "10.73.2.0",
+			1001, 1003, 1, &len);
+
+	inet_pton(AF_INET, "10.73.0.0", &saddr);
+	inet_pton(AF_INET, "10.73.2.0", &daddr);
+
+	rc = dp_test_session_init_sentry_packet(&sp_forw, ifp->if_index,
+			SENTRY_IPv4, (uint8_t) IPPROTO_UDP, 1, htons(1001),
+			&saddr, htons(1003), &daddr);
+	dp_test_fail_unless(rc == 0, "session init sentry_packet: %d\n", rc);
+	sentry_packet_reverse(&sp_forw, &sp_back);
+
+	dp_test_session_create_from_sentry_packets(f, &sp_forw, &sp_back,
+			ifp, 10, &s, &created);
+	rte_pktmbuf_free(f);
+	s->se_fw = 1;
+
+	memset(&watch_test, 0, sizeof(watch_test));
+	watch_test.session = s;
+	watch_test.blocked = true;
+
+	rc = dp_session_watch_register_flags(&watch_test_watch,
+					     SESSION_WATCH_F_DEFERRED);
+	dp_test_fail_unless(rc == 0, "session watch register: %d\n", rc);
+
+	return s;
+}
+
+static void watch_test_teardown(void)
+{
+	int rc;
+
+	rc = dp_session_watch_unregister(0);
+	dp_test_fail_unless(rc == 0, "session watch unregister: %d\n", rc);
+
+	dp_test_session_reset();
+	dp_test_nl_del_ip_addr_and_connected_vrf(IF_NAME, "1.1.1.1/24", 69);
+	dp_test_netlink_del_vrf(69, 0);
+}
+
+static void watch_test_wait(unsigned int *val, unsigned int exp,
+			    const char *what)
+{
+	unsigned int i;
+
+	for (i = 0; i < 5000 && CMM_LOAD_SHARED(*val) < exp; i++)
+		usleep(1000);
+	dp_test_fail_unless(CMM_LOAD_SHARED(*val) == exp,
+			    "session watch %s %u, expected %u",
+			    what, CMM_LOAD_SHARED(*val), exp);
+}
+
+static void watch_test_entered(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < 5000 && !CMM_LOAD_SHARED(watch_test.entered); i++)
+		usleep(1000);
+	dp_test_fail_unless(CMM_LOAD_SHARED(watch_test.entered),
+			    "session watch callback not called");
+}
+
+static void watch_test_show(unsigned int queued, unsigned int dropped,
+			    unsigned int delivered)
+{
+	json_object *exp;
+
+	exp = dp_test_json_create(
+		"{"
+		"  \"session_watch\":{"
+		"    \"name\":\"dp_test\","
+		"    \"deferred\":true,"
+		"    \"queued\":%u,"
+		"    \"dropped\":%u,"
+		"    \"delivered\":%u"
+		"  }"
+		"}",
+		queued, dropped, delivered);
+
+	dp_test_check_json_state("session-op show session watch", exp,
+				 DP_TEST_JSON_CHECK_SUBSET, false);
+	json_object_put(exp);
+}
+
+static void watch_test_raise(struct session *s, enum dp_session_hook hook,
+			     unsigned int n)
+{
+	unsigned int i;
+
+	for (i = 0; i < n; i++)
+		session_do_watch(s, hook);
+}
+
+/*
+ * Deferred events are delivered from the watch thread, each holding a
+ * reference that keeps the session until it has been delivered.
+ */
+DP_DECL_TEST_CASE(session_suite, session_watch_deferred, NULL, NULL);
+DP_START_TEST(session_watch_deferred, test41)
+{
+	struct session *s;
+
+	s = watch_test_setup();
+
+	/* one held in the callback, two queued behind it */
+	watch_test_raise(s, SESSION_STATE_CHANGE, 1);
+	watch_test_entered();
+	watch_test_raise(s, SESSION_STATE_CHANGE, 2);
+
+	dp_test_fail_unless(rte_atomic32_read(&s->se_watch_cnt) == 3,
+			    "session watch references %d, expected 3",
+			    rte_atomic32_read(&s->se_watch_cnt));
+	watch_test_show(3, 0, 0);
+
+	/* The session outlives its removal until the events are delivered */
+	dp_test_session_reset();
+
+	CMM_STORE_SHARED(watch_test.blocked, false);
+	watch_test_wait(&watch_test.calls, 3, "calls");
+	watch_test_wait(&watch_test.held, 3, "calls holding a reference");
+	watch_test_show(3, 0, 3);
+
+	watch_test_teardown();
+} DP_END_TEST;
+
+/*
+ * Events are dropped, and their references released, when the ring is
+ * full.
+ */
+DP_DECL_TEST_CASE(session_suite, session_watch_drop, NULL, NULL);
+DP_START_TEST(session_watch_drop, test42)
+{
+	struct session *s;
+
+	s = watch_test_setup();
+
+	watch_test_raise(s, SESSION_STATE_CHANGE, 1);
+	watch_test_entered();
+
+	/* The ring holds one less than its size */
+	watch_test_raise(s, SESSION_STATE_CHANGE, WATCH_RING_SZ - 1 + 10);
+
+	dp_test_fail_unless(rte_atomic32_read(&s->se_watch_cnt) ==
+			    WATCH_RING_SZ,
+			    "session watch references %d, expected %d",
+			    rte_atomic32_read(&s->se_watch_cnt), WATCH_RING_SZ);
+	watch_test_show(WATCH_RING_SZ, 10, 0);
+
+	CMM_STORE_SHARED(watch_test.blocked, false);
+	watch_test_wait(&watch_test.calls, WATCH_RING_SZ, "calls");
+	watch_test_show(WATCH_RING_SZ, 10, WATCH_RING_SZ);
+	dp_test_fail_unless(rte_atomic32_read(&s->se_watch_cnt) == 0,
+			    "session watch references %d, expected 0",
+			    rte_atomic32_read(&s->se_watch_cnt));
+
+	watch_test_teardown();
+} DP_END_TEST;
+
+/*
+ * Only one stats update is queued for a session at a time, however
+ * many packets update it. Once the watcher has been called for it,
+ * the next one is queued again.
+ */
+DP_DECL_TEST_CASE(session_suite, session_watch_stats, NULL, NULL);
+DP_START_TEST(session_watch_stats, test43)
+{
+	struct session *s;
+
+	s = watch_test_setup();
+
+	watch_test_raise(s, SESSION_STATS_UPDATE, 1);
+	watch_test_entered();
+
+	watch_test_raise(s, SESSION_STATS_UPDATE, 100);
+	watch_test_raise(s, SESSION_STATE_CHANGE, 1);
+	watch_test_raise(s, SESSION_STATS_UPDATE, 100);
+
+	dp_test_fail_unless(rte_atomic32_read(&s->se_watch_cnt) == 3,
+			    "session watch references %d, expected 3",
+			    rte_atomic32_read(&s->se_watch_cnt));
+	watch_test_show(3, 0, 0);
+
+	CMM_STORE_SHARED(watch_test.blocked, false);
+	watch_test_wait(&watch_test.calls, 3, "calls");
+	watch_test_show(3, 0, 3);
+
+	watch_test_raise(s, SESSION_STATS_UPDATE, 100);
+	watch_test_wait(&watch_test.calls, 4, "calls");
+	watch_test_show(4, 0, 4);
+
+	watch_test_teardown();
+} DP_END_TEST;
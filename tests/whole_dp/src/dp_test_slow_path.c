@@ -15,6 +15,9 @@
 #include "main.h"
 #include "shadow.h"
 #include "if/gre.h"
+#include "in_cksum.h"
+#include "ip_checksum.h"
+#include "util.h"
 
 #include "dp_test.h"
 #include "dp_test_lib_internal.h"
@@ -191,3 +194,118 @@ DP_START_TEST(slow_dp_pkt, test_spath_gre)
 	dp_test_nl_del_ip_addr_and_connected("dp1T1", "1.1.2.1/24");
 
 } DP_END_TEST;
+
+/*
+ * Segments of a TCP flow are coalesced before being written to the tap,
+ * but not fragments or segments whose checksum doesn't verify, and
+ * nothing is moved across those.
+ */
+DP_START_TEST(slow_dp_pkt, test_shadow_gro)
+{
+	struct rte_mbuf *pkts[4];
+	struct tcphdr *tcp;
+	struct iphdr *ip;
+	int len = 100;
+	unsigned int i, n;
+
+	for (i = 0; i < ARRAY_SIZE(pkts); i++) {
+		pkts[i] = dp_test_create_tcp_ipv4_pak("1.1.1.2", "1.1.1.1",
+						      41000, 179, TH_ACK,
+						      1 + i * len, 1, 5000,
+						      NULL, 1, &len);
+		dp_test_fail_unless(pkts[i], "failed to create packet %u", i);
+		ip = dp_pktmbuf_mtol3(pkts[i], struct iphdr *);
+		ip->frag_off = htons(IP_DF);
+		dp_set_cksum_hdr(ip);
+	}
+
+	/* The third is a fragment, the fourth has a bad checksum */
+	ip = dp_pktmbuf_mtol3(pkts[2], struct iphdr *);
+	ip->frag_off = htons(IP_MF);
+	dp_set_cksum_hdr(ip);
+	ip = dp_pktmbuf_mtol3(pkts[3], struct iphdr *);
+	tcp = (struct tcphdr *)(ip + 1);
+	tcp->check ^= htons(1);
+
+	n = shadow_gro(pkts, ARRAY_SIZE(pkts));
+	dp_test_fail_unless(n == 3, "expected 3 packets after GRO, got %u", n);
+
+	/* First two merged, with checksums recalculated */
+	dp_test_fail_unless(pkts[0]->pkt_len == RTE_ETHER_HDR_LEN +
+			    sizeof(*ip) + sizeof(*tcp) + 2 * len,
+			    "merged packet length %u", pkts[0]->pkt_len);
+	dp_test_fail_unless(pkts[0]->ol_flags & PKT_TX_TCP_SEG,
+			    "merged packet not flagged for GSO");
+	dp_test_fail_unless(pkts[0]->tso_segsz == len,
+			    "merged packet segment size %u",
+			    pkts[0]->tso_segsz);
+	ip = dp_pktmbuf_mtol3(pkts[0], struct iphdr *);
+	dp_test_fail_unless(ip_checksum(ip, sizeof(*ip)) == 0,
+			    "merged packet has bad IP checksum");
+	dp_test_fail_unless(dp_in4_cksum_mbuf(pkts[0], ip, ip + 1) == 0,
+			    "merged packet has bad TCP checksum");
+
+	/* The others are left alone, in order */
+	for (i = 1; i < n; i++) {
+		ip = dp_pktmbuf_mtol3(pkts[i], struct iphdr *);
+		tcp = (struct tcphdr *)(ip + 1);
+		dp_test_fail_unless(ntohl(tcp->seq) == 1 + (i + 1) * len,
+				    "packet %u out of order", i);
+		dp_test_fail_unless(!(pkts[i]->ol_flags & PKT_TX_TCP_SEG),
+				    "packet %u flagged for GSO", i);
+	}
+
+	for (i = 0; i < n; i++)
+		rte_pktmbuf_free(pkts[i]);
+
+} DP_END_TEST;
+
+/*
+ * A segment with PSH is merged into the segments before it, with PSH
+ * set on the merged packet, but nothing after it is merged.
+ */
+DP_START_TEST(slow_dp_pkt, test_shadow_gro_push)
+{
+	struct rte_mbuf *pkts[3];
+	struct tcphdr *tcp;
+	struct iphdr *ip;
+	int len = 100;
+	unsigned int i, n;
+
+	for (i = 0; i < ARRAY_SIZE(pkts); i++) {
+		pkts[i] = dp_test_create_tcp_ipv4_pak("1.1.1.2", "1.1.1.1",
+						      41000, 179,
+						      i == 1 ? TH_ACK | TH_PUSH :
+						      TH_ACK,
+						      1 + i * len, 1, 5000,
+						      NULL, 1, &len);
+		dp_test_fail_unless(pkts[i], "failed to create packet %u", i);
+		ip = dp_pktmbuf_mtol3(pkts[i], struct iphdr *);
+		ip->frag_off = htons(IP_DF);
+		dp_set_cksum_hdr(ip);
+	}
+
+	n = shadow_gro(pkts, ARRAY_SIZE(pkts));
+	dp_test_fail_unless(n == 2, "expected 2 packets after GRO, got %u", n);
+
+	ip = dp_pktmbuf_mtol3(pkts[0], struct iphdr *);
+	tcp = (struct tcphdr *)(ip + 1);
+	dp_test_fail_unless(pkts[0]->pkt_len == RTE_ETHER_HDR_LEN +
+			    sizeof(*ip) + sizeof(*tcp) + 2 * len,
+			    "merged packet length %u", pkts[0]->pkt_len);
+	dp_test_fail_unless(tcp->th_flags == (TH_ACK | TH_PUSH),
+			    "merged packet flags 0x%x", tcp->th_flags);
+	dp_test_fail_unless(dp_in4_cksum_mbuf(pkts[0], ip, tcp) == 0,
+			    "merged packet has bad TCP checksum");
+
+	ip = dp_pktmbuf_mtol3(pkts[1], struct iphdr *);
+	tcp = (struct tcphdr *)(ip + 1);
+	dp_test_fail_unless(ntohl(tcp->seq) == 1 + 2 * len,
+			    "packet after PSH out of order");
+	dp_test_fail_unless(tcp->th_flags == TH_ACK,
+			    "packet after PSH flags 0x%x", tcp->th_flags);
+
+	for (i = 0; i < n; i++)
+		rte_pktmbuf_free(pkts[i]);
+
+} DP_END_TEST;
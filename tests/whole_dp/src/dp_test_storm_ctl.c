@@ -11,7 +11,9 @@
 #include "dp_test_controller.h"
 #include "dp_test_cmd_state.h"
 #include "dp_test_console.h"
+#include "dp_test_lib_exp.h"
 #include "dp_test_lib_intf_internal.h"
+#include "dp_test_pktmbuf_lib_internal.h"
 #include "bridge_vlan_set.h"
 
 DP_DECL_TEST_SUITE(storm_ctl);
@@ -632,3 +634,80 @@ DP_START_TEST(add_profile, out_order_delete)
 	dp_test_send_config_src(dp_test_cont_src_get(),
 				"switchport dpT10 hw-switching disable");
 } DP_END_TEST;
+
+/*
+ * Without hw-switching the frames flooded by the software bridge are
+ * policed in software, against one bucket for the interface.
+ *
+ * 8 kbit/s is 1000 bytes/sec, with a burst of 10ms, so of two frames
+ * of 1000 bytes back to back the first is flooded and the second
+ * dropped, and counted as a drop on the bridge.
+ */
+DP_START_TEST(add_profile, sw_police)
+{
+	const char *mac_a = "00:00:a4:00:00:aa";
+	const char *mac_b = "00:00:a4:00:00:bb";
+	struct if_data start_stats, stats;
+	struct dp_test_expected *exp;
+	struct rte_mbuf *test_pak;
+	json_object *jexp;
+	int len = 1000;
+
+	dp_test_intf_bridge_create("br1");
+	dp_test_intf_bridge_add_port("br1", "dp1T0");
+	dp_test_intf_bridge_add_port("br1", "dp2T1");
+
+	dp_test_send_config_src(dp_test_cont_src_get(),
+				"storm-ctl SET profile PR1 unicast bandwidth-level 8");
+	dp_test_send_config_src(dp_test_cont_src_get(),
+				"storm-ctl SET dpT10 profile PR1");
+
+	dp_test_intf_initial_stats_for_if("br1", &start_stats);
+
+	/* Unknown unicast, so flooded */
+	test_pak = dp_test_create_l2_pak(mac_b, mac_a, DP_TEST_ET_LLDP,
+					 1, &len);
+	exp = dp_test_exp_create(test_pak);
+	dp_test_exp_set_oif_name(exp, "dp2T1");
+	dp_test_pak_receive(test_pak, "dp1T0", exp);
+
+	test_pak = dp_test_create_l2_pak(mac_b, mac_a, DP_TEST_ET_LLDP,
+					 1, &len);
+	exp = dp_test_exp_create(test_pak);
+	dp_test_exp_set_fwd_status(exp, DP_TEST_FWD_DROPPED);
+	dp_test_pak_receive(test_pak, "dp1T0", exp);
+
+	jexp = dp_test_json_create(
+		"{ \"storm_ctl_state\": {"
+		"    \"intfs\": [{"
+		"        \"ifname\": \"dpT10\","
+		"        \"whole_interface\": {"
+		"            \"profile\": \"PR1\","
+		"            \"unicast\": {"
+		"                \"cfg_rate\": 8,"
+		"                \"pkts_accepted\": 1,"
+		"                \"pkts_dropped\": 1"
+		"            }"
+		"        }"
+		"    }]"
+		"} }");
+	dp_test_check_json_poll_state("storm-ctl show dpT10", jexp,
+				      DP_TEST_JSON_CHECK_SUBSET, false, 0);
+	json_object_put(jexp);
+
+	dp_test_intf_delta_stats_for_if("br1", &start_stats, &stats);
+	dp_test_fail_unless(stats.ifi_idropped == 1,
+			    "br1 dropped %" PRIu64 ", expected 1",
+			    stats.ifi_idropped);
+
+	dp_test_send_config_src(dp_test_cont_src_get(),
+				"storm-ctl DELETE dpT10 profile PR1");
+	dp_test_send_config_src(dp_test_cont_src_get(),
+				"storm-ctl DELETE profile PR1 unicast bandwidth-level");
+	dp_test_verify_storm_ctl_profile("PR1", false);
+	dp_test_verify_storm_ctl_state(SC_MON_OFF, 0);
+
+	dp_test_intf_bridge_remove_port("br1", "dp1T0");
+	dp_test_intf_bridge_remove_port("br1", "dp2T1");
+	dp_test_intf_bridge_del("br1");
+} DP_END_TEST;
@@ -126,7 +126,7 @@ int spath_receive(zmq_pollitem_t *item, struct tun_pi *pi,
 /* VR case: Packet coming for dpdk interfaces.
  * Send the packet directly for validation.
  */
-int tuntap_write(int fd, struct rte_mbuf *m, struct ifnet *ifp)
+int tuntap_write(int fd, struct rte_mbuf *m, struct ifnet *ifp, bool vnet_hdr)
 {
 	struct shadow_if_info *sii = get_fd2shadowif(fd);
 	struct ifnet *ifp_phys;
@@ -155,7 +155,7 @@ bool local_packet_filter(const struct ifnet *ifp, struct rte_mbuf *m)
 	return true;
 }
 
-int tap_attach(const char *ifname)
+int tap_attach(const char *ifname, bool vnet_hdr __unused)
 {
 	int pipefd[2];
 	portid_t portid = dp_test_intf_name2port(ifname);
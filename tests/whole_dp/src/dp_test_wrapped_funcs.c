@@ -25,8 +25,10 @@
 #include "rte_log.h"
 #include <rte_eal.h>
 #include <rte_errno.h>
+#include <rte_ethdev.h>
 #include <rte_launch.h>
 #include <rte_mempool.h>
+#include <rte_tm.h>
 
 #include "vplane_debug.h"
 #include "ip_funcs.h"
@@ -109,3 +111,143 @@ int __wrap_pclose(FILE *stream)
 {
 	return 0;
 }
+
+/*
+ * The rte_tm hierarchy of the port being given a NIC's shapers, which
+ * counts its nodes rather than keeping them.
+ */
+static struct {
+	bool enabled;
+	bool fail_delete;
+	bool fail_leaf_add;
+	bool shaping;		/* committed with nodes in it */
+	uint16_t port;
+	uint32_t n_nodes;
+} dp_test_tm;
+
+void dp_test_tm_emulate(const char *real_ifname, bool enable)
+{
+	memset(&dp_test_tm, 0, sizeof(dp_test_tm));
+	dp_test_tm.enabled = enable;
+	dp_test_tm.port = dp_test_intf_name2port(real_ifname);
+}
+
+void dp_test_tm_fail_delete(bool fail)
+{
+	dp_test_tm.fail_delete = fail;
+}
+
+void dp_test_tm_fail_leaf_add(bool fail)
+{
+	dp_test_tm.fail_leaf_add = fail;
+}
+
+bool dp_test_tm_shaping(void)
+{
+	return dp_test_tm.shaping;
+}
+
+uint32_t dp_test_tm_nodes(void)
+{
+	return dp_test_tm.n_nodes;
+}
+
+static bool dp_test_tm_port(uint16_t port_id)
+{
+	return dp_test_tm.enabled && port_id == dp_test_tm.port;
+}
+
+int __wrap_rte_tm_capabilities_get(uint16_t port_id,
+				   struct rte_tm_capabilities *cap,
+				   struct rte_tm_error *error)
+{
+	if (!dp_test_tm_port(port_id))
+		return __real_rte_tm_capabilities_get(port_id, cap, error);
+
+	memset(cap, 0, sizeof(*cap));
+	cap->n_levels_max = 4;
+	return 0;
+}
+
+int __wrap_rte_tm_get_number_of_leaf_nodes(uint16_t port_id,
+					   uint32_t *n_leaf_nodes,
+					   struct rte_tm_error *error)
+{
+	if (!dp_test_tm_port(port_id))
+		return __real_rte_tm_get_number_of_leaf_nodes(port_id,
+							      n_leaf_nodes,
+							      error);
+	*n_leaf_nodes = 2;
+	return 0;
+}
+
+int __wrap_rte_tm_shaper_profile_add(uint16_t port_id,
+				     uint32_t shaper_profile_id,
+				     struct rte_tm_shaper_params *profile,
+				     struct rte_tm_error *error)
+{
+	if (!dp_test_tm_port(port_id))
+		return __real_rte_tm_shaper_profile_add(port_id,
+							shaper_profile_id,
+							profile, error);
+	return 0;
+}
+
+int __wrap_rte_tm_shaper_profile_delete(uint16_t port_id,
+					uint32_t shaper_profile_id,
+					struct rte_tm_error *error)
+{
+	if (!dp_test_tm_port(port_id))
+		return __real_rte_tm_shaper_profile_delete(port_id,
+							   shaper_profile_id,
+							   error);
+	return 0;
+}
+
+int __wrap_rte_tm_node_add(uint16_t port_id, uint32_t node_id,
+			   uint32_t parent_node_id, uint32_t priority,
+			   uint32_t weight, uint32_t level_id,
+			   struct rte_tm_node_params *params,
+			   struct rte_tm_error *error)
+{
+	if (!dp_test_tm_port(port_id))
+		return __real_rte_tm_node_add(port_id, node_id,
+					      parent_node_id, priority,
+					      weight, level_id, params,
+					      error);
+
+	/* Leaves are the transmit queues, with the lowest ids */
+	if (dp_test_tm.fail_leaf_add && node_id < RTE_MAX_QUEUES_PER_PORT) {
+		error->type = RTE_TM_ERROR_TYPE_NODE_ID;
+		error->message = "no such queue";
+		return -EINVAL;
+	}
+	dp_test_tm.n_nodes++;
+	return 0;
+}
+
+int __wrap_rte_tm_node_delete(uint16_t port_id, uint32_t node_id,
+			      struct rte_tm_error *error)
+{
+	if (!dp_test_tm_port(port_id))
+		return __real_rte_tm_node_delete(port_id, node_id, error);
+
+	if (dp_test_tm.fail_delete) {
+		error->type = RTE_TM_ERROR_TYPE_NODE_ID;
+		error->message = "node busy";
+		return -EBUSY;
+	}
+	dp_test_assert_internal(dp_test_tm.n_nodes);
+	dp_test_tm.n_nodes--;
+	return 0;
+}
+
+int __wrap_rte_tm_hierarchy_commit(uint16_t port_id, int clear_on_fail,
+				   struct rte_tm_error *error)
+{
+	if (!dp_test_tm_port(port_id))
+		return __real_rte_tm_hierarchy_commit(port_id, clear_on_fail,
+						      error);
+	dp_test_tm.shaping = dp_test_tm.n_nodes != 0;
+	return 0;
+}